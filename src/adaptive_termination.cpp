@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "include/adaptive_termination.h"
+#include "include/hnsw.h"
+
+namespace vector_index::hnsw {
+    // Multipliers tried by the calibration, from the cheapest.
+    static constexpr double MIN_MULTIPLIER = 0.5;
+    static constexpr double MAX_MULTIPLIER = 64;
+    static constexpr double MULTIPLIER_STEP = 1.25;
+
+    TerminationModel::TerminationModel(size_t numWarmupHops): numWarmupHops(numWarmupHops), multiplier(1) {
+        if (numWarmupHops == 0) {
+            throw std::invalid_argument("TerminationModel needs at least one warmup hop");
+        }
+    }
+
+    void TerminationModel::fit(const std::vector<TerminationSample> &samples, double ridge) {
+        constexpr size_t n = NUM_TERMINATION_FEATURES;
+        // Normal equations (X^T X + ridge I) w = X^T y, with the bias left unregularized.
+        std::array<std::array<double, n + 1>, n> system{};
+        size_t numSamples = 0;
+        for (auto &sample: samples) {
+            if (!sample.warmedUp) {
+                continue;
+            }
+            auto target = std::log1p((double) sample.distances);
+            for (size_t i = 0; i < n; i++) {
+                for (size_t j = 0; j < n; j++) {
+                    system[i][j] += sample.features[i] * sample.features[j];
+                }
+                system[i][n] += sample.features[i] * target;
+            }
+            numSamples++;
+        }
+        if (numSamples == 0) {
+            throw std::invalid_argument("No training query outlasted the warmup hops");
+        }
+        for (size_t i = 1; i < n; i++) {
+            system[i][i] += ridge * numSamples;
+        }
+
+        // Gaussian elimination with partial pivoting.
+        for (size_t col = 0; col < n; col++) {
+            size_t pivot = col;
+            for (size_t row = col + 1; row < n; row++) {
+                if (std::abs(system[row][col]) > std::abs(system[pivot][col])) {
+                    pivot = row;
+                }
+            }
+            std::swap(system[col], system[pivot]);
+            if (std::abs(system[col][col]) < 1e-12) {
+                // A constant feature, e.g. the stability of a search that keeps improving.
+                system[col][col] = 1;
+                continue;
+            }
+            for (size_t row = 0; row < n; row++) {
+                if (row == col) {
+                    continue;
+                }
+                auto factor = system[row][col] / system[col][col];
+                for (size_t j = col; j <= n; j++) {
+                    system[row][j] -= factor * system[col][j];
+                }
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            weights[i] = system[i][n] / system[i][i];
+        }
+    }
+
+    double TerminationModel::predict(const TerminationFeatures &features) const {
+        double logDistances = 0;
+        for (size_t i = 0; i < NUM_TERMINATION_FEATURES; i++) {
+            logDistances += weights[i] * features[i];
+        }
+        return std::max(1.0, std::expm1(logDistances));
+    }
+
+    void TerminationModel::save(const std::string &path) const {
+        std::ofstream out(path);
+        if (!out) {
+            throw std::runtime_error("Error opening file " + path);
+        }
+        out << std::setprecision(17);
+        out << "warmup " << numWarmupHops << "\n";
+        out << "multiplier " << multiplier << "\n";
+        out << "weights";
+        for (auto weight: weights) {
+            out << " " << weight;
+        }
+        out << "\n";
+    }
+
+    TerminationModel TerminationModel::load(const std::string &path) {
+        std::ifstream in(path);
+        if (!in) {
+            throw std::runtime_error("Error opening file " + path);
+        }
+        TerminationModel model;
+        std::string line;
+        size_t numWeights = 0;
+        while (std::getline(in, line)) {
+            std::stringstream ss(line);
+            std::string name;
+            ss >> name;
+            if (name == "warmup") {
+                ss >> model.numWarmupHops;
+            } else if (name == "multiplier") {
+                ss >> model.multiplier;
+            } else if (name == "weights") {
+                while (numWeights < NUM_TERMINATION_FEATURES && ss >> model.weights[numWeights]) {
+                    numWeights++;
+                }
+            }
+        }
+        if (numWeights != NUM_TERMINATION_FEATURES || model.numWarmupHops == 0) {
+            throw std::runtime_error("Invalid termination model " + path);
+        }
+        return model;
+    }
+
+    TerminationTracker::TerminationTracker(const TerminationModel* model, int k, const std::vector<int>* groundTruth): model(model), k(std::max(k, 1)) {
+        if (groundTruth) {
+            sampling = true;
+            auto end = groundTruth->begin() + std::min((size_t) this->k, groundTruth->size());
+            this->groundTruth.insert(groundTruth->begin(), end);
+        }
+    }
+
+    bool TerminationTracker::update(const MinQueue<Node*> &neighbors, size_t nodesVisited) {
+        hops++;
+        auto &records = neighbors.getRecords();
+        auto kth = records.begin();
+        size_t found = 0;
+        for (size_t i = 1; i < k && std::next(kth) != records.end(); i++) {
+            found += sampling && groundTruth.contains(kth->item->id);
+            kth++;
+        }
+        found += sampling && groundTruth.contains(kth->item->id);
+        if (hops == 1 || kth->distance < kthDistance) {
+            lastImprovement = hops;
+        }
+        kthDistance = kth->distance;
+        // The ground truth among the results are the ones visited so far.
+        if (found > this->found) {
+            this->found = found;
+            sample.distances = nodesVisited;
+        }
+
+        if (hops == model->getNumWarmupHops()) {
+            auto closest = records.begin()->distance;
+            sample.features = {
+                1,
+                std::log1p(std::max(entryDistance, 0.0)),
+                std::log1p(std::max(closest, 0.0)),
+                std::log1p(std::max(kthDistance, 0.0)),
+                (kthDistance + 1e-9) / (entryDistance + 1e-9),
+                (double) (hops - lastImprovement) / hops,
+                std::log1p((double) nodesVisited)
+            };
+            sample.warmedUp = true;
+            limit = model->getMultiplier() * model->predict(sample.features);
+        }
+        return sampling || hops < model->getNumWarmupHops() || nodesVisited < limit;
+    }
+
+    static double recall(HNSW &index, const TerminationModel &model, std::vector<std::vector<float>> &queries, std::vector<std::vector<int>> &groundTruth, int k, int efSearch) {
+        size_t matches = 0;
+        for (size_t i = 0; i < queries.size(); i++) {
+            auto &gt = groundTruth[i];
+            auto gtEnd = gt.begin() + std::min((size_t) k, gt.size());
+            for (auto id: index.knnSearchWithModel(queries[i], k, efSearch, model).ids) {
+                matches += std::find(gt.begin(), gtEnd, id) != gtEnd;
+            }
+        }
+        return (double) matches / (queries.size() * k);
+    }
+
+    std::shared_ptr<TerminationModel> trainTerminationModel(HNSW &index, std::vector<std::vector<float>> &queries, std::vector<std::vector<int>> &groundTruth, int k, int efSearch, double targetRecall, size_t numWarmupHops) {
+        if (queries.empty() || queries.size() != groundTruth.size()) {
+            throw std::invalid_argument("Every training query needs its ground truth");
+        }
+        auto model = std::make_shared<TerminationModel>(numWarmupHops);
+        std::vector<TerminationSample> samples;
+        for (size_t i = 0; i < queries.size(); i++) {
+            samples.push_back(index.sampleTermination(queries[i], k, efSearch, groundTruth[i], *model));
+        }
+        model->fit(samples);
+
+        // Recall grows with the multiplier, keep the first one that reaches the target. The searches
+        // bypass the query cache, whose results would not change with the multiplier.
+        for (double multiplier = MIN_MULTIPLIER; multiplier <= MAX_MULTIPLIER; multiplier *= MULTIPLIER_STEP) {
+            model->setMultiplier(multiplier);
+            if (recall(index, *model, queries, groundTruth, k, efSearch) >= targetRecall) {
+                break;
+            }
+        }
+        index.setTerminationModel(model);
+        return model;
+    }
+} // namespace vector_index::hnsw
@@ -0,0 +1,66 @@
+#include <algorithm>
+#include "include/arena.h"
+
+namespace vector_index {
+    Arena::Arena(size_t blockSize): current(0), offset(0) {
+        addBlock(blockSize);
+    }
+
+    void Arena::addBlock(size_t size) {
+        // Left uninitialized, unlike make_unique.
+        blocks.push_back(Block{std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+    }
+
+    void Arena::reset() {
+        if (blocks.size() > 1) {
+            auto capacity = getCapacity();
+            blocks.clear();
+            addBlock(capacity);
+        }
+        current = 0;
+        offset = 0;
+    }
+
+    size_t Arena::getCapacity() const {
+        size_t capacity = 0;
+        for (auto &block: blocks) {
+            capacity += block.size;
+        }
+        return capacity;
+    }
+
+    void* Arena::do_allocate(size_t bytes, size_t alignment) {
+        while (true) {
+            auto &block = blocks[current];
+            void* p = block.data.get() + offset;
+            auto space = block.size - offset;
+            if (std::align(alignment, bytes, p, space)) {
+                offset = block.size - space + bytes;
+                return p;
+            }
+            if (current + 1 == blocks.size()) {
+                // Grow geometrically, the chain is merged on the next reset.
+                addBlock(std::max(block.size * 2, bytes + alignment));
+            }
+            current++;
+            offset = 0;
+        }
+    }
+
+    // Arenas released by the searches of this thread.
+    static thread_local std::vector<std::unique_ptr<Arena>> freeArenas;
+
+    ScopedArena::ScopedArena() {
+        if (freeArenas.empty()) {
+            arena = std::make_unique<Arena>();
+        } else {
+            arena = std::move(freeArenas.back());
+            freeArenas.pop_back();
+        }
+        arena->reset();
+    }
+
+    ScopedArena::~ScopedArena() {
+        freeArenas.push_back(std::move(arena));
+    }
+} // namespace vector_index
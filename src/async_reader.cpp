@@ -0,0 +1,217 @@
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "include/async_reader.h"
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+
+namespace vector_index::io {
+    static std::runtime_error systemError(const char* call) {
+        return std::runtime_error(std::string(call) + " failed: " + strerror(errno));
+    }
+
+    IoUringReader::IoUringReader(const AsyncReaderOptions &options): options(options), fixedFiles(false), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqes(nullptr), queued(0), inFlight(0) {
+        if (options.queueDepth == 0) {
+            throw std::invalid_argument("Queue depth must be positive");
+        }
+        io_uring_params params{};
+        if (options.sqPoll) {
+            params.flags |= IORING_SETUP_SQPOLL;
+            params.sq_thread_idle = options.sqPollIdleMs;
+        }
+        ringFd = (int) syscall(__NR_io_uring_setup, options.queueDepth, &params);
+        if (ringFd < 0) {
+            throw systemError("io_uring_setup");
+        }
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        auto singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMapping) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        cqRing = singleMapping ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        auto sqesMapping = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqesMapping == MAP_FAILED) {
+            auto error = systemError("io_uring mmap");
+            if (sqesMapping != MAP_FAILED) {
+                munmap(sqesMapping, sqesSize);
+            }
+            if (cqRing != MAP_FAILED && cqRing != sqRing) {
+                munmap(cqRing, cqRingSize);
+            }
+            if (sqRing != MAP_FAILED) {
+                munmap(sqRing, sqRingSize);
+            }
+            close(ringFd);
+            throw error;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqesMapping);
+        auto sq = static_cast<uint8_t*>(sqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqFlags = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+        auto cq = static_cast<uint8_t*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    IoUringReader::~IoUringReader() {
+        munmap(sqes, sqesSize);
+        if (cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        munmap(sqRing, sqRingSize);
+        close(ringFd);
+    }
+
+    int IoUringReader::enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        while (true) {
+            auto ret = (int) syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+            if (ret >= 0) {
+                return ret;
+            }
+            if (errno != EINTR) {
+                throw systemError("io_uring_enter");
+            }
+        }
+    }
+
+    bool IoUringReader::read(const ReadRequest &request) {
+        if (pending() >= options.queueDepth) {
+            return false;
+        }
+        // Only this thread moves the tail, the kernel reads it.
+        auto tail = *sqTail;
+        auto index = tail & *sqMask;
+        auto sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = request.bufferIndex >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = request.file;
+        sqe->flags = fixedFiles ? IOSQE_FIXED_FILE : 0;
+        sqe->addr = reinterpret_cast<uint64_t>(request.buffer);
+        sqe->len = request.length;
+        sqe->off = request.offset;
+        sqe->buf_index = request.bufferIndex >= 0 ? request.bufferIndex : 0;
+        sqe->user_data = request.userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        queued++;
+        return true;
+    }
+
+    void IoUringReader::submit() {
+        if (queued == 0) {
+            return;
+        }
+        if (options.sqPoll) {
+            // The tail must be visible before the flags are read, or a sleeping poller could be missed.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (__atomic_load_n(sqFlags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+                enter(0, 0, IORING_ENTER_SQ_WAKEUP);
+            }
+        } else {
+            size_t submitted = 0;
+            while (submitted < queued) {
+                submitted += enter(queued - submitted, 0, 0);
+            }
+        }
+        inFlight += queued;
+        queued = 0;
+    }
+
+    size_t IoUringReader::reap(std::vector<Completion> &completions, size_t minCompletions) {
+        submit();
+        size_t count = 0;
+        while (true) {
+            auto head = *cqHead;
+            auto tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                auto &cqe = cqes[head & *cqMask];
+                completions.push_back(Completion{cqe.user_data, cqe.res});
+                count++;
+                inFlight--;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            if (count >= minCompletions || inFlight == 0) {
+                return count;
+            }
+            enter(0, std::min(minCompletions - count, inFlight), IORING_ENTER_GETEVENTS);
+        }
+    }
+
+    void IoUringReader::registerFiles(const std::vector<int> &fds) {
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_FILES, fds.data(), (unsigned) fds.size()) < 0) {
+            throw systemError("io_uring_register files");
+        }
+        fixedFiles = true;
+    }
+
+    void IoUringReader::registerBuffers(const std::vector<iovec> &buffers) {
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, buffers.data(), (unsigned) buffers.size()) < 0) {
+            throw systemError("io_uring_register buffers");
+        }
+    }
+
+    PreadReader::PreadReader(const AsyncReaderOptions &options): options(options) {
+        if (options.queueDepth == 0) {
+            throw std::invalid_argument("Queue depth must be positive");
+        }
+    }
+
+    bool PreadReader::read(const ReadRequest &request) {
+        if (pending() >= options.queueDepth) {
+            return false;
+        }
+        queued.push_back(request);
+        return true;
+    }
+
+    void PreadReader::submit() {
+        for (auto &request: queued) {
+            auto fd = files.empty() ? request.file : files[request.file];
+            auto bytes = pread(fd, request.buffer, request.length, request.offset);
+            completed.push_back(Completion{request.userData, bytes < 0 ? -errno : bytes});
+        }
+        queued.clear();
+    }
+
+    size_t PreadReader::reap(std::vector<Completion> &completions, size_t minCompletions) {
+        submit();
+        auto count = completed.size();
+        completions.insert(completions.end(), completed.begin(), completed.end());
+        completed.clear();
+        return count;
+    }
+
+    void PreadReader::registerFiles(const std::vector<int> &fds) {
+        files = fds;
+    }
+
+    std::unique_ptr<AsyncReader> makeAsyncReader(const AsyncReaderOptions &options) {
+        try {
+            return std::make_unique<IoUringReader>(options);
+        } catch (const std::runtime_error &) {
+            return std::make_unique<PreadReader>(options);
+        }
+    }
+} // namespace vector_index::io
@@ -0,0 +1,219 @@
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <stdexcept>
+#include "include/auto_tune.h"
+#include "include/utils.h"
+
+namespace vector_index::auto_tune {
+    AutoTuner::AutoTuner(std::vector<Parameter> parameters, SearchFunction search): parameters(std::move(parameters)), search(std::move(search)) {
+        if (this->parameters.empty()) {
+            throw std::invalid_argument("AutoTuner needs at least one parameter");
+        }
+        for (auto &parameter: this->parameters) {
+            if (parameter.values.empty()) {
+                throw std::invalid_argument("AutoTuner parameter " + parameter.name + " has no values");
+            }
+        }
+    }
+
+    std::vector<OperatingPoint> AutoTuner::explore(std::vector<std::vector<float>> &queries, std::vector<std::vector<int>> &groundTruth, int k) {
+        if (queries.empty()) {
+            throw std::invalid_argument("AutoTuner needs at least one query");
+        }
+        if (groundTruth.size() != queries.size()) {
+            throw std::invalid_argument("AutoTuner needs the ground truth of every query");
+        }
+        // Enumerate the cartesian product of the value indexes.
+        std::vector<std::vector<size_t>> combinations{{}};
+        for (auto &parameter: parameters) {
+            std::vector<std::vector<size_t>> next;
+            for (auto &combination: combinations) {
+                for (size_t i = 0; i < parameter.values.size(); i++) {
+                    auto extended = combination;
+                    extended.push_back(i);
+                    next.push_back(extended);
+                }
+            }
+            combinations = next;
+        }
+
+        // The cheapest and the most expensive settings bound everything else, evaluate them first and
+        // the rest in random order so that the pruning below kicks in early.
+        if (combinations.size() > 2) {
+            std::swap(combinations[1], combinations.back());
+            for (size_t i = combinations.size() - 1; i > 2; i--) {
+                std::swap(combinations[i], combinations[2 + Utils::rand_int(0, i - 2)]);
+            }
+        }
+
+        std::vector<std::vector<size_t>> evaluated;
+        std::vector<OperatingPoint> points;
+        for (auto &combination: combinations) {
+            if (!canImproveFrontier(combination, evaluated, points)) {
+                continue;
+            }
+            std::vector<int> values;
+            for (int i = 0; i < parameters.size(); i++) {
+                values.push_back(parameters[i].values[combination[i]]);
+            }
+            evaluated.push_back(combination);
+            points.push_back(evaluate(values, queries, groundTruth, k));
+        }
+        frontier = paretoFrontier(points);
+        return frontier;
+    }
+
+    bool AutoTuner::canImproveFrontier(const std::vector<size_t> &candidate, const std::vector<std::vector<size_t>> &evaluated, const std::vector<OperatingPoint> &points) const {
+        // Upper bound the recall with any more expensive setting and the QPS with any cheaper one.
+        double recallBound = 1.0;
+        double qpsBound = INFINITY;
+        for (int i = 0; i < evaluated.size(); i++) {
+            auto moreExpensive = true;
+            auto cheaper = true;
+            for (int j = 0; j < candidate.size(); j++) {
+                moreExpensive &= evaluated[i][j] >= candidate[j];
+                cheaper &= evaluated[i][j] <= candidate[j];
+            }
+            if (moreExpensive) {
+                recallBound = std::min(recallBound, points[i].recall);
+            }
+            if (cheaper) {
+                qpsBound = std::min(qpsBound, points[i].qps);
+            }
+        }
+        for (auto &point: points) {
+            if (point.recall >= recallBound && point.qps >= qpsBound) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    OperatingPoint AutoTuner::evaluate(const std::vector<int> &values, std::vector<std::vector<float>> &queries, std::vector<std::vector<int>> &groundTruth, int k) {
+        std::vector<double> latencies;
+        size_t matches = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < queries.size(); i++) {
+            auto queryStart = std::chrono::high_resolution_clock::now();
+            auto ids = search(queries[i], k, values);
+            latencies.push_back(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - queryStart).count());
+
+            auto &gt = groundTruth[i];
+            auto gtEnd = gt.begin() + std::min((size_t) k, gt.size());
+            for (auto id: ids) {
+                if (std::find(gt.begin(), gtEnd, id) != gtEnd) {
+                    matches++;
+                }
+            }
+        }
+        std::chrono::duration<double> total = std::chrono::high_resolution_clock::now() - start;
+
+        std::sort(latencies.begin(), latencies.end());
+        auto p99Idx = std::min(latencies.size() - 1, (size_t) std::ceil(0.99 * latencies.size()) - 1);
+        return OperatingPoint{values, (double) matches / (queries.size() * k), queries.size() / total.count(), latencies[p99Idx]};
+    }
+
+    std::vector<OperatingPoint> AutoTuner::paretoFrontier(std::vector<OperatingPoint> points) {
+        // Sort by decreasing QPS, a point is on the frontier if it beats the recall of every faster point.
+        std::sort(points.begin(), points.end(), [](const OperatingPoint &a, const OperatingPoint &b) {
+            return a.qps > b.qps || (a.qps == b.qps && a.recall > b.recall);
+        });
+        std::vector<OperatingPoint> frontier;
+        double bestRecall = -1;
+        for (auto &point: points) {
+            if (point.recall > bestRecall) {
+                frontier.push_back(point);
+                bestRecall = point.recall;
+            }
+        }
+        return frontier;
+    }
+
+    bool AutoTuner::selectForRecall(double targetRecall, OperatingPoint &point) const {
+        // The frontier is sorted by increasing recall and decreasing QPS.
+        for (auto &candidate: frontier) {
+            if (candidate.recall >= targetRecall) {
+                point = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool AutoTuner::selectForLatency(double targetP99Latency, OperatingPoint &point) const {
+        auto found = false;
+        for (auto &candidate: frontier) {
+            if (candidate.p99Latency <= targetP99Latency && (!found || candidate.recall > point.recall)) {
+                point = candidate;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    void AutoTuner::save(const std::string &path, const OperatingPoint &point) const {
+        std::ofstream out(path);
+        if (!out) {
+            throw std::runtime_error("Error opening file " + path);
+        }
+        for (int i = 0; i < parameters.size(); i++) {
+            out << parameters[i].name << " " << point.values[i] << "\n";
+        }
+        out << "# recall " << point.recall << " qps " << point.qps << " p99 " << point.p99Latency << "\n";
+    }
+
+    std::vector<int> AutoTuner::load(const std::string &path) const {
+        std::ifstream in(path);
+        if (!in) {
+            throw std::runtime_error("Error opening file " + path);
+        }
+        std::vector<int> values;
+        for (auto &parameter: parameters) {
+            values.push_back(parameter.values.front());
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::stringstream ss(line);
+            std::string name;
+            int value;
+            ss >> name >> value;
+            for (int i = 0; i < parameters.size(); i++) {
+                if (parameters[i].name == name) {
+                    values[i] = value;
+                }
+            }
+        }
+        return values;
+    }
+
+    SearchFunction hnswSearch(hnsw::HNSW &index) {
+        return [&index](std::vector<float> &query, int k, const std::vector<int> &values) {
+            return index.knnSearch(query, k, values[0]).ids;
+        };
+    }
+
+    SearchFunction smallWorldBeamSearch(small_world::SmallWorldNG &index) {
+        return [&index](std::vector<float> &query, int k, const std::vector<int> &values) {
+            return index.beamKnnSearch(query, values[0], k).ids;
+        };
+    }
+
+    SearchFunction smallWorldGreedySearch(small_world::SmallWorldNG &index) {
+        return [&index](std::vector<float> &query, int k, const std::vector<int> &values) {
+            return index.greedyKnnSearch(query, values[0], k).ids;
+        };
+    }
+
+    SearchFunction saTreeBeamSearch(sa_tree::SATree &index) {
+        return [&index](std::vector<float> &query, int k, const std::vector<int> &values) {
+            return index.beamKnnSearch(query, values[0], k).ids;
+        };
+    }
+} // namespace vector_index::auto_tune
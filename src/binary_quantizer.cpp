@@ -0,0 +1,40 @@
+#include <cmath>
+#include <algorithm>
+#include "include/binary_quantizer.h"
+
+namespace vector_index {
+    BinaryQuantizer::BinaryQuantizer(size_t dimension, bool rotate, uint64_t seed): dimension(dimension), numWords((dimension + 63) / 64), mean(dimension, 0) {
+        if (rotate) {
+            rotation = std::make_unique<VectorTransform>(dimension, TransformType::RANDOM_ROTATION, 0, seed);
+        }
+    }
+
+    void BinaryQuantizer::train(const float* data, size_t numVectors) {
+        std::fill(mean.begin(), mean.end(), 0);
+        for (size_t i = 0; i < numVectors; i++) {
+            for (size_t j = 0; j < dimension; j++) {
+                mean[j] += data[i * dimension + j];
+            }
+        }
+        for (size_t j = 0; j < dimension && numVectors > 0; j++) {
+            mean[j] /= numVectors;
+        }
+    }
+
+    void BinaryQuantizer::encode(const float* x, uint64_t* code) const {
+        std::vector<float> centered(dimension);
+        for (size_t j = 0; j < dimension; j++) {
+            centered[j] = x[j] - mean[j];
+        }
+        if (rotation) {
+            auto rotated = centered;
+            rotation->apply(rotated.data(), centered.data());
+        }
+        std::fill(code, code + numWords, 0);
+        for (size_t j = 0; j < dimension; j++) {
+            if (centered[j] > 0) {
+                code[j / 64] |= uint64_t(1) << (j % 64);
+            }
+        }
+    }
+} // namespace vector_index
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "include/buffer_manager.h"
+#include "include/utils.h"
+
+namespace vector_index::io {
+    BufferManager::BufferManager(int fd, size_t pageSize, size_t memoryBudget, EvictionPolicy policy, unsigned k):
+            fd(fd), pageSize(pageSize), numFrames(pageSize == 0 ? 0 : memoryBudget / pageSize), policy(policy), k(k),
+            buffers(std::max<size_t>(pageSize, 1), std::max<size_t>(numFrames, 1)), hand(0), clock(0), hits(0), misses(0), evictions(0) {
+        if (pageSize == 0 || numFrames == 0) {
+            throw std::invalid_argument("The memory budget must hold at least one page");
+        }
+        if (k == 0 || k > MAX_K) {
+            throw std::invalid_argument("K must be between 1 and " + std::to_string(MAX_K));
+        }
+        frames = std::make_unique<Frame[]>(numFrames);
+        for (size_t i = 0; i < numFrames; i++) {
+            frames[i].data = buffers.acquire();
+        }
+    }
+
+    BufferManager::Shard &BufferManager::shardOf(uint64_t page) {
+        return shards[(page * 0x9e3779b97f4a7c15ULL) >> 58];
+    }
+
+    void BufferManager::touch(Frame &frame) {
+        frame.referenced.store(true, std::memory_order_relaxed);
+        if (policy == EvictionPolicy::LRU_K) {
+            auto now = clock.fetch_add(1, std::memory_order_relaxed) + 1;
+            for (unsigned i = k - 1; i > 0; i--) {
+                frame.history[i].store(frame.history[i - 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            frame.history[0].store(now, std::memory_order_relaxed);
+        }
+    }
+
+    BufferManager::PageHandle BufferManager::pin(uint64_t page) {
+        auto &shard = shardOf(page);
+        Frame* found = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.table.find(page);
+            if (it != shard.table.end()) {
+                found = it->second;
+                found->pinCount.fetch_add(1, std::memory_order_acquire);
+                touch(*found);
+            }
+        }
+        if (found != nullptr) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return waitReady(found);
+        }
+
+        // The frame is reserved without the shard lock, another thread may map the page meanwhile.
+        auto frame = reserveFrame();
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto [it, inserted] = shard.table.emplace(page, frame);
+            if (!inserted) {
+                found = it->second;
+                found->pinCount.fetch_add(1, std::memory_order_acquire);
+                touch(*found);
+            } else {
+                frame->page.store(page, std::memory_order_relaxed);
+                touch(*frame);
+            }
+        }
+        if (found != nullptr) {
+            // Unmapped and unpinned, the frame is free for the next reservation.
+            frame->pinCount.fetch_sub(1, std::memory_order_release);
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return waitReady(found);
+        }
+
+        misses.fetch_add(1, std::memory_order_relaxed);
+        auto bytes = Utils::read(fd, frame->data, pageSize, (off_t) (page * pageSize));
+        if (bytes < 0) {
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.table.erase(page);
+                frame->page.store(NO_PAGE, std::memory_order_relaxed);
+            }
+            frame->state.store(FAILED, std::memory_order_release);
+            frame->state.notify_all();
+            frame->pinCount.fetch_sub(1, std::memory_order_release);
+            throw std::runtime_error("Reading page " + std::to_string(page) + " failed: " + strerror(errno));
+        }
+        // The last page of the file is short.
+        memset(static_cast<char*>(frame->data) + bytes, 0, pageSize - bytes);
+        frame->state.store(READY, std::memory_order_release);
+        frame->state.notify_all();
+        return PageHandle(frame);
+    }
+
+    BufferManager::PageHandle BufferManager::waitReady(Frame* frame) {
+        PageHandle handle(frame);
+        int state;
+        while ((state = frame->state.load(std::memory_order_acquire)) == LOADING) {
+            frame->state.wait(LOADING, std::memory_order_acquire);
+        }
+        if (state == FAILED) {
+            throw std::runtime_error("Reading a page failed");
+        }
+        return handle;
+    }
+
+    BufferManager::Frame* BufferManager::reserveFrame() {
+        std::lock_guard<std::mutex> lock(evictionMutex);
+        auto frame = policy == EvictionPolicy::CLOCK ? clockVictim() : lruKVictim();
+        if (frame == nullptr) {
+            throw std::runtime_error("All " + std::to_string(numFrames) + " frames are pinned");
+        }
+        frame->state.store(LOADING, std::memory_order_relaxed);
+        frame->referenced.store(false, std::memory_order_relaxed);
+        for (auto &time: frame->history) {
+            time.store(0, std::memory_order_relaxed);
+        }
+        return frame;
+    }
+
+    bool BufferManager::tryEvict(Frame &frame) {
+        auto page = frame.page.load(std::memory_order_relaxed);
+        if (page == NO_PAGE) {
+            // Unmapped frames only change hands under evictionMutex.
+            if (frame.pinCount.load(std::memory_order_acquire) != 0) {
+                return false;
+            }
+            frame.pinCount.store(1, std::memory_order_relaxed);
+            return true;
+        }
+        // Pins are taken with the shard locked, so an unpinned frame stays unpinned until it is unmapped.
+        auto &shard = shardOf(page);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (frame.pinCount.load(std::memory_order_acquire) != 0 || frame.page.load(std::memory_order_relaxed) != page) {
+            return false;
+        }
+        shard.table.erase(page);
+        frame.page.store(NO_PAGE, std::memory_order_relaxed);
+        frame.pinCount.store(1, std::memory_order_relaxed);
+        evictions.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    BufferManager::Frame* BufferManager::clockVictim() {
+        // The first sweep may only clear reference bits, the second finds a victim unless all are pinned.
+        for (size_t scanned = 0; scanned <= 2 * numFrames; scanned++) {
+            auto &frame = frames[hand];
+            hand = hand + 1 == numFrames ? 0 : hand + 1;
+            if (frame.pinCount.load(std::memory_order_relaxed) != 0) {
+                continue;
+            }
+            if (frame.page.load(std::memory_order_relaxed) != NO_PAGE && frame.referenced.exchange(false, std::memory_order_relaxed)) {
+                continue;
+            }
+            if (tryEvict(frame)) {
+                return &frame;
+            }
+        }
+        return nullptr;
+    }
+
+    BufferManager::Frame* BufferManager::lruKVictim() {
+        while (true) {
+            Frame* victim = nullptr;
+            uint64_t victimKth = UINT64_MAX, victimLast = UINT64_MAX;
+            for (size_t i = 0; i < numFrames; i++) {
+                auto &frame = frames[i];
+                if (frame.pinCount.load(std::memory_order_relaxed) != 0) {
+                    continue;
+                }
+                if (frame.page.load(std::memory_order_relaxed) == NO_PAGE) {
+                    victim = &frame;
+                    break;
+                }
+                // Fewer than K accesses count as infinitely old, ties go to the least recently used.
+                auto kth = frame.history[k - 1].load(std::memory_order_relaxed);
+                auto last = frame.history[0].load(std::memory_order_relaxed);
+                if (kth < victimKth || (kth == victimKth && last < victimLast)) {
+                    victim = &frame;
+                    victimKth = kth;
+                    victimLast = last;
+                }
+            }
+            if (victim == nullptr) {
+                return nullptr;
+            }
+            // Retried when the victim was pinned after the scan.
+            if (tryEvict(*victim)) {
+                return victim;
+            }
+        }
+    }
+
+    void BufferManager::read(void* out, uint64_t offset, size_t length) {
+        auto target = static_cast<char*>(out);
+        while (length > 0) {
+            auto page = offset / pageSize;
+            auto skip = offset % pageSize;
+            auto n = std::min(length, pageSize - skip);
+            auto handle = pin(page);
+            memcpy(target, static_cast<const char*>(handle.data()) + skip, n);
+            target += n;
+            offset += n;
+            length -= n;
+        }
+    }
+
+    BufferManagerStats BufferManager::getStats() const {
+        return BufferManagerStats{hits.load(), misses.load(), evictions.load()};
+    }
+
+    void BufferManager::resetStats() {
+        hits = 0;
+        misses = 0;
+        evictions = 0;
+    }
+} // namespace vector_index::io
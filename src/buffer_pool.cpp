@@ -0,0 +1,141 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "include/buffer_pool.h"
+
+namespace vector_index::io {
+    int openFile(const char* path, IoMode mode) {
+#ifdef TARGET_OS_MAC
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0 && mode == IoMode::DIRECT) {
+            fcntl(fd, F_NOCACHE, 1);
+        }
+#else
+        int fd = open(path, O_RDONLY | (mode == IoMode::DIRECT ? O_DIRECT : 0));
+#endif
+        if (fd < 0) {
+            throw std::runtime_error(std::string("Cannot open ") + path + (mode == IoMode::DIRECT ? " for direct I/O: " : ": ") + strerror(errno));
+        }
+        return fd;
+    }
+
+    size_t directIoAlignment(int fd) {
+#ifdef STATX_DIOALIGN
+        struct statx st{};
+        if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &st) == 0 && (st.stx_mask & STATX_DIOALIGN) && st.stx_dio_offset_align != 0) {
+            return std::max(st.stx_dio_mem_align, st.stx_dio_offset_align);
+        }
+#endif
+        return SECTOR_SIZE;
+    }
+
+    static size_t roundUp(size_t size, size_t alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    AlignedRange alignRange(uint64_t offset, size_t length, size_t alignment) {
+        auto begin = offset / alignment * alignment;
+        auto end = roundUp(offset + length, alignment);
+        return AlignedRange{begin, end - begin, offset - begin};
+    }
+
+    BufferPool::BufferPool(size_t bufferSize, size_t numBuffers, size_t buffersPerSlab, size_t alignment): numBuffers(numBuffers), buffersPerSlab(buffersPerSlab), alignment(alignment), head(NONE), numFree(0) {
+        if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment < sizeof(void*)) {
+            throw std::invalid_argument("Alignment must be a power of two");
+        }
+        if (bufferSize == 0 || numBuffers == 0 || buffersPerSlab == 0 || numBuffers >= NONE) {
+            throw std::invalid_argument("Buffer size and counts must be positive");
+        }
+        // Buffers are padded to the alignment so that each of them starts aligned.
+        this->bufferSize = roundUp(bufferSize, alignment);
+        for (size_t i = 0; i < numBuffers; i += buffersPerSlab) {
+            auto slab = std::aligned_alloc(alignment, slabLength(slabs.size()));
+            if (slab == nullptr) {
+                for (auto allocated: slabs) {
+                    std::free(allocated);
+                }
+                throw std::bad_alloc();
+            }
+            slabs.push_back(slab);
+        }
+        next = std::make_unique<std::atomic<uint32_t>[]>(numBuffers);
+        for (uint32_t i = numBuffers; i-- > 0;) {
+            release(bufferAt(i));
+        }
+    }
+
+    BufferPool::~BufferPool() {
+        for (auto slab: slabs) {
+            std::free(slab);
+        }
+    }
+
+    size_t BufferPool::slabLength(size_t slab) const {
+        // The last slab only holds the buffers left over.
+        return bufferSize * std::min(buffersPerSlab, numBuffers - slab * buffersPerSlab);
+    }
+
+    void* BufferPool::bufferAt(uint32_t index) const {
+        return static_cast<std::byte*>(slabs[index / buffersPerSlab]) + (index % buffersPerSlab) * bufferSize;
+    }
+
+    uint32_t BufferPool::indexOf(const void* buffer) const {
+        auto slab = slabOf(buffer);
+        auto offset = static_cast<const std::byte*>(buffer) - static_cast<const std::byte*>(slabs[slab]);
+        if (offset % bufferSize != 0 || slab * buffersPerSlab + offset / bufferSize >= numBuffers) {
+            throw std::invalid_argument("Buffer does not belong to the pool");
+        }
+        return slab * buffersPerSlab + offset / bufferSize;
+    }
+
+    int BufferPool::slabOf(const void* buffer) const {
+        auto p = static_cast<const std::byte*>(buffer);
+        for (size_t i = 0; i < slabs.size(); i++) {
+            auto begin = static_cast<const std::byte*>(slabs[i]);
+            if (p >= begin && p < begin + slabLength(i)) {
+                return (int) i;
+            }
+        }
+        throw std::invalid_argument("Buffer does not belong to the pool");
+    }
+
+    std::vector<iovec> BufferPool::getSlabs() const {
+        std::vector<iovec> iovs;
+        for (size_t i = 0; i < slabs.size(); i++) {
+            iovs.push_back(iovec{slabs[i], slabLength(i)});
+        }
+        return iovs;
+    }
+
+    void* BufferPool::acquire() {
+        auto top = head.load(std::memory_order_acquire);
+        while (true) {
+            auto index = (uint32_t) top;
+            if (index == NONE) {
+                return nullptr;
+            }
+            // next[index] may be stale if another thread popped the buffer meanwhile, the counter then
+            // makes the exchange fail.
+            auto popped = (((top >> 32) + 1) << 32) | next[index].load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(top, popped, std::memory_order_acquire, std::memory_order_acquire)) {
+                numFree.fetch_sub(1, std::memory_order_relaxed);
+                return bufferAt(index);
+            }
+        }
+    }
+
+    void BufferPool::release(void* buffer) {
+        auto index = indexOf(buffer);
+        auto top = head.load(std::memory_order_relaxed);
+        do {
+            next[index].store((uint32_t) top, std::memory_order_relaxed);
+        } while (!head.compare_exchange_weak(top, (top & ~uint64_t(UINT32_MAX)) | index, std::memory_order_release, std::memory_order_relaxed));
+        numFree.fetch_add(1, std::memory_order_relaxed);
+    }
+} // namespace vector_index::io
@@ -10,6 +10,13 @@
 #include <uv.h>
 #include <filesystem>
 #include <functional>
+#include <random>
+#include <fstream>
+#include <chrono>
+#include "async_reader.h"
+#include "buffer_pool.h"
+#include "histogram.h"
+#include "hnsw.h"
 
 using namespace std;
 
@@ -55,79 +62,184 @@ public:
 
 static int64_t ONE_MB = 1 * 1024 * 1024;
 
-int open_file(const char* filePath, int withKernelCache) {
-#ifdef TARGET_OS_MAC
-    int fd = open(filePath, O_RDONLY, 0633);
-    if (!withKernelCache) {
-        fcntl(fd, F_NOCACHE, 1);
-    }
-#else
-    int fd;
-    if (withKernelCache) {
-        fd = open(filePath, O_DIRECT | O_RDONLY, 0633);
-    } else {
-        fd = open(filePath, O_RDONLY, 0633);
+using vector_index::LatencyHistogram;
+
+// Totals of one run of an engine. Latencies are per read, in nanoseconds, from submission to
+// completion.
+struct RunResult {
+    int64_t duration = 0;
+    int64_t requests = 0;
+    int64_t bytes = 0;
+    LatencyHistogram latencies;
+    // Read while searching only: latencies of the concurrent searches.
+    int64_t searches = 0;
+    LatencyHistogram searchLatencies;
+
+    void merge(const RunResult &other) {
+        duration += other.duration;
+        requests += other.requests;
+        bytes += other.bytes;
+        latencies.merge(other.latencies);
+        searches += other.searches;
+        searchLatencies.merge(other.searchLatencies);
     }
-#endif
-    if (fd < 0) {
-        std::cerr << "Error opening file" << std::endl;
-        throw std::runtime_error("Error opening file");
+};
+
+inline int64_t now_nanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Short or failed reads invalidate a run. Checked in every build type, unlike assert.
+inline void check_read(int64_t read_bytes, int64_t expected) {
+    if (read_bytes != expected) {
+        throw std::runtime_error("Read returned " + std::to_string(read_bytes) + " bytes, expected " + std::to_string(expected));
     }
-    return fd;
 }
 
-void read_from_file(int i, int fd, int64_t buffer_size, int64_t batch_size, int withKernelCache, Barrier *barrier, std::uintmax_t fileSize, int64_t gap) {
-#ifdef TARGET_OS_MAC
-    fcntl(fd, F_NOCACHE, withKernelCache);
-#endif
-    char* buffer = new char[buffer_size];
+inline void record_read(RunResult &result, int64_t start, int64_t read_bytes, int64_t expected) {
+    check_read(read_bytes, expected);
+    result.latencies.record(now_nanos() - start);
+    result.requests++;
+    result.bytes += read_bytes;
+}
+
+using vector_index::io::BufferPool;
+
+// Without the kernel cache reads are direct, so buffers come from a BufferPool and offsets and chunk
+// sizes are multiples of SECTOR_SIZE, which satisfies the direct I/O alignment of common devices.
+int open_file(const char* filePath, int withKernelCache) {
+    return vector_index::io::openFile(filePath, withKernelCache ? vector_index::io::IoMode::CACHED : vector_index::io::IoMode::DIRECT);
+}
+
+// Offset of the i-th read, aligned and such that the whole chunk lies in the file.
+inline uint64_t read_offset(int64_t i, int64_t chunkSize, int64_t gap, std::uintmax_t fileSize) {
+    auto offset = (i * chunkSize + gap) % (fileSize - chunkSize + 1);
+    return offset / vector_index::io::SECTOR_SIZE * vector_index::io::SECTOR_SIZE;
+}
+
+void read_from_file(int i, int fd, int64_t buffer_size, int64_t batch_size, BufferPool *buffers, Barrier *barrier, std::uintmax_t fileSize, int64_t gap, RunResult *result) {
+    auto buffer = buffers->acquire();
     barrier->wait();
     for (int j = 0; j < batch_size; j++) {
         // pread from random offset
-        auto offset = (((i + j) * buffer_size) + gap) % fileSize;
+        auto offset = read_offset(i + j, buffer_size, gap, fileSize);
+        auto start = now_nanos();
         auto read_bytes = pread(fd, buffer, buffer_size, offset);
-        assert(read_bytes == buffer_size);
+        record_read(*result, start, read_bytes, buffer_size);
     }
+    buffers->release(buffer);
 }
 
-int64_t run_on_multiple_threads(const char* filePath, int numThreads, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap) {
+RunResult run_on_multiple_threads(const char* filePath, int numThreads, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap) {
     Barrier barrier( numThreads + 1);
     std::vector<thread *> threads;
+    std::vector<RunResult> results(numThreads);
+    BufferPool buffers(chunkSize, numThreads);
     int fd = open_file(filePath, withKernelCache);
     auto batch_size = numRandomOperations / numThreads;
     for (int i = 0; i < numThreads; i++) {
-        threads.push_back(new thread(read_from_file, i, fd, chunkSize, batch_size, withKernelCache, &barrier, fileSize, gap));
+        threads.push_back(new thread(read_from_file, i, fd, chunkSize, batch_size, &buffers, &barrier, fileSize, gap, &results[i]));
     }
 
     barrier.wait();
     auto start_time = std::chrono::high_resolution_clock::now();
     for (auto &t : threads) {
         t->join();
+        delete t;
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    RunResult result;
+    for (auto &r: results) {
+        result.merge(r);
+    }
+    result.duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+    close(fd);
+    return result;
+}
+
+// The concurrent searches of the read while searching scenario.
+struct SearchLoad {
+    vector_index::hnsw::HNSW *index;
+    std::vector<std::vector<float>> *queries;
+    int numThreads;
+    int k;
+    int efSearch;
+};
+
+void search_until(SearchLoad *load, int i, Barrier *barrier, std::atomic<bool> *done, RunResult *result) {
+    vector_index::hnsw::Result found;
+    barrier->wait();
+    for (size_t j = i; !done->load(std::memory_order_relaxed); j += load->numThreads) {
+        auto start = now_nanos();
+        load->index->knnSearch((*load->queries)[j % load->queries->size()], load->k, load->efSearch, found);
+        result->searchLatencies.record(now_nanos() - start);
+        result->searches++;
+    }
+}
+
+// Random reads on numThreads threads while load->numThreads threads search the index, as a disk backed
+// index fetching vectors while it traverses the graph would. Reports both latency distributions.
+RunResult read_while_searching(const char* filePath, int numThreads, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap, SearchLoad *load) {
+    Barrier barrier(numThreads + load->numThreads + 1);
+    std::atomic<bool> done(false);
+    std::vector<thread> readers, searchers;
+    std::vector<RunResult> results(numThreads + load->numThreads);
+    BufferPool buffers(chunkSize, numThreads);
+    int fd = open_file(filePath, withKernelCache);
+    auto batch_size = numRandomOperations / numThreads;
+    for (int i = 0; i < numThreads; i++) {
+        readers.emplace_back(read_from_file, i, fd, chunkSize, batch_size, &buffers, &barrier, fileSize, gap, &results[i]);
+    }
+    for (int i = 0; i < load->numThreads; i++) {
+        searchers.emplace_back(search_until, load, i, &barrier, &done, &results[numThreads + i]);
+    }
+
+    barrier.wait();
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (auto &t: readers) {
+        t.join();
     }
     auto end_time = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+    done = true;
+    for (auto &t: searchers) {
+        t.join();
+    }
+    RunResult result;
+    for (auto &r: results) {
+        result.merge(r);
+    }
+    result.duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
     close(fd);
-    return duration;
+    return result;
 }
 
+struct UvRead {
+    RunResult *result;
+    int64_t start;
+    int64_t expected;
+};
 
 inline void on_read(uv_fs_t *req) {
-    assert(req->result == *(int64_t*)req->data);
+    auto read = static_cast<UvRead*>(req->data);
+    record_read(*read->result, read->start, req->result, read->expected);
+    uv_fs_req_cleanup(req);
 }
 
-int64_t run_exp_with_uv(const char* filePath, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap) {
+RunResult run_exp_with_uv(const char* filePath, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap) {
+    RunResult result;
     int fd = open_file(filePath, withKernelCache);
     uv_loop_t *loop = uv_loop_new();
     uv_loop_init(loop);
     auto read_req = new uv_fs_t[numRandomOperations];
+    auto reads = new UvRead[numRandomOperations];
     for (int i = 0; i < numRandomOperations; i++) {
-        read_req[i].data = &chunkSize;
+        reads[i] = UvRead{&result, 0, chunkSize};
+        read_req[i].data = &reads[i];
     }
     auto iovs = new uv_buf_t[numRandomOperations];
-    auto paddedChunkSize = chunkSize + 64 + 64;
-    char* buffers = new char[numRandomOperations * paddedChunkSize];
+    BufferPool buffers(chunkSize, numRandomOperations);
     for (int64_t i = 0; i < numRandomOperations; i++) {
-        iovs[i] = uv_buf_init(buffers + (i * paddedChunkSize) + 64, chunkSize);
+        iovs[i] = uv_buf_init(static_cast<char*>(buffers.acquire()), chunkSize);
     }
 
 //    uv_loop_init(loop);
@@ -140,25 +252,85 @@ int64_t run_exp_with_uv(const char* filePath, int64_t numRandomOperations, int64
 
     auto start_time = std::chrono::high_resolution_clock::now();
     for (int i = 0; i < numRandomOperations; i++) {
-        uint64_t offset = (i * chunkSize + gap) % fileSize;
+        uint64_t offset = read_offset(i, chunkSize, gap, fileSize);
+        reads[i].start = now_nanos();
         uv_fs_read(loop, &read_req[i], fd, &iovs[i], 1, offset, on_read);
     }
     uv_run(loop, UV_RUN_DEFAULT);
     auto end_time = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+    result.duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
     uv_loop_close(loop);
     close(fd);
-    delete[] buffers;
-    return duration;
+    delete[] iovs;
+    delete[] reads;
+    delete[] read_req;
+    return result;
+}
+
+// Keeps up to queueDepth reads in flight on one thread and submits them in batches of batchSize, so one
+// system call hands batchSize reads to the kernel (none with SQPOLL while its thread is awake).
+RunResult run_exp_with_io_uring(const char* filePath, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap, unsigned queueDepth, unsigned batchSize, bool sqPoll) {
+    RunResult result;
+    int fd = open_file(filePath, withKernelCache);
+    vector_index::io::AsyncReaderOptions options;
+    options.queueDepth = queueDepth;
+    options.sqPoll = sqPoll;
+    vector_index::io::IoUringReader reader(options);
+    // One buffer per queue slot, the slabs of the pool are registered.
+    BufferPool buffers(chunkSize, queueDepth);
+    std::vector<void*> bufferOfSlot;
+    std::vector<int> freeSlots;
+    std::vector<int64_t> startOfSlot(queueDepth);
+    for (unsigned i = 0; i < queueDepth; i++) {
+        bufferOfSlot.push_back(buffers.acquire());
+        freeSlots.push_back((int) i);
+    }
+    reader.registerBuffers(buffers.getSlabs());
+    reader.registerFiles({fd});
+    std::vector<vector_index::io::Completion> completions;
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    int64_t next = 0, done = 0;
+    unsigned batch = 0;
+    while (done < numRandomOperations) {
+        while (next < numRandomOperations && !freeSlots.empty()) {
+            auto slot = freeSlots.back();
+            freeSlots.pop_back();
+            uint64_t offset = read_offset(next, chunkSize, gap, fileSize);
+            startOfSlot[slot] = now_nanos();
+            reader.read({0, bufferOfSlot[slot], (size_t) chunkSize, offset, (uint64_t) slot, buffers.slabOf(bufferOfSlot[slot])});
+            next++;
+            if (++batch == batchSize) {
+                reader.submit();
+                batch = 0;
+            }
+        }
+        // Submits a partial batch as well.
+        batch = 0;
+        completions.clear();
+        reader.reap(completions, 1);
+        for (auto &completion: completions) {
+            auto slot = (int) completion.userData;
+            record_read(result, startOfSlot[slot], completion.result, chunkSize);
+            freeSlots.push_back(slot);
+            done++;
+        }
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    result.duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+    close(fd);
+    return result;
 }
 
-int64_t read_random_on_single_thread(const char* filePath, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap) {
-    char* buffer = new char[chunkSize];
+RunResult read_random_on_single_thread(const char* filePath, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap) {
+    RunResult result;
+    BufferPool buffers(chunkSize, 1);
+    auto buffer = buffers.acquire();
     int fd = open_file(filePath, withKernelCache);
     // create random vector of size numRandomOperations with random indexes
     vector<uint64_t> randomOffsets;
     for (int i = 0; i < numRandomOperations; i++) {
-        randomOffsets.push_back((i * chunkSize + gap) % fileSize);
+        randomOffsets.push_back(read_offset(i, chunkSize, gap, fileSize));
     }
     auto rd = std::random_device {};
     auto rng = std::default_random_engine { rd() };
@@ -166,78 +338,124 @@ int64_t read_random_on_single_thread(const char* filePath, int64_t numRandomOper
     auto start_time = std::chrono::high_resolution_clock::now();
     for (int i = 0; i < numRandomOperations; i++) {
         auto offset = randomOffsets[i];
+        auto start = now_nanos();
         auto read_bytes = pread(fd, buffer, chunkSize, offset);
-        assert(read_bytes == chunkSize);
+        record_read(result, start, read_bytes, chunkSize);
     }
     auto end_time = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+    result.duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
     close(fd);
-    delete[] buffer;
-    return duration;
+    buffers.release(buffer);
+    return result;
 }
 
-int64_t read_sorted_random_on_single_thread(const char* filePath, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap) {
-    char* buffer = new char[chunkSize];
+RunResult read_sorted_random_on_single_thread(const char* filePath, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap) {
+    RunResult result;
+    BufferPool buffers(chunkSize, 1);
+    auto buffer = buffers.acquire();
     int fd = open_file(filePath, withKernelCache);
     // create random vector of size numRandomOperations with random indexes
     vector<uint64_t> randomOffsets;
     for (int i = 0; i < numRandomOperations; i++) {
-        randomOffsets.push_back((i * chunkSize + gap) % fileSize);
+        randomOffsets.push_back(read_offset(i, chunkSize, gap, fileSize));
     }
     auto start_time = std::chrono::high_resolution_clock::now();
     for (int i = 0; i < numRandomOperations; i++) {
         auto offset = randomOffsets[i];
+        auto start = now_nanos();
         auto read_bytes = pread(fd, buffer, chunkSize, offset);
-        assert(read_bytes == chunkSize);
+        record_read(result, start, read_bytes, chunkSize);
     }
     auto end_time = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+    result.duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
     close(fd);
-    delete[] buffer;
-    return duration;
+    buffers.release(buffer);
+    return result;
 }
 
-int64_t read_sequential(const char* filePath, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap) {
-    char* buffer = new char[chunkSize * numRandomOperations];
+RunResult read_sequential(const char* filePath, int64_t numRandomOperations, int64_t chunkSize, int withKernelCache, std::uintmax_t fileSize, int64_t gap) {
+    RunResult result;
+    BufferPool buffers(chunkSize * numRandomOperations, 1);
+    auto buffer = buffers.acquire();
     int fd = open_file(filePath, withKernelCache);
     auto start_time = std::chrono::high_resolution_clock::now();
+    auto start = now_nanos();
     auto read_bytes = pread(fd, buffer, chunkSize * numRandomOperations, gap);
-    assert(read_bytes == chunkSize * numRandomOperations);
+    record_read(result, start, read_bytes, chunkSize * numRandomOperations);
     auto end_time = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+    result.duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
     close(fd);
-    delete[] buffer;
-    return duration;
+    buffers.release(buffer);
+    return result;
 }
 
 constexpr int64_t WARMUP_COUNT = 4;
 constexpr int64_t BENCHMARK_COUNT = 20;
 
-void run_benchmark(std::function<int64_t()> func, const char* name) {
+// Latencies in microseconds.
+std::string histogram_json(const LatencyHistogram &histogram) {
+    std::ostringstream json;
+    json << "{\"count\": " << histogram.getCount()
+         << ", \"min_us\": " << histogram.getMin() / 1e3
+         << ", \"mean_us\": " << histogram.getMean() / 1e3
+         << ", \"p50_us\": " << histogram.percentile(0.5) / 1e3
+         << ", \"p99_us\": " << histogram.percentile(0.99) / 1e3
+         << ", \"p999_us\": " << histogram.percentile(0.999) / 1e3
+         << ", \"max_us\": " << histogram.getMax() / 1e3 << "}";
+    return json.str();
+}
+
+// Runs func after warm up runs and appends the totals over all measured runs to `reports` as a JSON
+// object.
+void run_benchmark(std::function<RunResult()> func, const std::string &name, std::vector<std::string> &reports) {
     // warm up
     std::cout << "================================================" << std::endl;
     std::cout << "Benchmark name " << name << std::endl;
     for (int i = 0; i < WARMUP_COUNT; i++) {
-        auto duration = func();
+        auto duration = func().duration;
         std::cout << "Warm up run " << i << " took " << duration << " microseconds" << std::endl;
     }
 
     // actual execution
-    std::vector<int64_t> durations;
+    RunResult total;
     for (int i = 0; i < BENCHMARK_COUNT; i++) {
-        auto duration = func();
-        durations.push_back(duration);
-        std::cout << "Run " << i << " took " << duration << " microseconds" << std::endl;
+        auto result = func();
+        std::cout << "Run " << i << " took " << result.duration << " microseconds" << std::endl;
+        total.merge(result);
     }
-    // Take average
-    int64_t sum = 0;
-    for (auto &d: durations) {
-        sum += d;
+    auto seconds = total.duration / 1e6;
+    auto iops = total.requests / seconds;
+    auto bandwidth = total.bytes / seconds / ONE_MB;
+    auto &latencies = total.latencies;
+    std::cout << "Average duration for " << name << " is " << total.duration / BENCHMARK_COUNT << " microseconds" << std::endl;
+    printf("IOPS %.0f, bandwidth %.1f MiB/s, latency p50 %.1f us, p99 %.1f us, p99.9 %.1f us\n", iops, bandwidth,
+           latencies.percentile(0.5) / 1e3, latencies.percentile(0.99) / 1e3, latencies.percentile(0.999) / 1e3);
+    std::ostringstream json;
+    json << "{\"name\": \"" << name << "\", \"runs\": " << BENCHMARK_COUNT
+         << ", \"requests\": " << total.requests << ", \"bytes\": " << total.bytes
+         << ", \"duration_us\": " << total.duration << ", \"iops\": " << iops
+         << ", \"bandwidth_mib_s\": " << bandwidth << ", \"latency\": " << histogram_json(latencies);
+    if (total.searches > 0) {
+        auto &searchLatencies = total.searchLatencies;
+        printf("Searches %ld, QPS %.0f, search latency p50 %.1f us, p99 %.1f us, p99.9 %.1f us\n", total.searches, total.searches / seconds,
+               searchLatencies.percentile(0.5) / 1e3, searchLatencies.percentile(0.99) / 1e3, searchLatencies.percentile(0.999) / 1e3);
+        json << ", \"searches\": " << total.searches << ", \"qps\": " << total.searches / seconds
+             << ", \"search_latency\": " << histogram_json(searchLatencies);
     }
-    std::cout << "Average duration for " << name << " is " << sum / BENCHMARK_COUNT << " microseconds" << std::endl;
+    json << "}";
+    reports.push_back(json.str());
     std::cout << "================================================" << std::endl;
 }
 
+std::vector<unsigned> parse_list(const std::string &option, const std::string &defaultValue) {
+    std::vector<unsigned> values;
+    std::stringstream stream(option.empty() ? defaultValue : option);
+    std::string value;
+    while (std::getline(stream, value, ',')) {
+        values.push_back(stoi(value));
+    }
+    return values;
+}
 
 int main(int argc, char **argv) {
     InputParser input(argc, argv);
@@ -248,8 +466,21 @@ int main(int argc, char **argv) {
     auto withKernelCache = stoi(input.getCmdOption("-k"));
     auto gap_in_mbs = stoi(input.getCmdOption("-g"));
     auto gap = gap_in_mbs * ONE_MB;
+    // io_uring sweep: comma separated queue depths and batch sizes, -s 1 for SQPOLL.
+    auto queueDepths = parse_list(input.getCmdOption("-q"), "1,4,16,64");
+    auto batchSizes = parse_list(input.getCmdOption("-b"), "1,4,16");
+    auto sqPoll = !input.getCmdOption("-s").empty() && stoi(input.getCmdOption("-s")) != 0;
+    // Read while searching: -m search threads over an HNSW index of -n random vectors of dimension -d.
+    auto numSearchThreads = input.getCmdOption("-m").empty() ? 0 : stoi(input.getCmdOption("-m"));
+    size_t numVectors = input.getCmdOption("-n").empty() ? 20000 : stoi(input.getCmdOption("-n"));
+    size_t dimension = input.getCmdOption("-d").empty() ? 128 : stoi(input.getCmdOption("-d"));
+    // JSON report, printed to stdout when no file is given.
+    const std::string &jsonPath = input.getCmdOption("-j");
 
     std::uintmax_t fileSize = std::filesystem::file_size(filePath.data());
+    if (!withKernelCache && chunkSize % vector_index::io::SECTOR_SIZE != 0) {
+        throw std::invalid_argument("Direct I/O needs a chunk size that is a multiple of " + std::to_string(vector_index::io::SECTOR_SIZE));
+    }
 
     printf("File path: %s\n", filePath.data());
     printf("File size: %zu\n", fileSize);
@@ -258,10 +489,47 @@ int main(int argc, char **argv) {
     printf("Chunk size: %ld\n", chunkSize);
     printf("With kernel cache: %d\n", withKernelCache);
 
-    run_benchmark([&](){return read_sequential(filePath.data(), numRandomOperations, chunkSize, withKernelCache, fileSize, gap);}, "read_sequential");
-    run_benchmark([&](){return run_on_multiple_threads(filePath.data(), numThreads, numRandomOperations, chunkSize, withKernelCache, fileSize, gap);}, "run_on_multiple_threads");
-    run_benchmark([&](){return run_exp_with_uv(filePath.data(), numRandomOperations, chunkSize, withKernelCache, fileSize, gap);}, "run_exp_with_uv");
-    run_benchmark([&](){return read_sorted_random_on_single_thread(filePath.data(), numRandomOperations, chunkSize, withKernelCache, fileSize, gap);}, "read_sorted_random_on_single_thread");
-    run_benchmark([&](){return read_random_on_single_thread(filePath.data(), numRandomOperations, chunkSize, withKernelCache, fileSize, gap);}, "read_random_on_single_thread");
+    std::vector<std::string> reports;
+    run_benchmark([&](){return read_sequential(filePath.data(), numRandomOperations, chunkSize, withKernelCache, fileSize, gap);}, "read_sequential", reports);
+    run_benchmark([&](){return run_on_multiple_threads(filePath.data(), numThreads, numRandomOperations, chunkSize, withKernelCache, fileSize, gap);}, "run_on_multiple_threads", reports);
+    run_benchmark([&](){return run_exp_with_uv(filePath.data(), numRandomOperations, chunkSize, withKernelCache, fileSize, gap);}, "run_exp_with_uv", reports);
+    for (auto queueDepth: queueDepths) {
+        for (auto batchSize: batchSizes) {
+            if (batchSize > queueDepth) {
+                continue;
+            }
+            auto name = "run_exp_with_io_uring qd=" + std::to_string(queueDepth) + " batch=" + std::to_string(batchSize) + (sqPoll ? " sqpoll" : "");
+            run_benchmark([&](){return run_exp_with_io_uring(filePath.data(), numRandomOperations, chunkSize, withKernelCache, fileSize, gap, queueDepth, batchSize, sqPoll);}, name, reports);
+        }
+    }
+    run_benchmark([&](){return read_sorted_random_on_single_thread(filePath.data(), numRandomOperations, chunkSize, withKernelCache, fileSize, gap);}, "read_sorted_random_on_single_thread", reports);
+    run_benchmark([&](){return read_random_on_single_thread(filePath.data(), numRandomOperations, chunkSize, withKernelCache, fileSize, gap);}, "read_random_on_single_thread", reports);
+    if (numSearchThreads > 0) {
+        vector_index::Random random(42);
+        std::vector<float> data(numVectors * dimension);
+        for (auto &x: data) {
+            x = random.nextDouble();
+        }
+        vector_index::hnsw::HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+        std::vector<std::vector<float>> queries;
+        for (size_t i = 0; i < std::min<size_t>(numVectors, 1000); i++) {
+            queries.emplace_back(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+        }
+        SearchLoad load{&index, &queries, numSearchThreads, 10, 64};
+        run_benchmark([&](){return read_while_searching(filePath.data(), numThreads, numRandomOperations, chunkSize, withKernelCache, fileSize, gap, &load);}, "read_while_searching", reports);
+    }
+
+    std::ostringstream json;
+    json << "{\"file_size\": " << fileSize << ", \"threads\": " << numThreads << ", \"operations\": " << numRandomOperations
+         << ", \"chunk_size\": " << chunkSize << ", \"kernel_cache\": " << withKernelCache << ", \"benchmarks\": [";
+    for (size_t i = 0; i < reports.size(); i++) {
+        json << (i == 0 ? "\n  " : ",\n  ") << reports[i];
+    }
+    json << "\n]}\n";
+    if (jsonPath.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream(jsonPath) << json.str();
+    }
     return 0;
 }
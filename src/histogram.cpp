@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "include/histogram.h"
+
+namespace vector_index {
+    LatencyHistogram::LatencyHistogram(unsigned precisionBits): precisionBits(precisionBits) {
+        if (precisionBits < 1 || precisionBits > 16) {
+            throw std::invalid_argument("Precision bits must be between 1 and 16");
+        }
+        // 2^p exact values, then 2^(p-1) buckets for each of the 64 - p remaining powers of two.
+        size_t subBuckets = size_t(1) << precisionBits;
+        counts.resize(subBuckets + (64 - precisionBits) * (subBuckets / 2));
+        reset();
+    }
+
+    size_t LatencyHistogram::bucketOf(uint64_t value) const {
+        size_t subBuckets = size_t(1) << precisionBits;
+        if (value < subBuckets) {
+            return value;
+        }
+        // The value shifted right keeps its precisionBits leading bits, in [2^(p-1), 2^p).
+        unsigned shift = 64 - __builtin_clzll(value) - precisionBits;
+        return subBuckets + (shift - 1) * (subBuckets / 2) + ((value >> shift) - subBuckets / 2);
+    }
+
+    uint64_t LatencyHistogram::highestOf(size_t bucket) const {
+        size_t subBuckets = size_t(1) << precisionBits;
+        if (bucket < subBuckets) {
+            return bucket;
+        }
+        auto shift = (bucket - subBuckets) / (subBuckets / 2) + 1;
+        auto leading = (bucket - subBuckets) % (subBuckets / 2) + subBuckets / 2;
+        return (leading << shift) + ((uint64_t(1) << shift) - 1);
+    }
+
+    void LatencyHistogram::record(uint64_t value) {
+        counts[bucketOf(value)]++;
+        count++;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        sum += (double) value;
+    }
+
+    void LatencyHistogram::merge(const LatencyHistogram &other) {
+        if (other.precisionBits != precisionBits) {
+            throw std::invalid_argument("Histograms differ in precision");
+        }
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += other.counts[i];
+        }
+        count += other.count;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        sum += other.sum;
+    }
+
+    void LatencyHistogram::reset() {
+        std::fill(counts.begin(), counts.end(), 0);
+        count = 0;
+        min = std::numeric_limits<uint64_t>::max();
+        max = 0;
+        sum = 0;
+    }
+
+    uint64_t LatencyHistogram::percentile(double q) const {
+        if (count == 0) {
+            return 0;
+        }
+        auto target = std::max<uint64_t>(1, (uint64_t) std::ceil(std::clamp(q, 0.0, 1.0) * (double) count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= target) {
+                return std::min(highestOf(i), max);
+            }
+        }
+        return max;
+    }
+
+    double LatencyHistogram::getMean() const {
+        return count == 0 ? 0 : sum / (double) count;
+    }
+} // namespace vector_index
@@ -3,71 +3,79 @@
 #include "include/utils.h"
 #include "include/min_queue.h"
 #include "math.h"
+#include <unordered_map>
+#include <stdexcept>
+#include <numeric>
+#include <algorithm>
 
 namespace vector_index::hnsw {
-    HNSW::HNSW(float *data, size_t dimension, size_t numVectors, int efConstruction, int m, int m0): m(m), m0(m0), entrypoint(nullptr), id(0), nodesVisited(0) {
+    HNSW::HNSW(float *data, size_t dimension, size_t numVectors, int efConstruction, int m, int m0, uint64_t seed, StorageType storage, std::shared_ptr<VectorTransform> transform, Metric metric): m(m), m0(m0), entrypoint(nullptr), id(0), reduction(dimension, metric), dimension(transform ? transform->getOutputDimension() : reduction.getDimension()), vectors(this->dimension, storage, reduction.getStoreMetric()), transform(transform), searchDimension(0), links(std::make_unique<PagePool>()), random(seed), prefetchDistance(DEFAULT_PREFETCH_DISTANCE), hammingMargin(0), earlyAbandon(true) {
         mL = 1.0 / log(m);
-        auto i = 0;
-        std::vector<std::vector<float>> embeddings;
-        while (i < numVectors) {
-            std::vector<float> embedding;
-            for (int j = i * dimension; j < (i + 1) * dimension; j++) {
-                embedding.push_back(data[j]);
+        reduction.fit(data, numVectors);
+        if (transform) {
+            if (transform->getDimension() != reduction.getDimension()) {
+                throw std::invalid_argument("Transform dimension does not match the data");
+            }
+            if (metric == Metric::INNER_PRODUCT) {
+                // Centering shifts every inner product by a different amount.
+                throw std::invalid_argument("Transforms do not preserve inner products");
+            }
+            if (!transform->isTrained()) {
+                auto reduced = metric == Metric::L2 ? std::vector<float>() : reduction.reduceVectors(data, numVectors);
+                transform->train(reduced.empty() ? data : reduced.data(), numVectors);
             }
-            embeddings.push_back(embedding);
-            i++;
         }
-
-        i = 0;
-        for (auto embedding: embeddings) {
+        for (size_t i = 0; i < numVectors; i++) {
+            std::vector<float> embedding(data + i * dimension, data + (i + 1) * dimension);
             insert(embedding, efConstruction);
             if (i % 10000 == 0) {
-                printf("Inserted %d nodes\n", i);
+                printf("Inserted %zu nodes\n", i);
             }
-            i++;
         }
     }
 
     void HNSW::insert(std::vector<float> &embedding, int efConstruction) {
-        auto layer = size_t(-log(Utils::rand_double()) * mL);
+        requireResident("Inserting");
+        auto layer = size_t(-log(1.0 - random.nextDouble()) * mL);
+        ScopedArena arena;
+        auto query = prepare(embedding, arena.get(), false);
         if (entrypoint == nullptr) {
             // TODO - insert first node
             auto node = std::make_unique<Node>();
             node->id = id++;
-            node->embedding = embedding;
-            node->children = std::vector<MinQueue<Node*>>(layer + 1);
+            node->embedding = vectors.add(query.embedding.data());
+            encode(node.get());
+            encodeBinary(node.get());
             for (int i = 0; i <= layer; i++) {
-                if (i == 0) {
-                    node->children[i] = MinQueue<Node*>(m0);
-                } else {
-                    node->children[i] = MinQueue<Node*>(m);
-                }
+                node->children.emplace_back(i == 0 ? m0 : m, links.get());
             }
+            allocateNeighbors(node.get());
             entrypoint = node.get();
             nodes.push_back(std::move(node));
+            if (queryCache) {
+                nodesById.push_back(nodes.back().get());
+                queryCache->invalidate();
+            }
             return;
         }
 
         // initialize node
         auto node = std::make_unique<Node>();
         node->id = id++;
-        node->embedding = embedding;
-        node->children = std::vector<MinQueue<Node*>>(layer + 1);
+        node->embedding = vectors.add(query.embedding.data());
+        encode(node.get());
+        encodeBinary(node.get());
         for (int i = 0; i <= layer; i++) {
-            if (i == 0) {
-                node->children[i] = MinQueue<Node*>(m0);
-            } else {
-                node->children[i] = MinQueue<Node*>(m);
-            }
+            node->children.emplace_back(i == 0 ? m0 : m, links.get());
         }
+        allocateNeighbors(node.get());
 
-
-        auto ep = MinQueue<Node*>(1);
-        ep.insert(Record<Node*>{entrypoint, Utils::l2_distance(entrypoint->embedding, embedding)});
+        auto ep = MinQueue<Node*>(1, arena.get());
+        ep.insert(Record<Node*>{entrypoint, distance(entrypoint, query)});
         auto maxLayer = entrypoint->children.size() - 1;
 
         for (int i = maxLayer; i > layer; i--) {
-            ep = searchLayer(embedding, ep, 1, i);
+            ep = searchLayer(query, ep, 1, i, arena.get());
         }
 
         auto mMax = m;
@@ -76,51 +84,535 @@ namespace vector_index::hnsw {
             if (i == 0) {
                 mMax = m0;
             }
-            ep = searchLayer(embedding, ep, efConstruction, i);
+            ep = searchLayer(query, ep, efConstruction, i, arena.get());
             auto mNeighbors = searchNeighborsSimple(ep, mMax);
             for (auto neighbor: mNeighbors) {
                 node->children[i].insert(neighbor);
                 neighbor.item->children[i].insert(Record<Node*>{node.get(), neighbor.distance});
+                flattenNeighbors(neighbor.item, i);
+                if (i == 0 && packedCodes) {
+                    packNeighbors(neighbor.item);
+                }
             }
+            flattenNeighbors(node.get(), i);
+        }
+        if (packedCodes) {
+            packNeighbors(node.get());
         }
 
         if (layer > maxLayer) {
             entrypoint = node.get();
         }
         nodes.push_back(std::move(node));
+        if (queryCache) {
+            nodesById.push_back(nodes.back().get());
+            queryCache->invalidate();
+        }
     }
 
-    MinQueue<Node*> HNSW::searchLayer(std::vector<float> &query, MinQueue<Node*> entrypoints, int efSearch, int layer) {
-        auto mNeighbors = MinQueue<Node*>(efSearch);
-        std::unordered_set<int> visited;
-        auto candidates = MinQueue<Node*>(SIZE_MAX);
-
+    LayerSearch::LayerSearch(MinQueue<Node*> &entrypoints, int efSearch, int layer, std::pmr::memory_resource* resource): neighbors(efSearch, resource), candidates(SIZE_MAX, resource), visited(resource), expanded(nullptr), unvisited(resource), positions(resource), packedDistances(resource), fetched(resource), fetchedIds(resource), fetchedEmbeddings(resource), efSearch(efSearch), layer(layer), nodesVisited(0) {
         for (auto ep: entrypoints.getRecords()) {
-            mNeighbors.insert(ep);
+            neighbors.insert(ep);
             candidates.insert(ep);
             visited.insert(ep.item->id);
         }
+    }
+
+    Query HNSW::prepare(const std::vector<float> &embedding, std::pmr::memory_resource* resource, bool isQuery) {
+        std::pmr::vector<float> reduced(reduction.getDimension(), resource);
+        if (isQuery) {
+            reduction.reduceQuery(embedding.data(), reduced.data());
+        } else {
+            reduction.reduceVector(embedding.data(), reduced.data());
+        }
+        Query query{std::pmr::vector<float>(resource), nullptr, std::pmr::vector<uint64_t>(resource), dimension};
+        if (transform) {
+            query.embedding.resize(dimension);
+            transform->apply(reduced.data(), query.embedding.data());
+        } else {
+            query.embedding = std::move(reduced);
+        }
+        if (quantizer) {
+            query.codeDistance = quantizer->prepare(query.embedding.data());
+        }
+        if (binaryQuantizer) {
+            query.binaryCode.resize(binaryQuantizer->getNumWords());
+            binaryQuantizer->encode(query.embedding.data(), query.binaryCode.data());
+        }
+        if (tiers) {
+            query.hotTier = tiers->snapshot();
+        }
+        return query;
+    }
 
-        while (candidates.size() > 0) {
-            auto closest = candidates.top();
-            auto furthest = mNeighbors.last();
-            if (mNeighbors.size() >= efSearch && furthest.distance < closest.distance) {
+    void HNSW::setSearchDimension(size_t numDimensions) {
+        if (numDimensions > dimension) {
+            throw std::invalid_argument("Search dimension larger than the index dimension");
+        }
+        searchDimension = numDimensions;
+        invalidateQueryCache();
+    }
+
+    MinQueue<Node*> HNSW::searchLayer(std::vector<float> &query, MinQueue<Node*> entrypoints, int efSearch, int layer) {
+        auto resource = std::pmr::get_default_resource();
+        auto prepared = prepare(query, resource);
+        return searchLayer(prepared, entrypoints, efSearch, layer, resource);
+    }
+
+    MinQueue<Node*> HNSW::searchLayer(Query &query, MinQueue<Node*> &entrypoints, int efSearch, int layer, std::pmr::memory_resource* resource) {
+        LayerSearch search(entrypoints, efSearch, layer, resource);
+        if (layer == 0) {
+            query.termination.begin(search.neighbors);
+        }
+        while (nextCandidate(search) && query.budget.allowHop(query.nodesVisited + search.nodesVisited)) {
+            expandCandidate(search, query, prefetchDistance);
+            if (layer == 0 && !query.termination.afterHop(search.neighbors, search.nodesVisited)) {
                 break;
             }
-            for (auto neighbor: closest.item->children[layer].getRecords()) {
-                if (visited.contains(neighbor.item->id)) {
-                    continue;
+        }
+        query.nodesVisited += search.nodesVisited;
+        return std::move(search.neighbors);
+    }
+
+    bool HNSW::nextCandidate(LayerSearch &search) {
+        while (search.candidates.size() > 0) {
+            auto closest = search.candidates.top();
+            search.furthest = search.neighbors.last();
+            if (search.neighbors.size() >= search.efSearch && search.furthest.distance < closest.distance) {
+                return false;
+            }
+            // Pull in the neighbors of the next candidate while we work on this one.
+            if (prefetchDistance > 0 && search.candidates.size() > 0) {
+                prefetchNeighbors(search.candidates.first().item, search.layer);
+            }
+
+            search.expanded = closest.item;
+            search.unvisited.clear();
+            search.positions.clear();
+            size_t position = 0;
+            for (auto neighbor = neighborsOf(closest.item, search.layer); *neighbor != nullptr; neighbor++) {
+                if (!search.visited.contains((*neighbor)->id)) {
+                    search.visited.insert((*neighbor)->id);
+                    search.unvisited.push_back(*neighbor);
+                    search.positions.push_back(position);
                 }
-                auto child = Record<Node*>{neighbor.item, Utils::l2_distance(neighbor.item->embedding, query)};
-                nodesVisited++;
-                visited.insert(neighbor.item->id);
-                if (mNeighbors.size() < efSearch || furthest.distance > child.distance) {
-                    mNeighbors.insert(child);
-                    candidates.insert(child);
+                position++;
+            }
+            if (!search.unvisited.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void HNSW::expandCandidate(LayerSearch &search, Query &query, size_t lookahead) {
+        auto &unvisited = search.unvisited;
+        if (packedCodes && search.layer == 0) {
+            // Score the whole neighborhood from the packed codes, visited neighbors included.
+            auto numNeighbors = search.expanded->children[0].size();
+            search.packedDistances.resize(numNeighbors);
+            query.codeDistance->packedDistances(search.expanded->packedNeighbors, numNeighbors, search.packedDistances.data());
+            for (size_t i = 0; i < unvisited.size(); i++) {
+                auto child = Record<Node*>{unvisited[i], search.packedDistances[search.positions[i]]};
+                search.nodesVisited++;
+                if (search.neighbors.size() < search.efSearch || search.furthest.distance > child.distance) {
+                    search.neighbors.insert(child);
+                    search.candidates.insert(child);
                 }
             }
+            return;
+        }
+        if (tiers && !query.codeDistance) {
+            expandTiered(search, query);
+            return;
+        }
+        // Keep the embeddings of the next `lookahead` neighbors in flight.
+        for (size_t i = 0; i < std::min(lookahead, unvisited.size()); i++) {
+            prefetchEmbedding(unvisited[i]);
+        }
+        auto prefilter = binaryQuantizer && search.neighbors.size() >= search.efSearch;
+        auto maxHamming = prefilter ? hamming(search.furthest.item, query) + hammingMargin : 0;
+        auto bound = search.neighbors.size() >= search.efSearch ? search.furthest.distance : INFINITY;
+        for (size_t i = 0; i < unvisited.size(); i++) {
+            if (i + lookahead < unvisited.size()) {
+                prefetchEmbedding(unvisited[i + lookahead]);
+            }
+            if (prefilter && hamming(unvisited[i], query) > maxHamming) {
+                continue;
+            }
+            auto child = Record<Node*>{unvisited[i], distance(unvisited[i], query, bound)};
+            search.nodesVisited++;
+            if (search.neighbors.size() < search.efSearch || search.furthest.distance > child.distance) {
+                search.neighbors.insert(child);
+                search.candidates.insert(child);
+            }
+        }
+    }
+
+    void HNSW::expandTiered(LayerSearch &search, Query &query) {
+        auto prefilter = binaryQuantizer && search.neighbors.size() >= search.efSearch;
+        auto maxHamming = prefilter ? hamming(search.furthest.item, query) + hammingMargin : 0;
+        auto bound = search.neighbors.size() >= search.efSearch ? search.furthest.distance : INFINITY;
+        search.fetched.clear();
+        search.fetchedIds.clear();
+        for (auto node: search.unvisited) {
+            if (prefilter && hamming(node, query) > maxHamming) {
+                continue;
+            }
+            search.fetched.push_back(node);
+            search.fetchedIds.push_back(node->id);
+        }
+        search.fetchedEmbeddings.resize(search.fetched.size());
+        tiers->fetch(*query.hotTier, search.fetchedIds.data(), search.fetched.size(), search.fetchedEmbeddings.data());
+        for (size_t i = 0; i < search.fetched.size(); i++) {
+            auto embedding = search.fetchedEmbeddings[i];
+            auto child = Record<Node*>{search.fetched[i], earlyAbandon ? embeddingDistance(embedding, query, bound) : embeddingDistance(embedding, query)};
+            search.nodesVisited++;
+            if (search.neighbors.size() < search.efSearch || search.furthest.distance > child.distance) {
+                search.neighbors.insert(child);
+                search.candidates.insert(child);
+            }
+        }
+    }
+
+    const void* HNSW::fetchEmbedding(const Node *node, Query &query) {
+        const void* embedding;
+        tiers->fetch(*query.hotTier, &node->id, 1, &embedding);
+        return embedding;
+    }
+
+    void HNSW::requireResident(const char* operation) const {
+        if (tiers) {
+            throw std::logic_error(std::string(operation) + " needs the embeddings in memory, they are tiered");
+        }
+    }
+
+    void HNSW::enableTiering(const std::string &path, size_t hotBudget, const TieringOptions &options) {
+        requireResident("Tiering");
+        std::vector<const void*> byId(nodes.size());
+        for (auto &node: nodes) {
+            byId[node->id] = node->embedding;
+        }
+        tiers = std::make_unique<TieredVectors>(path, vectors.getRecordSize(), nodes.size(), [&](size_t i) { return byId[i]; }, hotBudget, options);
+        // Every search descends through the upper layers, their nodes start hot. Any visit counts more
+        // than this ranking once the visits are in.
+        for (auto &node: nodes) {
+            tiers->addVisits(node->id, (uint32_t) node->children.size() - 1);
+        }
+        tiers->rebalance();
+        for (auto &node: nodes) {
+            node->embedding = nullptr;
+        }
+        vectors = VectorStore(dimension, vectors.getType(), vectors.getMetric());
+    }
+
+    void HNSW::rebalanceTiers() {
+        if (!tiers) {
+            throw std::logic_error("The index is not tiered");
+        }
+        tiers->rebalance();
+    }
+
+    TierStats HNSW::getTierStats() const {
+        return tiers ? tiers->getStats() : TierStats{};
+    }
+
+    void HNSW::setTerminationModel(std::shared_ptr<const TerminationModel> model) {
+        terminationModel = std::move(model);
+        invalidateQueryCache();
+    }
+
+    void HNSW::enableQueryCache(const QueryCacheOptions &options) {
+        queryCache = std::make_unique<QueryCache>(reduction.getDimension(), options);
+        nodesById.resize(nodes.size());
+        for (auto &node: nodes) {
+            nodesById[node->id] = node.get();
+        }
+    }
+
+    void HNSW::disableQueryCache() {
+        queryCache.reset();
+        nodesById = std::vector<Node*>();
+    }
+
+    QueryCacheStats HNSW::getQueryCacheStats() const {
+        return queryCache ? queryCache->getStats() : QueryCacheStats{};
+    }
+
+    TerminationSample HNSW::sampleTermination(std::vector<float> &embedding, int k, int efSearch, const std::vector<int> &groundTruth, const TerminationModel &model) {
+        ScopedArena arena;
+        auto query = prepare(embedding, arena.get());
+        query.termination = TerminationTracker(&model, k, &groundTruth);
+        Result result;
+        knnSearch(query, k, efSearch, result, arena.get());
+        return query.termination.getSample();
+    }
+
+    Result HNSW::knnSearchWithModel(std::vector<float> &embedding, int k, int efSearch, const TerminationModel &model) {
+        auto start = std::chrono::high_resolution_clock::now();
+        ScopedArena arena;
+        auto query = prepare(embedding, arena.get());
+        query.termination = TerminationTracker(&model, k);
+        Result result;
+        knnSearch(query, k, efSearch, result, arena.get());
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = query.nodesVisited;
+        result.hops = query.budget.getHops();
+        result.depth = 0;
+        return result;
+    }
+
+    void HNSW::prefetchEmbedding(Node *node) {
+        if (binaryQuantizer) {
+            // Most neighbors are discarded on their binary code, only it is worth loading ahead.
+            Utils::prefetch(node->binaryCode, binaryQuantizer->getNumWords() * sizeof(uint64_t));
+        } else if (quantizer) {
+            Utils::prefetch(node->code, quantizer->getCodeSize());
+        } else if (node->embedding != nullptr) {
+            Utils::prefetch(node->embedding, vectors.getRecordSize());
+        }
+    }
+
+    void HNSW::allocateNeighbors(Node *node) {
+        auto slots = numNeighborSlots(node->children.size());
+        node->neighbors = static_cast<Node**>(links->allocate(slots * sizeof(Node*), alignof(Node*)));
+        std::fill(node->neighbors, node->neighbors + slots, nullptr);
+    }
+
+    void HNSW::flattenNeighbors(Node *node, int layer) {
+        auto neighbor = neighborsOf(node, layer);
+        for (auto &record: node->children[layer].getRecords()) {
+            *neighbor++ = record.item;
+        }
+        *neighbor = nullptr;
+    }
+
+    void HNSW::prefetchNeighbors(const Node *node, int layer) const {
+        // The node itself is usually cached, its distance was computed when it became a candidate.
+        Utils::prefetch(neighborsOf(node, layer), (layer == 0 ? m0 + 1 : m + 1) * sizeof(Node*));
+    }
+
+    HNSW::HNSW(const HNSW &other): id(other.id), reduction(other.reduction), dimension(other.dimension), vectors(other.dimension, other.vectors.getType(), other.vectors.getMetric()), transform(other.transform), searchDimension(other.searchDimension), quantizer(other.quantizer), binaryQuantizer(other.binaryQuantizer), hammingMargin(other.hammingMargin), links(std::make_unique<PagePool>()), entrypoint(nullptr), m(other.m), m0(other.m0), mL(other.mL), random(other.random), prefetchDistance(other.prefetchDistance), earlyAbandon(other.earlyAbandon), terminationModel(other.terminationModel) {
+        std::vector<int> order(other.nodes.size());
+        std::iota(order.begin(), order.end(), 0);
+        layOut(other, order);
+    }
+
+    void HNSW::reorder(reorder::Ordering ordering) {
+        if (nodes.empty()) {
+            return;
+        }
+        std::unordered_map<Node*, int> positions;
+        for (int i = 0; i < nodes.size(); i++) {
+            positions[nodes[i].get()] = i;
+        }
+        std::vector<std::vector<int>> adjacency(nodes.size());
+        for (int i = 0; i < nodes.size(); i++) {
+            for (auto neighbor: nodes[i]->children[0].getRecords()) {
+                adjacency[i].push_back(positions[neighbor.item]);
+            }
+        }
+        layOut(*this, reorder::computeOrder(adjacency, ordering, positions[entrypoint]));
+    }
+
+    void HNSW::layOut(const HNSW &source, const std::vector<int> &order) {
+        source.requireResident("Laying out the nodes");
+        std::unordered_map<const Node*, int> positions;
+        for (int i = 0; i < source.nodes.size(); i++) {
+            positions[source.nodes[i].get()] = i;
+        }
+
+        // Allocate the nodes and copy the embeddings in the new order, then rebuild the links.
+        VectorStore reorderedVectors(dimension, vectors.getType(), vectors.getMetric());
+        std::unique_ptr<CodeStore> reorderedCodes;
+        if (quantizer) {
+            reorderedCodes = std::make_unique<CodeStore>(quantizer->getCodeSize());
+        }
+        std::unique_ptr<BinaryCodeStore> reorderedBinaryCodes;
+        if (binaryQuantizer) {
+            reorderedBinaryCodes = std::make_unique<BinaryCodeStore>(binaryQuantizer->getNumWords());
+        }
+        std::vector<std::unique_ptr<Node>> reorderedNodes(source.nodes.size());
+        std::vector<Node*> moved(source.nodes.size());
+        for (int i = 0; i < order.size(); i++) {
+            auto &node = source.nodes[order[i]];
+            reorderedNodes[i] = std::make_unique<Node>();
+            reorderedNodes[i]->id = node->id;
+            reorderedNodes[i]->embedding = reorderedVectors.copy(node->embedding);
+            if (quantizer) {
+                reorderedNodes[i]->code = reorderedCodes->add(node->code);
+            }
+            if (binaryQuantizer) {
+                reorderedNodes[i]->binaryCode = reorderedBinaryCodes->add(node->binaryCode);
+            }
+            moved[order[i]] = reorderedNodes[i].get();
+        }
+        for (int i = 0; i < order.size(); i++) {
+            auto &node = source.nodes[order[i]];
+            auto &children = reorderedNodes[i]->children;
+            for (int layer = 0; layer < node->children.size(); layer++) {
+                children.emplace_back(layer == 0 ? m0 : m, links.get());
+                for (auto neighbor: node->children[layer].getRecords()) {
+                    children[layer].insert(Record<Node*>{moved[positions[neighbor.item]], neighbor.distance});
+                }
+            }
+            allocateNeighbors(reorderedNodes[i].get());
+            for (int layer = 0; layer < children.size(); layer++) {
+                flattenNeighbors(reorderedNodes[i].get(), layer);
+            }
+        }
+        if (&source == this) {
+            for (auto &node: nodes) {
+                links->deallocate(node->neighbors, numNeighborSlots(node->children.size()) * sizeof(Node*), alignof(Node*));
+            }
+        }
+        auto fastScan = source.packedCodes != nullptr;
+        entrypoint = source.entrypoint ? moved[positions[source.entrypoint]] : nullptr;
+        nodes = std::move(reorderedNodes);
+        vectors = std::move(reorderedVectors);
+        codes = std::move(reorderedCodes);
+        binaryCodes = std::move(reorderedBinaryCodes);
+        if (fastScan) {
+            enableFastScan();
+        }
+        if (queryCache) {
+            for (auto &node: nodes) {
+                nodesById[node->id] = node.get();
+            }
+        }
+    }
+
+    void HNSW::quantize(ScalarQuantizerType type) {
+        quantize(std::make_unique<ScalarQuantizer>(dimension, type));
+    }
+
+    void HNSW::quantize(std::unique_ptr<Quantizer> quantizer) {
+        if (vectors.getMetric() == Metric::INNER_PRODUCT) {
+            throw std::logic_error("Quantizers approximate L2 distances, not inner products");
+        }
+        requireResident("Quantizing");
+        auto data = decodeAll();
+        quantizer->train(data.data(), nodes.size());
+        this->quantizer = std::move(quantizer);
+        codes = std::make_unique<CodeStore>(this->quantizer->getCodeSize());
+        packedCodes = nullptr;
+        for (auto &node: nodes) {
+            node->packedNeighbors = nullptr;
+            encode(node.get());
+        }
+        invalidateQueryCache();
+    }
+
+    void HNSW::enableFastScan() {
+        if (!quantizer || !quantizer->supportsPacking()) {
+            throw std::logic_error("Fast scan needs a quantizer that supports packing");
+        }
+        packedCodes = std::make_unique<CodeStore>(quantizer->getPackedSize(m0));
+        for (auto &node: nodes) {
+            node->packedNeighbors = nullptr;
+            packNeighbors(node.get());
+        }
+        invalidateQueryCache();
+    }
+
+    void HNSW::packNeighbors(Node *node) {
+        if (node->packedNeighbors == nullptr) {
+            std::vector<uint8_t> empty(packedCodes->getRecordLength());
+            node->packedNeighbors = packedCodes->add(empty.data());
+        }
+        std::vector<const uint8_t*> neighborCodes;
+        for (auto neighbor: node->children[0].getRecords()) {
+            neighborCodes.push_back(neighbor.item->code);
+        }
+        quantizer->pack(neighborCodes, node->packedNeighbors);
+    }
+
+    void HNSW::enableBinaryPrefilter(int margin, bool rotate) {
+        if (vectors.getMetric() == Metric::INNER_PRODUCT) {
+            throw std::logic_error("Hamming distances approximate angles, not inner products");
+        }
+        requireResident("The binary prefilter");
+        auto data = decodeAll();
+        binaryQuantizer = std::make_unique<BinaryQuantizer>(dimension, rotate);
+        binaryQuantizer->train(data.data(), nodes.size());
+        binaryCodes = std::make_unique<BinaryCodeStore>(binaryQuantizer->getNumWords());
+        hammingMargin = margin;
+        for (auto &node: nodes) {
+            encodeBinary(node.get());
+        }
+        invalidateQueryCache();
+    }
+
+    void HNSW::disableBinaryPrefilter() {
+        for (auto &node: nodes) {
+            node->binaryCode = nullptr;
+        }
+        binaryQuantizer = nullptr;
+        binaryCodes = nullptr;
+        invalidateQueryCache();
+    }
+
+    void HNSW::encodeBinary(Node *node) {
+        if (!binaryQuantizer) {
+            return;
+        }
+        std::vector<float> embedding(dimension);
+        vectors.decode(node->embedding, embedding.data());
+        std::vector<uint64_t> code(binaryQuantizer->getNumWords());
+        binaryQuantizer->encode(embedding.data(), code.data());
+        node->binaryCode = binaryCodes->add(code.data());
+    }
+
+    void HNSW::encode(Node *node) {
+        if (!quantizer) {
+            return;
+        }
+        std::vector<float> embedding(dimension);
+        vectors.decode(node->embedding, embedding.data());
+        std::vector<uint8_t> code(quantizer->getCodeSize());
+        quantizer->encode(embedding.data(), code.data());
+        node->code = codes->add(code.data());
+    }
+
+    std::vector<float> HNSW::decodeAll() {
+        std::vector<float> data(nodes.size() * dimension);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            vectors.decode(nodes[i]->embedding, data.data() + i * dimension);
+        }
+        return data;
+    }
+
+    void HNSW::topK(MinQueue<Node*> &candidates, Query &query, int k, Result &result, std::pmr::memory_resource* resource) {
+        auto records = &candidates.getRecords();
+        MinQueue<Node*> reranked(k, resource);
+        if (quantizer || query.numDimensions < dimension) {
+            // The candidates were ranked on codes or on a prefix, re-rank them with the full embeddings.
+            std::pmr::vector<int> ids(resource);
+            std::pmr::vector<const void*> embeddings(resource);
+            if (tiers) {
+                for (auto &candidate: candidates.getRecords()) {
+                    ids.push_back(candidate.item->id);
+                }
+                embeddings.resize(ids.size());
+                tiers->fetch(*query.hotTier, ids.data(), ids.size(), embeddings.data());
+            }
+            size_t i = 0;
+            for (auto &candidate: candidates.getRecords()) {
+                auto embedding = tiers ? embeddings[i++] : candidate.item->embedding;
+                reranked.insert(Record<Node*>{candidate.item, vectors.distance(query.embedding.data(), embedding)});
+            }
+            records = &reranked.getRecords();
+        }
+        result.ids.clear();
+        result.distances.clear();
+        for (auto &record: *records) {
+            if (result.ids.size() >= k) {
+                break;
+            }
+            result.ids.push_back(record.item->id);
+            // toMetric is increasing, the order is kept. The query norm only matters to reduced inner products.
+            result.distances.push_back(reduction.getMetric() == Metric::COSINE ? reduction.toMetric(record.distance, 0) : record.distance);
         }
-        return mNeighbors;
     }
 
     std::set<Record<Node*>> HNSW::searchNeighborsSimple(MinQueue<Node*> &elements, int mMax) {
@@ -135,17 +627,149 @@ namespace vector_index::hnsw {
         return neighbors;
     }
 
-    Result HNSW::knnSearch(std::vector<float> &query, int k, int efSearch) {
+    Result HNSW::knnSearch(std::vector<float> &embedding, int k, int efSearch) {
+        Result result;
+        knnSearch(embedding, k, efSearch, result);
+        return result;
+    }
+
+    Result HNSW::knnSearch(std::vector<float> &embedding, int k, int efSearch, const SearchBudget &budget) {
+        Result result;
+        knnSearch(embedding, k, efSearch, result, budget);
+        return result;
+    }
+
+    void HNSW::knnSearch(std::vector<float> &embedding, int k, int efSearch, Result &result, const SearchBudget &budget) {
+        auto start = std::chrono::high_resolution_clock::now();
+        // The seed ids of a near duplicate land in result.ids, which the search overwrites.
+        auto match = queryCache ? queryCache->lookup(embedding.data(), k, efSearch, result.ids, result.distances) : CacheMatch::NONE;
+        if (match == CacheMatch::EXACT) {
+            result.searchTime = std::chrono::high_resolution_clock::now() - start;
+            result.nodesVisited = 0;
+            result.hops = 0;
+            result.depth = 0;
+            result.partial = false;
+            return;
+        }
+        ScopedArena arena;
+        auto query = prepare(embedding, arena.get());
+        query.budget = BudgetTracker(budget);
+        query.termination = TerminationTracker(terminationModel.get(), k);
+        knnSearch(query, k, efSearch, result, arena.get(), match == CacheMatch::NEAR ? &result.ids : nullptr);
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = query.nodesVisited;
+        result.hops = query.budget.getHops();
+        result.depth = 0;
+        result.partial = query.budget.isExhausted();
+        if (queryCache && !result.partial) {
+            queryCache->insert(embedding.data(), efSearch, result.ids, result.distances);
+        }
+    }
+
+    void HNSW::knnSearch(Query &query, int k, int efSearch, Result &result, std::pmr::memory_resource* resource, const std::vector<int>* seeds) {
+        if (searchDimension > 0) {
+            query.numDimensions = searchDimension;
+        }
+        auto ep = seeds ? seedEntrypoints(*seeds, query, efSearch, resource) : MinQueue<Node*>(1, resource);
+        if (!seeds) {
+            size_t maxLayer = entrypoint->children.size() - 1;
+            ep.insert(Record<Node*>{entrypoint, distance(entrypoint, query)});
+            for (int i = maxLayer; i >= 1; i--) {
+                ep = searchLayer(query, ep, 1, i, resource);
+            }
+        }
+
+        ep = searchLayer(query, ep, efSearch, 0, resource);
+        topK(ep, query, k, result, resource);
+    }
+
+    MinQueue<Node*> HNSW::seedEntrypoints(const std::vector<int> &seeds, Query &query, int efSearch, std::pmr::memory_resource* resource) {
+        MinQueue<Node*> ep(std::max<size_t>(efSearch, 1), resource);
+        for (auto id: seeds) {
+            auto node = nodesById[id];
+            ep.insert(Record<Node*>{node, distance(node, query)});
+            query.nodesVisited++;
+        }
+        if (ep.size() == 0) {
+            ep.insert(Record<Node*>{entrypoint, distance(entrypoint, query)});
+        }
+        return ep;
+    }
+
+    Task<Result> HNSW::knnSearchTask(std::vector<float> &embedding, int k, int efSearch, SearchBudget budget) {
         auto start = std::chrono::high_resolution_clock::now();
-        nodesVisited = 0;
-        size_t maxLayer = entrypoint->children.size() - 1;
-        auto ep = MinQueue<Node*>(1);
-        ep.insert(Record<Node*>{entrypoint, Utils::l2_distance(entrypoint->embedding, query)});
-        for (int i = maxLayer; i >= 1; i--) {
-            ep = searchLayer(query, ep, 1, i);
+        size_t visitedCount = 0;
+        Result result;
+        auto match = queryCache ? queryCache->lookup(embedding.data(), k, efSearch, result.ids, result.distances) : CacheMatch::NONE;
+        if (match == CacheMatch::EXACT) {
+            result.searchTime = std::chrono::high_resolution_clock::now() - start;
+            result.nodesVisited = 0;
+            result.hops = 0;
+            result.depth = 0;
+            co_return result;
+        }
+        // Held until the task completes, every query in flight has its own arena.
+        ScopedArena arena;
+        auto query = prepare(embedding, arena.get());
+        query.budget = BudgetTracker(budget);
+        query.termination = TerminationTracker(terminationModel.get(), k);
+        if (searchDimension > 0) {
+            query.numDimensions = searchDimension;
+        }
+        auto ep = MinQueue<Node*>(1, arena.get());
+        auto topLayer = (int) entrypoint->children.size() - 1;
+        if (match == CacheMatch::NEAR) {
+            ep = seedEntrypoints(result.ids, query, efSearch, arena.get());
+            visitedCount = query.nodesVisited;
+            topLayer = 0;
+        } else {
+            ep.insert(Record<Node*>{entrypoint, distance(entrypoint, query)});
+        }
+        for (int layer = topLayer; layer >= 0; layer--) {
+            LayerSearch search(ep, layer == 0 ? efSearch : 1, layer, arena.get());
+            if (layer == 0) {
+                query.termination.begin(search.neighbors);
+            }
+            while (nextCandidate(search) && query.budget.allowHop(visitedCount + search.nodesVisited)) {
+                // Issue the loads for the whole neighborhood and let the other queries run meanwhile.
+                if (packedCodes && layer == 0) {
+                    Utils::prefetch(search.expanded->packedNeighbors, packedCodes->getRecordLength());
+                } else {
+                    for (auto node: search.unvisited) {
+                        prefetchEmbedding(node);
+                    }
+                }
+                co_await std::suspend_always{};
+                expandCandidate(search, query, 0);
+                if (layer == 0 && !query.termination.afterHop(search.neighbors, search.nodesVisited)) {
+                    break;
+                }
+            }
+            visitedCount += search.nodesVisited;
+            ep = std::move(search.neighbors);
         }
+        topK(ep, query, k, result, arena.get());
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = visitedCount;
+        result.hops = query.budget.getHops();
+        result.depth = 0;
+        result.partial = query.budget.isExhausted();
+        if (queryCache && !result.partial) {
+            queryCache->insert(embedding.data(), efSearch, result.ids, result.distances);
+        }
+        co_return result;
+    }
 
-        ep = searchLayer(query, ep, efSearch, 0);
-        return Result{searchNeighborsSimple(ep, k), std::chrono::high_resolution_clock::now() - start, nodesVisited, 0, 0};
+    std::vector<Result> HNSW::knnSearchBatch(std::vector<std::vector<float>> &queries, int k, int efSearch, size_t numInFlight, const SearchBudget &budget) {
+        auto deadline = std::chrono::steady_clock::now() + budget.time;
+        return interleave<Result>(queries.size(), numInFlight, [&](size_t i) {
+            auto remaining = budget;
+            if (budget.time.count() > 0) {
+                // Queries that wait for a slot only get what is left, a spent budget still leaves the
+                // query its entry points.
+                remaining.time = std::max(std::chrono::nanoseconds(1), std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()));
+            }
+            return knnSearchTask(queries[i], k, efSearch, remaining);
+        });
     }
 } // namespace vector_index::hnsw
@@ -0,0 +1,146 @@
+#include <sys/mman.h>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <new>
+#include <memory>
+#include "include/huge_pages.h"
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << 26)
+#endif
+
+namespace vector_index {
+    static std::atomic<PagePolicy> pagePolicy{PagePolicy::NONE};
+
+    // Bytes of the live buffers, by obtained kind.
+    static std::atomic<size_t> pageBytes[3];
+
+    void setPagePolicy(PagePolicy policy) {
+        pagePolicy = policy;
+    }
+
+    PagePolicy getPagePolicy() {
+        return pagePolicy;
+    }
+
+    PageStats getPageStats() {
+        PageStats stats{pageBytes[(int) PagePolicy::EXPLICIT], pageBytes[(int) PagePolicy::TRANSPARENT], pageBytes[(int) PagePolicy::NONE], 0};
+        std::ifstream smaps("/proc/self/smaps_rollup");
+        std::string key;
+        size_t value;
+        while (smaps >> key) {
+            if (key == "AnonHugePages:" && smaps >> value) {
+                stats.anonHugeBytes = value << 10;
+                break;
+            }
+        }
+        return stats;
+    }
+
+    static size_t roundUp(size_t size, size_t alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    PageBuffer::PageBuffer(size_t size, PagePolicy policy): data(nullptr), size(size), kind(PagePolicy::NONE), mapping(nullptr), mappingSize(0) {
+        if (policy == PagePolicy::EXPLICIT) {
+            auto hugeSize = roundUp(size, HUGE_PAGE_SIZE);
+            auto p = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+            if (p != MAP_FAILED) {
+                data = mapping = p;
+                this->size = mappingSize = hugeSize;
+                kind = PagePolicy::EXPLICIT;
+            }
+        }
+        if (data == nullptr && policy != PagePolicy::NONE) {
+            // Over-allocate by a huge page to align the buffer, then give back the unaligned ends.
+            auto hugeSize = roundUp(size, HUGE_PAGE_SIZE);
+            auto p = mmap(nullptr, hugeSize + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED) {
+                auto begin = reinterpret_cast<uintptr_t>(p);
+                auto aligned = roundUp(begin, HUGE_PAGE_SIZE);
+                if (aligned > begin) {
+                    munmap(p, aligned - begin);
+                }
+                auto tail = begin + hugeSize + HUGE_PAGE_SIZE - (aligned + hugeSize);
+                if (tail > 0) {
+                    munmap(reinterpret_cast<void*>(aligned + hugeSize), tail);
+                }
+                data = mapping = reinterpret_cast<void*>(aligned);
+                this->size = mappingSize = hugeSize;
+                // Without THP support the mapping is kept with regular pages.
+                kind = madvise(data, hugeSize, MADV_HUGEPAGE) == 0 ? PagePolicy::TRANSPARENT : PagePolicy::NONE;
+            }
+        }
+        if (data == nullptr) {
+            data = operator new(size, std::align_val_t(64));
+        }
+        pageBytes[(int) kind] += this->size;
+    }
+
+    PageBuffer::PageBuffer(PageBuffer &&other) noexcept: data(other.data), size(other.size), kind(other.kind), mapping(other.mapping), mappingSize(other.mappingSize) {
+        other.data = nullptr;
+        other.mapping = nullptr;
+    }
+
+    PageBuffer &PageBuffer::operator=(PageBuffer &&other) noexcept {
+        if (this != &other) {
+            release();
+            data = other.data;
+            size = other.size;
+            kind = other.kind;
+            mapping = other.mapping;
+            mappingSize = other.mappingSize;
+            other.data = nullptr;
+            other.mapping = nullptr;
+        }
+        return *this;
+    }
+
+    PageBuffer::~PageBuffer() {
+        release();
+    }
+
+    void PageBuffer::release() {
+        if (data == nullptr) {
+            return;
+        }
+        pageBytes[(int) kind] -= size;
+        if (mapping != nullptr) {
+            munmap(mapping, mappingSize);
+        } else {
+            operator delete(data, std::align_val_t(64));
+        }
+        data = nullptr;
+        mapping = nullptr;
+    }
+
+    PagePool::Chunks::Chunks(PagePolicy policy): policy(policy), offset(0) {}
+
+    void* PagePool::Chunks::do_allocate(size_t bytes, size_t alignment) {
+        if (!buffers.empty()) {
+            void* p = static_cast<std::byte*>(buffers.back().get()) + offset;
+            auto space = buffers.back().getSize() - offset;
+            if (std::align(alignment, bytes, p, space)) {
+                offset = buffers.back().getSize() - space + bytes;
+                return p;
+            }
+        }
+        // The pool asks for chunks of growing size, a buffer holds several of them.
+        buffers.emplace_back(std::max(bytes + alignment, HUGE_PAGE_SIZE), policy);
+        offset = 0;
+        return do_allocate(bytes, alignment);
+    }
+
+    PagePool::PagePool(PagePolicy policy): chunks(policy), pool(&chunks) {}
+
+    void* PagePool::do_allocate(size_t bytes, size_t alignment) {
+        return pool.allocate(bytes, alignment);
+    }
+
+    void PagePool::do_deallocate(void* p, size_t bytes, size_t alignment) {
+        pool.deallocate(p, bytes, alignment);
+    }
+} // namespace vector_index
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <min_queue.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace vector_index::hnsw {
+    struct Node;
+    class HNSW;
+
+    // Features of a layer 0 search after the warmup hops of a TerminationModel, in model order.
+    static constexpr size_t NUM_TERMINATION_FEATURES = 7;
+    using TerminationFeatures = std::array<double, NUM_TERMINATION_FEATURES>;
+
+    // A training example: the features of a query and the distance computations of layer 0 after which
+    // its results held every ground truth neighbor the search finds.
+    struct TerminationSample {
+        TerminationFeatures features{};
+        size_t distances = 0;
+        // False when the search converged during the warmup, there is nothing to predict then.
+        bool warmedUp = false;
+    };
+
+    // Predicts, from the first hops of a layer 0 search, how many distance computations the query
+    // needs (after Li et al., learned adaptive early termination). The log of the distances is a
+    // linear function of the features: the distance of the layer 0 entry point, the closest and k-th
+    // distances after the warmup, the ratio of the k-th to the entry distance, how many warmup hops
+    // ago the k-th distance last improved and the distances computed during the warmup. A search
+    // stops once it has computed multiplier times the prediction.
+    class TerminationModel {
+    public:
+        explicit TerminationModel(size_t numWarmupHops = DEFAULT_NUM_WARMUP_HOPS);
+
+        // Ridge regression of the log distances of the warmed up samples.
+        void fit(const std::vector<TerminationSample> &samples, double ridge = DEFAULT_RIDGE);
+
+        // Distance computations of layer 0 the query needs, before the multiplier.
+        double predict(const TerminationFeatures &features) const;
+
+        inline size_t getNumWarmupHops() const {
+            return numWarmupHops;
+        }
+
+        inline double getMultiplier() const {
+            return multiplier;
+        }
+
+        inline void setMultiplier(double value) {
+            multiplier = value;
+        }
+
+        // Persists the model as "name value" lines, usually next to the index file.
+        void save(const std::string &path) const;
+
+        static TerminationModel load(const std::string &path);
+
+        static constexpr size_t DEFAULT_NUM_WARMUP_HOPS = 20;
+        static constexpr double DEFAULT_RIDGE = 1e-3;
+
+    private:
+        size_t numWarmupHops;
+        TerminationFeatures weights{};
+        double multiplier;
+    };
+
+    // Termination state of one layer 0 search. Without a model it never stops the search. With ground
+    // truth it records a TerminationSample instead of stopping.
+    class TerminationTracker {
+    public:
+        TerminationTracker() = default;
+
+        TerminationTracker(const TerminationModel* model, int k, const std::vector<int>* groundTruth = nullptr);
+
+        // Before the first hop, with the entry points of layer 0.
+        inline void begin(const MinQueue<Node*> &neighbors) {
+            if (model) {
+                entryDistance = neighbors.getRecords().begin()->distance;
+            }
+        }
+
+        // After every hop, with the results and the distances computed on layer 0 so far. False once
+        // the search should stop.
+        inline bool afterHop(const MinQueue<Node*> &neighbors, size_t nodesVisited) {
+            return !model || update(neighbors, nodesVisited);
+        }
+
+        inline const TerminationSample &getSample() const {
+            return sample;
+        }
+
+    private:
+        bool update(const MinQueue<Node*> &neighbors, size_t nodesVisited);
+
+        const TerminationModel* model = nullptr;
+        size_t k = 0;
+        std::unordered_set<int> groundTruth;
+        bool sampling = false;
+        double entryDistance = 0;
+        double kthDistance = 0;
+        size_t hops = 0;
+        size_t lastImprovement = 0;
+        // Distance computations after which the search stops, set after the warmup.
+        double limit = 0;
+        size_t found = 0;
+        TerminationSample sample;
+    };
+
+    // Trains a model for the index from training queries and their ground truth, searching with
+    // efSearch as the cap of the result queue, and calibrates its multiplier to the smallest one whose
+    // recall@k on the training queries reaches targetRecall (the largest tried if none does). The model
+    // is left installed on the index.
+    std::shared_ptr<TerminationModel> trainTerminationModel(HNSW &index, std::vector<std::vector<float>> &queries, std::vector<std::vector<int>> &groundTruth, int k, int efSearch, double targetRecall, size_t numWarmupHops = TerminationModel::DEFAULT_NUM_WARMUP_HOPS);
+} // namespace vector_index::hnsw
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <memory_resource>
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+namespace vector_index {
+    // Bump allocator for the scratch state of a search: its queues, visited set and buffers. Deallocation
+    // is a no-op and reset() rewinds without giving the memory back, so once the arena has grown to the
+    // largest search it serves, searches no longer call malloc.
+    class Arena: public std::pmr::memory_resource {
+    public:
+        explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+
+        // Forgets every allocation. Blocks that were chained during the last search are merged into a
+        // single one, so that the next search of the same size fits without skipping.
+        void reset();
+
+        // Bytes reserved by the blocks.
+        size_t getCapacity() const;
+
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 64 << 10;
+
+    protected:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {}
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+
+    private:
+        struct Block {
+            std::unique_ptr<std::byte[]> data;
+            size_t size;
+        };
+
+        void addBlock(size_t size);
+
+        std::vector<Block> blocks;
+        // Block being filled and its first free byte.
+        size_t current;
+        size_t offset;
+    };
+
+    // Lends an arena of the calling thread for the lifetime of a search and resets it. Every thread keeps
+    // its released arenas for reuse, so threads never share an allocator and a thread interleaving
+    // several searches holds one arena per search in flight.
+    class ScopedArena {
+    public:
+        ScopedArena();
+
+        ~ScopedArena();
+
+        ScopedArena(const ScopedArena&) = delete;
+
+        ScopedArena &operator=(const ScopedArena&) = delete;
+
+        inline Arena* get() {
+            return arena.get();
+        }
+
+    private:
+        std::unique_ptr<Arena> arena;
+    };
+} // namespace vector_index
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace vector_index::io {
+    struct ReadRequest {
+        // A file descriptor, or the index of a file registered with registerFiles().
+        int file;
+        void* buffer;
+        size_t length;
+        uint64_t offset;
+        // Returned with the completion.
+        uint64_t userData;
+        // Index of the registered buffer holding `buffer`, -1 when it is not registered.
+        int bufferIndex = -1;
+    };
+
+    struct Completion {
+        uint64_t userData;
+        // Bytes read, or -errno.
+        int64_t result;
+    };
+
+    struct AsyncReaderOptions {
+        // Reads in flight at most.
+        unsigned queueDepth = 64;
+        // io_uring only: a kernel thread polls the submission queue, so submit() needs no system call
+        // while the thread is awake.
+        bool sqPoll = false;
+        unsigned sqPollIdleMs = 100;
+    };
+
+    // Positional reads that complete asynchronously. read() queues a request, submit() hands the queued
+    // requests to the kernel in one call and reap() collects the completions, in any order. Not thread
+    // safe, meant to be owned by one search thread.
+    class AsyncReader {
+    public:
+        virtual ~AsyncReader() = default;
+
+        // Queues a read, returns false when queueDepth reads are already queued or in flight.
+        virtual bool read(const ReadRequest &request) = 0;
+
+        virtual void submit() = 0;
+
+        // Submits the queued reads, waits until at least minCompletions reads completed (fewer if
+        // fewer are in flight) and appends the completions. Returns their number.
+        virtual size_t reap(std::vector<Completion> &completions, size_t minCompletions) = 0;
+
+        // Lets the kernel resolve the files and pin the buffers once instead of on every read.
+        // Requests then refer to a file by its index and may name their buffer's index.
+        virtual void registerFiles(const std::vector<int> &fds) = 0;
+
+        virtual void registerBuffers(const std::vector<iovec> &buffers) = 0;
+
+        // Reads queued or in flight.
+        virtual size_t pending() const = 0;
+
+        virtual const char* name() const = 0;
+    };
+
+    // io_uring through its raw system calls, no liburing needed. Throws std::runtime_error when the
+    // kernel does not support io_uring or denies it.
+    class IoUringReader: public AsyncReader {
+    public:
+        explicit IoUringReader(const AsyncReaderOptions &options = {});
+
+        ~IoUringReader() override;
+
+        bool read(const ReadRequest &request) override;
+
+        void submit() override;
+
+        size_t reap(std::vector<Completion> &completions, size_t minCompletions) override;
+
+        void registerFiles(const std::vector<int> &fds) override;
+
+        void registerBuffers(const std::vector<iovec> &buffers) override;
+
+        inline size_t pending() const override {
+            return queued + inFlight;
+        }
+
+        inline const char* name() const override {
+            return "io_uring";
+        }
+
+    private:
+        int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+        AsyncReaderOptions options;
+        int ringFd;
+        bool fixedFiles;
+        // Mappings of the submission ring, the completion ring (the same one on kernels with a single
+        // mapping) and the submission entries.
+        void* sqRing;
+        size_t sqRingSize;
+        void* cqRing;
+        size_t cqRingSize;
+        struct io_uring_sqe* sqes;
+        size_t sqesSize;
+        unsigned* sqTail;
+        unsigned* sqMask;
+        unsigned* sqArray;
+        unsigned* sqFlags;
+        unsigned* cqHead;
+        unsigned* cqTail;
+        unsigned* cqMask;
+        struct io_uring_cqe* cqes;
+        size_t queued;
+        size_t inFlight;
+    };
+
+    // Synchronous fallback: submit() runs the queued reads with pread on the calling thread.
+    class PreadReader: public AsyncReader {
+    public:
+        explicit PreadReader(const AsyncReaderOptions &options = {});
+
+        bool read(const ReadRequest &request) override;
+
+        void submit() override;
+
+        size_t reap(std::vector<Completion> &completions, size_t minCompletions) override;
+
+        void registerFiles(const std::vector<int> &fds) override;
+
+        void registerBuffers(const std::vector<iovec> &buffers) override {}
+
+        inline size_t pending() const override {
+            return queued.size() + completed.size();
+        }
+
+        inline const char* name() const override {
+            return "pread";
+        }
+
+    private:
+        AsyncReaderOptions options;
+        std::vector<int> files;
+        std::vector<ReadRequest> queued;
+        std::vector<Completion> completed;
+    };
+
+    // An IoUringReader, or a PreadReader where io_uring is not available.
+    std::unique_ptr<AsyncReader> makeAsyncReader(const AsyncReaderOptions &options = {});
+} // namespace vector_index::io
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <hnsw.h>
+#include <small_world.h>
+#include <sa_tree.h>
+
+#include <vector>
+#include <string>
+#include <functional>
+
+namespace vector_index::auto_tune {
+    // A search time parameter (efSearch, beam width, restarts...) with the values to explore.
+    // Values are expected to be ordered from the cheapest to the most expensive setting.
+    struct Parameter {
+        std::string name;
+        std::vector<int> values;
+    };
+
+    struct OperatingPoint {
+        // One value per parameter, in the same order as the parameter space.
+        std::vector<int> values;
+        double recall;
+        double qps;
+        // p99 of the per query latency in seconds.
+        double p99Latency;
+    };
+
+    // Runs a single query with the given parameter values and returns the ids of the results.
+    using SearchFunction = std::function<std::vector<int>(std::vector<float> &query, int k, const std::vector<int> &values)>;
+
+    // Explores the parameter space of a native index on a held out query sample, similar in spirit
+    // to faiss::ParameterSpace. Like faiss we assume that recall and cost are monotone in every
+    // parameter, which lets us skip settings that cannot improve the recall/QPS frontier.
+    class AutoTuner {
+    public:
+        AutoTuner(std::vector<Parameter> parameters, SearchFunction search);
+
+        // Returns the recall/QPS pareto frontier, sorted by increasing recall.
+        std::vector<OperatingPoint> explore(std::vector<std::vector<float>> &queries, std::vector<std::vector<int>> &groundTruth, int k);
+
+        // Cheapest (highest QPS) explored setting with recall >= targetRecall.
+        bool selectForRecall(double targetRecall, OperatingPoint &point) const;
+
+        // Most accurate explored setting with p99 latency <= targetP99Latency.
+        bool selectForLatency(double targetP99Latency, OperatingPoint &point) const;
+
+        // Persists the chosen setting as "name value" lines, usually next to the index file.
+        void save(const std::string &path, const OperatingPoint &point) const;
+
+        // Reads a setting written by save(). Parameters missing from the file keep their cheapest value.
+        std::vector<int> load(const std::string &path) const;
+
+        static std::vector<OperatingPoint> paretoFrontier(std::vector<OperatingPoint> points);
+
+        const std::vector<Parameter> &getParameters() const {
+            return parameters;
+        }
+
+        const std::vector<OperatingPoint> &getFrontier() const {
+            return frontier;
+        }
+
+    private:
+        OperatingPoint evaluate(const std::vector<int> &values, std::vector<std::vector<float>> &queries, std::vector<std::vector<int>> &groundTruth, int k);
+
+        bool canImproveFrontier(const std::vector<size_t> &candidate, const std::vector<std::vector<size_t>> &evaluated, const std::vector<OperatingPoint> &points) const;
+
+    private:
+        std::vector<Parameter> parameters;
+        SearchFunction search;
+        std::vector<OperatingPoint> frontier;
+    };
+
+    // Adapters for the native indexes.
+    // HNSW: efSearch
+    SearchFunction hnswSearch(hnsw::HNSW &index);
+
+    // SmallWorldNG::beamKnnSearch: b
+    SearchFunction smallWorldBeamSearch(small_world::SmallWorldNG &index);
+
+    // SmallWorldNG::greedyKnnSearch: m
+    SearchFunction smallWorldGreedySearch(small_world::SmallWorldNG &index);
+
+    // SATree::beamKnnSearch: b
+    SearchFunction saTreeBeamSearch(sa_tree::SATree &index);
+} // namespace vector_index::auto_tune
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <utils.h>
+#include <transform.h>
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace vector_index {
+    // One bit per dimension: the sign of the vector once centered on the training mean, optionally
+    // after a random rotation which spreads the variance evenly over the bits. Codes are compared by
+    // Hamming distance, a 960-d vector fits in 15 words instead of 3840 bytes of floats.
+    class BinaryQuantizer {
+    public:
+        BinaryQuantizer(size_t dimension, bool rotate = false, uint64_t seed = Random::DEFAULT_SEED);
+
+        // Learns the per dimension mean of numVectors row major vectors.
+        void train(const float* data, size_t numVectors);
+
+        void encode(const float* x, uint64_t* code) const;
+
+        inline size_t getNumWords() const {
+            return numWords;
+        }
+
+        static inline int hamming(const uint64_t* a, const uint64_t* b, size_t numWords) {
+            size_t i = 0;
+            int distance = 0;
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512F__)
+            auto acc = _mm512_setzero_si512();
+            for (; i + 8 <= numWords; i += 8) {
+                auto x = _mm512_xor_si512(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+                acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+            }
+            distance = _mm512_reduce_add_epi64(acc);
+#endif
+            for (; i < numWords; i++) {
+                distance += __builtin_popcountll(a[i] ^ b[i]);
+            }
+            return distance;
+        }
+
+    private:
+        size_t dimension;
+        size_t numWords;
+        std::vector<float> mean;
+        // Applied to the centered vectors, null unless rotate is set.
+        std::unique_ptr<VectorTransform> rotation;
+    };
+} // namespace vector_index
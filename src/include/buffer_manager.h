@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "buffer_pool.h"
+
+namespace vector_index::io {
+    enum class EvictionPolicy {
+        // Second chance: a sweeping hand evicts the first unpinned frame not referenced since its last
+        // pass.
+        CLOCK,
+        // Evicts the unpinned frame whose K-th most recent access is oldest, frames accessed fewer than
+        // K times first. A single scan of cold pages then cannot flush pages that are used repeatedly,
+        // like the upper layers of a graph.
+        LRU_K
+    };
+
+    struct BufferManagerStats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+    };
+
+    // Caches fixed-size pages of a file in a memory budget, read with Utils::read on a miss. Frames come
+    // from a BufferPool, so the file may be opened for direct I/O when the page size is a multiple of
+    // its alignment. Thread safe: the page table is sharded by page, and pages being read are waited
+    // for rather than read twice.
+    class BufferManager {
+    public:
+        class PageHandle;
+
+        BufferManager(int fd, size_t pageSize, size_t memoryBudget, EvictionPolicy policy = EvictionPolicy::CLOCK, unsigned k = 2);
+
+        // Pins the page, reading it on a miss. A pinned page is not evicted until its handle is unpinned
+        // or destroyed. Throws std::runtime_error when the read fails or every frame is pinned.
+        PageHandle pin(uint64_t page);
+
+        // Copies [offset, offset + length) of the file through the cache. Bytes past the end of the file
+        // read as zeros.
+        void read(void* out, uint64_t offset, size_t length);
+
+        BufferManagerStats getStats() const;
+
+        void resetStats();
+
+        inline size_t getPageSize() const {
+            return pageSize;
+        }
+
+        inline size_t getNumFrames() const {
+            return numFrames;
+        }
+
+        static constexpr unsigned MAX_K = 8;
+
+    private:
+        static constexpr uint64_t NO_PAGE = UINT64_MAX;
+
+        enum FrameState {
+            LOADING,
+            READY,
+            FAILED
+        };
+
+        struct Frame {
+            void* data;
+            std::atomic<uint64_t> page{NO_PAGE};
+            std::atomic<int> pinCount{0};
+            std::atomic<int> state{LOADING};
+            // CLOCK reference bit.
+            std::atomic<bool> referenced{false};
+            // LRU-K: logical times of the last K accesses, most recent first, 0 when missing.
+            std::array<std::atomic<uint64_t>, MAX_K> history{};
+        };
+
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_map<uint64_t, Frame*> table;
+        };
+
+        static constexpr size_t NUM_SHARDS = 64;
+
+        Shard &shardOf(uint64_t page);
+
+        // Records an access, called with the shard of the frame's page locked.
+        void touch(Frame &frame);
+
+        // An unmapped frame with one pin and state LOADING, evicting a page if needed.
+        Frame* reserveFrame();
+
+        // Unmaps the frame's page unless it is pinned. Called with evictionMutex locked.
+        bool tryEvict(Frame &frame);
+
+        Frame* clockVictim();
+
+        Frame* lruKVictim();
+
+        PageHandle waitReady(Frame* frame);
+
+        int fd;
+        size_t pageSize;
+        size_t numFrames;
+        EvictionPolicy policy;
+        unsigned k;
+        BufferPool buffers;
+        std::unique_ptr<Frame[]> frames;
+        std::array<Shard, NUM_SHARDS> shards;
+        // Serializes the choice of victims, taken before a shard lock, never while holding one.
+        std::mutex evictionMutex;
+        size_t hand;
+        std::atomic<uint64_t> clock;
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> misses;
+        std::atomic<uint64_t> evictions;
+
+    public:
+        // A pinned page, unpinned on destruction.
+        class PageHandle {
+        public:
+            PageHandle(): frame(nullptr) {}
+
+            explicit PageHandle(Frame* frame): frame(frame) {}
+
+            PageHandle(PageHandle &&other) noexcept: frame(other.frame) {
+                other.frame = nullptr;
+            }
+
+            PageHandle &operator=(PageHandle &&other) noexcept {
+                if (this != &other) {
+                    unpin();
+                    frame = other.frame;
+                    other.frame = nullptr;
+                }
+                return *this;
+            }
+
+            ~PageHandle() {
+                unpin();
+            }
+
+            inline const void* data() const {
+                return frame->data;
+            }
+
+            inline void unpin() {
+                if (frame != nullptr) {
+                    frame->pinCount.fetch_sub(1, std::memory_order_release);
+                    frame = nullptr;
+                }
+            }
+
+        private:
+            Frame* frame;
+        };
+    };
+} // namespace vector_index::io
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace vector_index::io {
+    // Alignment that satisfies direct I/O on common devices, used when the file system does not report
+    // its own.
+    static constexpr size_t SECTOR_SIZE = 4096;
+
+    enum class IoMode {
+        // Reads go through the page cache.
+        CACHED,
+        // Reads bypass the page cache (O_DIRECT, F_NOCACHE on macOS). Buffers, offsets and lengths must
+        // be aligned to directIoAlignment().
+        DIRECT
+    };
+
+    // Opens a file read only in the mode, throws std::runtime_error when it cannot be opened, e.g. on a
+    // file system without direct I/O.
+    int openFile(const char* path, IoMode mode);
+
+    // Alignment of direct I/O buffers, offsets and lengths on the file, SECTOR_SIZE when the kernel does
+    // not report it.
+    size_t directIoAlignment(int fd);
+
+    // A read of [offset, offset + length) widened to aligned boundaries. The requested bytes start
+    // `skip` bytes into the buffer of the aligned read.
+    struct AlignedRange {
+        uint64_t offset;
+        size_t length;
+        size_t skip;
+    };
+
+    AlignedRange alignRange(uint64_t offset, size_t length, size_t alignment);
+
+    // Fixed number of equally sized buffers, aligned for direct I/O, carved from slabs of
+    // buffersPerSlab buffers, the last slab holding only the ones left. acquire() and release() pop and push a lock-free free list, so I/O
+    // threads can share one pool. Buffers are released to the pool they came from.
+    class BufferPool {
+    public:
+        BufferPool(size_t bufferSize, size_t numBuffers, size_t buffersPerSlab = 64, size_t alignment = SECTOR_SIZE);
+
+        ~BufferPool();
+
+        BufferPool(const BufferPool &) = delete;
+
+        BufferPool &operator=(const BufferPool &) = delete;
+
+        // A free buffer, nullptr when all are in use.
+        void* acquire();
+
+        void release(void* buffer);
+
+        // Index of the slab holding the buffer, to name it in reads from buffers registered with
+        // getSlabs().
+        int slabOf(const void* buffer) const;
+
+        // The slabs, e.g. for AsyncReader::registerBuffers().
+        std::vector<iovec> getSlabs() const;
+
+        inline size_t getBufferSize() const {
+            return bufferSize;
+        }
+
+        inline size_t getNumBuffers() const {
+            return numBuffers;
+        }
+
+        inline size_t getNumFree() const {
+            return numFree.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+        // Bytes of the slab, the last one may hold fewer than buffersPerSlab buffers.
+        size_t slabLength(size_t slab) const;
+
+        void* bufferAt(uint32_t index) const;
+
+        uint32_t indexOf(const void* buffer) const;
+
+        size_t bufferSize;
+        size_t numBuffers;
+        size_t buffersPerSlab;
+        size_t alignment;
+        std::vector<void*> slabs;
+        // Next free buffer of each free buffer.
+        std::unique_ptr<std::atomic<uint32_t>[]> next;
+        // Top of the free list in the low half, a counter in the high half that changes on every pop so
+        // that a stale compare and swap fails (ABA).
+        std::atomic<uint64_t> head;
+        std::atomic<size_t> numFree;
+    };
+} // namespace vector_index::io
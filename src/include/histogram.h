@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace vector_index {
+    // Log-linear histogram in the style of HdrHistogram, e.g. of latencies in nanoseconds. Values below
+    // 2^precisionBits are counted exactly, larger ones in buckets of relative width 2^-(precisionBits - 1),
+    // so percentiles keep that precision from nanoseconds to seconds in a few KiB. Not thread safe,
+    // threads record into their own histograms and merge them.
+    class LatencyHistogram {
+    public:
+        explicit LatencyHistogram(unsigned precisionBits = 7);
+
+        void record(uint64_t value);
+
+        // Adds the values of a histogram with the same precision.
+        void merge(const LatencyHistogram &other);
+
+        void reset();
+
+        // Value at or below which a fraction q (in [0, 1]) of the recorded values lie, as the highest
+        // value of its bucket, 0 when nothing was recorded.
+        uint64_t percentile(double q) const;
+
+        double getMean() const;
+
+        inline uint64_t getCount() const {
+            return count;
+        }
+
+        inline uint64_t getMin() const {
+            return count == 0 ? 0 : min;
+        }
+
+        inline uint64_t getMax() const {
+            return max;
+        }
+
+    private:
+        size_t bucketOf(uint64_t value) const;
+
+        uint64_t highestOf(size_t bucket) const;
+
+        unsigned precisionBits;
+        std::vector<uint64_t> counts;
+        uint64_t count;
+        uint64_t min;
+        uint64_t max;
+        double sum;
+    };
+} // namespace vector_index
@@ -1,30 +1,117 @@
 #pragma once
 
 #include <min_queue.h>
+#include <utils.h>
+#include <task.h>
+#include <vector_store.h>
+#include <reorder.h>
+#include <quantizer.h>
+#include <scalar_quantizer.h>
+#include <binary_quantizer.h>
+#include <transform.h>
+#include <metric.h>
+#include <arena.h>
+#include <huge_pages.h>
+#include <tiered_vectors.h>
+#include <search_budget.h>
+#include <adaptive_termination.h>
+#include <query_cache.h>
 
 #include <vector>
 #include <unordered_set>
 #include <set>
 #include <chrono>
+#include <memory>
+#include <memory_resource>
 
 namespace vector_index::hnsw {
     struct Node {
+        // Insertion id, reported in results. It is kept when the graph is reordered.
         int id;
-        std::vector<float> embedding;
+        // Points into the VectorStore of the index, in its storage type.
+        const void* embedding;
+        // Points into the CodeStore of the index once it is quantized.
+        uint8_t* code = nullptr;
+        // Points into the BinaryCodeStore of the index when the Hamming prefilter is enabled.
+        uint64_t* binaryCode = nullptr;
+        // Codes of the layer 0 neighbors packed for fast scan, in children[0] order.
+        uint8_t* packedNeighbors = nullptr;
+        // The neighbors of every layer in children order, one contiguous array the search scans and
+        // prefetches instead of the trees of the queues: m0 + 1 slots for layer 0 then m + 1 per upper
+        // layer, each list terminated by nullptr. Allocated from the links of the index.
+        Node** neighbors = nullptr;
         std::vector<MinQueue<Node*>> children;
     };
 
+    // A query and, when the index is quantized, its distance state (e.g. PQ lookup tables) which is
+    // prepared once per search. The buffers are allocated from the arena of the search.
+    struct Query {
+        // In the space of the stored embeddings, i.e. after the pre-transform if the index has one.
+        std::pmr::vector<float> embedding;
+        std::unique_ptr<CodeDistance> codeDistance;
+        // Binary code of the query, empty unless the Hamming prefilter is enabled.
+        std::pmr::vector<uint64_t> binaryCode;
+        // Leading dimensions the float distances of traversal are computed on.
+        size_t numDimensions;
+        // Distances computed so far, kept per query so that concurrent searches do not share a counter.
+        size_t nodesVisited = 0;
+        // Hot tier of a tiered index when the search started, which keeps its embeddings alive.
+        std::shared_ptr<const HotTier> hotTier;
+        // Unlimited unless the search was given a budget, counts the hops over all the layers.
+        BudgetTracker budget;
+        // Stops layer 0 when the index has a termination model.
+        TerminationTracker termination;
+    };
+
     struct Result {
-        std::set<Record<Node*>> nodes;
+        // Ids of the k nearest neighbors and their distances, closest first.
+        std::vector<int> ids;
+        std::vector<double> distances;
         std::chrono::duration<double> searchTime;
         size_t nodesVisited;
         size_t hops;
         size_t depth;
+        // The search ran out of budget, the results are the best found until then.
+        bool partial = false;
+    };
+
+    // State of a best first search on a single layer. It is stepped by searchLayer and, one candidate
+    // per resume, by the interleaved batch search. Its containers are allocated from `resource`.
+    struct LayerSearch {
+        LayerSearch(MinQueue<Node*> &entrypoints, int efSearch, int layer, std::pmr::memory_resource* resource);
+
+        MinQueue<Node*> neighbors;
+        MinQueue<Node*> candidates;
+        std::pmr::unordered_set<int> visited;
+        // Candidate being expanded, its unvisited neighbors and their positions in its neighbor list.
+        Node* expanded;
+        std::pmr::vector<Node*> unvisited;
+        std::pmr::vector<size_t> positions;
+        // Fast scan distances to all the neighbors of the expanded candidate.
+        std::pmr::vector<float> packedDistances;
+        // Tiered index: the neighbors to score and their embeddings, fetched together.
+        std::pmr::vector<Node*> fetched;
+        std::pmr::vector<int> fetchedIds;
+        std::pmr::vector<const void*> fetchedEmbeddings;
+        Record<Node*> furthest;
+        int efSearch;
+        int layer;
+        size_t nodesVisited;
     };
 
     class HNSW {
     public:
-        HNSW(float *data, size_t dimension, size_t numVectors, int efConstruction, int m, int m0);
+        // The embeddings are kept in the given storage type, queries are always fp32. With a transform,
+        // the embeddings and the queries are transformed before they are indexed or searched, and the
+        // transform is trained on the data first unless it already is.
+        // Cosine vectors are normalized at ingest and inner products are scored natively (see
+        // MetricReduction), result distances are reported in the metric. An inner product index
+        // supports neither transforms nor quantization, which assume L2.
+        HNSW(float *data, size_t dimension, size_t numVectors, int efConstruction, int m, int m0, uint64_t seed = Random::DEFAULT_SEED, StorageType storage = StorageType::FP32, std::shared_ptr<VectorTransform> transform = nullptr, Metric metric = Metric::L2);
+
+        // Deep copy of the graph, the embeddings and the codes, allocated by the calling thread (e.g. a
+        // replica per NUMA node). The trained quantizers and the transform are shared.
+        HNSW(const HNSW &other);
 
         void insert(std::vector<float> &embedding, int efConstruction);
 
@@ -36,13 +123,254 @@ namespace vector_index::hnsw {
 
         Result knnSearch(std::vector<float> &query, int k, int efSearch);
 
+        // Stops once the budget is spent, with the best results so far flagged as partial. A search that
+        // runs out in the upper layers returns fewer than k results.
+        Result knnSearch(std::vector<float> &query, int k, int efSearch, const SearchBudget &budget);
+
+        // Same, filling `result` whose arrays keep their capacity across calls. The scratch state of the
+        // search comes from an arena of the calling thread, so a thread reusing its Result does not
+        // allocate once the arena has grown to the largest search (fp32 or reduced precision
+        // embeddings, no quantizer, transform or binary prefilter).
+        void knnSearch(std::vector<float> &query, int k, int efSearch, Result &result, const SearchBudget &budget = {});
+
+        // Searches the queries on the calling thread, keeping numInFlight of them interleaved. Every query
+        // suspends after prefetching a neighborhood so that its DRAM stalls overlap with the distance
+        // computations of the others. The search time of a result includes the time spent suspended.
+        // The time budget is shared by the batch: every query gets what is left of it when it enters.
+        std::vector<Result> knnSearchBatch(std::vector<std::vector<float>> &queries, int k, int efSearch, size_t numInFlight = DEFAULT_NUM_IN_FLIGHT, const SearchBudget &budget = {});
+
+        // Number of neighbors ahead of the current one whose embeddings are prefetched during
+        // traversal, along with the neighbors array of the next candidate. 0 disables prefetching.
+        inline void setPrefetchDistance(size_t distance) {
+            prefetchDistance = distance;
+        }
+
+        static constexpr size_t DEFAULT_PREFETCH_DISTANCE = 2;
+
+        // Stop the float distance of a neighbor once it exceeds the furthest of the efSearch results,
+        // such a neighbor would be discarded anyway. On by default.
+        inline void setEarlyAbandon(bool enabled) {
+            earlyAbandon = enabled;
+        }
+
+        static constexpr size_t DEFAULT_NUM_IN_FLIGHT = 12;
+
+        // Traverses with the distance on the first numDimensions dimensions only, the efSearch candidates
+        // of layer 0 are re-ranked on all of them. Meant for a PCA transform, whose leading dimensions
+        // carry most of the variance. 0 searches on all the dimensions.
+        void setSearchDimension(size_t numDimensions);
+
+        // Lays out the nodes, their embeddings and their links in the given traversal order of the base
+        // layer so that neighbors are close in memory. Node ids are preserved, so results do not change.
+        void reorder(reorder::Ordering ordering);
+
+        // Trains a scalar quantizer on the stored embeddings and switches graph traversal (search and
+        // further inserts) to the codes. The efSearch candidates of layer 0 are re-ranked with the
+        // full precision embeddings before the top k are returned.
+        void quantize(ScalarQuantizerType type);
+
+        // Same with any quantizer, e.g. a ProductQuantizer whose lookup tables are computed once per
+        // query. The quantizer is trained on the stored embeddings.
+        void quantize(std::unique_ptr<Quantizer> quantizer);
+
+        // Packs the codes of the layer 0 neighbors of every node next to it, so that a whole
+        // neighborhood is scored at once with the quantized lookup tables of the query. Needs a
+        // quantizer that supports packing (4 bit PQ). Further inserts keep the packs up to date.
+        void enableFastScan();
+
+        // Stores a binary code next to every node. Once efSearch results are collected, a neighbor whose
+        // Hamming distance to the query exceeds the one of the furthest result by more than `margin`
+        // bits is discarded without computing its distance. nodesVisited only counts the neighbors
+        // whose distance was computed.
+        void enableBinaryPrefilter(int margin, bool rotate = false);
+
+        void disableBinaryPrefilter();
+
+        // Moves the embeddings to a file at `path` and keeps only the most visited ones in memory, in
+        // at most hotBudget bytes; the graph and the codes stay resident. Searches read cold embeddings
+        // a neighborhood at a time with the async reader of their thread, so a quantized index only
+        // reads the ones it re-ranks. The hot set starts with the nodes of the upper layers and follows
+        // the visits, rebalanced in the background every options.rebalanceInterval. Searches may run
+        // concurrently with rebalancing; inserts, quantization, reordering and copies need the
+        // embeddings in memory and are no longer supported.
+        void enableTiering(const std::string &path, size_t hotBudget, const TieringOptions &options = {});
+
+        // Promotes the most visited embeddings now.
+        void rebalanceTiers();
+
+        TierStats getTierStats() const;
+
+        // Replaces the static efSearch of layer 0 by a per query prediction of the model, efSearch then
+        // only caps the result queue. nullptr restores static efSearch. Not concurrent with searches.
+        void setTerminationModel(std::shared_ptr<const TerminationModel> model);
+
+        // Searches without the installed model and returns the training sample of the query for
+        // `model`, given its ground truth neighbors.
+        TerminationSample sampleTermination(std::vector<float> &query, int k, int efSearch, const std::vector<int> &groundTruth, const TerminationModel &model);
+
+        // Searches with `model` in place of the installed one and without the query cache, e.g. to
+        // calibrate the multiplier of a model before installing it.
+        Result knnSearchWithModel(std::vector<float> &query, int k, int efSearch, const TerminationModel &model);
+
+        // Answers repeated queries from a cache of results, and starts the layer 0 search of a query
+        // within options.epsilon of a cached one from its results instead of descending the layers.
+        // Inserts, quantization, fast scan, the binary prefilter, the search dimension and the
+        // termination model invalidate the cached results, which keep seeding searches. Partial results
+        // are not cached. Not concurrent with searches.
+        void enableQueryCache(const QueryCacheOptions &options = {});
+
+        void disableQueryCache();
+
+        QueryCacheStats getQueryCacheStats() const;
+
+    private:
+        // Reduces and transforms the embedding if needed and prepares its distance state. Embeddings
+        // that are inserted are reduced as vectors, not as queries.
+        Query prepare(const std::vector<float> &embedding, std::pmr::memory_resource* resource, bool isQuery = true);
+
+        // The returned queue is allocated from `resource`, like the scratch state of the search.
+        MinQueue<Node *> searchLayer(Query &query, MinQueue<Node*> &entrypoints, int efSearch, int layer, std::pmr::memory_resource* resource);
+
+        // Descends the layers with a prepared query and writes its top k to the result. With seeds, the
+        // search starts on layer 0 from the nodes of these ids.
+        void knnSearch(Query &query, int k, int efSearch, Result &result, std::pmr::memory_resource* resource, const std::vector<int>* seeds = nullptr);
+
+        // Layer 0 entry points at the nodes of the ids.
+        MinQueue<Node*> seedEntrypoints(const std::vector<int> &seeds, Query &query, int efSearch, std::pmr::memory_resource* resource);
+
+        // Takes the budget by value, the coroutine outlives the caller's copy.
+        Task<Result> knnSearchTask(std::vector<float> &query, int k, int efSearch, SearchBudget budget);
+
+        // Pops candidates until one has unvisited neighbors, returns false once the search converged.
+        bool nextCandidate(LayerSearch &search);
+
+        // Computes the distances to the unvisited neighbors, prefetching `lookahead` neighbors ahead.
+        void expandCandidate(LayerSearch &search, Query &query, size_t lookahead);
+
+        // Same for a tiered index, fetching the embeddings of the neighbors that pass the prefilter
+        // together before scoring them.
+        void expandTiered(LayerSearch &search, Query &query);
+
+        inline double distance(const Node *node, Query &query) {
+            if (query.codeDistance) {
+                return query.codeDistance->distance(node->code);
+            }
+            return embeddingDistance(embeddingOf(node, query), query);
+        }
+
+        // A distance > bound may be partial. Codes are always scored fully.
+        inline double distance(const Node *node, Query &query, double bound) {
+            if (query.codeDistance || !earlyAbandon) {
+                return distance(node, query);
+            }
+            return embeddingDistance(embeddingOf(node, query), query, bound);
+        }
+
+        inline double embeddingDistance(const void* embedding, Query &query) {
+            if (query.numDimensions < dimension) {
+                return vectors.prefixDistance(query.embedding.data(), embedding, query.numDimensions);
+            }
+            return vectors.distance(query.embedding.data(), embedding);
+        }
+
+        inline double embeddingDistance(const void* embedding, Query &query, double bound) {
+            if (query.numDimensions < dimension) {
+                return vectors.prefixDistance(query.embedding.data(), embedding, query.numDimensions, bound);
+            }
+            return vectors.distance(query.embedding.data(), embedding, bound);
+        }
+
+        inline const void* embeddingOf(const Node *node, Query &query) {
+            return tiers ? fetchEmbedding(node, query) : node->embedding;
+        }
+
+        // Reads the embedding from the tiers, valid until the next fetch of the thread.
+        const void* fetchEmbedding(const Node *node, Query &query);
+
+        // Throws std::logic_error once the embeddings are tiered.
+        void requireResident(const char* operation) const;
+
+        // After a change of what searches return, cached results keep seeding searches but are no
+        // longer returned as they are.
+        inline void invalidateQueryCache() {
+            if (queryCache) {
+                queryCache->invalidate();
+            }
+        }
+
+        void encode(Node *node);
+
+        // The stored embeddings decoded to floats, row major in node order.
+        std::vector<float> decodeAll();
+
+        void packNeighbors(Node *node);
+
+        void encodeBinary(Node *node);
+
+        inline int hamming(const Node *node, Query &query) {
+            return BinaryQuantizer::hamming(node->binaryCode, query.binaryCode.data(), binaryQuantizer->getNumWords());
+        }
+
+        // Writes the k closest candidates to the result, re-ranked with the embeddings when traversal ran
+        // on codes or on a prefix of the dimensions, with their distances in the metric of the index.
+        void topK(MinQueue<Node*> &candidates, Query &query, int k, Result &result, std::pmr::memory_resource* resource);
+
+        void prefetchEmbedding(Node *node);
+
+        // Slots of the neighbors array of a node with the given number of layers.
+        inline size_t numNeighborSlots(size_t numLayers) const {
+            return m0 + 1 + (numLayers - 1) * (m + 1);
+        }
+
+        inline Node** neighborsOf(const Node *node, int layer) const {
+            return node->neighbors + (layer == 0 ? 0 : m0 + 1 + (layer - 1) * (m + 1));
+        }
+
+        // Allocates the neighbors array once the children of the node are created.
+        void allocateNeighbors(Node *node);
+
+        // Copies children[layer] to the neighbors array after it changed.
+        void flattenNeighbors(Node *node, int layer);
+
+        void prefetchNeighbors(const Node *node, int layer) const;
+
+        // Replaces the nodes, embeddings, codes and links of this index by copies of the ones of
+        // `source`, allocated in the given order of its nodes. source may be this index.
+        void layOut(const HNSW &source, const std::vector<int> &order);
+
     private:
         int id;
+        MetricReduction reduction;
+        // Dimension of the stored embeddings, the output dimension of the transform if there is one.
+        size_t dimension;
+        VectorStore vectors;
+        // Set by enableTiering, the nodes then have no resident embedding.
+        std::unique_ptr<TieredVectors> tiers;
+        std::shared_ptr<VectorTransform> transform;
+        // 0 when traversal uses all the dimensions.
+        size_t searchDimension;
+        std::shared_ptr<Quantizer> quantizer;
+        std::unique_ptr<CodeStore> codes;
+        // Packed neighbor codes, set by enableFastScan.
+        std::unique_ptr<CodeStore> packedCodes;
+        std::shared_ptr<BinaryQuantizer> binaryQuantizer;
+        std::unique_ptr<BinaryCodeStore> binaryCodes;
+        int hammingMargin;
+        // Allocates the links of the nodes, with the page policy of the index's creation. Declared before
+        // the nodes, which release their links into it.
+        std::unique_ptr<PagePool> links;
         std::vector<std::unique_ptr<Node>> nodes;
         Node* entrypoint;
         int m;
         int m0;
         double mL;
-        size_t nodesVisited;
+        // Draws the insert levels, seeded in the constructor so that builds are reproducible.
+        Random random;
+        size_t prefetchDistance;
+        bool earlyAbandon;
+        std::shared_ptr<const TerminationModel> terminationModel;
+        std::unique_ptr<QueryCache> queryCache;
+        // Nodes by id while the query cache is enabled, cached results hold ids.
+        std::vector<Node*> nodesById;
     };
 } // namespace vector_index::hnsw
\ No newline at end of file
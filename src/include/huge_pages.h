@@ -0,0 +1,115 @@
+#pragma once
+
+#include <memory_resource>
+#include <vector>
+#include <cstddef>
+
+namespace vector_index {
+    enum class PagePolicy {
+        // Regular 4 KiB pages from the heap.
+        NONE,
+        // Transparent huge pages: 2 MiB aligned anonymous mappings advised with MADV_HUGEPAGE. The
+        // kernel backs them with huge pages when it can assemble them.
+        TRANSPARENT,
+        // Pages of the hugetlbfs pool (MAP_HUGETLB), falling back to TRANSPARENT when the pool is
+        // exhausted or not configured (vm.nr_hugepages).
+        EXPLICIT
+    };
+
+    static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+    // Pages of the vector, code and link stores created afterwards, NONE by default. Stores keep the
+    // policy they were created with.
+    void setPagePolicy(PagePolicy policy);
+
+    PagePolicy getPagePolicy();
+
+    struct PageStats {
+        // Bytes held by the live stores, by the kind of pages they obtained.
+        size_t explicitBytes;
+        size_t transparentBytes;
+        size_t regularBytes;
+        // Anonymous memory of the process that the kernel actually backs with transparent huge pages
+        // (AnonHugePages of /proc/self/smaps_rollup), 0 when it cannot be read.
+        size_t anonHugeBytes;
+    };
+
+    PageStats getPageStats();
+
+    // Memory of at least `size` bytes with the pages of the policy, released on destruction. Huge page
+    // buffers are rounded up to whole huge pages.
+    class PageBuffer {
+    public:
+        PageBuffer(size_t size, PagePolicy policy);
+
+        PageBuffer(PageBuffer &&other) noexcept;
+
+        PageBuffer &operator=(PageBuffer &&other) noexcept;
+
+        ~PageBuffer();
+
+        inline void* get() const {
+            return data;
+        }
+
+        inline size_t getSize() const {
+            return size;
+        }
+
+        // The pages that were obtained, which may differ from the requested policy.
+        inline PagePolicy getKind() const {
+            return kind;
+        }
+
+    private:
+        void release();
+
+        void* data;
+        size_t size;
+        PagePolicy kind;
+        // Start of the mapping of a TRANSPARENT buffer, before its alignment to a huge page.
+        void* mapping;
+        size_t mappingSize;
+    };
+
+    // Pool for many small long lived allocations, e.g. the links of a graph, carved from PageBuffers of
+    // the policy. Not thread safe.
+    class PagePool: public std::pmr::memory_resource {
+    public:
+        explicit PagePool(PagePolicy policy = getPagePolicy());
+
+    protected:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+
+    private:
+        // Upstream of the pool: bump allocates the chunks of the pool from PageBuffers, which are only
+        // released with the pool.
+        class Chunks: public std::pmr::memory_resource {
+        public:
+            explicit Chunks(PagePolicy policy);
+
+        protected:
+            void* do_allocate(size_t bytes, size_t alignment) override;
+
+            void do_deallocate(void* p, size_t bytes, size_t alignment) override {}
+
+            bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+                return this == &other;
+            }
+
+        private:
+            PagePolicy policy;
+            std::vector<PageBuffer> buffers;
+            size_t offset;
+        };
+
+        Chunks chunks;
+        std::pmr::unsynchronized_pool_resource pool;
+    };
+} // namespace vector_index
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace vector_index {
+    enum class Metric {
+        L2,
+        // Maximum inner product search, distances are reported as -<q, x>.
+        INNER_PRODUCT,
+        // Distances are reported as 1 - cos(q, x).
+        COSINE
+    };
+
+    // Rewrites the vectors and the queries once so that the index ranks them with the distance of
+    // getStoreMetric(), no norm is recomputed per comparison.
+    // - COSINE normalizes both sides, then |q - x|^2 = 2 (1 - cos(q, x)): inner product search on the
+    //   unit sphere, run with the L2 kernels so that early abandoning and the quantizers still apply.
+    // - INNER_PRODUCT is scored natively as -<q, x> by graph indexes, which need no metric space. With
+    //   reduceInnerProduct, for the SATree whose pruning relies on the triangle inequality, it appends
+    //   sqrt(M^2 - |x|^2) to every vector, M being the largest norm of the fitted data, and 0 to the
+    //   queries: |q - x|^2 = |q|^2 + M^2 - 2 <q, x>. The reduced data clusters around (0, ..., M) with
+    //   the best answers as outliers, which greedy graph search handles poorly.
+    class MetricReduction {
+    public:
+        MetricReduction(size_t dimension, Metric metric, bool reduceInnerProduct = false);
+
+        // Learns M from numVectors row major vectors (reduced INNER_PRODUCT only).
+        void fit(const float* data, size_t numVectors);
+
+        // x has `dimension` values and y getDimension(). Vectors added after fit() whose norm exceeds M
+        // get a 0 extra coordinate, their inner products are then slightly under ranked.
+        void reduceVector(const float* x, float* y) const;
+
+        std::vector<float> reduceVectors(const float* data, size_t numVectors) const;
+
+        void reduceQuery(const float* query, float* y) const;
+
+        // Converts the L2 distance between a reduced query and a reduced vector to the metric.
+        // querySquaredNorm is the one of the query before reduction (reduced INNER_PRODUCT only).
+        double toMetric(double distance, double querySquaredNorm) const;
+
+        // Inverse of toMetric, e.g. for a range search radius.
+        double fromMetric(double distance, double querySquaredNorm) const;
+
+        static double squaredNorm(const float* x, size_t dimension);
+
+        // Dimension of the reduced vectors.
+        inline size_t getDimension() const {
+            return augments() ? dimension + 1 : dimension;
+        }
+
+        inline Metric getMetric() const {
+            return metric;
+        }
+
+        // Distance of the VectorStore holding the reduced vectors.
+        inline Metric getStoreMetric() const {
+            return metric == Metric::INNER_PRODUCT && !reduceInnerProduct ? Metric::INNER_PRODUCT : Metric::L2;
+        }
+
+    private:
+        inline bool augments() const {
+            return metric == Metric::INNER_PRODUCT && reduceInnerProduct;
+        }
+
+        size_t dimension;
+        Metric metric;
+        bool reduceInnerProduct;
+        double maxSquaredNorm;
+    };
+} // namespace vector_index
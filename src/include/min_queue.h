@@ -2,6 +2,8 @@
 
 #include <vector>
 #include <set>
+#include <memory_resource>
+#include <cstddef>
 
 namespace vector_index {
     template <typename T>
@@ -20,24 +22,30 @@ namespace vector_index {
         return x.distance < y.distance;
     }
 
+    // Records sorted by increasing distance, allocated from the memory resource of their queue.
+    template <typename T>
+    using RecordSet = std::pmr::set<Record<T>>;
+
     template <typename T>
     class MinQueue {
     public:
             explicit MinQueue(): maxSize{0} {};
             explicit MinQueue(size_t maxSize): maxSize{maxSize} {};
+            // The records are allocated from resource, e.g. the Arena of a search. Copies use the default
+            // resource, moves keep it.
+            MinQueue(size_t maxSize, std::pmr::memory_resource* resource): maxSize{maxSize}, records(resource) {};
             inline void insert(Record<T> record) {
                 if (records.size() < maxSize) {
                     records.insert(record);
                 } else {
-                    auto maxRecord = last();
-                    if (record.distance < maxRecord.distance) {
-                        records.erase(maxRecord);
+                    if (record.distance < last().distance) {
+                        records.erase(--records.end());
                         records.insert(record);
                     }
                 }
             }
             inline Record<T> pop() {
-                auto last = records.last();
+                auto last = this->last();
                 records.erase(--records.end());
                 return last;
             }
@@ -50,18 +58,22 @@ namespace vector_index {
                 return *(--records.end());
             }
 
+            // Closest record, without removing it.
+            inline Record<T> first() {
+                return *(records.begin());
+            }
+
             inline Record<T> top() {
                 auto top = *(records.begin());
                 records.erase(records.begin());
                 return top;
             }
 
-            // return records
-            inline std::set<Record<T>> getRecords() const {
+            inline const RecordSet<T> &getRecords() const {
                 return records;
             }
     private:
         size_t maxSize;
-        std::set<Record<T>> records;
+        RecordSet<T> records;
     };
 } // namespace vector_index
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <quantizer.h>
+#include <utils.h>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace vector_index {
+    // Product quantizer: the vector is split into m sub-vectors of dimension / m dimensions, each
+    // encoded by the id of its closest centroid among 2^nbits learned by k-means. Distances are
+    // asymmetric (ADC): a query precomputes its squared distance to every centroid once, and a code
+    // is then scored with m table lookups.
+    //
+    // With nbits = 4 codes can also be packed by blocks of 32 (fast scan): the tables are quantized
+    // to 8 bits and a whole block is scored with byte shuffles, 32 codes per instruction.
+    class ProductQuantizer: public Quantizer {
+    public:
+        ProductQuantizer(size_t dimension, size_t m, size_t nbits = 8, uint64_t seed = Random::DEFAULT_SEED);
+
+        // Runs k-means on every sub-space, sub-spaces are trained in parallel.
+        void train(const float* data, size_t numVectors) override;
+
+        void encode(const float* x, uint8_t* code) const override;
+
+        void decode(const uint8_t* code, float* x) const;
+
+        std::unique_ptr<CodeDistance> prepare(const float* query) const override;
+
+        // m * ksub squared distances between the query sub-vectors and the centroids.
+        void computeDistanceTable(const float* query, float* table) const;
+
+        inline size_t getCodeSize() const override {
+            return codeSize;
+        }
+
+        bool supportsPacking() const override {
+            return nbits == 4;
+        }
+
+        size_t getPackedSize(size_t numCodes) const override;
+
+        void pack(const std::vector<const uint8_t*> &codes, uint8_t* packed) const override;
+
+        inline size_t getM() const {
+            return m;
+        }
+
+        inline size_t getKsub() const {
+            return ksub;
+        }
+
+        // Sub-quantizer q of a code.
+        inline int getCode(const uint8_t* code, size_t q) const {
+            return nbits == 8 ? code[q] : (code[q / 2] >> ((q % 2) * 4)) & 0xf;
+        }
+
+        static constexpr size_t BLOCK_SIZE = 32;
+
+        static constexpr int NUM_ITERATIONS = 25;
+
+        // Training vectors used per centroid, like faiss larger training sets are subsampled.
+        static constexpr size_t MAX_POINTS_PER_CENTROID = 256;
+
+    private:
+        void trainSubspace(const float* data, size_t numVectors, size_t q);
+
+    private:
+        size_t dimension;
+        size_t m;
+        size_t nbits;
+        size_t dsub;
+        size_t ksub;
+        size_t codeSize;
+        uint64_t seed;
+        // m * ksub * dsub, the centroids of sub-space q start at q * ksub * dsub.
+        std::vector<float> centroids;
+    };
+} // namespace vector_index
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace vector_index::server {
+    // Every message is a frame: a u32 length of the rest of the frame, a u8 MessageType and a u64 request
+    // id echoed by the response, then the payload. Fields are little endian.
+    // - SEARCH request: u32 k, u32 efSearch, u32 deadline in microseconds (0 for none), u32 dimension,
+    //   dimension f32.
+    // - SEARCH response: u8 Status, u32 n, n i32 ids, n f32 distances, closest first.
+    // - METRICS request: no payload. Response: u8 Status, u32 length, the metrics as text.
+    enum class MessageType: uint8_t {
+        SEARCH = 1,
+        METRICS = 2
+    };
+
+    enum class Status: uint8_t {
+        OK = 0,
+        // The deadline passed before the search ran, the response has no results.
+        DEADLINE_EXCEEDED = 1,
+        BAD_REQUEST = 2,
+        // The search stopped at the deadline, the results are the best found until then.
+        PARTIAL = 3,
+        // The search failed on the server, the request itself was well formed.
+        INTERNAL_ERROR = 4
+    };
+
+    struct Request {
+        MessageType type;
+        uint64_t requestId;
+        uint32_t k = 0;
+        uint32_t efSearch = 0;
+        uint32_t deadlineMicros = 0;
+        std::vector<float> query{};
+    };
+
+    struct Response {
+        MessageType type;
+        uint64_t requestId;
+        Status status = Status::OK;
+        std::vector<int> ids{};
+        std::vector<float> distances{};
+        std::string text{};
+    };
+
+    // Size of the length prefix and of the header every frame starts with.
+    static constexpr size_t LENGTH_SIZE = sizeof(uint32_t);
+    static constexpr size_t HEADER_SIZE = LENGTH_SIZE + sizeof(uint8_t) + sizeof(uint64_t);
+
+    // Larger frames are rejected, the connection is closed.
+    static constexpr size_t MAX_FRAME_SIZE = 1 << 20;
+
+    // Size of the frame at the start of `data`, 0 while it is incomplete. Throws std::invalid_argument
+    // when the frame is larger than MAX_FRAME_SIZE or shorter than a header.
+    size_t frameSize(const char* data, size_t size);
+
+    // Append the frame of the message to `out`.
+    void encode(const Request &request, std::vector<char> &out);
+
+    void encode(const Response &response, std::vector<char> &out);
+
+    // Decode one complete frame, throw std::invalid_argument when it is malformed.
+    Request decodeRequest(const char* frame, size_t size);
+
+    Response decodeResponse(const char* frame, size_t size);
+
+    // A blocking connection to a server, one request in flight at a time. Addresses are host:port or
+    // unix:path.
+    class Client {
+    public:
+        explicit Client(const std::string &address);
+
+        ~Client();
+
+        Client(const Client &) = delete;
+
+        Client &operator=(const Client &) = delete;
+
+        Response search(const std::vector<float> &query, uint32_t k, uint32_t efSearch, uint32_t deadlineMicros = 0);
+
+        std::string metrics();
+
+    private:
+        Response call(const Request &request);
+
+        int fd;
+        uint64_t nextRequestId;
+        std::vector<char> buffer;
+    };
+
+    // Opens a connected stream socket to host:port or unix:path, throws std::runtime_error on failure.
+    int connectTo(const std::string &address);
+} // namespace vector_index::server
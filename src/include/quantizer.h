@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+namespace vector_index {
+    // Distances from one query to encoded vectors. Implementations hold whatever can be computed
+    // once per query (e.g. the lookup tables of a product quantizer), so one is prepared per search.
+    class CodeDistance {
+    public:
+        virtual ~CodeDistance() = default;
+
+        // L2 distance to a single code.
+        virtual double distance(const uint8_t* code) = 0;
+
+        // L2 distances to numCodes codes laid out by Quantizer::pack.
+        virtual void packedDistances(const uint8_t* packed, size_t numCodes, float* distances) {
+            throw std::logic_error("Packed distances are not supported by this quantizer");
+        }
+    };
+
+    // A codec the graph indexes traverse with instead of the float embeddings.
+    class Quantizer {
+    public:
+        virtual ~Quantizer() = default;
+
+        // Trains on numVectors row major vectors.
+        virtual void train(const float* data, size_t numVectors) = 0;
+
+        virtual void encode(const float* x, uint8_t* code) const = 0;
+
+        virtual size_t getCodeSize() const = 0;
+
+        virtual std::unique_ptr<CodeDistance> prepare(const float* query) const = 0;
+
+        // Quantizers that can score a block of codes at once (fast scan) lay them out with pack.
+        virtual bool supportsPacking() const {
+            return false;
+        }
+
+        // Bytes needed to pack numCodes codes.
+        virtual size_t getPackedSize(size_t numCodes) const {
+            return 0;
+        }
+
+        virtual void pack(const std::vector<const uint8_t*> &codes, uint8_t* packed) const {
+            throw std::logic_error("Packing is not supported by this quantizer");
+        }
+    };
+} // namespace vector_index
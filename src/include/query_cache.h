@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace vector_index {
+    struct QueryCacheOptions {
+        // Entries over all the shards, every shard keeps capacity / numShards of them.
+        size_t capacity = 10000;
+        size_t numShards = 16;
+        // Queries are bucketed by the signs of numHashBits random projections of their offset from the
+        // first cached query, near duplicates are only found among the queries of the same bucket. Fewer
+        // bits catch more distant duplicates but make longer buckets to scan. At most 64.
+        size_t numHashBits = 12;
+        // L2 distance within which a cached query seeds the search of another one, relative to the norm
+        // of the query. 0 only matches repeats.
+        double epsilon = 0.05;
+    };
+
+    struct QueryCacheStats {
+        // Repeats answered from the cache.
+        uint64_t hits;
+        // Searches seeded with the results of a near duplicate, or of a repeat that is no longer current.
+        uint64_t nearHits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t invalidations;
+        size_t size;
+    };
+
+    enum class CacheMatch {
+        NONE,
+        // The top k of a repeat searched with the same efSearch.
+        EXACT,
+        // The results of a near duplicate, to seed the search with.
+        NEAR
+    };
+
+    // Results of recent queries in sharded LRU lists, each behind its own mutex. A shard holds the buckets
+    // whose key hashes to it. The key is a sign random projection (LSH) signature, which near duplicates
+    // share with a probability that falls with their angle as seen from the first cached query.
+    class QueryCache {
+    public:
+        QueryCache(size_t dimension, const QueryCacheOptions &options = {});
+
+        // EXACT fills ids and distances with the cached top k of the same query, compared bit for bit.
+        // NEAR fills ids with the results of the closest cached query of the bucket within epsilon.
+        CacheMatch lookup(const float* query, int k, int efSearch, std::vector<int> &ids, std::vector<double> &distances);
+
+        // Caches the results of a query, replacing the ones of a previous search with the same efSearch.
+        void insert(const float* query, int efSearch, const std::vector<int> &ids, const std::vector<double> &distances);
+
+        // After an insert into the index: the cached results are no longer returned as they are but keep
+        // seeding searches, their ids stay valid.
+        void invalidate();
+
+        // Drops all the entries, e.g. once cached ids may no longer exist.
+        void clear();
+
+        QueryCacheStats getStats() const;
+
+    private:
+        struct Entry {
+            uint64_t key;
+            std::vector<float> query;
+            int efSearch;
+            std::vector<int> ids;
+            std::vector<double> distances;
+            // Results older than the cache epoch are stale.
+            uint64_t epoch;
+        };
+
+        struct Shard {
+            std::mutex mutex;
+            // Most recently used first.
+            std::list<Entry> entries;
+            std::unordered_multimap<uint64_t, std::list<Entry>::iterator> buckets;
+        };
+
+        uint64_t key(const float* query) const;
+
+        inline Shard &shardOf(uint64_t key) {
+            return *shards[key % shards.size()];
+        }
+
+    private:
+        size_t dimension;
+        QueryCacheOptions options;
+        size_t shardCapacity;
+        // numHashBits x dimension gaussian projections.
+        std::vector<float> projections;
+        // The first cached query, set once.
+        std::vector<float> center;
+        std::once_flag centerOnce;
+        std::atomic<bool> centered;
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::atomic<uint64_t> epoch;
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> nearHits;
+        std::atomic<uint64_t> misses;
+        std::atomic<uint64_t> evictions;
+        std::atomic<uint64_t> invalidations;
+    };
+} // namespace vector_index
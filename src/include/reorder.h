@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+namespace vector_index::reorder {
+    enum class Ordering {
+        // Breadth first traversal from the entry point.
+        BFS,
+        // Reverse Cuthill-McKee, reduces the bandwidth of the adjacency matrix.
+        RCM,
+        // Gorder (Wei et al., SIGMOD 2016), greedily places nodes that share neighbors within a window.
+        GORDER
+    };
+
+    // Computes a locality friendly layout of a graph. The adjacency lists are indexed by the current
+    // position of a node and are treated as undirected. Returns the new layout as
+    // order[newPosition] = currentPosition.
+    std::vector<int> computeOrder(const std::vector<std::vector<int>> &adjacency, Ordering ordering, int start = 0);
+
+    // Window size of Gorder.
+    constexpr int GORDER_WINDOW = 5;
+} // namespace vector_index::reorder
@@ -1,5 +1,14 @@
 #pragma once
 
+#include <utils.h>
+#include <min_queue.h>
+#include <vector_store.h>
+#include <scalar_quantizer.h>
+#include <transform.h>
+#include <metric.h>
+#include <arena.h>
+#include <search_budget.h>
+
 #include <vector>
 #include <set>
 #include <chrono>
@@ -7,7 +16,10 @@
 namespace vector_index::sa_tree {
     struct Node {
         int id;
-        std::vector<float> embedding;
+        // Points into the VectorStore of the tree, in its storage type.
+        const void* embedding;
+        // Points into the CodeStore of the tree once it is quantized.
+        uint8_t* code = nullptr;
         // The maximum distance from this node to any of its children.
         double radius;
         std::vector<std::unique_ptr<Node>> children;
@@ -26,29 +38,93 @@ namespace vector_index::sa_tree {
     };
 
     struct ResultObject {
-        std::multiset<NodeWithDistance> nodes;
+        // Ids of the nearest nodes found and their distances, closest first.
+        std::vector<int> ids;
+        std::vector<double> distances;
         std::chrono::duration<double> searchTime;
         size_t nodesVisited;
         size_t maxDepth;
+        // The search ran out of budget, the results are the best found until then.
+        bool partial = false;
     };
 
     class SATree {
     public:
-        SATree(float* data, size_t dimension, size_t numVectors);
-        ResultObject rangeSearch(std::vector<float> &query, double r, double digression);
-        ResultObject knnSearch(std::vector<float> &query, int k);
-        ResultObject beamKnnSearch2(std::vector<float> &query, int b, int k);
-        ResultObject beamKnnSearch(std::vector<float> &query, int b, int k);
-        ResultObject greedyKnnSearch(std::vector<float> &query, int m, int b, int k);
+        // The embeddings are kept in the given storage type, queries are always fp32. With a transform,
+        // the embeddings and the queries are transformed first, see hnsw::HNSW. Cosine and inner product
+        // are reduced to L2 at ingest so that the tree keeps pruning with the triangle inequality.
+        // Result distances and the rangeSearch radius are in the metric.
+        SATree(float* data, size_t dimension, size_t numVectors, uint64_t seed = Random::DEFAULT_SEED, StorageType storage = StorageType::FP32, std::shared_ptr<VectorTransform> transform = nullptr, Metric metric = Metric::L2);
+        // A budget bounds the nodes whose children are expanded (hops).
+        ResultObject rangeSearch(std::vector<float> &query, double r, double digression, const SearchBudget &budget = {});
+        ResultObject knnSearch(std::vector<float> &query, int k, const SearchBudget &budget = {});
+
+        // Reuse the arrays of the result, like the flat beamKnnSearch.
+        void rangeSearch(std::vector<float> &query, double r, double digression, ResultObject &result, const SearchBudget &budget = {});
+        void knnSearch(std::vector<float> &query, int k, ResultObject &result, const SearchBudget &budget = {});
+
+        ResultObject beamKnnSearch2(std::vector<float> &query, int b, int k, const SearchBudget &budget = {});
+        ResultObject beamKnnSearch(std::vector<float> &query, int b, int k, const SearchBudget &budget = {});
+
+        // Reuses the arrays of the result, a warmed up thread searches without heap allocations.
+        void beamKnnSearch(std::vector<float> &query, int b, int k, ResultObject &result, const SearchBudget &budget = {});
+        ResultObject greedyKnnSearch(std::vector<float> &query, int m, int b, int k, const SearchBudget &budget = {});
         void getGraphStats(size_t &avgDegree, size_t &maxDegree, size_t &minDegree);
 
+        // In knnSearch, stop the distance of a child once it exceeds the k-th result distance plus the
+        // child's covering radius: neither the child nor its subtree can then improve the result.
+        // On by default.
+        inline void setEarlyAbandon(bool enabled) {
+            earlyAbandon = enabled;
+        }
+
+        // Trains a scalar quantizer on the embeddings and makes the beam and greedy searches traverse
+        // the codes, re-ranking their candidates with the full precision embeddings. rangeSearch and
+        // knnSearch rely on exact distances for pruning and are not affected.
+        void quantize(ScalarQuantizerType type);
+
     private:
         // TODO - implement incremental insert
-        static void buildTree(Node* root, std::vector<std::unique_ptr<Node>> &availableNodes);
-        void rangeSearch(Node* node, std::vector<float> &query, double distance, double r, double digression, std::multiset<NodeWithDistance> &result);
+        void buildTree(Node* root, std::vector<std::unique_ptr<Node>> &availableNodes);
+        // childDistances is scratch space shared by the whole descent.
+        void rangeSearch(Node* node, const float* query, double distance, double r, double digression, std::pmr::multiset<NodeWithDistance> &result, std::pmr::vector<double> &childDistances, BudgetTracker &budget);
+
+        // The query in the space of the stored embeddings.
+        std::pmr::vector<float> prepare(const std::vector<float> &query, std::pmr::memory_resource* resource);
+
+        // Fills the result with the nodes, closest first.
+        void toResult(const std::pmr::multiset<NodeWithDistance> &nodes, ResultObject &result);
+
+        // Converts the distances of the result found for rawQuery to the metric, in place.
+        void toMetric(ResultObject &result, const std::vector<float> &rawQuery);
+
+        inline double distance(const Node* node, const float* query) {
+            return vectors.distance(query, node->embedding);
+        }
+
+        inline double distance(const Node* node, const float* query, double bound) {
+            return earlyAbandon ? vectors.distance(query, node->embedding, bound) : distance(node, query);
+        }
+
+        inline double approximateDistance(const Node* node, const float* query) {
+            if (quantizer) {
+                return quantizer->distance(query, node->code);
+            }
+            return distance(node, query);
+        }
+
+        // Fills the result with the k closest candidates, re-ranked with the embeddings when traversal
+        // ran on codes.
+        void topK(const RecordSet<Node *> &candidates, const float* query, int k, ResultObject &result, std::pmr::memory_resource* resource);
 
     private:
         std::unique_ptr<Node> root;
+        MetricReduction reduction;
+        VectorStore vectors;
+        std::shared_ptr<VectorTransform> transform;
+        std::unique_ptr<ScalarQuantizer> quantizer;
+        std::unique_ptr<CodeStore> codes;
+        bool earlyAbandon;
     public:
         size_t dimension;
         size_t numVectors;
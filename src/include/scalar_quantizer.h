@@ -0,0 +1,60 @@
+#pragma once
+
+#include <quantizer.h>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace vector_index {
+    enum class ScalarQuantizerType {
+        // One byte per dimension.
+        SQ8,
+        // Four bits per dimension, two dimensions per byte.
+        SQ4
+    };
+
+    // Uniform scalar quantizer trained with the min/max of every dimension. Distances are asymmetric:
+    // the query stays in float and the codes are widened and decoded in registers, so a hop only
+    // reads 1/4 (SQ8) or 1/8 (SQ4) of the bytes of a float embedding.
+    class ScalarQuantizer: public Quantizer {
+    public:
+        ScalarQuantizer(size_t dimension, ScalarQuantizerType type);
+
+        // Learns the range of every dimension from numVectors row major vectors.
+        void train(const float* data, size_t numVectors) override;
+
+        // Values outside of the trained range are clamped.
+        void encode(const float* x, uint8_t* code) const override;
+
+        void decode(const uint8_t* code, float* x) const;
+
+        // L2 distance between a float query and an encoded vector.
+        double distance(const float* query, const uint8_t* code) const;
+
+        std::unique_ptr<CodeDistance> prepare(const float* query) const override;
+
+        inline size_t getCodeSize() const override {
+            return codeSize;
+        }
+
+        inline ScalarQuantizerType getType() const {
+            return type;
+        }
+
+    private:
+        float sq8SquaredDistance(const float* query, const uint8_t* code) const;
+
+        float sq4SquaredDistance(const float* query, const uint8_t* code) const;
+
+    private:
+        size_t dimension;
+        ScalarQuantizerType type;
+        size_t codeSize;
+        // Number of quantization steps, 255 for SQ8 and 15 for SQ4.
+        int levels;
+        // A code c of dimension i decodes to vmin[i] + c * step[i].
+        std::vector<float> vmin;
+        std::vector<float> step;
+    };
+} // namespace vector_index
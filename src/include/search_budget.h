@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+namespace vector_index {
+    // Limits of a single search, 0 leaves a limit out. A search that runs out of budget returns the best
+    // results found so far and flags them as partial.
+    struct SearchBudget {
+        // Wall clock time from the start of the search.
+        std::chrono::nanoseconds time{0};
+        // Distance computations, nodesVisited in the results.
+        size_t maxDistances = 0;
+        // Nodes whose neighborhood is expanded.
+        size_t maxHops = 0;
+    };
+
+    // Consumption of a budget by one search. The limits are checked before every hop, so a search may
+    // exceed maxDistances by one neighborhood; the clock is only read when there is a time limit.
+    class BudgetTracker {
+    public:
+        BudgetTracker(): BudgetTracker(SearchBudget{}) {}
+
+        explicit BudgetTracker(const SearchBudget &budget): budget(budget), hops(0), exhausted(false) {
+            if (budget.time.count() > 0) {
+                deadline = std::chrono::steady_clock::now() + budget.time;
+            }
+        }
+
+        // Counts a hop about to be taken after `distances` distance computations, false once the
+        // budget is spent.
+        inline bool allowHop(size_t distances) {
+            if (exhausted) {
+                return false;
+            }
+            if ((budget.maxHops > 0 && hops >= budget.maxHops) || (budget.maxDistances > 0 && distances >= budget.maxDistances) ||
+                    (budget.time.count() > 0 && std::chrono::steady_clock::now() >= deadline)) {
+                exhausted = true;
+                return false;
+            }
+            hops++;
+            return true;
+        }
+
+        inline bool isExhausted() const {
+            return exhausted;
+        }
+
+        inline size_t getHops() const {
+            return hops;
+        }
+
+    private:
+        SearchBudget budget;
+        std::chrono::steady_clock::time_point deadline;
+        size_t hops;
+        bool exhausted;
+    };
+} // namespace vector_index
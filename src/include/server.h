@@ -0,0 +1,116 @@
+#pragma once
+
+#include <protocol.h>
+#include <histogram.h>
+#include <hnsw.h>
+#include <search_budget.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace vector_index::server {
+    // Searches a batch of queries with the same k and efSearch within the budget, e.g.
+    // HNSW::knnSearchBatch. Results the budget cut short are flagged partial.
+    using BatchSearch = std::function<std::vector<hnsw::Result>(std::vector<std::vector<float>> &queries, int k, int efSearch, const SearchBudget &budget)>;
+
+    struct ServerOptions {
+        // host:port (port 0 picks a free one, see getAddress()) or unix:path.
+        std::string address = "127.0.0.1:0";
+        // A batch is searched once it has maxBatchSize queries or its oldest query waited maxBatchDelay.
+        size_t maxBatchSize = 32;
+        std::chrono::microseconds maxBatchDelay{200};
+        // Threads searching batches.
+        size_t numWorkers = 1;
+        // Requests asking for more results or a larger efSearch are answered BAD_REQUEST, so that a
+        // client cannot force an exhaustive traversal. At most INT_MAX.
+        size_t maxK = 1024;
+        size_t maxEfSearch = 4096;
+    };
+
+    // Serves kNN searches over TCP or a Unix socket (see protocol.h). A libuv loop thread accepts
+    // connections, decodes requests and writes responses; searches are collected into micro-batches
+    // searched by worker threads through the batch search. A request whose deadline passes while it
+    // is queued is answered DEADLINE_EXCEEDED without being searched. The search of a batch gets the
+    // time left to its earliest deadline, a request whose results it cut short is answered PARTIAL
+    // with them, and one whose search ran past its deadline anyway gets DEADLINE_EXCEEDED. A search
+    // that throws is answered INTERNAL_ERROR.
+    // Connections may pipeline requests, responses come back in completion order.
+    class Server {
+    public:
+        Server(BatchSearch search, size_t dimension, const ServerOptions &options = {});
+
+        // Stops the server.
+        ~Server();
+
+        Server(const Server &) = delete;
+
+        Server &operator=(const Server &) = delete;
+
+        // Binds the address and starts the loop and the workers, throws std::runtime_error when the
+        // address cannot be bound.
+        void start();
+
+        // Closes the connections and joins the threads, queued requests are dropped.
+        void stop();
+
+        // The bound address, with the actual port.
+        std::string getAddress() const;
+
+        // Counters and latency percentiles in the Prometheus text format.
+        std::string getMetrics();
+
+    private:
+        struct Loop;
+
+        struct Pending {
+            uint64_t connectionId;
+            Request request;
+            std::chrono::steady_clock::time_point arrival;
+        };
+
+        // Called on the loop thread for every decoded request.
+        void dispatch(uint64_t connectionId, Request request);
+
+        // Hands a response to the loop thread, which writes it unless the connection closed.
+        void respond(uint64_t connectionId, const Response &response, std::chrono::steady_clock::time_point arrival);
+
+        void work();
+
+        void searchBatch(std::vector<Pending> &batch);
+
+        BatchSearch search;
+        size_t dimension;
+        ServerOptions options;
+        std::unique_ptr<Loop> loop;
+        std::thread loopThread;
+        std::vector<std::thread> workers;
+
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        std::deque<Pending> queue;
+        bool stopping;
+
+        std::mutex metricsMutex;
+        LatencyHistogram latencies;
+        LatencyHistogram batchSizes;
+        std::atomic<uint64_t> requests;
+        std::atomic<uint64_t> completed;
+        std::atomic<uint64_t> deadlinesExceeded;
+        std::atomic<uint64_t> partials;
+        std::atomic<uint64_t> badRequests;
+        std::atomic<uint64_t> internalErrors;
+        std::atomic<uint64_t> batches;
+        std::atomic<uint64_t> connections;
+    };
+} // namespace vector_index::server
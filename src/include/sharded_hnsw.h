@@ -0,0 +1,118 @@
+#pragma once
+
+#include <hnsw.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+namespace vector_index::hnsw {
+    enum class Routing {
+        // Vectors are spread evenly by a hash of their id, every query probes every shard.
+        RANDOM,
+        // Vectors go to the shard of their nearest k-means centroid, a query may probe only the shards
+        // of its nearest centroids.
+        KMEANS
+    };
+
+    // Independent HNSW indexes over a partition of the data. Every shard has a worker thread bound to a
+    // NUMA node (shards are dealt round robin to the nodes) which builds the shard, so its graph and
+    // embeddings are local to the node, and then runs all its inserts and searches, so the shard needs
+    // no lock. A search scatters the query to the probed shards and merges their top k. Inserts into
+    // different shards run concurrently, and throughput scales with the number of shards rather than
+    // with the number of calling threads.
+    class ShardedHNSW {
+    public:
+        ShardedHNSW(float* data, size_t dimension, size_t numVectors, size_t numShards, Routing routing, int efConstruction, int m, int m0, uint64_t seed = Random::DEFAULT_SEED, Metric metric = Metric::L2);
+
+        ~ShardedHNSW();
+
+        ShardedHNSW(const ShardedHNSW &) = delete;
+
+        ShardedHNSW &operator=(const ShardedHNSW &) = delete;
+
+        // Returns the id of the vector, ids of the constructor's vectors are their positions.
+        int insert(std::vector<float> &embedding, int efConstruction);
+
+        // Searches the numProbes shards whose centroids are the nearest to the query, 0 probes all of
+        // them. Random routing probes all the shards. nodesVisited and hops add up over the shards.
+        // Every probed shard gets the whole budget, the shards search in parallel, and the result is
+        // partial when any of them ran out.
+        Result knnSearch(std::vector<float> &query, int k, int efSearch, size_t numProbes = 0, const SearchBudget &budget = {});
+
+        // Every shard searches the queries probing it in turn, which amortizes the handoff to the
+        // workers over the batch. The search time of a result is the one of its slowest shard. The time
+        // budget is shared by the batch: a shard searches every query with what is left of it.
+        std::vector<Result> knnSearchBatch(std::vector<std::vector<float>> &queries, int k, int efSearch, size_t numProbes = 0, const SearchBudget &budget = {});
+
+        // Shards to probe for the query, the nearest centroid first.
+        std::vector<size_t> route(const float* query, size_t numProbes) const;
+
+        inline size_t getNumShards() const {
+            return shards.size();
+        }
+
+        inline size_t getShardSize(size_t shard) const {
+            return shards[shard]->size.load(std::memory_order_relaxed);
+        }
+
+        // K-means iterations of the centroid training.
+        static constexpr int NUM_ITERATIONS = 20;
+
+        // Training vectors used per centroid, larger datasets are subsampled.
+        static constexpr size_t MAX_POINTS_PER_CENTROID = 256;
+
+    private:
+        struct Shard {
+            // Null until the shard has a vector.
+            std::unique_ptr<HNSW> index;
+            // Global id of every local id.
+            std::vector<int> ids;
+            std::atomic<size_t> size{0};
+            size_t node;
+            std::thread worker;
+            std::mutex queueMutex;
+            std::condition_variable queueCondition;
+            std::deque<std::function<void()>> queue;
+            bool stopping = false;
+        };
+
+        void build(const float* data, int efConstruction);
+
+        // Stops and joins the workers.
+        void stop();
+
+        void trainCentroids(const float* data, size_t numVectors, size_t numShards);
+
+        size_t assign(const float* embedding, int id) const;
+
+        // Runs task(j) on the worker of shards[targets[j]] for every j and waits for all of them,
+        // rethrowing the first exception.
+        void scatter(const std::vector<size_t> &targets, const std::function<void(size_t)> &task);
+
+        void work(Shard &shard);
+
+        // Runs on the worker of the shard, the ids of the result are global.
+        void searchShard(Shard &shard, std::vector<float> &query, int k, int efSearch, Result &result, const SearchBudget &budget = {});
+
+        // Partial results of the shards into the top k.
+        static void merge(std::vector<Result> &partials, int k, Result &result);
+
+        size_t dimension;
+        Routing routing;
+        int m;
+        int m0;
+        uint64_t seed;
+        Metric metric;
+        // numShards * dimension, KMEANS routing only.
+        std::vector<float> centroids;
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::atomic<int> nextId;
+    };
+} // namespace vector_index::hnsw
@@ -1,6 +1,13 @@
 #pragma once
 
 #include <min_queue.h>
+#include <utils.h>
+#include <vector_store.h>
+#include <reorder.h>
+#include <scalar_quantizer.h>
+#include <metric.h>
+#include <arena.h>
+#include <search_budget.h>
 
 #include <vector>
 #include <unordered_set>
@@ -9,40 +16,119 @@
 
 namespace vector_index::small_world {
     struct Node {
+        // Insertion id, reported in results. It is kept when the graph is reordered.
         int id;
-        std::vector<float> embedding;
+        // Points into the VectorStore of the index, in its storage type.
+        const void* embedding;
+        // Points into the CodeStore of the index once it is quantized.
+        uint8_t* code = nullptr;
         std::unordered_set<Node *> children;
+        // The children in one contiguous array, which the searches scan and prefetch instead of the
+        // buckets of the set.
+        std::vector<Node *> neighbors;
     };
 
     struct Result {
-        std::set<Record<Node*>> nodes;
+        // Ids of the k nearest neighbors found and their distances, closest first.
+        std::vector<int> ids;
+        std::vector<double> distances;
         std::chrono::duration<double> searchTime;
         size_t nodesVisited;
         size_t hops;
         size_t depth;
+        // The search ran out of budget, the results are the best found until then.
+        bool partial = false;
     };
 
     class SmallWorldNG {
     public:
-        SmallWorldNG(float *data, size_t dimension, size_t numVectors, int f, int w);
+        // The embeddings are kept in the given storage type, queries are always fp32. Cosine vectors are
+        // normalized at ingest and inner products are scored natively (see MetricReduction), result
+        // distances are reported in the metric.
+        SmallWorldNG(float *data, size_t dimension, size_t numVectors, int f, int w, uint64_t seed = Random::DEFAULT_SEED, StorageType storage = StorageType::FP32, Metric metric = Metric::L2);
 
-        void insert(std::vector<float> nodeEmbedding, int f, int w);
+        void insert(std::vector<float> rawEmbedding, int f, int w);
 
         Result trueKnnSearch(std::vector<float> &query, int k);
 
-        Result beamKnnSearch(std::vector<float> &query, int b, int k);
+        // A budget bounds the nodes whose neighborhoods are expanded (hops).
+        Result beamKnnSearch(std::vector<float> &query, int b, int k, const SearchBudget &budget = {});
 
-        Result beamKnnSearch2(std::vector<float> &query, int b, int k);
+        // Reuses the arrays of the result, a warmed up thread searches without heap allocations.
+        void beamKnnSearch(std::vector<float> &query, int b, int k, Result &result, const SearchBudget &budget = {});
 
-        Result someOtherKnnSearch(std::vector<float> &query, int b, int k);
+        Result beamKnnSearch2(std::vector<float> &query, int b, int k, const SearchBudget &budget = {});
 
-        Result greedyKnnSearch(std::vector<float> &query, int m, int k);
+        Result someOtherKnnSearch(std::vector<float> &query, int b, int k, const SearchBudget &budget = {});
+
+        Result greedyKnnSearch(std::vector<float> &query, int m, int k, const SearchBudget &budget = {});
 
         void getGraphStats(size_t &avgDegree, size_t &maxDegree, size_t &minDegree);
 
+        // Lays out the nodes, their embeddings and their links in the given traversal order so that
+        // neighbors are close in memory. Node ids are preserved, so results do not change.
+        void reorder(reorder::Ordering ordering);
+
+        // Trains a scalar quantizer on the stored embeddings and switches graph traversal (search and
+        // further inserts) to the codes. The beam or result queue of a search is re-ranked with the
+        // full precision embeddings before the top k are returned. trueKnnSearch stays exact.
+        void quantize(ScalarQuantizerType type);
+
+        // Number of neighbors ahead of the current one whose embeddings are prefetched during
+        // traversal, along with the neighbors array of the next candidate. 0 disables prefetching.
+        inline void setPrefetchDistance(size_t distance) {
+            prefetchDistance = distance;
+        }
+
+        static constexpr size_t DEFAULT_PREFETCH_DISTANCE = 2;
+
         std::chrono::duration<double> buildTime;
+    private:
+        // Runs on a reduced query, leaves the k closest nodes found in `nodes` and returns the stats.
+        Result greedyKnnSearch(const float* query, int m, int k, Random &random, const SearchBudget &budget, MinQueue<Node*> &nodes, std::pmr::memory_resource* resource);
+
+        // The query reduced for the metric of the index.
+        std::pmr::vector<float> prepare(const std::vector<float> &query, std::pmr::memory_resource* resource);
+
+        // Marks the unvisited children of node as visited and prefetches the first few embeddings.
+        void collectUnvisited(Node *node, std::pmr::unordered_set<int> &visited, std::pmr::vector<Node *> &unvisited);
+
+        void prefetchAhead(std::pmr::vector<Node *> &unvisited, size_t i);
+
+        // Adds to to the children of from unless it is one already.
+        static void link(Node *from, Node *to);
+
+        static void prefetchNeighbors(const Node *node);
+
+        inline double distance(const Node *node, const float* query) {
+            if (quantizer) {
+                return quantizer->distance(query, node->code);
+            }
+            return vectors.distance(query, node->embedding);
+        }
+
+        void prefetchEmbedding(Node *node);
+
+        void encode(Node *node);
+
+        // Fills the result with the k closest candidates, re-ranked with the embeddings when traversal
+        // ran on codes, in the metric.
+        void topK(const RecordSet<Node*> &candidates, const float* query, int k, Result &result, std::pmr::memory_resource* resource);
+
+        // Fills the result with the first k records, in the metric.
+        void toResult(const RecordSet<Node*> &records, int k, Result &result);
+
     private:
         int id;
+        MetricReduction reduction;
+        // Dimension of the stored, reduced embeddings.
+        size_t dimension;
+        VectorStore vectors;
+        std::unique_ptr<ScalarQuantizer> quantizer;
+        std::unique_ptr<CodeStore> codes;
         std::vector<std::unique_ptr<Node>> nodes;
+        // Picks the entry points while building, searches use the thread local generator.
+        Random random;
+        size_t prefetchDistance;
     };
 } // namespace vector_index::small_world
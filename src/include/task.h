@@ -0,0 +1,115 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace vector_index {
+    // A lazily started coroutine producing a T. The coroutine suspends (co_await std::suspend_always{})
+    // after issuing prefetches, and is driven to completion by interleave().
+    template <typename T>
+    class Task {
+    public:
+        struct promise_type {
+            std::optional<T> value;
+            std::exception_ptr exception;
+
+            Task get_return_object() {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept {
+                return {};
+            }
+
+            void return_value(T result) {
+                value = std::move(result);
+            }
+
+            void unhandled_exception() {
+                exception = std::current_exception();
+            }
+        };
+
+        Task(Task &&other) noexcept: handle(std::exchange(other.handle, nullptr)) {}
+
+        Task &operator=(Task &&other) noexcept {
+            if (this != &other) {
+                if (handle) {
+                    handle.destroy();
+                }
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+
+        Task(const Task &) = delete;
+        Task &operator=(const Task &) = delete;
+
+        ~Task() {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        inline bool done() const {
+            return handle.done();
+        }
+
+        inline void resume() {
+            handle.resume();
+        }
+
+        inline T result() {
+            if (handle.promise().exception) {
+                std::rethrow_exception(handle.promise().exception);
+            }
+            return std::move(*handle.promise().value);
+        }
+
+    private:
+        explicit Task(std::coroutine_handle<promise_type> handle): handle(handle) {}
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    // Runs numTasks tasks on the calling thread with at most numInFlight of them alive at once. Tasks are
+    // resumed round robin, so the memory stalls of one task are hidden behind the work of the others.
+    template <typename T>
+    std::vector<T> interleave(size_t numTasks, size_t numInFlight, const std::function<Task<T>(size_t)> &makeTask) {
+        std::vector<T> results(numTasks);
+        std::vector<std::pair<size_t, Task<T>>> inFlight;
+        size_t next = 0;
+        while (next < numTasks && inFlight.size() < std::max(numInFlight, (size_t) 1)) {
+            inFlight.emplace_back(next, makeTask(next));
+            next++;
+        }
+
+        while (!inFlight.empty()) {
+            for (size_t i = 0; i < inFlight.size();) {
+                auto &task = inFlight[i].second;
+                task.resume();
+                if (!task.done()) {
+                    i++;
+                    continue;
+                }
+                results[inFlight[i].first] = task.result();
+                if (next < numTasks) {
+                    inFlight[i] = {next, makeTask(next)};
+                    next++;
+                    i++;
+                } else {
+                    inFlight.erase(inFlight.begin() + i);
+                }
+            }
+        }
+        return results;
+    }
+} // namespace vector_index
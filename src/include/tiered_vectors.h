@@ -0,0 +1,110 @@
+#pragma once
+
+#include <huge_pages.h>
+#include <buffer_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace vector_index {
+    struct TieringOptions {
+        // CACHED reads cold records through the page cache, DIRECT bypasses it so that only the hot
+        // tier holds memory.
+        io::IoMode mode = io::IoMode::CACHED;
+        // Period of the background promotion and demotion, 0 rebalances only on rebalance().
+        std::chrono::milliseconds rebalanceInterval{1000};
+        // Cold reads in flight per thread.
+        unsigned queueDepth = 64;
+    };
+
+    struct TierStats {
+        uint64_t hotReads;
+        uint64_t coldReads;
+        uint64_t promotions;
+        uint64_t demotions;
+        size_t numHot;
+    };
+
+    // Records resident in memory, an immutable snapshot replaced as a whole by every rebalance. A search
+    // holds the snapshot it started with, so its records stay valid while newer ones are published.
+    struct HotTier {
+        HotTier(size_t numRecords, size_t capacity, size_t recordSize);
+
+        // Slot of every record in `data`, -1 for cold records.
+        std::vector<int32_t> slots;
+        PageBuffer data;
+        size_t numHot;
+    };
+
+    // Fixed size records in two tiers: all of them in a file, read with the AsyncReader of the calling
+    // thread, and the most visited ones in a hot tier of at most hotBudget bytes. Fetches count visits
+    // (sampled), and rebalancing, in the background or on demand, promotes the most visited records
+    // and halves the counts so that the hot set follows a shifting workload. The file is removed with
+    // the store.
+    class TieredVectors {
+    public:
+        // Writes the numRecords records returned by record(i) to `path`.
+        TieredVectors(const std::string &path, size_t recordSize, size_t numRecords, const std::function<const void*(size_t)> &record, size_t hotBudget, const TieringOptions &options = {});
+
+        ~TieredVectors();
+
+        TieredVectors(const TieredVectors &) = delete;
+
+        TieredVectors &operator=(const TieredVectors &) = delete;
+
+        std::shared_ptr<const HotTier> snapshot() const;
+
+        // Points records[i] at record ids[i]: into `hot`, or into a buffer of the calling thread that
+        // is valid until its next fetch. Cold records are read together, one submission for all of them
+        // when they fit the queue depth.
+        void fetch(const HotTier &hot, const int* ids, size_t n, const void** records);
+
+        // Raises the visit count of a record, e.g. to start the entry points of a graph hot.
+        void addVisits(int id, uint32_t count);
+
+        // Makes the hot tier the most visited records and halves the visit counts.
+        void rebalance();
+
+        TierStats getStats() const;
+
+        inline size_t getRecordSize() const {
+            return recordSize;
+        }
+
+        // Visits are counted for one fetched record in VISIT_SAMPLE, which keeps the shared counters
+        // of the hottest records from bouncing between cores.
+        static constexpr uint32_t VISIT_SAMPLE = 4;
+
+    private:
+        void rebalanceLoop();
+
+        std::string path;
+        size_t recordSize;
+        // Bytes between records in the file, recordSize rounded up to the direct I/O alignment.
+        size_t stride;
+        size_t numRecords;
+        size_t capacity;
+        TieringOptions options;
+        int fd;
+        std::unique_ptr<std::atomic<uint32_t>[]> visits;
+        std::atomic<std::shared_ptr<const HotTier>> hot;
+        std::mutex rebalanceMutex;
+        std::atomic<uint64_t> hotReads;
+        std::atomic<uint64_t> coldReads;
+        std::atomic<uint64_t> promotions;
+        std::atomic<uint64_t> demotions;
+        std::mutex stopMutex;
+        std::condition_variable stopCondition;
+        bool stopping;
+        std::thread rebalancer;
+    };
+} // namespace vector_index
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <cstddef>
+
+namespace vector_index::numa {
+    // Topology of the host. Built without libnuma (VECTOR_INDEX_HAVE_NUMA undefined), or when the kernel
+    // has no NUMA support, the host is a single node holding all the CPUs and only thread pinning
+    // has an effect.
+    bool available();
+
+    // Nodes that have CPUs, numbered from 0.
+    size_t numNodes();
+
+    std::vector<int> nodeCpus(size_t node);
+
+    // Pins the calling thread to one CPU.
+    void pinToCpu(int cpu);
+
+    // Runs the calling thread on the CPUs of the node and allocates its new pages from the node's
+    // memory, falling back to other nodes when it is full.
+    void bindToNode(size_t node);
+
+    // Read-only copies of an index, one per NUMA node. Every replica is copy constructed by a thread
+    // bound to its node, so that the pages it first touches are local to the node. Searches run on
+    // workers pinned to the CPUs of a node and read that node's replica only, no query crosses the
+    // interconnect. The index must be copy constructible and its searches safe to run concurrently.
+    template <typename Index>
+    class Replicated {
+    public:
+        // threadsPerNode workers search on every node, 0 runs one worker per CPU of the node.
+        explicit Replicated(const Index &index, size_t threadsPerNode = 0): threadsPerNode(threadsPerNode) {
+            replicas.resize(numNodes());
+            std::vector<std::thread> builders;
+            for (size_t node = 0; node < replicas.size(); node++) {
+                builders.emplace_back([&, node]() {
+                    bindToNode(node);
+                    replicas[node] = std::make_unique<Index>(index);
+                });
+            }
+            for (auto &builder: builders) {
+                builder.join();
+            }
+        }
+
+        inline Index &replica(size_t node) {
+            return *replicas[node];
+        }
+
+        inline size_t numReplicas() const {
+            return replicas.size();
+        }
+
+        // Calls search(replica, i) for every query i < numQueries. The workers pull chunks of queries
+        // from a shared counter, so the nodes share the batch in proportion to their throughput.
+        void forEach(size_t numQueries, const std::function<void(Index&, size_t)> &search, size_t chunkSize = DEFAULT_CHUNK_SIZE) {
+            std::atomic<size_t> next{0};
+            std::vector<std::thread> workers;
+            for (size_t node = 0; node < replicas.size(); node++) {
+                auto cpus = nodeCpus(node);
+                auto numWorkers = threadsPerNode > 0 ? threadsPerNode : cpus.size();
+                for (size_t i = 0; i < numWorkers; i++) {
+                    workers.emplace_back([&, node, cpu = cpus[i % cpus.size()]]() {
+                        bindToNode(node);
+                        pinToCpu(cpu);
+                        auto &index = *replicas[node];
+                        for (auto begin = next.fetch_add(chunkSize); begin < numQueries; begin = next.fetch_add(chunkSize)) {
+                            for (auto query = begin; query < std::min(begin + chunkSize, numQueries); query++) {
+                                search(index, query);
+                            }
+                        }
+                    });
+                }
+            }
+            for (auto &worker: workers) {
+                worker.join();
+            }
+        }
+
+        static constexpr size_t DEFAULT_CHUNK_SIZE = 16;
+
+    private:
+        std::vector<std::unique_ptr<Index>> replicas;
+        size_t threadsPerNode;
+    };
+} // namespace vector_index::numa
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <utils.h>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace vector_index {
+    enum class TransformType {
+        // Projects on the principal components, sorted by decreasing variance.
+        PCA,
+        // Uniformly random orthonormal basis, spreads the variance evenly over the dimensions.
+        RANDOM_ROTATION
+    };
+
+    // Linear pre-transform y = R (x - mean) applied to the vectors before they are indexed and to the
+    // queries before they are searched. R has outputDimension orthonormal rows, so distances are
+    // preserved when no dimension is dropped. After PCA the variance is front-loaded: early abandoned
+    // distances stop sooner and a prefix of the dimensions is a good first pass distance.
+    class VectorTransform {
+    public:
+        // An outputDimension of 0 keeps all the dimensions.
+        VectorTransform(size_t dimension, TransformType type, size_t outputDimension = 0, uint64_t seed = Random::DEFAULT_SEED);
+
+        // Learns the mean and, for PCA, the covariance eigenvectors of numVectors row major vectors.
+        // Larger training sets are subsampled. A random rotation needs no data, train is a no-op.
+        void train(const float* data, size_t numVectors);
+
+        void apply(const float* x, float* y) const;
+
+        // Transforms numVectors row major vectors.
+        std::vector<float> apply(const float* data, size_t numVectors) const;
+
+        inline bool isTrained() const {
+            return trained;
+        }
+
+        inline size_t getDimension() const {
+            return dimension;
+        }
+
+        inline size_t getOutputDimension() const {
+            return outputDimension;
+        }
+
+        // Variance of every output dimension, in decreasing order (PCA only).
+        inline const std::vector<double> &getEigenvalues() const {
+            return eigenvalues;
+        }
+
+        static constexpr size_t MAX_TRAINING_VECTORS = 1 << 15;
+
+    private:
+        size_t dimension;
+        TransformType type;
+        size_t outputDimension;
+        uint64_t seed;
+        bool trained;
+        std::vector<float> mean;
+        // dimension x outputDimension, the transpose of R so that apply() accumulates full rows.
+        std::vector<float> matrix;
+        std::vector<double> eigenvalues;
+    };
+} // namespace vector_index
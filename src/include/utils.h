@@ -1,17 +1,96 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
 
 namespace vector_index {
+    // xoshiro256** (https://prng.di.unimi.it/) seeded through splitmix64. Cheap enough to be drawn
+    // from on every insert, and two generators with the same seed produce the same sequence.
+    class Random {
+    public:
+        static constexpr uint64_t DEFAULT_SEED = 0x5eed;
+
+        explicit Random(uint64_t seed = DEFAULT_SEED) {
+            this->seed(seed);
+        }
+
+        inline void seed(uint64_t seed) {
+            for (auto &word: s) {
+                seed += 0x9e3779b97f4a7c15;
+                uint64_t z = seed;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+                word = z ^ (z >> 31);
+            }
+        }
+
+        inline uint64_t next() {
+            auto result = rotl(s[1] * 5, 7) * 9;
+            auto t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+            return result;
+        }
+
+        // Uniform in [0, 1).
+        inline double nextDouble() {
+            return (next() >> 11) * 0x1.0p-53;
+        }
+
+        // Uniform in [min, max], unbiased (Lemire's multiply and reject).
+        inline int nextInt(int min, int max) {
+            uint64_t range = (uint64_t) ((int64_t) max - min) + 1;
+            auto m = (unsigned __int128) next() * range;
+            auto low = (uint64_t) m;
+            if (low < range) {
+                auto threshold = -range % range;
+                while (low < threshold) {
+                    m = (unsigned __int128) next() * range;
+                    low = (uint64_t) m;
+                }
+            }
+            return (int) (min + (int64_t) (m >> 64));
+        }
+
+    private:
+        static inline uint64_t rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+
+        uint64_t s[4];
+    };
+
     struct Utils {
         static double l2_distance(std::vector<float> &a, std::vector<float> &b);
 
+        static double l2_distance(const float* a, const float* b, size_t d);
+
+        // Early abandoning L2: the partial sum is checked every ABANDON_BLOCK dimensions and the
+        // computation stops once it exceeds bound. An abandoned distance is a partial distance > bound,
+        // otherwise it is bit for bit the unbounded distance.
+        static double l2_distance(const float* a, const float* b, size_t d, double bound);
+
+        static double inner_product(const float* a, const float* b, size_t d);
+
+        // 1 - cos(a, b), in [0, 2].
         static double cosine_distance(std::vector<float> &a, std::vector<float> &b);
 
         static float* fvecs_read(const char* fname, size_t* d_out, size_t* n_out);
 
         static int* ivecs_read(const char* fname, size_t* d_out, size_t* n_out);
 
+        // The generator of the calling thread. Seeded once per thread from std::random_device unless
+        // seed() is called.
+        static Random& thread_random();
+
+        static void seed(uint64_t seed);
+
         static double rand_double();
 
         static int rand_int(int min, int max);
@@ -21,5 +100,17 @@ namespace vector_index {
         static int close(int fd);
 
         static int read(int fd, void* buf, size_t numBytes, off_t offset);
+
+        // Issues a read prefetch for every cache line of [addr, addr + numBytes).
+        static inline void prefetch(const void* addr, size_t numBytes) {
+            auto ptr = (const char*) addr;
+            for (size_t offset = 0; offset < numBytes; offset += CACHE_LINE_SIZE) {
+                __builtin_prefetch(ptr + offset, 0, 3);
+            }
+        }
+
+        static constexpr size_t CACHE_LINE_SIZE = 64;
+
+        static constexpr size_t ABANDON_BLOCK = 32;
     };
 } // namespace vector_index
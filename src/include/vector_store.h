@@ -0,0 +1,118 @@
+#pragma once
+
+#include <metric.h>
+#include <huge_pages.h>
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace vector_index {
+    // Fixed length records (embeddings, quantized codes...) stored back to back in fixed size blocks.
+    // Pointers handed out by add() stay valid for the lifetime of the store, so graph nodes can point
+    // straight into it. Adding records in traversal order keeps neighbors close in memory. With huge
+    // pages, blocks span at least one huge page.
+    template <typename T>
+    class BlockStore {
+    public:
+        explicit BlockStore(size_t recordLength, size_t blockSize = DEFAULT_BLOCK_SIZE, PagePolicy pages = getPagePolicy()): recordLength(recordLength), blockSize(pages == PagePolicy::NONE || recordLength == 0 ? blockSize : std::max(blockSize, (HUGE_PAGE_SIZE - 1) / (recordLength * sizeof(T)) + 1)), pages(pages), numRecords(0) {}
+
+        // Copies the record into the store and returns its stable location.
+        T* add(const T* record) {
+            if (numRecords == blocks.size() * blockSize) {
+                blocks.emplace_back(blockSize * recordLength * sizeof(T), pages);
+            }
+            auto location = static_cast<T*>(blocks.back().get()) + (numRecords % blockSize) * recordLength;
+            memcpy(location, record, recordLength * sizeof(T));
+            numRecords++;
+            return location;
+        }
+
+        inline size_t size() const {
+            return numRecords;
+        }
+
+        // Number of elements of T per record.
+        inline size_t getRecordLength() const {
+            return recordLength;
+        }
+
+        // Number of records per block.
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 14;
+
+    private:
+        size_t recordLength;
+        size_t blockSize;
+        PagePolicy pages;
+        size_t numRecords;
+        std::vector<PageBuffer> blocks;
+    };
+
+    enum class StorageType {
+        FP32,
+        // IEEE half precision: 5 exponent bits, 10 mantissa bits.
+        FP16,
+        // bfloat16: the 8 exponent bits of fp32 and 7 mantissa bits.
+        BF16
+    };
+
+    // Embeddings, one record per vector of `dimension` values of the storage type. Vectors are added
+    // and decoded as floats and queries stay in fp32: distances widen the stored values in registers
+    // (F16C for fp16, a 16 bit shift for bf16), so fp16/bf16 halve the bytes read per distance.
+    class VectorStore {
+    public:
+        // With Metric::INNER_PRODUCT the distances are -<query, x>. Cosine indexes normalize their vectors
+        // and store them for L2.
+        explicit VectorStore(size_t dimension, StorageType type = StorageType::FP32, Metric metric = Metric::L2);
+
+        // Converts the vector to the storage type and returns its stable location.
+        const void* add(const float* x);
+
+        // Copies a record of a store with the same dimension and type, without converting it.
+        const void* copy(const void* record);
+
+        void decode(const void* record, float* x) const;
+
+        // Distance between a float query and a stored vector.
+        double distance(const float* query, const void* record) const;
+
+        // Early abandoning version, see Utils::l2_distance. A distance > bound may be partial. Inner
+        // products are always complete.
+        double distance(const float* query, const void* record, double bound) const;
+
+        // Distance on the first numDimensions dimensions, early abandoned like the above.
+        double prefixDistance(const float* query, const void* record, size_t numDimensions, double bound = INFINITY) const;
+
+        inline size_t size() const {
+            return records.size();
+        }
+
+        inline StorageType getType() const {
+            return type;
+        }
+
+        inline Metric getMetric() const {
+            return metric;
+        }
+
+        // Bytes per vector.
+        inline size_t getRecordSize() const {
+            return records.getRecordLength();
+        }
+
+    private:
+        size_t dimension;
+        StorageType type;
+        Metric metric;
+        BlockStore<uint8_t> records;
+    };
+
+    // Quantized codes, one record per vector of `codeSize` bytes.
+    using CodeStore = BlockStore<uint8_t>;
+
+    // Binary codes, one record per vector of `numWords` 64 bit words.
+    using BinaryCodeStore = BlockStore<uint64_t>;
+} // namespace vector_index
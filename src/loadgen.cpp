@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "histogram.h"
+#include "protocol.h"
+#include "utils.h"
+
+using namespace vector_index;
+
+class InputParser {
+public:
+    InputParser(int &argc, char **argv) {
+        for (int i = 1; i < argc; ++i) {
+            this->tokens.emplace_back(argv[i]);
+        }
+    }
+
+    const std::string &getCmdOption(const std::string &option) const {
+        std::vector<std::string>::const_iterator itr;
+        itr = std::find(this->tokens.begin(), this->tokens.end(), option);
+        if (itr != this->tokens.end() && ++itr != this->tokens.end()) {
+            return *itr;
+        }
+        static const std::string emptyString;
+        return emptyString;
+    }
+
+private:
+    std::vector<std::string> tokens;
+};
+
+static size_t option(const InputParser &input, const std::string &name, size_t defaultValue) {
+    return input.getCmdOption(name).empty() ? defaultValue : std::stoul(input.getCmdOption(name));
+}
+
+// Closed loop load on a search server: every connection sends its next query once the previous one
+// is answered, so the offered load grows with the number of connections.
+//   -a host:port | unix:path [-f queries.fvecs | -D dimension of random queries] [-c connections]
+//   [-t seconds] [-k k] [-e efSearch] [-l deadline in us]
+int main(int argc, char **argv) {
+    InputParser input(argc, argv);
+    const std::string &address = input.getCmdOption("-a");
+    if (address.empty()) {
+        std::cerr << "usage: " << argv[0] << " -a address [-f queries.fvecs | -D dimension] [-c connections] [-t seconds] [-k k] [-e efSearch] [-l deadline us]" << std::endl;
+        return 1;
+    }
+    auto numConnections = option(input, "-c", 8);
+    auto duration = std::chrono::seconds(option(input, "-t", 10));
+    auto k = (uint32_t) option(input, "-k", 10);
+    auto efSearch = (uint32_t) option(input, "-e", 64);
+    auto deadline = (uint32_t) option(input, "-l", 0);
+
+    std::vector<std::vector<float>> queries;
+    if (!input.getCmdOption("-f").empty()) {
+        size_t dimension, numQueries;
+        std::unique_ptr<float[]> data(Utils::fvecs_read(input.getCmdOption("-f").c_str(), &dimension, &numQueries));
+        for (size_t i = 0; i < numQueries; i++) {
+            queries.emplace_back(data.get() + i * dimension, data.get() + (i + 1) * dimension);
+        }
+    } else {
+        auto dimension = option(input, "-D", 128);
+        Random random(7);
+        queries.resize(1000, std::vector<float>(dimension));
+        for (auto &query: queries) {
+            for (auto &x: query) {
+                x = random.nextDouble();
+            }
+        }
+    }
+
+    std::vector<LatencyHistogram> latencies(numConnections);
+    std::vector<uint64_t> ok(numConnections, 0), partial(numConnections, 0), expired(numConnections, 0), rejected(numConnections, 0), failed(numConnections, 0);
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + duration;
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < numConnections; c++) {
+        threads.emplace_back([&, c]() {
+            server::Client client(address);
+            for (size_t i = c; std::chrono::steady_clock::now() < end; i += numConnections) {
+                auto sent = std::chrono::steady_clock::now();
+                auto response = client.search(queries[i % queries.size()], k, efSearch, deadline);
+                latencies[c].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sent).count());
+                switch (response.status) {
+                    case server::Status::OK:
+                        ok[c]++;
+                        break;
+                    case server::Status::PARTIAL:
+                        partial[c]++;
+                        break;
+                    case server::Status::DEADLINE_EXCEEDED:
+                        expired[c]++;
+                        break;
+                    case server::Status::BAD_REQUEST:
+                        rejected[c]++;
+                        break;
+                    case server::Status::INTERNAL_ERROR:
+                        failed[c]++;
+                        break;
+                }
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    LatencyHistogram total;
+    uint64_t numOk = 0, numPartial = 0, numExpired = 0, numRejected = 0, numFailed = 0;
+    for (size_t c = 0; c < numConnections; c++) {
+        total.merge(latencies[c]);
+        numOk += ok[c];
+        numPartial += partial[c];
+        numExpired += expired[c];
+        numRejected += rejected[c];
+        numFailed += failed[c];
+    }
+    printf("Connections: %zu, requests: %lu (ok %lu, partial %lu, deadline exceeded %lu, bad request %lu, internal error %lu)\n", numConnections, total.getCount(), numOk, numPartial, numExpired, numRejected, numFailed);
+    printf("QPS: %.1f\n", total.getCount() / elapsed.count());
+    printf("Latency us: mean %.1f, p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n", total.getMean() / 1e3, total.percentile(0.5) / 1e3, total.percentile(0.99) / 1e3, total.percentile(0.999) / 1e3, total.getMax() / 1e3);
+    printf("Server metrics:\n%s", server::Client(address).metrics().c_str());
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "include/metric.h"
+
+namespace vector_index {
+    MetricReduction::MetricReduction(size_t dimension, Metric metric, bool reduceInnerProduct): dimension(dimension), metric(metric), reduceInnerProduct(reduceInnerProduct), maxSquaredNorm(0) {}
+
+    void MetricReduction::fit(const float* data, size_t numVectors) {
+        if (!augments()) {
+            return;
+        }
+        maxSquaredNorm = 0;
+        for (size_t i = 0; i < numVectors; i++) {
+            maxSquaredNorm = std::max(maxSquaredNorm, squaredNorm(data + i * dimension, dimension));
+        }
+    }
+
+    void MetricReduction::reduceVector(const float* x, float* y) const {
+        if (metric == Metric::COSINE) {
+            reduceQuery(x, y);
+            return;
+        }
+        memcpy(y, x, dimension * sizeof(float));
+        if (augments()) {
+            y[dimension] = sqrt(std::max(0.0, maxSquaredNorm - squaredNorm(x, dimension)));
+        }
+    }
+
+    std::vector<float> MetricReduction::reduceVectors(const float* data, size_t numVectors) const {
+        std::vector<float> reduced(numVectors * getDimension());
+        for (size_t i = 0; i < numVectors; i++) {
+            reduceVector(data + i * dimension, reduced.data() + i * getDimension());
+        }
+        return reduced;
+    }
+
+    void MetricReduction::reduceQuery(const float* query, float* y) const {
+        if (metric == Metric::COSINE) {
+            auto norm = sqrt(squaredNorm(query, dimension));
+            // A zero vector stays zero, it is then at distance 1 of every unit vector.
+            auto scale = norm > 0 ? 1 / norm : 0;
+            for (size_t j = 0; j < dimension; j++) {
+                y[j] = query[j] * scale;
+            }
+            return;
+        }
+        memcpy(y, query, dimension * sizeof(float));
+        if (augments()) {
+            y[dimension] = 0;
+        }
+    }
+
+    double MetricReduction::toMetric(double distance, double querySquaredNorm) const {
+        if (metric == Metric::COSINE) {
+            return distance * distance / 2;
+        }
+        if (augments()) {
+            return (distance * distance - querySquaredNorm - maxSquaredNorm) / 2;
+        }
+        return distance;
+    }
+
+    double MetricReduction::fromMetric(double distance, double querySquaredNorm) const {
+        if (metric == Metric::COSINE) {
+            return sqrt(std::max(0.0, 2 * distance));
+        }
+        if (augments()) {
+            return sqrt(std::max(0.0, 2 * distance + querySquaredNorm + maxSquaredNorm));
+        }
+        return distance;
+    }
+
+    double MetricReduction::squaredNorm(const float* x, size_t dimension) {
+        double norm = 0;
+        for (size_t j = 0; j < dimension; j++) {
+            norm += x[j] * x[j];
+        }
+        return norm;
+    }
+} // namespace vector_index
@@ -0,0 +1,260 @@
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+#include "include/product_quantizer.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace vector_index {
+    // Holds the distance table of a query, and for 4 bit codes its 8 bit version used by fast scan.
+    class PQCodeDistance: public CodeDistance {
+    public:
+        PQCodeDistance(const ProductQuantizer &quantizer, const float* query): quantizer(quantizer), m(quantizer.getM()), ksub(quantizer.getKsub()), table(m * ksub) {
+            quantizer.computeDistanceTable(query, table.data());
+            if (quantizer.supportsPacking()) {
+                quantizeTable();
+            }
+        }
+
+        double distance(const uint8_t* code) override {
+            float distance = 0;
+            for (size_t q = 0; q < m; q++) {
+                distance += table[q * ksub + quantizer.getCode(code, q)];
+            }
+            return sqrt(distance);
+        }
+
+        void packedDistances(const uint8_t* packed, size_t numCodes, float* distances) override {
+            constexpr auto blockSize = ProductQuantizer::BLOCK_SIZE;
+            uint16_t sums[blockSize];
+            for (size_t block = 0; block * blockSize < numCodes; block++) {
+                scanBlock(packed + block * m * blockSize / 2, sums);
+                for (size_t i = 0; i < std::min(blockSize, numCodes - block * blockSize); i++) {
+                    distances[block * blockSize + i] = sqrt(std::max(0.0f, bias + scale * sums[i]));
+                }
+            }
+        }
+
+    private:
+        // Every row of the table is shifted by its minimum and all rows share one scale, so that the
+        // m 8 bit entries of a code sum into 16 bits and the distance is bias + scale * sum.
+        void quantizeTable() {
+            float maxRange = 0;
+            bias = 0;
+            std::vector<float> rowMin(m);
+            for (size_t q = 0; q < m; q++) {
+                auto row = table.begin() + q * ksub;
+                auto [min, max] = std::minmax_element(row, row + ksub);
+                rowMin[q] = *min;
+                bias += *min;
+                maxRange = std::max(maxRange, *max - *min);
+            }
+            scale = maxRange > 0 ? maxRange / 255 : 1;
+            lut.resize(m * ksub);
+            for (size_t i = 0; i < m * ksub; i++) {
+                lut[i] = std::lround((table[i] - rowMin[i / ksub]) / scale);
+            }
+        }
+
+        // A block holds, for every sub-quantizer, 16 bytes whose low nibbles are the codes of
+        // vectors 0..15 and high nibbles the codes of vectors 16..31.
+        void scanBlock(const uint8_t* block, uint16_t* sums) {
+#if defined(__AVX2__)
+            auto mask = _mm_set1_epi8(0xf);
+            auto accLow = _mm256_setzero_si256();
+            auto accHigh = _mm256_setzero_si256();
+            for (size_t q = 0; q < m; q++) {
+                auto bytes = _mm_loadu_si128((const __m128i*) (block + q * 16));
+                auto low = _mm_and_si128(bytes, mask);
+                auto high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+                auto lookup = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) (lut.data() + q * 16)));
+                auto values = _mm256_shuffle_epi8(lookup, _mm256_set_m128i(high, low));
+                accLow = _mm256_adds_epu16(accLow, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(values)));
+                accHigh = _mm256_adds_epu16(accHigh, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(values, 1)));
+            }
+            _mm256_storeu_si256((__m256i*) sums, accLow);
+            _mm256_storeu_si256((__m256i*) (sums + 16), accHigh);
+#else
+            std::fill(sums, sums + ProductQuantizer::BLOCK_SIZE, 0);
+            for (size_t q = 0; q < m; q++) {
+                for (size_t j = 0; j < 16; j++) {
+                    auto byte = block[q * 16 + j];
+                    sums[j] += lut[q * 16 + (byte & 0xf)];
+                    sums[j + 16] += lut[q * 16 + (byte >> 4)];
+                }
+            }
+#endif
+        }
+
+    private:
+        const ProductQuantizer &quantizer;
+        size_t m;
+        size_t ksub;
+        std::vector<float> table;
+        std::vector<uint8_t> lut;
+        float bias = 0;
+        float scale = 1;
+    };
+
+    ProductQuantizer::ProductQuantizer(size_t dimension, size_t m, size_t nbits, uint64_t seed): dimension(dimension), m(m), nbits(nbits), seed(seed) {
+        if (m == 0 || dimension % m != 0) {
+            throw std::invalid_argument("PQ dimension must be a multiple of the number of sub-quantizers");
+        }
+        if (nbits != 4 && nbits != 8) {
+            throw std::invalid_argument("PQ supports 4 or 8 bits per sub-quantizer");
+        }
+        dsub = dimension / m;
+        ksub = 1 << nbits;
+        codeSize = nbits == 8 ? m : (m + 1) / 2;
+        centroids.resize(m * ksub * dsub);
+    }
+
+    void ProductQuantizer::train(const float* data, size_t numVectors) {
+        if (numVectors < ksub) {
+            throw std::invalid_argument("PQ needs at least as many training vectors as centroids");
+        }
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> workers;
+        auto numWorkers = std::min((size_t) std::max(1u, std::thread::hardware_concurrency()), m);
+        for (size_t i = 0; i < numWorkers; i++) {
+            workers.emplace_back([&]() {
+                for (auto q = next++; q < m; q = next++) {
+                    trainSubspace(data, numVectors, q);
+                }
+            });
+        }
+        for (auto &worker: workers) {
+            worker.join();
+        }
+    }
+
+    void ProductQuantizer::trainSubspace(const float* data, size_t numVectors, size_t q) {
+        // Each sub-space has its own generator so that training does not depend on the scheduling.
+        Random random(seed + q);
+        std::vector<size_t> sample(numVectors);
+        for (size_t i = 0; i < numVectors; i++) {
+            sample[i] = i;
+        }
+        auto numPoints = std::min(numVectors, ksub * MAX_POINTS_PER_CENTROID);
+        for (size_t i = 0; i < numPoints; i++) {
+            std::swap(sample[i], sample[random.nextInt(i, numVectors - 1)]);
+        }
+        std::vector<float> points(numPoints * dsub);
+        for (size_t i = 0; i < numPoints; i++) {
+            memcpy(points.data() + i * dsub, data + sample[i] * dimension + q * dsub, dsub * sizeof(float));
+        }
+
+        // The sample is shuffled, so its first ksub points are a random initialization.
+        auto centroid = centroids.data() + q * ksub * dsub;
+        memcpy(centroid, points.data(), ksub * dsub * sizeof(float));
+        std::vector<int> assignment(numPoints);
+        std::vector<size_t> counts(ksub);
+        for (int iteration = 0; iteration < NUM_ITERATIONS; iteration++) {
+            for (size_t i = 0; i < numPoints; i++) {
+                auto best = std::numeric_limits<float>::max();
+                for (size_t c = 0; c < ksub; c++) {
+                    auto distance = Utils::l2_distance(points.data() + i * dsub, centroid + c * dsub, dsub);
+                    if (distance < best) {
+                        best = distance;
+                        assignment[i] = c;
+                    }
+                }
+            }
+
+            std::fill(centroid, centroid + ksub * dsub, 0);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (size_t i = 0; i < numPoints; i++) {
+                counts[assignment[i]]++;
+                for (size_t j = 0; j < dsub; j++) {
+                    centroid[assignment[i] * dsub + j] += points[i * dsub + j];
+                }
+            }
+            for (size_t c = 0; c < ksub; c++) {
+                for (size_t j = 0; j < dsub && counts[c] > 0; j++) {
+                    centroid[c * dsub + j] /= counts[c];
+                }
+            }
+
+            // Like faiss, an empty cluster takes over half of the largest one by splitting its centroid.
+            for (size_t c = 0; c < ksub; c++) {
+                if (counts[c] > 0) {
+                    continue;
+                }
+                auto largest = std::max_element(counts.begin(), counts.end()) - counts.begin();
+                for (size_t j = 0; j < dsub; j++) {
+                    auto value = centroid[largest * dsub + j];
+                    auto epsilon = (j % 2 == 0 ? 1 : -1) * (1.0f / 1024) * (std::abs(value) + 1e-6f);
+                    centroid[c * dsub + j] = value + epsilon;
+                    centroid[largest * dsub + j] = value - epsilon;
+                }
+                counts[c] = counts[largest] / 2;
+                counts[largest] -= counts[c];
+            }
+        }
+    }
+
+    void ProductQuantizer::encode(const float* x, uint8_t* code) const {
+        std::fill(code, code + codeSize, 0);
+        for (size_t q = 0; q < m; q++) {
+            auto centroid = centroids.data() + q * ksub * dsub;
+            auto best = std::numeric_limits<float>::max();
+            size_t bestCentroid = 0;
+            for (size_t c = 0; c < ksub; c++) {
+                auto distance = Utils::l2_distance(x + q * dsub, centroid + c * dsub, dsub);
+                if (distance < best) {
+                    best = distance;
+                    bestCentroid = c;
+                }
+            }
+            if (nbits == 8) {
+                code[q] = bestCentroid;
+            } else {
+                code[q / 2] |= bestCentroid << ((q % 2) * 4);
+            }
+        }
+    }
+
+    void ProductQuantizer::decode(const uint8_t* code, float* x) const {
+        for (size_t q = 0; q < m; q++) {
+            memcpy(x + q * dsub, centroids.data() + (q * ksub + getCode(code, q)) * dsub, dsub * sizeof(float));
+        }
+    }
+
+    void ProductQuantizer::computeDistanceTable(const float* query, float* table) const {
+        for (size_t q = 0; q < m; q++) {
+            for (size_t c = 0; c < ksub; c++) {
+                auto distance = Utils::l2_distance(query + q * dsub, centroids.data() + (q * ksub + c) * dsub, dsub);
+                table[q * ksub + c] = distance * distance;
+            }
+        }
+    }
+
+    std::unique_ptr<CodeDistance> ProductQuantizer::prepare(const float* query) const {
+        return std::make_unique<PQCodeDistance>(*this, query);
+    }
+
+    size_t ProductQuantizer::getPackedSize(size_t numCodes) const {
+        auto numBlocks = (numCodes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        return numBlocks * m * BLOCK_SIZE / 2;
+    }
+
+    void ProductQuantizer::pack(const std::vector<const uint8_t*> &codes, uint8_t* packed) const {
+        if (!supportsPacking()) {
+            throw std::logic_error("Only 4 bit PQ codes can be packed");
+        }
+        memset(packed, 0, getPackedSize(codes.size()));
+        for (size_t i = 0; i < codes.size(); i++) {
+            auto block = packed + (i / BLOCK_SIZE) * m * BLOCK_SIZE / 2;
+            auto position = i % BLOCK_SIZE;
+            for (size_t q = 0; q < m; q++) {
+                block[q * 16 + position % 16] |= getCode(codes[i], q) << ((position / 16) * 4);
+            }
+        }
+    }
+} // namespace vector_index
@@ -0,0 +1,257 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include "include/protocol.h"
+
+namespace vector_index::server {
+    template <typename T>
+    static void put(std::vector<char> &out, T value) {
+        auto size = out.size();
+        out.resize(size + sizeof(T));
+        memcpy(out.data() + size, &value, sizeof(T));
+    }
+
+    static void putBytes(std::vector<char> &out, const void* data, size_t size) {
+        auto offset = out.size();
+        out.resize(offset + size);
+        memcpy(out.data() + offset, data, size);
+    }
+
+    // Reads the fields of a frame in order, throwing when the frame ends first.
+    class FrameReader {
+    public:
+        FrameReader(const char* data, size_t size): data(data), size(size), offset(0) {}
+
+        template <typename T>
+        T get() {
+            T value;
+            getBytes(&value, sizeof(T));
+            return value;
+        }
+
+        void getBytes(void* out, size_t n) {
+            if (n > size - offset) {
+                throw std::invalid_argument("Truncated frame");
+            }
+            memcpy(out, data + offset, n);
+            offset += n;
+        }
+
+        void expectEnd() const {
+            if (offset != size) {
+                throw std::invalid_argument("Trailing bytes in frame");
+            }
+        }
+
+    private:
+        const char* data;
+        size_t size;
+        size_t offset;
+    };
+
+    // Starts a frame, its length is patched by endFrame.
+    static size_t beginFrame(std::vector<char> &out, MessageType type, uint64_t requestId) {
+        auto start = out.size();
+        put<uint32_t>(out, 0);
+        put<uint8_t>(out, (uint8_t) type);
+        put<uint64_t>(out, requestId);
+        return start;
+    }
+
+    static void endFrame(std::vector<char> &out, size_t start) {
+        auto length = (uint32_t) (out.size() - start - LENGTH_SIZE);
+        memcpy(out.data() + start, &length, sizeof(length));
+    }
+
+    static MessageType readType(FrameReader &reader) {
+        auto type = reader.get<uint8_t>();
+        if (type != (uint8_t) MessageType::SEARCH && type != (uint8_t) MessageType::METRICS) {
+            throw std::invalid_argument("Unknown message type " + std::to_string(type));
+        }
+        return (MessageType) type;
+    }
+
+    size_t frameSize(const char* data, size_t size) {
+        if (size < LENGTH_SIZE) {
+            return 0;
+        }
+        uint32_t length;
+        memcpy(&length, data, sizeof(length));
+        if (length + LENGTH_SIZE > MAX_FRAME_SIZE || length + LENGTH_SIZE < HEADER_SIZE) {
+            throw std::invalid_argument("Invalid frame length " + std::to_string(length));
+        }
+        return size < length + LENGTH_SIZE ? 0 : length + LENGTH_SIZE;
+    }
+
+    void encode(const Request &request, std::vector<char> &out) {
+        auto start = beginFrame(out, request.type, request.requestId);
+        if (request.type == MessageType::SEARCH) {
+            put<uint32_t>(out, request.k);
+            put<uint32_t>(out, request.efSearch);
+            put<uint32_t>(out, request.deadlineMicros);
+            put<uint32_t>(out, (uint32_t) request.query.size());
+            putBytes(out, request.query.data(), request.query.size() * sizeof(float));
+        }
+        endFrame(out, start);
+    }
+
+    void encode(const Response &response, std::vector<char> &out) {
+        auto start = beginFrame(out, response.type, response.requestId);
+        put<uint8_t>(out, (uint8_t) response.status);
+        if (response.type == MessageType::SEARCH) {
+            put<uint32_t>(out, (uint32_t) response.ids.size());
+            putBytes(out, response.ids.data(), response.ids.size() * sizeof(int));
+            putBytes(out, response.distances.data(), response.distances.size() * sizeof(float));
+        } else {
+            put<uint32_t>(out, (uint32_t) response.text.size());
+            putBytes(out, response.text.data(), response.text.size());
+        }
+        endFrame(out, start);
+    }
+
+    Request decodeRequest(const char* frame, size_t size) {
+        FrameReader reader(frame + LENGTH_SIZE, size - LENGTH_SIZE);
+        Request request;
+        request.type = readType(reader);
+        request.requestId = reader.get<uint64_t>();
+        if (request.type == MessageType::SEARCH) {
+            request.k = reader.get<uint32_t>();
+            request.efSearch = reader.get<uint32_t>();
+            request.deadlineMicros = reader.get<uint32_t>();
+            auto dimension = reader.get<uint32_t>();
+            if (dimension > MAX_FRAME_SIZE / sizeof(float)) {
+                throw std::invalid_argument("Invalid dimension " + std::to_string(dimension));
+            }
+            request.query.resize(dimension);
+            reader.getBytes(request.query.data(), dimension * sizeof(float));
+        }
+        reader.expectEnd();
+        return request;
+    }
+
+    Response decodeResponse(const char* frame, size_t size) {
+        FrameReader reader(frame + LENGTH_SIZE, size - LENGTH_SIZE);
+        Response response;
+        response.type = readType(reader);
+        response.requestId = reader.get<uint64_t>();
+        response.status = (Status) reader.get<uint8_t>();
+        auto n = reader.get<uint32_t>();
+        if (n > MAX_FRAME_SIZE) {
+            throw std::invalid_argument("Invalid result count " + std::to_string(n));
+        }
+        if (response.type == MessageType::SEARCH) {
+            response.ids.resize(n);
+            response.distances.resize(n);
+            reader.getBytes(response.ids.data(), n * sizeof(int));
+            reader.getBytes(response.distances.data(), n * sizeof(float));
+        } else {
+            response.text.resize(n);
+            reader.getBytes(response.text.data(), n);
+        }
+        reader.expectEnd();
+        return response;
+    }
+
+    int connectTo(const std::string &address) {
+        int fd;
+        if (address.rfind("unix:", 0) == 0) {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            auto path = address.substr(5);
+            if (path.size() >= sizeof(addr.sun_path)) {
+                throw std::invalid_argument("Socket path too long: " + path);
+            }
+            memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0 || connect(fd, (sockaddr*) &addr, sizeof(addr)) != 0) {
+                auto error = std::string(strerror(errno));
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                throw std::runtime_error("Cannot connect to " + address + ": " + error);
+            }
+            return fd;
+        }
+
+        auto colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::invalid_argument("Address must be host:port or unix:path, got " + address);
+        }
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses;
+        auto status = getaddrinfo(address.substr(0, colon).c_str(), address.substr(colon + 1).c_str(), &hints, &addresses);
+        if (status != 0) {
+            throw std::runtime_error("Cannot resolve " + address + ": " + gai_strerror(status));
+        }
+        fd = -1;
+        for (auto ai = addresses; ai != nullptr && fd < 0; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(addresses);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot connect to " + address + ": " + strerror(errno));
+        }
+        // Requests are small and latency bound.
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    Client::Client(const std::string &address): fd(connectTo(address)), nextRequestId(0) {}
+
+    Client::~Client() {
+        ::close(fd);
+    }
+
+    Response Client::search(const std::vector<float> &query, uint32_t k, uint32_t efSearch, uint32_t deadlineMicros) {
+        return call(Request{MessageType::SEARCH, nextRequestId++, k, efSearch, deadlineMicros, query});
+    }
+
+    std::string Client::metrics() {
+        return call(Request{MessageType::METRICS, nextRequestId++}).text;
+    }
+
+    Response Client::call(const Request &request) {
+        buffer.clear();
+        encode(request, buffer);
+        for (size_t sent = 0; sent < buffer.size();) {
+            auto n = send(fd, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno != EINTR) {
+                throw std::runtime_error(std::string("Sending a request failed: ") + strerror(errno));
+            }
+            sent += n < 0 ? 0 : n;
+        }
+
+        buffer.clear();
+        size_t size;
+        while ((size = frameSize(buffer.data(), buffer.size())) == 0) {
+            char chunk[4096];
+            auto n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n == 0) {
+                throw std::runtime_error("The server closed the connection");
+            }
+            if (n < 0 && errno != EINTR) {
+                throw std::runtime_error(std::string("Receiving a response failed: ") + strerror(errno));
+            }
+            buffer.insert(buffer.end(), chunk, chunk + std::max<ssize_t>(n, 0));
+        }
+        auto response = decodeResponse(buffer.data(), size);
+        if (response.requestId != request.requestId) {
+            throw std::runtime_error("Response to request " + std::to_string(response.requestId) + " while waiting for " + std::to_string(request.requestId));
+        }
+        return response;
+    }
+} // namespace vector_index::server
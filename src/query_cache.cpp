@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "include/query_cache.h"
+#include "include/utils.h"
+
+namespace vector_index {
+    QueryCache::QueryCache(size_t dimension, const QueryCacheOptions &options): dimension(dimension), options(options), projections(options.numHashBits * dimension), center(dimension), centered(false), epoch(0), hits(0), nearHits(0), misses(0), evictions(0), invalidations(0) {
+        if (options.numShards == 0 || options.capacity == 0) {
+            throw std::invalid_argument("QueryCache needs at least one shard and one entry");
+        }
+        if (options.numHashBits == 0 || options.numHashBits > 64) {
+            throw std::invalid_argument("QueryCache needs between 1 and 64 hash bits");
+        }
+        shardCapacity = std::max<size_t>(1, options.capacity / options.numShards);
+        for (size_t i = 0; i < options.numShards; i++) {
+            shards.push_back(std::make_unique<Shard>());
+        }
+        Random random;
+        for (size_t i = 0; i < projections.size(); i++) {
+            // Box-Muller, nextDouble() is in [0, 1) so 1 - u is never 0.
+            projections[i] = (float) (sqrt(-2 * log(1 - random.nextDouble())) * cos(2 * M_PI * random.nextDouble()));
+        }
+    }
+
+    uint64_t QueryCache::key(const float* query) const {
+        // The hyperplanes go through the center, a sample of the queries, so that they split the queries
+        // evenly rather than all of them landing on the same side as seen from the origin.
+        uint64_t signature = 0;
+        for (size_t i = 0; i < options.numHashBits; i++) {
+            auto projection = projections.data() + i * dimension;
+            double dot = 0;
+            for (size_t j = 0; j < dimension; j++) {
+                dot += projection[j] * (query[j] - center[j]);
+            }
+            signature |= (uint64_t) (dot > 0) << i;
+        }
+        return signature;
+    }
+
+    CacheMatch QueryCache::lookup(const float* query, int k, int efSearch, std::vector<int> &ids, std::vector<double> &distances) {
+        if (!centered.load(std::memory_order_acquire)) {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return CacheMatch::NONE;
+        }
+        auto bucket = key(query);
+        auto &shard = shardOf(bucket);
+        auto current = epoch.load(std::memory_order_acquire);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto [begin, end] = shard.buckets.equal_range(bucket);
+        auto nearest = shard.entries.end();
+        double nearestDistance = INFINITY;
+        for (auto it = begin; it != end; it++) {
+            auto entry = it->second;
+            auto repeat = std::equal(query, query + dimension, entry->query.begin());
+            if (repeat && entry->epoch == current && entry->efSearch == efSearch && entry->ids.size() >= (size_t) k) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+                ids.assign(entry->ids.begin(), entry->ids.begin() + k);
+                distances.assign(entry->distances.begin(), entry->distances.begin() + k);
+                hits.fetch_add(1, std::memory_order_relaxed);
+                return CacheMatch::EXACT;
+            }
+            auto distance = repeat ? 0 : Utils::l2_distance(query, entry->query.data(), dimension);
+            if (distance < nearestDistance) {
+                nearest = entry;
+                nearestDistance = distance;
+            }
+        }
+        auto norm = sqrt(Utils::inner_product(query, query, dimension));
+        if (nearest != shard.entries.end() && nearestDistance <= options.epsilon * norm) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, nearest);
+            ids.assign(nearest->ids.begin(), nearest->ids.end());
+            nearHits.fetch_add(1, std::memory_order_relaxed);
+            return CacheMatch::NEAR;
+        }
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return CacheMatch::NONE;
+    }
+
+    void QueryCache::insert(const float* query, int efSearch, const std::vector<int> &ids, const std::vector<double> &distances) {
+        std::call_once(centerOnce, [&]() {
+            std::copy(query, query + dimension, center.begin());
+            centered.store(true, std::memory_order_release);
+        });
+        auto bucket = key(query);
+        auto &shard = shardOf(bucket);
+        auto current = epoch.load(std::memory_order_acquire);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto [begin, end] = shard.buckets.equal_range(bucket);
+        for (auto it = begin; it != end; it++) {
+            auto entry = it->second;
+            if (entry->efSearch == efSearch && std::equal(query, query + dimension, entry->query.begin())) {
+                entry->ids = ids;
+                entry->distances = distances;
+                entry->epoch = current;
+                shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+                return;
+            }
+        }
+        shard.entries.push_front(Entry{bucket, std::vector<float>(query, query + dimension), efSearch, ids, distances, current});
+        shard.buckets.emplace(bucket, shard.entries.begin());
+        if (shard.entries.size() > shardCapacity) {
+            auto last = std::prev(shard.entries.end());
+            auto [first, stop] = shard.buckets.equal_range(last->key);
+            for (auto it = first; it != stop; it++) {
+                if (it->second == last) {
+                    shard.buckets.erase(it);
+                    break;
+                }
+            }
+            shard.entries.pop_back();
+            evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void QueryCache::invalidate() {
+        epoch.fetch_add(1, std::memory_order_acq_rel);
+        invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void QueryCache::clear() {
+        for (auto &shard: shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->buckets.clear();
+            shard->entries.clear();
+        }
+        invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    QueryCacheStats QueryCache::getStats() const {
+        size_t size = 0;
+        for (auto &shard: shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            size += shard->entries.size();
+        }
+        return QueryCacheStats{hits.load(), nearHits.load(), misses.load(), evictions.load(), invalidations.load(), size};
+    }
+} // namespace vector_index
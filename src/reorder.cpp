@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <queue>
+#include <cmath>
+#include "include/reorder.h"
+
+namespace vector_index::reorder {
+    using Adjacency = std::vector<std::vector<int>>;
+
+    static Adjacency symmetrize(const Adjacency &adjacency) {
+        Adjacency undirected(adjacency.size());
+        for (int u = 0; u < adjacency.size(); u++) {
+            for (auto v: adjacency[u]) {
+                if (u == v) {
+                    continue;
+                }
+                undirected[u].push_back(v);
+                undirected[v].push_back(u);
+            }
+        }
+        for (auto &neighbors: undirected) {
+            std::sort(neighbors.begin(), neighbors.end());
+            neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        }
+        return undirected;
+    }
+
+    // Appends the nodes reachable from start in breadth first order. With byDegree set, the neighbors
+    // of a node are enqueued from the lowest to the highest degree (Cuthill-McKee).
+    static void bfs(const Adjacency &adjacency, int start, bool byDegree, std::vector<bool> &placed, std::vector<int> &order) {
+        std::queue<int> queue;
+        std::vector<int> neighbors;
+        queue.push(start);
+        placed[start] = true;
+        while (!queue.empty()) {
+            auto u = queue.front();
+            queue.pop();
+            order.push_back(u);
+            neighbors.clear();
+            for (auto v: adjacency[u]) {
+                if (!placed[v]) {
+                    neighbors.push_back(v);
+                }
+            }
+            if (byDegree) {
+                std::stable_sort(neighbors.begin(), neighbors.end(), [&adjacency](int a, int b) {
+                    return adjacency[a].size() < adjacency[b].size();
+                });
+            }
+            for (auto v: neighbors) {
+                placed[v] = true;
+                queue.push(v);
+            }
+        }
+    }
+
+    static std::vector<int> bfsOrder(const Adjacency &adjacency, int start) {
+        std::vector<bool> placed(adjacency.size(), false);
+        std::vector<int> order;
+        bfs(adjacency, start, false, placed, order);
+        for (int u = 0; u < adjacency.size(); u++) {
+            if (!placed[u]) {
+                bfs(adjacency, u, false, placed, order);
+            }
+        }
+        return order;
+    }
+
+    static std::vector<int> rcmOrder(const Adjacency &adjacency) {
+        // Every component starts from its lowest degree node, a cheap stand in for a peripheral node.
+        std::vector<int> byDegree(adjacency.size());
+        for (int u = 0; u < adjacency.size(); u++) {
+            byDegree[u] = u;
+        }
+        std::stable_sort(byDegree.begin(), byDegree.end(), [&adjacency](int a, int b) {
+            return adjacency[a].size() < adjacency[b].size();
+        });
+        std::vector<bool> placed(adjacency.size(), false);
+        std::vector<int> order;
+        for (auto u: byDegree) {
+            if (!placed[u]) {
+                bfs(adjacency, u, true, placed, order);
+            }
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    static std::vector<int> gorderOrder(const Adjacency &adjacency, int start, int window) {
+        auto n = adjacency.size();
+        std::vector<int> score(n, 0);
+        std::vector<bool> placed(n, false);
+        std::priority_queue<std::pair<int, int>> heap;
+        // Like the paper, skip sibling scores through hubs, they would cost O(degree^2) for little locality.
+        auto hubDegree = std::max((size_t) std::sqrt(n), (size_t) 1);
+
+        auto addScore = [&](int v, int delta) {
+            if (placed[v]) {
+                return;
+            }
+            score[v] += delta;
+            if (delta > 0) {
+                heap.push({score[v], -v});
+            }
+        };
+        // A node entering (+1) or leaving (-1) the window changes the score of its neighbors and siblings.
+        auto update = [&](int u, int delta) {
+            for (auto v: adjacency[u]) {
+                addScore(v, delta);
+                if (adjacency[v].size() > hubDegree) {
+                    continue;
+                }
+                for (auto w: adjacency[v]) {
+                    if (w != u) {
+                        addScore(w, delta);
+                    }
+                }
+            }
+        };
+
+        std::vector<int> order;
+        int next = start;
+        int scan = 0;
+        while (true) {
+            placed[next] = true;
+            order.push_back(next);
+            if (order.size() == n) {
+                break;
+            }
+            update(next, 1);
+            if (order.size() > window) {
+                update(order[order.size() - 1 - window], -1);
+            }
+
+            next = -1;
+            while (!heap.empty()) {
+                auto [s, v] = heap.top();
+                v = -v;
+                if (placed[v] || s != score[v]) {
+                    heap.pop();
+                    // Scores only get a fresh entry when they grow, re-add the ones that shrank.
+                    if (!placed[v] && s > score[v] && score[v] > 0) {
+                        heap.push({score[v], -v});
+                    }
+                    continue;
+                }
+                next = v;
+                break;
+            }
+            if (next == -1) {
+                while (placed[scan]) {
+                    scan++;
+                }
+                next = scan;
+            }
+        }
+        return order;
+    }
+
+    std::vector<int> computeOrder(const std::vector<std::vector<int>> &adjacency, Ordering ordering, int start) {
+        if (adjacency.empty()) {
+            return {};
+        }
+        auto undirected = symmetrize(adjacency);
+        switch (ordering) {
+            case Ordering::BFS:
+                return bfsOrder(undirected, start);
+            case Ordering::RCM:
+                return rcmOrder(undirected);
+            case Ordering::GORDER:
+                return gorderOrder(undirected, start, GORDER_WINDOW);
+        }
+        return {};
+    }
+} // namespace vector_index::reorder
@@ -7,26 +7,44 @@
 #include "include/min_queue.h"
 #include <chrono>
 #include <algorithm>
+#include <stdexcept>
 
 
 namespace vector_index::sa_tree {
-    SATree::SATree(float *data, size_t dimension, size_t numVectors) {
+    SATree::SATree(float *data, size_t dimension, size_t numVectors, uint64_t seed, StorageType storage, std::shared_ptr<VectorTransform> transform, Metric metric): reduction(dimension, metric, true), vectors(transform ? transform->getOutputDimension() : reduction.getDimension(), storage), transform(transform), earlyAbandon(true) {
+        std::vector<float> reduced, transformed;
+        reduction.fit(data, numVectors);
+        if (metric != Metric::L2) {
+            reduced = reduction.reduceVectors(data, numVectors);
+            data = reduced.data();
+            dimension = reduction.getDimension();
+        }
+        if (transform) {
+            if (transform->getDimension() != dimension) {
+                throw std::invalid_argument("Transform dimension does not match the data");
+            }
+            if (!transform->isTrained()) {
+                transform->train(data, numVectors);
+            }
+            transformed = transform->apply(data, numVectors);
+            data = transformed.data();
+            dimension = transform->getOutputDimension();
+        }
+        this->dimension = dimension;
         std::vector<std::unique_ptr<Node>> nodes;
         auto i = 0;
         while (i < numVectors) {
-            std::vector<float> embedding;
-            for (int j = i * dimension; j < (i+1) * dimension; j++) {
-                embedding.push_back(data[j]);
-            }
             auto node = std::make_unique<Node>();
             node->id = i;
-            node->embedding = embedding;
+            node->embedding = vectors.add(data + i * dimension);
             node->radius = 0;
             nodes.push_back(std::move(node));
             i++;
         }
 
         // Chose a random node as the root.
+        Random random(seed);
+        std::swap(nodes[random.nextInt(0, nodes.size() - 1)], nodes.back());
         this->root = std::move(nodes.back());
         nodes.pop_back();
 
@@ -35,7 +53,6 @@ namespace vector_index::sa_tree {
         buildTree(this->root.get(), nodes);
         buildTime = std::chrono::high_resolution_clock::now() - start;
 
-        this->dimension = dimension;
         this->numVectors = numVectors;
     }
 
@@ -48,19 +65,23 @@ namespace vector_index::sa_tree {
         root->children.clear();
         root->radius = 0;
         // Sort the available nodes by distance from the root.
-        std::sort(availableNodes.begin(), availableNodes.end(), [&root](std::unique_ptr<Node> &a, std::unique_ptr<Node> &b) {
-            return Utils::l2_distance(a.get()->embedding, root->embedding) < Utils::l2_distance(b.get()->embedding, root->embedding);
+        std::vector<float> rootEmbedding(dimension);
+        vectors.decode(root->embedding, rootEmbedding.data());
+        std::sort(availableNodes.begin(), availableNodes.end(), [&](std::unique_ptr<Node> &a, std::unique_ptr<Node> &b) {
+            return distance(a.get(), rootEmbedding.data()) < distance(b.get(), rootEmbedding.data());
         });
 
         std::vector<std::unique_ptr<Node>> nonChildrenNodes;
+        std::vector<float> embedding(dimension);
         for (auto &availableNode : availableNodes) {
             auto node = availableNode.get();
-            auto dist = Utils::l2_distance(node->embedding, root->embedding);
+            vectors.decode(node->embedding, embedding.data());
+            auto dist = distance(node, rootEmbedding.data());
             root->radius = std::max(root->radius, dist);
             auto flag = true;
             for (const auto &j : root->children) {
                 auto child = j.get();
-                auto child_dist = Utils::l2_distance(node->embedding, child->embedding);
+                auto child_dist = distance(child, embedding.data());
                 // If a node is closer to a child than to the root, then set the flag and break.
                 if (child_dist <= dist) {
                     flag = false;
@@ -78,11 +99,12 @@ namespace vector_index::sa_tree {
 
         for (auto &nonChildrenNode : nonChildrenNodes) {
             auto node = nonChildrenNode.get();
+            vectors.decode(node->embedding, embedding.data());
             auto close_idx = 0;
             double min_dist = INFINITY;
             for (int i = 0; i < len; i++) {
                 auto child = root->children[i].get();
-                auto dist = Utils::l2_distance(node->embedding, child->embedding);
+                auto dist = distance(child, embedding.data());
                 if (dist < min_dist) {
                     min_dist = dist;
                     close_idx = i;
@@ -96,34 +118,84 @@ namespace vector_index::sa_tree {
         }
     }
 
+    std::pmr::vector<float> SATree::prepare(const std::vector<float> &query, std::pmr::memory_resource* resource) {
+        std::pmr::vector<float> reduced(reduction.getDimension(), resource);
+        reduction.reduceQuery(query.data(), reduced.data());
+        if (!transform) {
+            return reduced;
+        }
+        std::pmr::vector<float> transformed(dimension, resource);
+        transform->apply(reduced.data(), transformed.data());
+        return transformed;
+    }
+
+    void SATree::toResult(const std::pmr::multiset<NodeWithDistance> &nodes, ResultObject &result) {
+        result.ids.clear();
+        result.distances.clear();
+        for (auto &node: nodes) {
+            result.ids.push_back(node.node->id);
+            result.distances.push_back(node.distance);
+        }
+    }
+
+    void SATree::toMetric(ResultObject &result, const std::vector<float> &rawQuery) {
+        if (reduction.getMetric() == Metric::L2) {
+            return;
+        }
+        // toMetric is increasing, the order is kept.
+        auto squaredNorm = MetricReduction::squaredNorm(rawQuery.data(), rawQuery.size());
+        for (auto &distance: result.distances) {
+            distance = reduction.toMetric(distance, squaredNorm);
+        }
+    }
+
     // 1. Range search based on given query and radius.
     // 2. Only consider neighbours based on this triangle inequality.
     //    d(q, b) <= d(q, c) + 2r where b & c are a neighbour of some root. And c is closest to q. (Not q')
     // 2. digression of a node b the maximum d(q, b) - d(q, a) value for any a ancestor of b in the path from the root to b.
     // 3. Using MaxSuff we find the digression of the node.
-    ResultObject SATree::rangeSearch(std::vector<float> &query, double r, double digression) {
+    ResultObject SATree::rangeSearch(std::vector<float> &rawQuery, double r, double digression, const SearchBudget &budget) {
+        ResultObject result;
+        rangeSearch(rawQuery, r, digression, result, budget);
+        return result;
+    }
+
+    void SATree::rangeSearch(std::vector<float> &rawQuery, double r, double digression, ResultObject &result, const SearchBudget &searchBudget) {
+        ScopedArena arena;
+        auto query = prepare(rawQuery, arena.get());
+        BudgetTracker budget(searchBudget);
         auto start = std::chrono::high_resolution_clock::now();
         this->nodesVisited = 1;
-        std::multiset<NodeWithDistance> result;
-        auto distance = Utils::l2_distance(root->embedding, query);
-        rangeSearch(root.get(), query, distance, r, digression, result);
-        auto end = std::chrono::high_resolution_clock::now();
-        return {result, end - start, nodesVisited};
+        std::pmr::multiset<NodeWithDistance> nodes(arena.get());
+        std::pmr::vector<double> childDistances(arena.get());
+        auto distance = this->distance(root.get(), query.data());
+        auto squaredNorm = MetricReduction::squaredNorm(rawQuery.data(), rawQuery.size());
+        rangeSearch(root.get(), query.data(), distance, reduction.fromMetric(r, squaredNorm), digression, nodes, childDistances, budget);
+        toResult(nodes, result);
+        toMetric(result, rawQuery);
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = nodesVisited;
+        result.maxDepth = 0;
+        result.partial = budget.isExhausted();
     }
 
-    void SATree::rangeSearch(Node* node, std::vector<float> &query, double distance, double r, double digression, std::multiset<NodeWithDistance> &result) {
+    void SATree::rangeSearch(Node* node, const float* query, double distance, double r, double digression, std::pmr::multiset<NodeWithDistance> &result, std::pmr::vector<double> &childDistances, BudgetTracker &budget) {
         // Digression should be less than 2 * r.
         // Distance should be less than the cover radius of the node + r.
         if (digression <= 2 * r && distance <= node->radius + r) {
             if (distance <= r) {
                 result.insert({node, distance});
             }
+            if (!budget.allowHop(nodesVisited)) {
+                return;
+            }
 
-            std::vector<double> childDistances;
+            // The descent follows a single child, the distances are not needed once it recurses.
+            childDistances.clear();
             double min_dist = distance;
             for (const auto & i : node->children) {
                 auto child = i.get();
-                auto dist = Utils::l2_distance(child->embedding, query);
+                auto dist = this->distance(child, query);
                 this->nodesVisited += 1;
                 childDistances.push_back(dist);
                 if (dist < min_dist) {
@@ -135,19 +207,29 @@ namespace vector_index::sa_tree {
                 auto child = node->children[i].get();
                 auto childDistance = childDistances.at(i);
                 if (childDistance <= min_dist + (2 * r)) {
-                    return rangeSearch(child, query, r, childDistance, std::max(digression, (childDistance - distance)), result);
+                    return rangeSearch(child, query, r, childDistance, std::max(digression, (childDistance - distance)), result, childDistances, budget);
                 }
             }
         }
     }
 
-    ResultObject SATree::knnSearch(std::vector<float> &query, int k) {
+    ResultObject SATree::knnSearch(std::vector<float> &rawQuery, int k, const SearchBudget &budget) {
+        ResultObject result;
+        knnSearch(rawQuery, k, result, budget);
+        return result;
+    }
+
+    void SATree::knnSearch(std::vector<float> &rawQuery, int k, ResultObject &result, const SearchBudget &searchBudget) {
+        ScopedArena arena;
+        auto query = prepare(rawQuery, arena.get());
+        BudgetTracker budget(searchBudget);
         auto start = std::chrono::high_resolution_clock::now();
-        auto distance = Utils::l2_distance(root->embedding, query);
+        auto distance = this->distance(root.get(), query.data());
         this->nodesVisited = 1;
-        std::priority_queue<QueueObject> queue;
+        std::priority_queue<QueueObject, std::pmr::vector<QueueObject>> queue(std::less<QueueObject>(), std::pmr::vector<QueueObject>(arena.get()));
         queue.push({root.get(), std::max(0.0, (distance - root->radius)), 0, distance});
-        std::multiset<NodeWithDistance> result;
+        std::pmr::multiset<NodeWithDistance> nodes(arena.get());
+        std::pmr::vector<double> childDistances(arena.get());
         double rad = INFINITY;
         while (!queue.empty()) {
             auto element = queue.top();
@@ -156,64 +238,83 @@ namespace vector_index::sa_tree {
                 break;
             }
             auto elementDistance = element.distance;
-            result.insert({element.node, elementDistance});
-            if (result.size() >= k + 1) {
-                result.erase(--result.end());
+            nodes.insert({element.node, elementDistance});
+            if (nodes.size() >= k + 1) {
+                nodes.erase(--nodes.end());
             }
-            if (result.size() == k) {
-                rad = (--result.end())->distance;
+            if (nodes.size() == k) {
+                rad = (--nodes.end())->distance;
+            }
+            if (!budget.allowHop(nodesVisited)) {
+                break;
             }
 
             auto closest = NodeWithDistance{element.node, elementDistance};
-            std::vector<double> childDistances;
+            childDistances.clear();
             for (const auto &i : element.node->children) {
                 auto child = i.get();
-                auto childDistance = Utils::l2_distance(child->embedding, query);
+                // Beyond rad + radius the child would be queued with a weight > rad and never expanded.
+                auto bound = rad + child->radius;
+                auto childDistance = this->distance(child, query.data(), bound);
                 this->nodesVisited += 1;
                 childDistances.push_back(childDistance);
-                if (childDistance < closest.distance) {
+                // An abandoned distance is only a lower bound, it must not tighten the closest distance.
+                if (childDistance <= bound && childDistance < closest.distance) {
                     closest = NodeWithDistance{child, childDistance};
                 }
             }
             for (int i = 0; i < element.node->children.size(); i++) {
                 auto child = element.node->children[i].get();
                 auto childDistance = childDistances.at(i);
+                if (childDistance > rad + child->radius) {
+                    continue;
+                }
                 auto dig = std::max(0.0, (element.digression + (childDistance - elementDistance)));
                 auto weight = std::max(element.weight, std::max(dig, (childDistance - closest.distance) / 2));
                 queue.push({child, std::max(weight, (childDistance - child->radius)), dig, childDistance});
             }
         }
-        auto end = std::chrono::high_resolution_clock::now();
-        return {result, end - start, nodesVisited};
+        toResult(nodes, result);
+        toMetric(result, rawQuery);
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = nodesVisited;
+        result.maxDepth = 0;
+        result.partial = budget.isExhausted();
     }
 
-    ResultObject SATree::beamKnnSearch2(std::vector<float> &query, int b, int k) {
-        MinQueue<Node *> beam(b);
-        MinQueue<Node *> result(k);
+    ResultObject SATree::beamKnnSearch2(std::vector<float> &rawQuery, int b, int k, const SearchBudget &searchBudget) {
+        ScopedArena arena;
+        auto query = prepare(rawQuery, arena.get());
+        BudgetTracker budget(searchBudget);
+        MinQueue<Node *> beam(b, arena.get());
+        MinQueue<Node *> candidates(k, arena.get());
         size_t nodesVisited = 0;
         size_t maxDepth = 0;
-        std::unordered_set<int> visited;
+        std::pmr::unordered_set<int> visited(arena.get());
         auto start = std::chrono::high_resolution_clock::now();
-        beam.insert({root.get(), Utils::l2_distance(root->embedding, query)});
-        result.insert({root.get(), Utils::l2_distance(root->embedding, query)});
-        while (true) {
+        beam.insert({root.get(), approximateDistance(root.get(), query.data())});
+        candidates.insert({root.get(), approximateDistance(root.get(), query.data())});
+        while (!budget.isExhausted()) {
             double closestDistance = INFINITY;
-            if (result.size() >= k) {
-                closestDistance = result.last().distance;
+            if (candidates.size() >= k) {
+                closestDistance = candidates.last().distance;
             }
-            MinQueue<Node *> newBeam(b);
+            MinQueue<Node *> newBeam(b, arena.get());
             auto flag = false;
             for (auto record: beam.getRecords()) {
+                if (!budget.allowHop(nodesVisited)) {
+                    break;
+                }
                 for (const auto &childNode: record.item->children) {
                     if (visited.contains(childNode->id)) {
                         continue;
                     }
-                    auto child = Record<Node *>{childNode.get(), Utils::l2_distance(childNode->embedding, query)};
+                    auto child = Record<Node *>{childNode.get(), approximateDistance(childNode.get(), query.data())};
                     nodesVisited++;
                     newBeam.insert(child);
                     visited.insert(childNode->id);
                     flag = true;
-                    result.insert(child);
+                    candidates.insert(child);
                 }
             }
             if (flag) {
@@ -222,41 +323,54 @@ namespace vector_index::sa_tree {
             for (auto record: newBeam.getRecords()) {
                 beam.insert(record);
             }
-            if (result.last().distance >= closestDistance) {
+            if (candidates.last().distance >= closestDistance) {
                 break;
             }
         }
 
-        // copy beam to result
-        std::multiset<NodeWithDistance> newResult;
-        for (auto nodeWithDistance: result.getRecords()) {
-            newResult.insert({nodeWithDistance.item, nodeWithDistance.distance});
-        }
+        ResultObject result;
+        topK(candidates.getRecords(), query.data(), k, result, arena.get());
+        toMetric(result, rawQuery);
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = nodesVisited;
+        result.maxDepth = maxDepth;
+        result.partial = budget.isExhausted();
+        return result;
+    }
 
-        return {newResult, std::chrono::high_resolution_clock::now() - start, nodesVisited, maxDepth};
+    ResultObject SATree::beamKnnSearch(std::vector<float> &rawQuery, int b, int k, const SearchBudget &budget) {
+        ResultObject result;
+        beamKnnSearch(rawQuery, b, k, result, budget);
+        return result;
     }
 
-    ResultObject SATree::beamKnnSearch(std::vector<float> &query, int b, int k) {
-        MinQueue<Node *> beam(b);
+    void SATree::beamKnnSearch(std::vector<float> &rawQuery, int b, int k, ResultObject &result, const SearchBudget &searchBudget) {
+        ScopedArena arena;
+        auto query = prepare(rawQuery, arena.get());
+        BudgetTracker budget(searchBudget);
+        MinQueue<Node *> beam(b, arena.get());
         size_t nodesVisited = 0;
         size_t maxDepth = 0;
-        std::unordered_set<int> visited;
+        std::pmr::unordered_set<int> visited(arena.get());
         auto start = std::chrono::high_resolution_clock::now();
-        beam.insert({root.get(), Utils::l2_distance(root->embedding, query)});
+        beam.insert({root.get(), approximateDistance(root.get(), query.data())});
 
-        while (true) {
+        while (!budget.isExhausted()) {
             double closestDistance = INFINITY;
             if (beam.size() >= b) {
                 closestDistance = beam.last().distance;
             }
-            MinQueue<Node *> newBeam(b);
+            MinQueue<Node *> newBeam(b, arena.get());
             auto flag = false;
             for (auto record: beam.getRecords()) {
+                if (!budget.allowHop(nodesVisited)) {
+                    break;
+                }
                 for (const auto &childNode: record.item->children) {
                     if (visited.contains(childNode->id)) {
                         continue;
                     }
-                    auto child = Record<Node *>{childNode.get(), Utils::l2_distance(childNode->embedding, query)};
+                    auto child = Record<Node *>{childNode.get(), approximateDistance(childNode.get(), query.data())};
                     nodesVisited++;
                     newBeam.insert(child);
                     visited.insert(childNode->id);
@@ -274,38 +388,35 @@ namespace vector_index::sa_tree {
             }
         }
 
-        // copy beam to result
-        auto j = 0;
-        std::multiset<NodeWithDistance> result;
-        for (auto nodeWithDistance: beam.getRecords()) {
-            if (j >= k) {
-                break;
-            }
-            result.insert({nodeWithDistance.item, nodeWithDistance.distance});
-            j++;
-        }
-
-        return {result, std::chrono::high_resolution_clock::now() - start, nodesVisited, maxDepth};
+        topK(beam.getRecords(), query.data(), k, result, arena.get());
+        toMetric(result, rawQuery);
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = nodesVisited;
+        result.maxDepth = maxDepth;
+        result.partial = budget.isExhausted();
     }
 
-    ResultObject SATree::greedyKnnSearch(std::vector<float> &query, int m, int b, int k) {
+    ResultObject SATree::greedyKnnSearch(std::vector<float> &rawQuery, int m, int b, int k, const SearchBudget &searchBudget) {
+        ScopedArena arena;
+        auto query = prepare(rawQuery, arena.get());
+        BudgetTracker budget(searchBudget);
         auto start = std::chrono::high_resolution_clock::now();
-        std::multiset<NodeWithDistance> result;
+        std::pmr::multiset<NodeWithDistance> nodes(arena.get());
         size_t nodesVisited = 0;
-        for (int i = 0; i < m; i++) {
-            MinQueue<Node *> tmpResult(b);
-            std::unordered_set<int> visited;
+        for (int i = 0; i < m && !budget.isExhausted(); i++) {
+            MinQueue<Node *> tmpResult(b, arena.get());
+            std::pmr::unordered_set<int> visited(arena.get());
             // add results to visited
             auto p = 0;
-            for (auto nodeWithDistance: result) {
+            for (auto nodeWithDistance: nodes) {
                 if (p >= b) {
                     break;
                 }
                 visited.insert(nodeWithDistance.node->id);
                 p++;
             }
-            std::priority_queue<Record<Node *>> candidates;
-            candidates.push({root.get(), Utils::l2_distance(root->embedding, query)});
+            std::priority_queue<Record<Node *>, std::pmr::vector<Record<Node *>>> candidates(std::less<Record<Node *>>(), std::pmr::vector<Record<Node *>>(arena.get()));
+            candidates.push({root.get(), approximateDistance(root.get(), query.data())});
             nodesVisited++;
             while (!candidates.empty()) {
                 auto closest = candidates.top();
@@ -313,28 +424,83 @@ namespace vector_index::sa_tree {
                 if (tmpResult.size() >= b && tmpResult.last().distance < closest.distance) {
                     break;
                 }
+                if (!budget.allowHop(nodesVisited)) {
+                    break;
+                }
 
                 for (const auto &childNode: closest.item->children) {
                     if (visited.contains(childNode->id)) {
                         continue;
                     }
-                    auto child = Record<Node *>{childNode.get(), Utils::l2_distance(childNode->embedding, query)};
+                    auto child = Record<Node *>{childNode.get(), approximateDistance(childNode.get(), query.data())};
                     visited.insert(childNode->id);
                     candidates.push(child);
                     tmpResult.insert(child);
                     nodesVisited++;
                 }
             }
-            auto j = 0;
-            for (auto nodeWithDistance: tmpResult.getRecords()) {
-                if (j >= b) {
-                    break;
-                }
-                result.insert({nodeWithDistance.item, nodeWithDistance.distance});
-                j++;
+            for (auto record: tmpResult.getRecords()) {
+                // The candidates were ranked on codes, re-rank them with the full precision embeddings.
+                nodes.insert({record.item, quantizer ? distance(record.item, query.data()) : record.distance});
+            }
+        }
+        ResultObject result;
+        toResult(nodes, result);
+        toMetric(result, rawQuery);
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = nodesVisited;
+        result.maxDepth = 0;
+        result.partial = budget.isExhausted();
+        return result;
+    }
+
+    void SATree::quantize(ScalarQuantizerType type) {
+        std::vector<Node *> treeNodes;
+        std::queue<Node *> queue;
+        queue.push(root.get());
+        while (!queue.empty()) {
+            auto node = queue.front();
+            queue.pop();
+            treeNodes.push_back(node);
+            for (const auto &childNode: node->children) {
+                queue.push(childNode.get());
+            }
+        }
+
+        std::vector<float> data(treeNodes.size() * dimension);
+        for (size_t i = 0; i < treeNodes.size(); i++) {
+            vectors.decode(treeNodes[i]->embedding, data.data() + i * dimension);
+        }
+        quantizer = std::make_unique<ScalarQuantizer>(dimension, type);
+        quantizer->train(data.data(), treeNodes.size());
+        codes = std::make_unique<CodeStore>(quantizer->getCodeSize());
+        std::vector<uint8_t> code(quantizer->getCodeSize());
+        for (size_t i = 0; i < treeNodes.size(); i++) {
+            auto node = treeNodes[i];
+            quantizer->encode(data.data() + i * dimension, code.data());
+            node->code = codes->add(code.data());
+        }
+    }
+
+    void SATree::topK(const RecordSet<Node *> &candidates, const float* query, int k, ResultObject &result, std::pmr::memory_resource* resource) {
+        auto records = &candidates;
+        MinQueue<Node *> reranked(k, resource);
+        if (quantizer) {
+            // The candidates were ranked on codes, re-rank them with the full precision embeddings.
+            for (auto candidate: candidates) {
+                reranked.insert({candidate.item, distance(candidate.item, query)});
+            }
+            records = &reranked.getRecords();
+        }
+        result.ids.clear();
+        result.distances.clear();
+        for (auto &record: *records) {
+            if (result.ids.size() >= k) {
+                break;
             }
+            result.ids.push_back(record.item->id);
+            result.distances.push_back(record.distance);
         }
-        return {result, std::chrono::high_resolution_clock::now() - start, nodesVisited};
     }
 
     void SATree::getGraphStats(size_t &avgDegree, size_t &maxDegree, size_t &minDegree) {
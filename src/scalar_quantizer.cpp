@@ -0,0 +1,142 @@
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include "include/scalar_quantizer.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+namespace vector_index {
+    // Scalar codes need no per query state, the query is used as is.
+    class ScalarCodeDistance: public CodeDistance {
+    public:
+        ScalarCodeDistance(const ScalarQuantizer &quantizer, const float* query): quantizer(quantizer), query(query) {}
+
+        double distance(const uint8_t* code) override {
+            return quantizer.distance(query, code);
+        }
+
+    private:
+        const ScalarQuantizer &quantizer;
+        const float* query;
+    };
+
+    ScalarQuantizer::ScalarQuantizer(size_t dimension, ScalarQuantizerType type): dimension(dimension), type(type), vmin(dimension, 0), step(dimension, 0) {
+        if (type == ScalarQuantizerType::SQ8) {
+            codeSize = dimension;
+            levels = 255;
+        } else {
+            codeSize = (dimension + 1) / 2;
+            levels = 15;
+        }
+    }
+
+    void ScalarQuantizer::train(const float* data, size_t numVectors) {
+        std::vector<float> vmax(dimension, std::numeric_limits<float>::lowest());
+        std::fill(vmin.begin(), vmin.end(), std::numeric_limits<float>::max());
+        for (size_t i = 0; i < numVectors; i++) {
+            for (size_t j = 0; j < dimension; j++) {
+                vmin[j] = std::min(vmin[j], data[i * dimension + j]);
+                vmax[j] = std::max(vmax[j], data[i * dimension + j]);
+            }
+        }
+        for (size_t j = 0; j < dimension; j++) {
+            step[j] = vmax[j] > vmin[j] ? (vmax[j] - vmin[j]) / levels : 0;
+        }
+    }
+
+    void ScalarQuantizer::encode(const float* x, uint8_t* code) const {
+        std::fill(code, code + codeSize, 0);
+        for (size_t j = 0; j < dimension; j++) {
+            int c = 0;
+            if (step[j] > 0) {
+                c = std::clamp((int) std::lround((x[j] - vmin[j]) / step[j]), 0, levels);
+            }
+            if (type == ScalarQuantizerType::SQ8) {
+                code[j] = c;
+            } else {
+                code[j / 2] |= c << ((j % 2) * 4);
+            }
+        }
+    }
+
+    void ScalarQuantizer::decode(const uint8_t* code, float* x) const {
+        for (size_t j = 0; j < dimension; j++) {
+            int c = type == ScalarQuantizerType::SQ8 ? code[j] : (code[j / 2] >> ((j % 2) * 4)) & 0xf;
+            x[j] = vmin[j] + c * step[j];
+        }
+    }
+
+    double ScalarQuantizer::distance(const float* query, const uint8_t* code) const {
+        if (type == ScalarQuantizerType::SQ8) {
+            return sqrt(sq8SquaredDistance(query, code));
+        }
+        return sqrt(sq4SquaredDistance(query, code));
+    }
+
+    std::unique_ptr<CodeDistance> ScalarQuantizer::prepare(const float* query) const {
+        return std::make_unique<ScalarCodeDistance>(*this, query);
+    }
+
+#if defined(__AVX2__) && defined(__FMA__)
+    static inline float horizontalSum(__m256 v) {
+        auto sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+        return _mm_cvtss_f32(sum);
+    }
+
+    // Accumulates (query - (vmin + code * step))^2 for 8 dimensions whose codes are widened to 32 bits.
+    static inline __m256 accumulate(__m256 acc, __m256i codes, const float* query, const float* vmin, const float* step) {
+        auto x = _mm256_fmadd_ps(_mm256_cvtepi32_ps(codes), _mm256_loadu_ps(step), _mm256_loadu_ps(vmin));
+        auto diff = _mm256_sub_ps(_mm256_loadu_ps(query), x);
+        return _mm256_fmadd_ps(diff, diff, acc);
+    }
+#endif
+
+    float ScalarQuantizer::sq8SquaredDistance(const float* query, const uint8_t* code) const {
+        size_t j = 0;
+        float distance = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+        auto acc = _mm256_setzero_ps();
+        for (; j + 8 <= dimension; j += 8) {
+            auto codes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (code + j)));
+            acc = accumulate(acc, codes, query + j, vmin.data() + j, step.data() + j);
+        }
+        distance = horizontalSum(acc);
+#endif
+        for (; j < dimension; j++) {
+            auto diff = query[j] - (vmin[j] + code[j] * step[j]);
+            distance += diff * diff;
+        }
+        return distance;
+    }
+
+    float ScalarQuantizer::sq4SquaredDistance(const float* query, const uint8_t* code) const {
+        size_t j = 0;
+        float distance = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+        auto acc = _mm256_setzero_ps();
+        auto mask = _mm_set1_epi8(0xf);
+        for (; j + 8 <= dimension; j += 8) {
+            // 4 bytes hold 8 nibbles, interleave the low and high nibbles back into dimension order.
+            int32_t packed;
+            memcpy(&packed, code + j / 2, sizeof(packed));
+            auto bytes = _mm_cvtsi32_si128(packed);
+            auto low = _mm_and_si128(bytes, mask);
+            auto high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+            auto codes = _mm256_cvtepu8_epi32(_mm_unpacklo_epi8(low, high));
+            acc = accumulate(acc, codes, query + j, vmin.data() + j, step.data() + j);
+        }
+        distance = horizontalSum(acc);
+#endif
+        for (; j < dimension; j++) {
+            int c = (code[j / 2] >> ((j % 2) * 4)) & 0xf;
+            auto diff = query[j] - (vmin[j] + c * step[j]);
+            distance += diff * diff;
+        }
+        return distance;
+    }
+} // namespace vector_index
@@ -0,0 +1,440 @@
+#include <uv.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include "include/server.h"
+
+namespace vector_index::server {
+    struct Connection {
+        // First member, so that the handle and the connection have the same address.
+        union {
+            uv_tcp_t tcp;
+            uv_pipe_t pipe;
+        } handle;
+        uint64_t id;
+        Server* server;
+        std::vector<char> input;
+        char readBuffer[64 * 1024];
+    };
+
+    struct WriteRequest {
+        uv_write_t request;
+        std::vector<char> data;
+    };
+
+    struct Server::Loop {
+        uv_loop_t loop;
+        union {
+            uv_tcp_t tcp;
+            uv_pipe_t pipe;
+        } listener;
+        bool isUnix = false;
+        std::string address;
+        // Wakes the loop up for responses and for stopping.
+        uv_async_t wakeup;
+        uint64_t nextConnectionId = 0;
+        // Loop thread only.
+        std::unordered_map<uint64_t, Connection*> connections;
+        std::mutex outboxMutex;
+        std::vector<std::pair<uint64_t, std::vector<char>>> outbox;
+        bool stopping = false;
+    };
+
+    static std::string uvError(const std::string &what, int status) {
+        return what + ": " + uv_strerror(status);
+    }
+
+    static void onConnectionClosed(uv_handle_t* handle) {
+        delete reinterpret_cast<Connection*>(handle);
+    }
+
+    static void closeConnection(Connection* connection, std::unordered_map<uint64_t, Connection*> &connections) {
+        connections.erase(connection->id);
+        uv_close(reinterpret_cast<uv_handle_t*>(&connection->handle), onConnectionClosed);
+    }
+
+    static void onWrite(uv_write_t* request, int) {
+        delete reinterpret_cast<WriteRequest*>(request);
+    }
+
+    Server::Server(BatchSearch search, size_t dimension, const ServerOptions &options): search(std::move(search)), dimension(dimension), options(options), stopping(false),
+            requests(0), completed(0), deadlinesExceeded(0), partials(0), badRequests(0), internalErrors(0), batches(0), connections(0) {
+        if (options.maxBatchSize == 0 || options.numWorkers == 0) {
+            throw std::invalid_argument("Batch size and number of workers must be positive");
+        }
+        if (options.maxK == 0 || options.maxEfSearch == 0 || options.maxK > INT_MAX || options.maxEfSearch > INT_MAX) {
+            throw std::invalid_argument("The largest k and efSearch must be between 1 and INT_MAX");
+        }
+    }
+
+    Server::~Server() {
+        stop();
+    }
+
+    void Server::start() {
+        if (loop) {
+            throw std::logic_error("The server is already started");
+        }
+        loop = std::make_unique<Loop>();
+        auto l = loop.get();
+        uv_loop_init(&l->loop);
+        l->loop.data = this;
+        uv_stream_t* listener;
+        int status;
+        if (options.address.rfind("unix:", 0) == 0) {
+            l->isUnix = true;
+            auto path = options.address.substr(5);
+            uv_pipe_init(&l->loop, &l->listener.pipe, 0);
+            unlink(path.c_str());
+            status = uv_pipe_bind(&l->listener.pipe, path.c_str());
+            listener = reinterpret_cast<uv_stream_t*>(&l->listener.pipe);
+            l->address = options.address;
+        } else {
+            auto colon = options.address.rfind(':');
+            if (colon == std::string::npos) {
+                uv_loop_close(&l->loop);
+                loop.reset();
+                throw std::invalid_argument("Address must be host:port or unix:path, got " + options.address);
+            }
+            auto host = options.address.substr(0, colon);
+            auto port = std::stoi(options.address.substr(colon + 1));
+            sockaddr_storage addr{};
+            status = uv_ip4_addr(host.c_str(), port, reinterpret_cast<sockaddr_in*>(&addr));
+            if (status != 0) {
+                status = uv_ip6_addr(host.c_str(), port, reinterpret_cast<sockaddr_in6*>(&addr));
+            }
+            uv_tcp_init(&l->loop, &l->listener.tcp);
+            if (status == 0) {
+                status = uv_tcp_bind(&l->listener.tcp, reinterpret_cast<sockaddr*>(&addr), 0);
+            }
+            listener = reinterpret_cast<uv_stream_t*>(&l->listener.tcp);
+            if (status == 0) {
+                int length = sizeof(addr);
+                uv_tcp_getsockname(&l->listener.tcp, reinterpret_cast<sockaddr*>(&addr), &length);
+                port = ntohs(addr.ss_family == AF_INET ? reinterpret_cast<sockaddr_in*>(&addr)->sin_port : reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port);
+                l->address = host + ":" + std::to_string(port);
+            }
+        }
+        listener->data = this;
+        if (status == 0) {
+            status = uv_listen(listener, SOMAXCONN, [](uv_stream_t* listener, int status) {
+                auto server = static_cast<Server*>(listener->data);
+                auto l = server->loop.get();
+                if (status < 0) {
+                    return;
+                }
+                auto connection = new Connection();
+                connection->id = l->nextConnectionId++;
+                connection->server = server;
+                auto stream = reinterpret_cast<uv_stream_t*>(&connection->handle);
+                if (l->isUnix) {
+                    uv_pipe_init(&l->loop, &connection->handle.pipe, 0);
+                } else {
+                    uv_tcp_init(&l->loop, &connection->handle.tcp);
+                    uv_tcp_nodelay(&connection->handle.tcp, 1);
+                }
+                l->connections[connection->id] = connection;
+                if (uv_accept(listener, stream) != 0) {
+                    closeConnection(connection, l->connections);
+                    return;
+                }
+                server->connections.fetch_add(1, std::memory_order_relaxed);
+                uv_read_start(stream, [](uv_handle_t* handle, size_t, uv_buf_t* buffer) {
+                    auto connection = reinterpret_cast<Connection*>(handle);
+                    *buffer = uv_buf_init(connection->readBuffer, sizeof(connection->readBuffer));
+                }, [](uv_stream_t* stream, ssize_t n, const uv_buf_t* buffer) {
+                    auto connection = reinterpret_cast<Connection*>(stream);
+                    auto server = connection->server;
+                    if (n < 0) {
+                        closeConnection(connection, server->loop->connections);
+                        return;
+                    }
+                    auto &input = connection->input;
+                    input.insert(input.end(), buffer->base, buffer->base + n);
+                    size_t consumed = 0;
+                    try {
+                        size_t size;
+                        while ((size = frameSize(input.data() + consumed, input.size() - consumed)) > 0) {
+                            auto request = decodeRequest(input.data() + consumed, size);
+                            consumed += size;
+                            server->dispatch(connection->id, std::move(request));
+                        }
+                    } catch (const std::invalid_argument &) {
+                        // The stream cannot be resynchronized after a malformed frame.
+                        server->badRequests.fetch_add(1, std::memory_order_relaxed);
+                        closeConnection(connection, server->loop->connections);
+                        return;
+                    }
+                    input.erase(input.begin(), input.begin() + consumed);
+                });
+            });
+        }
+        uv_async_init(&l->loop, &l->wakeup, [](uv_async_t* wakeup) {
+            auto server = static_cast<Server*>(wakeup->loop->data);
+            auto l = server->loop.get();
+            std::vector<std::pair<uint64_t, std::vector<char>>> outbox;
+            bool stopping;
+            {
+                std::lock_guard<std::mutex> lock(l->outboxMutex);
+                outbox.swap(l->outbox);
+                stopping = l->stopping;
+            }
+            if (stopping) {
+                while (!l->connections.empty()) {
+                    closeConnection(l->connections.begin()->second, l->connections);
+                }
+                uv_close(reinterpret_cast<uv_handle_t*>(&l->listener), nullptr);
+                uv_close(reinterpret_cast<uv_handle_t*>(&l->wakeup), nullptr);
+                return;
+            }
+            // The responses of a connection that completed together go out in one write.
+            std::map<uint64_t, std::vector<char>> writes;
+            for (auto &[connectionId, data]: outbox) {
+                auto &write = writes[connectionId];
+                write.insert(write.end(), data.begin(), data.end());
+            }
+            for (auto &[connectionId, data]: writes) {
+                auto it = l->connections.find(connectionId);
+                if (it == l->connections.end()) {
+                    continue;
+                }
+                auto write = new WriteRequest{uv_write_t{}, std::move(data)};
+                auto buffer = uv_buf_init(write->data.data(), write->data.size());
+                if (uv_write(&write->request, reinterpret_cast<uv_stream_t*>(&it->second->handle), &buffer, 1, onWrite) != 0) {
+                    delete write;
+                    closeConnection(it->second, l->connections);
+                }
+            }
+        });
+
+        if (status != 0) {
+            uv_close(reinterpret_cast<uv_handle_t*>(&l->listener), nullptr);
+            uv_close(reinterpret_cast<uv_handle_t*>(&l->wakeup), nullptr);
+            uv_run(&l->loop, UV_RUN_DEFAULT);
+            uv_loop_close(&l->loop);
+            auto address = options.address;
+            loop.reset();
+            throw std::runtime_error(uvError("Cannot listen on " + address, status));
+        }
+        stopping = false;
+        loopThread = std::thread([l]() {
+            uv_run(&l->loop, UV_RUN_DEFAULT);
+        });
+        for (size_t i = 0; i < options.numWorkers; i++) {
+            workers.emplace_back(&Server::work, this);
+        }
+    }
+
+    void Server::stop() {
+        if (!loop) {
+            return;
+        }
+        // Workers first, they hand their responses to the loop.
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for (auto &worker: workers) {
+            worker.join();
+        }
+        workers.clear();
+        {
+            std::lock_guard<std::mutex> lock(loop->outboxMutex);
+            loop->stopping = true;
+        }
+        uv_async_send(&loop->wakeup);
+        loopThread.join();
+        uv_loop_close(&loop->loop);
+        if (loop->isUnix) {
+            unlink(loop->address.substr(5).c_str());
+        }
+        queue.clear();
+        loop.reset();
+    }
+
+    std::string Server::getAddress() const {
+        return loop ? loop->address : options.address;
+    }
+
+    void Server::dispatch(uint64_t connectionId, Request request) {
+        auto arrival = std::chrono::steady_clock::now();
+        if (request.type == MessageType::METRICS) {
+            respond(connectionId, Response{MessageType::METRICS, request.requestId, Status::OK, {}, {}, getMetrics()}, arrival);
+            return;
+        }
+        requests.fetch_add(1, std::memory_order_relaxed);
+        auto tooLarge = request.k > options.maxK || request.efSearch > options.maxEfSearch;
+        if (request.query.size() != dimension || request.k == 0 || request.efSearch == 0 || tooLarge) {
+            respond(connectionId, Response{MessageType::SEARCH, request.requestId, Status::BAD_REQUEST}, arrival);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(Pending{connectionId, std::move(request), arrival});
+        }
+        queueCondition.notify_one();
+    }
+
+    void Server::respond(uint64_t connectionId, const Response &response, std::chrono::steady_clock::time_point arrival) {
+        std::vector<char> data;
+        encode(response, data);
+        if (response.type == MessageType::SEARCH) {
+            auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - arrival).count();
+            std::lock_guard<std::mutex> lock(metricsMutex);
+            latencies.record(latency);
+            switch (response.status) {
+                case Status::OK:
+                    completed++;
+                    break;
+                case Status::DEADLINE_EXCEEDED:
+                    deadlinesExceeded++;
+                    break;
+                case Status::BAD_REQUEST:
+                    badRequests++;
+                    break;
+                case Status::PARTIAL:
+                    partials++;
+                    break;
+                case Status::INTERNAL_ERROR:
+                    internalErrors++;
+                    break;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(loop->outboxMutex);
+            loop->outbox.emplace_back(connectionId, std::move(data));
+        }
+        uv_async_send(&loop->wakeup);
+    }
+
+    void Server::work() {
+        std::vector<Pending> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [&]() { return stopping || !queue.empty(); });
+                if (stopping) {
+                    return;
+                }
+                // Waits for the batch to fill up, at most until its oldest query is maxBatchDelay old.
+                auto due = queue.front().arrival + options.maxBatchDelay;
+                queueCondition.wait_until(lock, due, [&]() { return stopping || queue.empty() || queue.size() >= options.maxBatchSize; });
+                if (stopping) {
+                    return;
+                }
+                // Another worker may have taken the queries meanwhile.
+                auto n = std::min(queue.size(), options.maxBatchSize);
+                for (size_t i = 0; i < n; i++) {
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+            if (!batch.empty()) {
+                searchBatch(batch);
+                batch.clear();
+            }
+        }
+    }
+
+    void Server::searchBatch(std::vector<Pending> &batch) {
+        batches.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(metricsMutex);
+            batchSizes.record(batch.size());
+        }
+        auto deadline = [](const Pending &pending) {
+            return pending.arrival + std::chrono::microseconds(pending.request.deadlineMicros);
+        };
+        auto expired = [&](const Pending &pending, std::chrono::steady_clock::time_point now) {
+            return pending.request.deadlineMicros > 0 && now > deadline(pending);
+        };
+
+        // The batch search takes one k and efSearch, queries are grouped by them.
+        std::map<std::pair<uint32_t, uint32_t>, std::vector<Pending*>> groups;
+        auto now = std::chrono::steady_clock::now();
+        for (auto &pending: batch) {
+            if (expired(pending, now)) {
+                respond(pending.connectionId, Response{MessageType::SEARCH, pending.request.requestId, Status::DEADLINE_EXCEEDED}, pending.arrival);
+            } else {
+                groups[{pending.request.k, pending.request.efSearch}].push_back(&pending);
+            }
+        }
+        for (auto &[parameters, group]: groups) {
+            // The group is searched until its earliest deadline.
+            SearchBudget budget;
+            now = std::chrono::steady_clock::now();
+            std::vector<std::vector<float>> queries;
+            for (auto pending: group) {
+                queries.push_back(std::move(pending->request.query));
+                if (pending->request.deadlineMicros > 0) {
+                    auto remaining = std::max(std::chrono::nanoseconds(1), std::chrono::duration_cast<std::chrono::nanoseconds>(deadline(*pending) - now));
+                    budget.time = budget.time.count() > 0 ? std::min(budget.time, remaining) : remaining;
+                }
+            }
+            std::vector<hnsw::Result> results;
+            try {
+                results = search(queries, (int) parameters.first, (int) parameters.second, budget);
+            } catch (const std::exception &) {
+                // The requests were validated on arrival, the failure is the server's.
+                for (auto pending: group) {
+                    respond(pending->connectionId, Response{MessageType::SEARCH, pending->request.requestId, Status::INTERNAL_ERROR}, pending->arrival);
+                }
+                continue;
+            }
+            now = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < group.size(); i++) {
+                auto pending = group[i];
+                Response response{MessageType::SEARCH, pending->request.requestId, results[i].partial ? Status::PARTIAL : Status::OK};
+                // Partial results are returned even when answering them took past the deadline.
+                if (expired(*pending, now) && !results[i].partial) {
+                    response.status = Status::DEADLINE_EXCEEDED;
+                } else {
+                    response.ids = std::move(results[i].ids);
+                    response.distances.assign(results[i].distances.begin(), results[i].distances.end());
+                }
+                respond(pending->connectionId, response, pending->arrival);
+            }
+        }
+    }
+
+    std::string Server::getMetrics() {
+        std::ostringstream out;
+        auto counter = [&](const std::string &name, const std::string &labels, uint64_t value) {
+            out << "vector_index_" << name << labels << " " << value << "\n";
+        };
+        out << "# TYPE vector_index_requests_total counter\n";
+        counter("requests_total", "", requests.load());
+        out << "# TYPE vector_index_responses_total counter\n";
+        counter("responses_total", "{status=\"ok\"}", completed.load());
+        counter("responses_total", "{status=\"deadline_exceeded\"}", deadlinesExceeded.load());
+        counter("responses_total", "{status=\"partial\"}", partials.load());
+        counter("responses_total", "{status=\"bad_request\"}", badRequests.load());
+        counter("responses_total", "{status=\"internal_error\"}", internalErrors.load());
+        out << "# TYPE vector_index_batches_total counter\n";
+        counter("batches_total", "", batches.load());
+        out << "# TYPE vector_index_connections_total counter\n";
+        counter("connections_total", "", connections.load());
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            out << "# TYPE vector_index_queue_depth gauge\n";
+            counter("queue_depth", "", queue.size());
+        }
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        out << "# TYPE vector_index_batch_size summary\n";
+        for (auto q: {0.5, 0.99}) {
+            out << "vector_index_batch_size{quantile=\"" << q << "\"} " << batchSizes.percentile(q) << "\n";
+        }
+        out << "vector_index_batch_size_count " << batchSizes.getCount() << "\n";
+        out << "# TYPE vector_index_latency_seconds summary\n";
+        for (auto q: {0.5, 0.99, 0.999}) {
+            out << "vector_index_latency_seconds{quantile=\"" << q << "\"} " << latencies.percentile(q) / 1e9 << "\n";
+        }
+        out << "vector_index_latency_seconds_count " << latencies.getCount() << "\n";
+        return out.str();
+    }
+} // namespace vector_index::server
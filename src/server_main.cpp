@@ -0,0 +1,103 @@
+#include <csignal>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "hnsw.h"
+#include "sharded_hnsw.h"
+#include "server.h"
+#include "utils.h"
+
+using namespace vector_index;
+
+class InputParser {
+public:
+    InputParser(int &argc, char **argv) {
+        for (int i = 1; i < argc; ++i) {
+            this->tokens.emplace_back(argv[i]);
+        }
+    }
+
+    const std::string &getCmdOption(const std::string &option) const {
+        std::vector<std::string>::const_iterator itr;
+        itr = std::find(this->tokens.begin(), this->tokens.end(), option);
+        if (itr != this->tokens.end() && ++itr != this->tokens.end()) {
+            return *itr;
+        }
+        static const std::string emptyString;
+        return emptyString;
+    }
+
+private:
+    std::vector<std::string> tokens;
+};
+
+static size_t option(const InputParser &input, const std::string &name, size_t defaultValue) {
+    return input.getCmdOption(name).empty() ? defaultValue : std::stoul(input.getCmdOption(name));
+}
+
+// Serves an HNSW index of the vectors of an fvecs file until SIGINT or SIGTERM.
+//   -f base.fvecs [-n max vectors] [-a host:port | unix:path] [-m M] [-e efConstruction]
+//   [-s shards, 0 for a single index] [-p probes per query, sharded only]
+//   [-b max batch size] [-d max batch delay in us] [-w worker threads] [-K max k] [-E max efSearch]
+int main(int argc, char **argv) {
+    InputParser input(argc, argv);
+    const std::string &basePath = input.getCmdOption("-f");
+    if (basePath.empty()) {
+        std::cerr << "usage: " << argv[0] << " -f base.fvecs [-n vectors] [-a address] [-m M] [-e efConstruction] [-s shards] [-p probes] [-b batch size] [-d batch delay us] [-w workers] [-K max k] [-E max efSearch]" << std::endl;
+        return 1;
+    }
+    server::ServerOptions options;
+    options.address = input.getCmdOption("-a").empty() ? "127.0.0.1:7000" : input.getCmdOption("-a");
+    options.maxBatchSize = option(input, "-b", options.maxBatchSize);
+    options.maxBatchDelay = std::chrono::microseconds(option(input, "-d", options.maxBatchDelay.count()));
+    options.numWorkers = option(input, "-w", options.numWorkers);
+    options.maxK = option(input, "-K", options.maxK);
+    options.maxEfSearch = option(input, "-E", options.maxEfSearch);
+    auto m = (int) option(input, "-m", 16);
+    auto efConstruction = (int) option(input, "-e", 64);
+    auto numShards = option(input, "-s", 0);
+    auto numProbes = option(input, "-p", 0);
+
+    size_t dimension, numVectors;
+    std::unique_ptr<float[]> data(Utils::fvecs_read(basePath.c_str(), &dimension, &numVectors));
+    numVectors = std::min(numVectors, option(input, "-n", numVectors));
+    printf("Indexing %zu vectors of dimension %zu\n", numVectors, dimension);
+
+    std::unique_ptr<hnsw::HNSW> index;
+    std::unique_ptr<hnsw::ShardedHNSW> sharded;
+    server::BatchSearch search;
+    if (numShards == 0) {
+        index = std::make_unique<hnsw::HNSW>(data.get(), dimension, numVectors, efConstruction, m, 2 * m);
+        search = [&](std::vector<std::vector<float>> &queries, int k, int efSearch, const SearchBudget &budget) {
+            return index->knnSearchBatch(queries, k, efSearch, hnsw::HNSW::DEFAULT_NUM_IN_FLIGHT, budget);
+        };
+    } else {
+        sharded = std::make_unique<hnsw::ShardedHNSW>(data.get(), dimension, numVectors, numShards, hnsw::Routing::KMEANS, efConstruction, m, 2 * m);
+        search = [&](std::vector<std::vector<float>> &queries, int k, int efSearch, const SearchBudget &budget) {
+            return sharded->knnSearchBatch(queries, k, efSearch, numProbes, budget);
+        };
+    }
+    data.reset();
+
+    // The signals are taken by sigwait, the server threads inherit the mask.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    server::Server server(search, dimension, options);
+    server.start();
+    printf("Listening on %s\n", server.getAddress().c_str());
+    fflush(stdout);
+    int signal;
+    sigwait(&signals, &signal);
+    printf("%s", server.getMetrics().c_str());
+    server.stop();
+    return 0;
+}
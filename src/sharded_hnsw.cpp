@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <latch>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include "include/sharded_hnsw.h"
+#include "include/topology.h"
+
+namespace vector_index::hnsw {
+    ShardedHNSW::ShardedHNSW(float* data, size_t dimension, size_t numVectors, size_t numShards, Routing routing, int efConstruction, int m, int m0, uint64_t seed, Metric metric):
+            dimension(dimension), routing(routing), m(m), m0(m0), seed(seed), metric(metric), nextId((int) numVectors) {
+        if (numShards == 0 || numVectors < numShards) {
+            throw std::invalid_argument("Every shard needs at least one vector");
+        }
+        if (routing == Routing::KMEANS) {
+            trainCentroids(data, numVectors, numShards);
+        }
+        auto numNodes = numa::numNodes();
+        for (size_t i = 0; i < numShards; i++) {
+            auto shard = std::make_unique<Shard>();
+            shard->node = i % numNodes;
+            shard->worker = std::thread(&ShardedHNSW::work, this, std::ref(*shard));
+            shards.push_back(std::move(shard));
+        }
+        for (size_t i = 0; i < numVectors; i++) {
+            shards[assign(data + i * dimension, (int) i)]->ids.push_back((int) i);
+        }
+
+        try {
+            build(data, efConstruction);
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    void ShardedHNSW::build(const float* data, int efConstruction) {
+        // Shards are built by their workers, in parallel and in the memory of their nodes.
+        std::vector<size_t> all(shards.size());
+        std::iota(all.begin(), all.end(), 0);
+        scatter(all, [&](size_t i) {
+            auto &shard = *shards[i];
+            if (shard.ids.empty()) {
+                return;
+            }
+            std::vector<float> vectors(shard.ids.size() * dimension);
+            for (size_t j = 0; j < shard.ids.size(); j++) {
+                memcpy(vectors.data() + j * dimension, data + (size_t) shard.ids[j] * dimension, dimension * sizeof(float));
+            }
+            shard.index = std::make_unique<HNSW>(vectors.data(), dimension, shard.ids.size(), efConstruction, m, m0, seed + i, StorageType::FP32, nullptr, metric);
+            shard.size.store(shard.ids.size(), std::memory_order_relaxed);
+        });
+    }
+
+    ShardedHNSW::~ShardedHNSW() {
+        stop();
+    }
+
+    void ShardedHNSW::stop() {
+        for (auto &shard: shards) {
+            {
+                std::lock_guard<std::mutex> lock(shard->queueMutex);
+                shard->stopping = true;
+            }
+            shard->queueCondition.notify_all();
+        }
+        for (auto &shard: shards) {
+            shard->worker.join();
+        }
+    }
+
+    void ShardedHNSW::trainCentroids(const float* data, size_t numVectors, size_t numShards) {
+        Random random(seed);
+        std::vector<size_t> sample(numVectors);
+        std::iota(sample.begin(), sample.end(), 0);
+        auto numPoints = std::min(numVectors, numShards * MAX_POINTS_PER_CENTROID);
+        for (size_t i = 0; i < numPoints; i++) {
+            std::swap(sample[i], sample[random.nextInt(i, numVectors - 1)]);
+        }
+
+        // The sample is shuffled, so its first numShards points are a random initialization.
+        centroids.resize(numShards * dimension);
+        for (size_t c = 0; c < numShards; c++) {
+            memcpy(centroids.data() + c * dimension, data + sample[c] * dimension, dimension * sizeof(float));
+        }
+        std::vector<size_t> assignment(numPoints);
+        std::vector<size_t> counts(numShards);
+        for (int iteration = 0; iteration < NUM_ITERATIONS; iteration++) {
+            for (size_t i = 0; i < numPoints; i++) {
+                assignment[i] = route(data + sample[i] * dimension, 1)[0];
+            }
+
+            std::fill(centroids.begin(), centroids.end(), 0);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (size_t i = 0; i < numPoints; i++) {
+                counts[assignment[i]]++;
+                auto point = data + sample[i] * dimension;
+                for (size_t j = 0; j < dimension; j++) {
+                    centroids[assignment[i] * dimension + j] += point[j];
+                }
+            }
+            for (size_t c = 0; c < numShards; c++) {
+                for (size_t j = 0; j < dimension && counts[c] > 0; j++) {
+                    centroids[c * dimension + j] /= counts[c];
+                }
+            }
+
+            // As in the product quantizer, an empty cluster takes over half of the largest one.
+            for (size_t c = 0; c < numShards; c++) {
+                if (counts[c] > 0) {
+                    continue;
+                }
+                auto largest = std::max_element(counts.begin(), counts.end()) - counts.begin();
+                for (size_t j = 0; j < dimension; j++) {
+                    auto value = centroids[largest * dimension + j];
+                    auto epsilon = (j % 2 == 0 ? 1 : -1) * (1.0f / 1024) * (std::abs(value) + 1e-6f);
+                    centroids[c * dimension + j] = value + epsilon;
+                    centroids[largest * dimension + j] = value - epsilon;
+                }
+                counts[c] = counts[largest] / 2;
+                counts[largest] -= counts[c];
+            }
+        }
+    }
+
+    size_t ShardedHNSW::assign(const float* embedding, int id) const {
+        if (routing == Routing::RANDOM) {
+            return (((uint64_t) id * 0x9e3779b97f4a7c15ULL) >> 32) % shards.size();
+        }
+        return route(embedding, 1)[0];
+    }
+
+    void ShardedHNSW::work(Shard &shard) {
+        numa::bindToNode(shard.node);
+        std::unique_lock<std::mutex> lock(shard.queueMutex);
+        while (true) {
+            shard.queueCondition.wait(lock, [&]() { return shard.stopping || !shard.queue.empty(); });
+            if (shard.queue.empty()) {
+                return;
+            }
+            auto task = std::move(shard.queue.front());
+            shard.queue.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    void ShardedHNSW::scatter(const std::vector<size_t> &targets, const std::function<void(size_t)> &task) {
+        std::latch done((std::ptrdiff_t) targets.size());
+        std::mutex errorMutex;
+        std::exception_ptr error;
+        for (size_t j = 0; j < targets.size(); j++) {
+            auto &shard = *shards[targets[j]];
+            {
+                std::lock_guard<std::mutex> lock(shard.queueMutex);
+                shard.queue.emplace_back([&, j]() {
+                    try {
+                        task(j);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> errorLock(errorMutex);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                    }
+                    done.count_down();
+                });
+            }
+            shard.queueCondition.notify_one();
+        }
+        done.wait();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    int ShardedHNSW::insert(std::vector<float> &embedding, int efConstruction) {
+        if (embedding.size() != dimension) {
+            throw std::invalid_argument("Embedding dimension does not match the index");
+        }
+        auto id = nextId.fetch_add(1, std::memory_order_relaxed);
+        auto target = assign(embedding.data(), id);
+        scatter({target}, [&](size_t) {
+            auto &shard = *shards[target];
+            if (shard.index) {
+                shard.index->insert(embedding, efConstruction);
+            } else {
+                shard.index = std::make_unique<HNSW>(embedding.data(), dimension, 1, efConstruction, m, m0, seed + target, StorageType::FP32, nullptr, metric);
+            }
+            shard.ids.push_back(id);
+            shard.size.store(shard.ids.size(), std::memory_order_relaxed);
+        });
+        return id;
+    }
+
+    Result ShardedHNSW::knnSearch(std::vector<float> &query, int k, int efSearch, size_t numProbes, const SearchBudget &budget) {
+        auto start = std::chrono::high_resolution_clock::now();
+        auto probes = route(query.data(), numProbes);
+        std::vector<Result> partials(probes.size());
+        scatter(probes, [&](size_t j) {
+            searchShard(*shards[probes[j]], query, k, efSearch, partials[j], budget);
+        });
+        Result result;
+        merge(partials, k, result);
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        return result;
+    }
+
+    std::vector<Result> ShardedHNSW::knnSearchBatch(std::vector<std::vector<float>> &queries, int k, int efSearch, size_t numProbes, const SearchBudget &budget) {
+        auto deadline = std::chrono::steady_clock::now() + budget.time;
+        // The queries of every shard and the partial result each of them fills.
+        std::vector<std::vector<std::pair<size_t, Result*>>> assigned(shards.size());
+        std::vector<std::vector<Result>> partials(queries.size());
+        for (size_t q = 0; q < queries.size(); q++) {
+            auto probes = route(queries[q].data(), numProbes);
+            partials[q].resize(probes.size());
+            for (size_t j = 0; j < probes.size(); j++) {
+                assigned[probes[j]].emplace_back(q, &partials[q][j]);
+            }
+        }
+        std::vector<size_t> targets;
+        for (size_t i = 0; i < shards.size(); i++) {
+            if (!assigned[i].empty()) {
+                targets.push_back(i);
+            }
+        }
+        scatter(targets, [&](size_t j) {
+            for (auto [q, partial]: assigned[targets[j]]) {
+                auto remaining = budget;
+                if (budget.time.count() > 0) {
+                    // A spent budget still leaves the query its entry points.
+                    remaining.time = std::max(std::chrono::nanoseconds(1), std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()));
+                }
+                searchShard(*shards[targets[j]], queries[q], k, efSearch, *partial, remaining);
+            }
+        });
+        std::vector<Result> results(queries.size());
+        for (size_t q = 0; q < queries.size(); q++) {
+            merge(partials[q], k, results[q]);
+            results[q].searchTime = std::chrono::duration<double>(0);
+            for (auto &partial: partials[q]) {
+                results[q].searchTime = std::max(results[q].searchTime, partial.searchTime);
+            }
+        }
+        return results;
+    }
+
+    void ShardedHNSW::searchShard(Shard &shard, std::vector<float> &query, int k, int efSearch, Result &result, const SearchBudget &budget) {
+        if (!shard.index) {
+            result = Result{};
+            return;
+        }
+        shard.index->knnSearch(query, k, efSearch, result, budget);
+        for (auto &id: result.ids) {
+            id = shard.ids[id];
+        }
+    }
+
+    void ShardedHNSW::merge(std::vector<Result> &partials, int k, Result &result) {
+        std::vector<std::pair<double, int>> merged;
+        result.nodesVisited = 0;
+        result.hops = 0;
+        result.depth = 0;
+        result.partial = false;
+        for (auto &partial: partials) {
+            for (size_t i = 0; i < partial.ids.size(); i++) {
+                merged.emplace_back(partial.distances[i], partial.ids[i]);
+            }
+            result.nodesVisited += partial.nodesVisited;
+            result.hops += partial.hops;
+            result.depth = std::max(result.depth, partial.depth);
+            result.partial = result.partial || partial.partial;
+        }
+        auto n = std::min(merged.size(), (size_t) std::max(k, 0));
+        std::partial_sort(merged.begin(), merged.begin() + n, merged.end());
+        result.ids.resize(n);
+        result.distances.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            result.distances[i] = merged[i].first;
+            result.ids[i] = merged[i].second;
+        }
+    }
+
+    std::vector<size_t> ShardedHNSW::route(const float* query, size_t numProbes) const {
+        auto numShards = routing == Routing::RANDOM ? shards.size() : centroids.size() / dimension;
+        std::vector<size_t> probes(numShards);
+        std::iota(probes.begin(), probes.end(), 0);
+        if (routing == Routing::RANDOM) {
+            return probes;
+        }
+        numProbes = numProbes == 0 ? numShards : std::min(numProbes, numShards);
+        std::vector<double> distances(numShards);
+        for (size_t i = 0; i < numShards; i++) {
+            distances[i] = Utils::l2_distance(query, centroids.data() + i * dimension, dimension);
+        }
+        std::partial_sort(probes.begin(), probes.begin() + numProbes, probes.end(), [&](size_t a, size_t b) {
+            return distances[a] < distances[b] || (distances[a] == distances[b] && a < b);
+        });
+        probes.resize(numProbes);
+        return probes;
+    }
+} // namespace vector_index::hnsw
@@ -6,71 +6,83 @@
 #include "include/min_queue.h"
 #include <random>
 #include <chrono>
+#include <unordered_map>
+#include <stdexcept>
 
 namespace vector_index::small_world {
-    SmallWorldNG::SmallWorldNG(float *data, size_t dimension, size_t numVectors, int m, int k) {
+    SmallWorldNG::SmallWorldNG(float *data, size_t dimension, size_t numVectors, int m, int k, uint64_t seed, StorageType storage, Metric metric): reduction(dimension, metric), dimension(reduction.getDimension()), vectors(this->dimension, storage, reduction.getStoreMetric()), random(seed), prefetchDistance(DEFAULT_PREFETCH_DISTANCE) {
         id = 0;
-        auto i = 0;
-        std::vector<std::vector<float>> embeddings;
-        while (i < numVectors) {
-            std::vector<float> embedding;
-            for (int j = i * dimension; j < (i + 1) * dimension; j++) {
-                embedding.push_back(data[j]);
-            }
-            embeddings.push_back(embedding);
-            i++;
-        }
-
+        reduction.fit(data, numVectors);
         auto start = std::chrono::high_resolution_clock::now();
-        i = 0;
-        for (auto embedding: embeddings) {
-            insert(embedding, m, k);
+        for (size_t i = 0; i < numVectors; i++) {
+            insert(std::vector<float>(data + i * dimension, data + (i + 1) * dimension), m, k);
             if (i % 10000 == 0) {
-                printf("Inserted %d nodes\n", i);
+                printf("Inserted %zu nodes\n", i);
             }
-            i++;
         }
 
         auto end = std::chrono::high_resolution_clock::now();
         buildTime = end - start;
     }
 
-    void SmallWorldNG::insert(std::vector<float> nodeEmbedding, int m, int k) {
+    void SmallWorldNG::insert(std::vector<float> rawEmbedding, int m, int k) {
+        std::vector<float> nodeEmbedding(dimension);
+        reduction.reduceVector(rawEmbedding.data(), nodeEmbedding.data());
         auto node = std::make_unique<Node>();
-        node->embedding = nodeEmbedding;
+        node->embedding = vectors.add(nodeEmbedding.data());
+        encode(node.get());
         node->id = id++;
         node->children = std::unordered_set<Node*>();
         if (nodes.size() < k) {
             for (auto &n: nodes) {
-                n->children.insert(node.get());
-                node->children.insert(n.get());
+                link(n.get(), node.get());
+                link(node.get(), n.get());
             }
             nodes.push_back(std::move(node));
             return;
         }
 
-        auto result = greedyKnnSearch(nodeEmbedding, m, k);
-        for (auto record: result.nodes) {
-            node->children.insert(record.item);
-            record.item->children.insert(node.get());
+        ScopedArena arena;
+        MinQueue<Node *> neighbors(k, arena.get());
+        greedyKnnSearch(nodeEmbedding.data(), m, k, random, {}, neighbors, arena.get());
+        for (auto record: neighbors.getRecords()) {
+            link(node.get(), record.item);
+            link(record.item, node.get());
         }
         nodes.push_back(std::move(node));
     }
 
-    Result SmallWorldNG::trueKnnSearch(std::vector<float> &query, int k) {
-        MinQueue<Node *> result(k);
+    Result SmallWorldNG::trueKnnSearch(std::vector<float> &rawQuery, int k) {
+        ScopedArena arena;
+        auto query = prepare(rawQuery, arena.get());
+        MinQueue<Node *> nearest(k, arena.get());
         auto start = std::chrono::high_resolution_clock::now();
         for (auto &node: nodes) {
-            auto dist = Utils::l2_distance(node->embedding, query);
-            result.insert({node.get(), dist});
+            auto dist = vectors.distance(query.data(), node->embedding);
+            nearest.insert({node.get(), dist});
         }
-        auto end = std::chrono::high_resolution_clock::now();
-        return Result{result.getRecords(), end - start, nodes.size(), 0, 0};
+        Result result;
+        toResult(nearest.getRecords(), k, result);
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = nodes.size();
+        result.hops = 0;
+        result.depth = 0;
+        return result;
+    }
+
+    Result SmallWorldNG::beamKnnSearch(std::vector<float> &rawQuery, int b, int k, const SearchBudget &budget) {
+        Result result;
+        beamKnnSearch(rawQuery, b, k, result, budget);
+        return result;
     }
 
-    Result SmallWorldNG::beamKnnSearch(std::vector<float> &query, int b, int k) {
-        MinQueue<Node *> beam(b);
-        std::unordered_set<int> visited;
+    void SmallWorldNG::beamKnnSearch(std::vector<float> &rawQuery, int b, int k, Result &result, const SearchBudget &searchBudget) {
+        ScopedArena arena;
+        auto query = prepare(rawQuery, arena.get());
+        BudgetTracker budget(searchBudget);
+        MinQueue<Node *> beam(b, arena.get());
+        std::pmr::unordered_set<int> visited(arena.get());
+        std::pmr::vector<Node *> unvisited(arena.get());
         size_t nodesVisited = 0;
         auto start = std::chrono::high_resolution_clock::now();
         size_t maxDepth = 0;
@@ -79,27 +91,28 @@ namespace vector_index::small_world {
                 break;
             }
             int entryPointIdx = Utils::rand_int(0, nodes.size() - 1);
-            while (visited.contains(entryPointIdx)) {
+            while (visited.contains(nodes.at(entryPointIdx)->id)) {
                 entryPointIdx = Utils::rand_int(0, nodes.size() - 1);
             }
-            auto entryPoint = Record<Node*>{nodes.at(entryPointIdx).get(), Utils::l2_distance(nodes.at(entryPointIdx).get()->embedding, query)};
+            auto entryPoint = Record<Node*>{nodes.at(entryPointIdx).get(), distance(nodes.at(entryPointIdx).get(), query.data())};
             nodesVisited++;
             beam.insert(entryPoint);
             visited.insert(entryPoint.item->id);
         }
 
-        while (true) {
+        while (!budget.isExhausted()) {
             auto closestDistance = beam.last().distance;
-            MinQueue<Node *> newBeam(b);
+            MinQueue<Node *> newBeam(b, arena.get());
             auto flag = false;
             for (auto record: beam.getRecords()) {
-                for (auto childNode: record.item->children) {
-                    if (visited.contains(childNode->id)) {
-                        continue;
-                    }
-                    auto child = Record<Node *>{childNode, Utils::l2_distance(childNode->embedding, query)};
+                if (!budget.allowHop(nodesVisited)) {
+                    break;
+                }
+                collectUnvisited(record.item, visited, unvisited);
+                for (size_t j = 0; j < unvisited.size(); j++) {
+                    prefetchAhead(unvisited, j);
+                    auto child = Record<Node *>{unvisited[j], distance(unvisited[j], query.data())};
                     nodesVisited++;
-                    visited.insert(childNode->id);
                     newBeam.insert(child);
                     flag = true;
                 }
@@ -115,19 +128,22 @@ namespace vector_index::small_world {
             }
         }
 
-        // copy beam to result
-        MinQueue<Node *> result(k);
-        for (auto nodeWithDistance: beam.getRecords()) {
-            result.insert(nodeWithDistance);
-        }
-
-        return Result{result.getRecords(), std::chrono::high_resolution_clock::now() - start, nodesVisited, 0, maxDepth};
+        topK(beam.getRecords(), query.data(), k, result, arena.get());
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = nodesVisited;
+        result.hops = budget.getHops();
+        result.depth = maxDepth;
+        result.partial = budget.isExhausted();
     }
 
-    Result SmallWorldNG::beamKnnSearch2(std::vector<float> &query, int b, int k) {
-        MinQueue<Node *> beam(b);
-        MinQueue<Node *> result(k);
-        std::unordered_set<int> visited;
+    Result SmallWorldNG::beamKnnSearch2(std::vector<float> &rawQuery, int b, int k, const SearchBudget &searchBudget) {
+        ScopedArena arena;
+        auto query = prepare(rawQuery, arena.get());
+        BudgetTracker budget(searchBudget);
+        MinQueue<Node *> beam(b, arena.get());
+        MinQueue<Node *> candidates(k, arena.get());
+        std::pmr::unordered_set<int> visited(arena.get());
+        std::pmr::vector<Node *> unvisited(arena.get());
         size_t nodesVisited = 0;
         auto start = std::chrono::high_resolution_clock::now();
         size_t maxDepth = 0;
@@ -136,33 +152,34 @@ namespace vector_index::small_world {
                 break;
             }
             int entryPointIdx = Utils::rand_int(0, nodes.size() - 1);
-            while (visited.contains(entryPointIdx)) {
+            while (visited.contains(nodes.at(entryPointIdx)->id)) {
                 entryPointIdx = Utils::rand_int(0, nodes.size() - 1);
             }
-            auto entryPoint = Record<Node*>{nodes.at(entryPointIdx).get(), Utils::l2_distance(nodes.at(entryPointIdx).get()->embedding, query)};
+            auto entryPoint = Record<Node*>{nodes.at(entryPointIdx).get(), distance(nodes.at(entryPointIdx).get(), query.data())};
             nodesVisited++;
             beam.insert(entryPoint);
-            result.insert(entryPoint);
+            candidates.insert(entryPoint);
             visited.insert(entryPoint.item->id);
         }
 
-        while (true) {
+        while (!budget.isExhausted()) {
             double closestDistance = INFINITY;
-            if (result.size() >= k) {
-                closestDistance = result.last().distance;
+            if (candidates.size() >= k) {
+                closestDistance = candidates.last().distance;
             }
-            MinQueue<Node *> newBeam(b);
+            MinQueue<Node *> newBeam(b, arena.get());
             auto flag = false;
             for (auto record: beam.getRecords()) {
-                for (auto childNode: record.item->children) {
-                    if (visited.contains(childNode->id)) {
-                        continue;
-                    }
-                    auto child = Record<Node *>{childNode, Utils::l2_distance(childNode->embedding, query)};
+                if (!budget.allowHop(nodesVisited)) {
+                    break;
+                }
+                collectUnvisited(record.item, visited, unvisited);
+                for (size_t j = 0; j < unvisited.size(); j++) {
+                    prefetchAhead(unvisited, j);
+                    auto child = Record<Node *>{unvisited[j], distance(unvisited[j], query.data())};
                     nodesVisited++;
-                    visited.insert(childNode->id);
                     newBeam.insert(child);
-                    result.insert(child);
+                    candidates.insert(child);
                     flag = true;
                 }
             }
@@ -172,20 +189,29 @@ namespace vector_index::small_world {
             for (auto record: newBeam.getRecords()) {
                 beam.insert(record);
             }
-            if (result.last().distance >= closestDistance) {
+            if (candidates.last().distance >= closestDistance) {
                 break;
             }
         }
 
-        return Result{result.getRecords(), std::chrono::high_resolution_clock::now() - start, nodesVisited, 0, maxDepth};
+        Result result;
+        topK(candidates.getRecords(), query.data(), k, result, arena.get());
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = nodesVisited;
+        result.hops = budget.getHops();
+        result.depth = maxDepth;
+        result.partial = budget.isExhausted();
+        return result;
     }
 
-    Result SmallWorldNG::someOtherKnnSearch(std::vector<float> &query, int b, int k) {
-        MinQueue<Node *> beam(b);
+    Result SmallWorldNG::someOtherKnnSearch(std::vector<float> &rawQuery, int b, int k, const SearchBudget &searchBudget) {
+        ScopedArena arena;
+        auto query = prepare(rawQuery, arena.get());
+        BudgetTracker budget(searchBudget);
+        MinQueue<Node *> beam(b, arena.get());
         std::priority_queue<Record<Node*>> candidates;
-        std::unordered_set<int> visited;
-        size_t hops = 0;
-        size_t maxDepth = 0;
+        std::pmr::unordered_set<int> visited(arena.get());
+        std::pmr::vector<Node *> unvisited(arena.get());
         size_t nodesVisited = 0;
         auto start = std::chrono::high_resolution_clock::now();
         for (int i = 0; i < b; i++) {
@@ -193,10 +219,10 @@ namespace vector_index::small_world {
                 break;
             }
             int entryPointIdx = Utils::rand_int(0, nodes.size() - 1);
-            while (visited.contains(entryPointIdx)) {
+            while (visited.contains(nodes.at(entryPointIdx)->id)) {
                 entryPointIdx = Utils::rand_int(0, nodes.size() - 1);
             }
-            auto entryPoint = Record<Node*>{nodes.at(entryPointIdx).get(), Utils::l2_distance(nodes.at(entryPointIdx).get()->embedding, query)};
+            auto entryPoint = Record<Node*>{nodes.at(entryPointIdx).get(), distance(nodes.at(entryPointIdx).get(), query.data())};
             nodesVisited++;
             beam.insert(entryPoint);
             visited.insert(entryPoint.item->id);
@@ -209,40 +235,54 @@ namespace vector_index::small_world {
             if (beam.size() >= b && beam.last().distance < closest.distance) {
                 break;
             }
+            if (!budget.allowHop(nodesVisited)) {
+                break;
+            }
+            if (prefetchDistance > 0 && !candidates.empty()) {
+                prefetchNeighbors(candidates.top().item);
+            }
 
-            for (auto childNode: closest.item->children) {
-                if (visited.contains(childNode->id)) {
-                    continue;
-                }
-                auto child = Record<Node *>{childNode, Utils::l2_distance(childNode->embedding, query)};
+            collectUnvisited(closest.item, visited, unvisited);
+            for (size_t j = 0; j < unvisited.size(); j++) {
+                prefetchAhead(unvisited, j);
+                auto child = Record<Node *>{unvisited[j], distance(unvisited[j], query.data())};
                 nodesVisited++;
-                visited.insert(childNode->id);
                 candidates.push(child);
                 beam.insert(child);
             }
         }
 
-        // copy beam to result
-        MinQueue<Node *> result(k);
-        for (auto nodeWithDistance: beam.getRecords()) {
-            result.insert(nodeWithDistance);
-        }
+        Result result;
+        topK(beam.getRecords(), query.data(), k, result, arena.get());
+        result.searchTime = std::chrono::high_resolution_clock::now() - start;
+        result.nodesVisited = nodesVisited;
+        result.hops = budget.getHops();
+        result.depth = 0;
+        result.partial = budget.isExhausted();
+        return result;
+    }
 
-        auto end = std::chrono::high_resolution_clock::now();
-        return Result{result.getRecords(), end - start, nodesVisited, 0, 0};
+    Result SmallWorldNG::greedyKnnSearch(std::vector<float> &rawQuery, int m, int k, const SearchBudget &budget) {
+        ScopedArena arena;
+        auto query = prepare(rawQuery, arena.get());
+        MinQueue<Node *> nearest(k, arena.get());
+        auto result = greedyKnnSearch(query.data(), m, k, Utils::thread_random(), budget, nearest, arena.get());
+        topK(nearest.getRecords(), query.data(), k, result, arena.get());
+        return result;
     }
 
-    Result SmallWorldNG::greedyKnnSearch(std::vector<float> &query, int m, int k) {
-        std::unordered_set<int> visited;
-        MinQueue<Node *> result(k);
+    Result SmallWorldNG::greedyKnnSearch(const float* query, int m, int k, Random &random, const SearchBudget &searchBudget, MinQueue<Node*> &nearest, std::pmr::memory_resource* resource) {
+        BudgetTracker budget(searchBudget);
+        std::pmr::unordered_set<int> visited(resource);
+        std::pmr::vector<Node *> unvisited(resource);
         size_t hops = 0;
         size_t maxDepth = 0;
         size_t nodesVisited = 0;
         auto start = std::chrono::high_resolution_clock::now();
-        for (int i = 0; i < m; i++) {
-            MinQueue<Node *> tmpResult(k);
-            MinQueue<Node *> candidates(k + 1);
-            int rand = Utils::rand_int(0, nodes.size() - 1);
+        for (int i = 0; i < m && !budget.isExhausted(); i++) {
+            MinQueue<Node *> tmpResult(k, resource);
+            MinQueue<Node *> candidates(k + 1, resource);
+            int rand = random.nextInt(0, nodes.size() - 1);
             if (visited.size() >= nodes.size()) {
                 break;
             }
@@ -250,7 +290,7 @@ namespace vector_index::small_world {
 //                rand = Utils::rand_int(0, nodes.size() - 1);
 //            }
             auto entrypoint = nodes.at(rand).get();
-            candidates.insert({entrypoint, Utils::l2_distance(entrypoint->embedding, query)});
+            candidates.insert({entrypoint, distance(entrypoint, query)});
             nodesVisited++;
             size_t depth = 0;
             while (candidates.size() != 0) {
@@ -258,16 +298,20 @@ namespace vector_index::small_world {
                 if (tmpResult.size() >= k && tmpResult.last().distance < closest.distance) {
                     break;
                 }
+                if (!budget.allowHop(nodesVisited)) {
+                    break;
+                }
 //                if (result.size() >= k && result.last().distance < closest.distance) {
 //                    break;
 //                }
+                if (prefetchDistance > 0 && candidates.size() > 0) {
+                    prefetchNeighbors(candidates.first().item);
+                }
                 auto countDepth = false;
-                for (auto childNode: closest.item->children) {
-                    if (visited.contains(childNode->id)) {
-                        continue;
-                    }
-                    auto child = Record<Node*>{childNode, Utils::l2_distance(childNode->embedding, query)};
-                    visited.insert(childNode->id);
+                collectUnvisited(closest.item, visited, unvisited);
+                for (size_t j = 0; j < unvisited.size(); j++) {
+                    prefetchAhead(unvisited, j);
+                    auto child = Record<Node*>{unvisited[j], distance(unvisited[j], query)};
                     candidates.insert(child);
                     tmpResult.insert(child);
                     hops++;
@@ -282,11 +326,153 @@ namespace vector_index::small_world {
 
             // push top k nodes from tmpResult to result
             for (auto nodeWithDistance: tmpResult.getRecords()) {
-                result.insert(nodeWithDistance);
+                nearest.insert(nodeWithDistance);
             }
         }
         auto end = std::chrono::high_resolution_clock::now();
-        return Result{result.getRecords(), end - start, nodesVisited, hops / m, maxDepth};
+        return Result{{}, {}, end - start, nodesVisited, hops / m, maxDepth, budget.isExhausted()};
+    }
+
+    void SmallWorldNG::collectUnvisited(Node *node, std::pmr::unordered_set<int> &visited, std::pmr::vector<Node *> &unvisited) {
+        unvisited.clear();
+        for (auto childNode: node->neighbors) {
+            if (visited.contains(childNode->id)) {
+                continue;
+            }
+            visited.insert(childNode->id);
+            unvisited.push_back(childNode);
+        }
+        for (size_t i = 0; i < std::min(prefetchDistance, unvisited.size()); i++) {
+            prefetchEmbedding(unvisited[i]);
+        }
+    }
+
+    void SmallWorldNG::link(Node *from, Node *to) {
+        if (from->children.insert(to).second) {
+            from->neighbors.push_back(to);
+        }
+    }
+
+    void SmallWorldNG::prefetchNeighbors(const Node *node) {
+        // The node itself is usually cached, its distance was computed when it became a candidate.
+        Utils::prefetch(node->neighbors.data(), node->neighbors.size() * sizeof(Node *));
+    }
+
+    void SmallWorldNG::prefetchAhead(std::pmr::vector<Node *> &unvisited, size_t i) {
+        if (i + prefetchDistance < unvisited.size()) {
+            prefetchEmbedding(unvisited[i + prefetchDistance]);
+        }
+    }
+
+    void SmallWorldNG::reorder(reorder::Ordering ordering) {
+        if (nodes.empty()) {
+            return;
+        }
+        std::unordered_map<Node*, int> positions;
+        for (int i = 0; i < nodes.size(); i++) {
+            positions[nodes[i].get()] = i;
+        }
+        std::vector<std::vector<int>> adjacency(nodes.size());
+        for (int i = 0; i < nodes.size(); i++) {
+            for (auto child: nodes[i]->children) {
+                adjacency[i].push_back(positions[child]);
+            }
+        }
+        auto order = reorder::computeOrder(adjacency, ordering);
+
+        // Allocate the nodes and copy the embeddings in the new order, then rebuild the links.
+        VectorStore reorderedVectors(dimension, vectors.getType(), vectors.getMetric());
+        std::unique_ptr<CodeStore> reorderedCodes;
+        if (quantizer) {
+            reorderedCodes = std::make_unique<CodeStore>(quantizer->getCodeSize());
+        }
+        std::vector<std::unique_ptr<Node>> reorderedNodes(nodes.size());
+        std::vector<Node*> moved(nodes.size());
+        for (int i = 0; i < order.size(); i++) {
+            auto &node = nodes[order[i]];
+            reorderedNodes[i] = std::make_unique<Node>();
+            reorderedNodes[i]->id = node->id;
+            reorderedNodes[i]->embedding = reorderedVectors.copy(node->embedding);
+            if (quantizer) {
+                reorderedNodes[i]->code = reorderedCodes->add(node->code);
+            }
+            moved[order[i]] = reorderedNodes[i].get();
+        }
+        for (int i = 0; i < order.size(); i++) {
+            for (auto child: nodes[order[i]]->neighbors) {
+                link(reorderedNodes[i].get(), moved[positions[child]]);
+            }
+        }
+        nodes = std::move(reorderedNodes);
+        vectors = std::move(reorderedVectors);
+        codes = std::move(reorderedCodes);
+    }
+
+    void SmallWorldNG::quantize(ScalarQuantizerType type) {
+        if (vectors.getMetric() == Metric::INNER_PRODUCT) {
+            throw std::logic_error("Quantizers approximate L2 distances, not inner products");
+        }
+        std::vector<float> data(nodes.size() * dimension);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            vectors.decode(nodes[i]->embedding, data.data() + i * dimension);
+        }
+        quantizer = std::make_unique<ScalarQuantizer>(dimension, type);
+        quantizer->train(data.data(), nodes.size());
+        codes = std::make_unique<CodeStore>(quantizer->getCodeSize());
+        for (auto &node: nodes) {
+            encode(node.get());
+        }
+    }
+
+    void SmallWorldNG::encode(Node *node) {
+        if (!quantizer) {
+            return;
+        }
+        std::vector<float> embedding(dimension);
+        vectors.decode(node->embedding, embedding.data());
+        std::vector<uint8_t> code(quantizer->getCodeSize());
+        quantizer->encode(embedding.data(), code.data());
+        node->code = codes->add(code.data());
+    }
+
+    void SmallWorldNG::prefetchEmbedding(Node *node) {
+        if (quantizer) {
+            Utils::prefetch(node->code, quantizer->getCodeSize());
+        } else {
+            Utils::prefetch(node->embedding, vectors.getRecordSize());
+        }
+    }
+
+    std::pmr::vector<float> SmallWorldNG::prepare(const std::vector<float> &query, std::pmr::memory_resource* resource) {
+        std::pmr::vector<float> reduced(dimension, resource);
+        reduction.reduceQuery(query.data(), reduced.data());
+        return reduced;
+    }
+
+    void SmallWorldNG::topK(const RecordSet<Node*> &candidates, const float* query, int k, Result &result, std::pmr::memory_resource* resource) {
+        auto records = &candidates;
+        MinQueue<Node*> reranked(k, resource);
+        if (quantizer) {
+            // The candidates were ranked on codes, re-rank them with the full precision embeddings.
+            for (auto candidate: candidates) {
+                reranked.insert(Record<Node*>{candidate.item, vectors.distance(query, candidate.item->embedding)});
+            }
+            records = &reranked.getRecords();
+        }
+        toResult(*records, k, result);
+    }
+
+    void SmallWorldNG::toResult(const RecordSet<Node*> &records, int k, Result &result) {
+        result.ids.clear();
+        result.distances.clear();
+        for (auto &record: records) {
+            if (result.ids.size() >= k) {
+                break;
+            }
+            result.ids.push_back(record.item->id);
+            // toMetric is increasing, the order is kept. The query norm only matters to reduced inner products.
+            result.distances.push_back(reduction.getMetric() == Metric::COSINE ? reduction.toMetric(record.distance, 0) : record.distance);
+        }
     }
 
     void SmallWorldNG::getGraphStats(size_t &avgDegree, size_t &maxDegree, size_t &minDegree) {
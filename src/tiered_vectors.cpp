@@ -0,0 +1,222 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include "include/tiered_vectors.h"
+#include "include/async_reader.h"
+#include "include/utils.h"
+
+namespace vector_index {
+    // Cold reads of the calling thread: its reader and the buffer the records are read into.
+    struct ColdScratch {
+        std::unique_ptr<io::AsyncReader> reader;
+        void* buffer = nullptr;
+        size_t capacity = 0;
+        std::vector<io::Completion> completions;
+
+        ~ColdScratch() {
+            std::free(buffer);
+        }
+
+        uint8_t* reserve(size_t bytes) {
+            if (bytes > capacity) {
+                std::free(buffer);
+                capacity = (bytes + io::SECTOR_SIZE - 1) / io::SECTOR_SIZE * io::SECTOR_SIZE;
+                buffer = std::aligned_alloc(io::SECTOR_SIZE, capacity);
+                if (buffer == nullptr) {
+                    capacity = 0;
+                    throw std::bad_alloc();
+                }
+            }
+            return static_cast<uint8_t*>(buffer);
+        }
+    };
+
+    static thread_local ColdScratch coldScratch;
+
+    // Sampling is random rather than every n-th fetch, a repeated search would otherwise count the same
+    // records every time and never the others.
+    static thread_local uint64_t visitSeed = 0x853c49e6748fea9bULL;
+
+    HotTier::HotTier(size_t numRecords, size_t capacity, size_t recordSize): slots(numRecords, -1), data(std::max<size_t>(capacity * recordSize, 1), getPagePolicy()), numHot(0) {}
+
+    TieredVectors::TieredVectors(const std::string &path, size_t recordSize, size_t numRecords, const std::function<const void*(size_t)> &record, size_t hotBudget, const TieringOptions &options):
+            path(path), recordSize(recordSize), numRecords(numRecords), capacity(recordSize == 0 ? 0 : hotBudget / recordSize), options(options),
+            hotReads(0), coldReads(0), promotions(0), demotions(0), stopping(false) {
+        if (recordSize == 0 || options.queueDepth == 0) {
+            throw std::invalid_argument("Record size and queue depth must be positive");
+        }
+        int out = Utils::open_file(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (out < 0) {
+            throw std::runtime_error("Cannot create " + path + ": " + strerror(errno));
+        }
+        auto alignment = options.mode == io::IoMode::DIRECT ? io::directIoAlignment(out) : 1;
+        stride = (recordSize + alignment - 1) / alignment * alignment;
+        // Written in batches of records, each padded to the stride.
+        size_t batchSize = 1024;
+        std::vector<uint8_t> batch(batchSize * stride, 0);
+        for (size_t first = 0; first < numRecords; first += batchSize) {
+            auto count = std::min(batchSize, numRecords - first);
+            for (size_t i = 0; i < count; i++) {
+                memcpy(batch.data() + i * stride, record(first + i), recordSize);
+            }
+            if (pwrite(out, batch.data(), count * stride, (off_t) (first * stride)) != (ssize_t) (count * stride)) {
+                Utils::close(out);
+                throw std::runtime_error("Cannot write " + path + ": " + strerror(errno));
+            }
+        }
+        Utils::close(out);
+        fd = io::openFile(path.c_str(), options.mode);
+        visits = std::make_unique<std::atomic<uint32_t>[]>(numRecords);
+        hot.store(std::make_shared<const HotTier>(numRecords, 0, recordSize));
+        if (options.rebalanceInterval.count() > 0) {
+            rebalancer = std::thread(&TieredVectors::rebalanceLoop, this);
+        }
+    }
+
+    TieredVectors::~TieredVectors() {
+        {
+            std::lock_guard<std::mutex> lock(stopMutex);
+            stopping = true;
+        }
+        stopCondition.notify_all();
+        if (rebalancer.joinable()) {
+            rebalancer.join();
+        }
+        Utils::close(fd);
+        unlink(path.c_str());
+    }
+
+    std::shared_ptr<const HotTier> TieredVectors::snapshot() const {
+        return hot.load(std::memory_order_acquire);
+    }
+
+    void TieredVectors::addVisits(int id, uint32_t count) {
+        visits[id].fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void TieredVectors::fetch(const HotTier &tier, const int* ids, size_t n, const void** records) {
+        size_t numCold = 0;
+        auto hotData = static_cast<const uint8_t*>(tier.data.get());
+        for (size_t i = 0; i < n; i++) {
+            visitSeed = visitSeed * 6364136223846793005ULL + 1442695040888963407ULL;
+            if ((visitSeed >> 32) % VISIT_SAMPLE == 0) {
+                visits[ids[i]].fetch_add(VISIT_SAMPLE, std::memory_order_relaxed);
+            }
+            auto slot = tier.slots[ids[i]];
+            if (slot >= 0) {
+                records[i] = hotData + (size_t) slot * recordSize;
+            } else {
+                records[i] = nullptr;
+                numCold++;
+            }
+        }
+        hotReads.fetch_add(n - numCold, std::memory_order_relaxed);
+        if (numCold == 0) {
+            return;
+        }
+        coldReads.fetch_add(numCold, std::memory_order_relaxed);
+
+        auto &scratch = coldScratch;
+        if (!scratch.reader) {
+            io::AsyncReaderOptions readerOptions;
+            readerOptions.queueDepth = options.queueDepth;
+            scratch.reader = io::makeAsyncReader(readerOptions);
+        }
+        auto buffer = scratch.reserve(numCold * stride);
+        size_t issued = 0, completed = 0;
+        bool failed = false;
+        auto reap = [&](size_t minCompletions) {
+            scratch.completions.clear();
+            completed += scratch.reader->reap(scratch.completions, minCompletions);
+            for (auto &completion: scratch.completions) {
+                failed |= completion.result < (int64_t) recordSize;
+            }
+        };
+        for (size_t i = 0; i < n; i++) {
+            if (records[i] != nullptr) {
+                continue;
+            }
+            auto target = buffer + issued * stride;
+            records[i] = target;
+            io::ReadRequest request{fd, target, stride, (uint64_t) ids[i] * stride, i};
+            while (!scratch.reader->read(request)) {
+                reap(1);
+            }
+            issued++;
+        }
+        // Every read is reaped, even after a failure, so that the reader is idle for the next fetch.
+        while (completed < issued) {
+            reap(issued - completed);
+        }
+        if (failed) {
+            throw std::runtime_error("Reading cold records from " + path + " failed");
+        }
+    }
+
+    void TieredVectors::rebalance() {
+        std::lock_guard<std::mutex> lock(rebalanceMutex);
+        auto old = hot.load(std::memory_order_acquire);
+        auto numHot = std::min(capacity, numRecords);
+        std::vector<uint32_t> counts(numRecords);
+        for (size_t i = 0; i < numRecords; i++) {
+            counts[i] = visits[i].load(std::memory_order_relaxed);
+        }
+        std::vector<int> order(numRecords);
+        std::iota(order.begin(), order.end(), 0);
+        std::nth_element(order.begin(), order.begin() + numHot, order.end(), [&](int a, int b) {
+            return counts[a] > counts[b] || (counts[a] == counts[b] && a < b);
+        });
+
+        auto tier = std::make_shared<HotTier>(numRecords, numHot, recordSize);
+        auto data = static_cast<uint8_t*>(tier->data.get());
+        auto oldData = static_cast<const uint8_t*>(old->data.get());
+        auto buffer = static_cast<uint8_t*>(std::aligned_alloc(io::SECTOR_SIZE, (stride + io::SECTOR_SIZE - 1) / io::SECTOR_SIZE * io::SECTOR_SIZE));
+        size_t promoted = 0;
+        for (size_t slot = 0; slot < numHot; slot++) {
+            auto id = order[slot];
+            auto target = data + slot * recordSize;
+            if (old->slots[id] >= 0) {
+                memcpy(target, oldData + (size_t) old->slots[id] * recordSize, recordSize);
+            } else {
+                if (Utils::read(fd, buffer, stride, (off_t) ((size_t) id * stride)) < (int) recordSize) {
+                    std::free(buffer);
+                    throw std::runtime_error("Reading cold records from " + path + " failed");
+                }
+                memcpy(target, buffer, recordSize);
+                promoted++;
+            }
+            tier->slots[id] = (int32_t) slot;
+        }
+        std::free(buffer);
+        tier->numHot = numHot;
+        promotions.fetch_add(promoted, std::memory_order_relaxed);
+        demotions.fetch_add(old->numHot + promoted - numHot, std::memory_order_relaxed);
+        hot.store(std::move(tier), std::memory_order_release);
+        // Concurrent visits may be halved along, the counts only rank the records.
+        for (size_t i = 0; i < numRecords; i++) {
+            visits[i].store(counts[i] / 2 + (visits[i].load(std::memory_order_relaxed) - counts[i]), std::memory_order_relaxed);
+        }
+    }
+
+    void TieredVectors::rebalanceLoop() {
+        std::unique_lock<std::mutex> lock(stopMutex);
+        while (!stopCondition.wait_for(lock, options.rebalanceInterval, [&]() { return stopping; })) {
+            lock.unlock();
+            try {
+                rebalance();
+            } catch (const std::runtime_error &) {
+                // The current hot tier stays, the next period retries.
+            }
+            lock.lock();
+        }
+    }
+
+    TierStats TieredVectors::getStats() const {
+        return TierStats{hotReads.load(), coldReads.load(), promotions.load(), demotions.load(), snapshot()->numHot};
+    }
+} // namespace vector_index
@@ -0,0 +1,96 @@
+#include <sched.h>
+#include "include/topology.h"
+
+#ifdef VECTOR_INDEX_HAVE_NUMA
+#include <numa.h>
+#endif
+
+namespace vector_index::numa {
+    // Kernel node ids of the nodes that have CPUs, and their CPUs.
+    struct Topology {
+        std::vector<int> nodeIds;
+        std::vector<std::vector<int>> cpus;
+    };
+
+    static Topology discover() {
+        Topology topology;
+#ifdef VECTOR_INDEX_HAVE_NUMA
+        if (numa_available() >= 0) {
+            auto mask = numa_allocate_cpumask();
+            for (int node = 0; node <= numa_max_node(); node++) {
+                if (numa_node_to_cpus(node, mask) != 0) {
+                    continue;
+                }
+                std::vector<int> cpus;
+                for (int cpu = 0; cpu < (int) numa_num_possible_cpus(); cpu++) {
+                    if (numa_bitmask_isbitset(mask, cpu)) {
+                        cpus.push_back(cpu);
+                    }
+                }
+                if (!cpus.empty()) {
+                    topology.nodeIds.push_back(node);
+                    topology.cpus.push_back(cpus);
+                }
+            }
+            numa_free_cpumask(mask);
+        }
+#endif
+        if (topology.nodeIds.empty()) {
+            // The CPUs the process may run on.
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            sched_getaffinity(0, sizeof(set), &set);
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+            if (cpus.empty()) {
+                cpus.push_back(0);
+            }
+            topology.nodeIds.push_back(0);
+            topology.cpus.push_back(cpus);
+        }
+        return topology;
+    }
+
+    static const Topology &topology() {
+        static Topology topology = discover();
+        return topology;
+    }
+
+    bool available() {
+#ifdef VECTOR_INDEX_HAVE_NUMA
+        return numa_available() >= 0;
+#else
+        return false;
+#endif
+    }
+
+    size_t numNodes() {
+        return topology().nodeIds.size();
+    }
+
+    std::vector<int> nodeCpus(size_t node) {
+        return topology().cpus.at(node);
+    }
+
+    void pinToCpu(int cpu) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        // Best effort, e.g. the CPU may be outside of the cpuset of the process.
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    void bindToNode(size_t node) {
+#ifdef VECTOR_INDEX_HAVE_NUMA
+        if (available()) {
+            auto id = topology().nodeIds.at(node);
+            numa_run_on_node(id);
+            numa_set_preferred(id);
+        }
+#endif
+    }
+} // namespace vector_index::numa
@@ -0,0 +1,327 @@
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include "include/transform.h"
+
+namespace vector_index {
+    // Eigen decomposition of a symmetric matrix: Householder reduction to a tridiagonal matrix
+    // (tred2) then implicit QL iterations (tql2), ported from the public domain JAMA package.
+    // `v` holds the n x n matrix in column major order and is replaced by the eigenvectors (column j
+    // for eigenvalue d[j]), column major keeps the inner loops of both passes contiguous.
+    class SymmetricEigenSolver {
+    public:
+        SymmetricEigenSolver(size_t n, std::vector<double> &v): n(n), v(v), d(n), e(n) {
+            tred2();
+            tql2();
+        }
+
+        std::vector<double> &getEigenvalues() {
+            return d;
+        }
+
+    private:
+        inline double &at(size_t row, size_t column) {
+            return v[column * n + row];
+        }
+
+        void tred2() {
+            for (size_t j = 0; j < n; j++) {
+                d[j] = at(n - 1, j);
+            }
+            for (size_t i = n - 1; i > 0; i--) {
+                double scale = 0;
+                double h = 0;
+                for (size_t k = 0; k < i; k++) {
+                    scale += std::abs(d[k]);
+                }
+                if (scale == 0) {
+                    e[i] = d[i - 1];
+                    for (size_t j = 0; j < i; j++) {
+                        d[j] = at(i - 1, j);
+                        at(i, j) = 0;
+                        at(j, i) = 0;
+                    }
+                } else {
+                    // Generate the Householder vector.
+                    for (size_t k = 0; k < i; k++) {
+                        d[k] /= scale;
+                        h += d[k] * d[k];
+                    }
+                    double f = d[i - 1];
+                    double g = f > 0 ? -sqrt(h) : sqrt(h);
+                    e[i] = scale * g;
+                    h -= f * g;
+                    d[i - 1] = f - g;
+                    std::fill(e.begin(), e.begin() + i, 0);
+
+                    // Apply the similarity transformation to the remaining columns.
+                    for (size_t j = 0; j < i; j++) {
+                        f = d[j];
+                        at(j, i) = f;
+                        g = e[j] + at(j, j) * f;
+                        for (size_t k = j + 1; k < i; k++) {
+                            g += at(k, j) * d[k];
+                            e[k] += at(k, j) * f;
+                        }
+                        e[j] = g;
+                    }
+                    f = 0;
+                    for (size_t j = 0; j < i; j++) {
+                        e[j] /= h;
+                        f += e[j] * d[j];
+                    }
+                    double hh = f / (h + h);
+                    for (size_t j = 0; j < i; j++) {
+                        e[j] -= hh * d[j];
+                    }
+                    for (size_t j = 0; j < i; j++) {
+                        f = d[j];
+                        g = e[j];
+                        for (size_t k = j; k < i; k++) {
+                            at(k, j) -= f * e[k] + g * d[k];
+                        }
+                        d[j] = at(i - 1, j);
+                        at(i, j) = 0;
+                    }
+                }
+                d[i] = h;
+            }
+
+            // Accumulate the transformations.
+            for (size_t i = 0; i + 1 < n; i++) {
+                at(n - 1, i) = at(i, i);
+                at(i, i) = 1;
+                double h = d[i + 1];
+                if (h != 0) {
+                    for (size_t k = 0; k <= i; k++) {
+                        d[k] = at(k, i + 1) / h;
+                    }
+                    for (size_t j = 0; j <= i; j++) {
+                        double g = 0;
+                        for (size_t k = 0; k <= i; k++) {
+                            g += at(k, i + 1) * at(k, j);
+                        }
+                        for (size_t k = 0; k <= i; k++) {
+                            at(k, j) -= g * d[k];
+                        }
+                    }
+                }
+                for (size_t k = 0; k <= i; k++) {
+                    at(k, i + 1) = 0;
+                }
+            }
+            for (size_t j = 0; j < n; j++) {
+                d[j] = at(n - 1, j);
+                at(n - 1, j) = 0;
+            }
+            at(n - 1, n - 1) = 1;
+            e[0] = 0;
+        }
+
+        void tql2() {
+            for (size_t i = 1; i < n; i++) {
+                e[i - 1] = e[i];
+            }
+            e[n - 1] = 0;
+            double f = 0;
+            double tst1 = 0;
+            double eps = std::pow(2.0, -52.0);
+            for (size_t l = 0; l < n; l++) {
+                // Find a small subdiagonal element.
+                tst1 = std::max(tst1, std::abs(d[l]) + std::abs(e[l]));
+                size_t m = l;
+                while (m < n && std::abs(e[m]) > eps * tst1) {
+                    m++;
+                }
+                // If m == l, d[l] is an eigenvalue, otherwise iterate.
+                if (m > l) {
+                    do {
+                        // Compute the implicit shift.
+                        double g = d[l];
+                        double p = (d[l + 1] - g) / (2 * e[l]);
+                        double r = std::hypot(p, 1.0);
+                        if (p < 0) {
+                            r = -r;
+                        }
+                        d[l] = e[l] / (p + r);
+                        d[l + 1] = e[l] * (p + r);
+                        double dl1 = d[l + 1];
+                        double h = g - d[l];
+                        for (size_t i = l + 2; i < n; i++) {
+                            d[i] -= h;
+                        }
+                        f += h;
+
+                        // Implicit QL transformation.
+                        p = d[m];
+                        double c = 1, c2 = 1, c3 = 1;
+                        double el1 = e[l + 1];
+                        double s = 0, s2 = 0;
+                        for (size_t i = m; i-- > l;) {
+                            c3 = c2;
+                            c2 = c;
+                            s2 = s;
+                            g = c * e[i];
+                            h = c * p;
+                            r = std::hypot(p, e[i]);
+                            e[i + 1] = s * r;
+                            s = e[i] / r;
+                            c = p / r;
+                            p = c * d[i] - s * g;
+                            d[i + 1] = h + s * (c * g + s * d[i]);
+                            // Accumulate the transformation.
+                            auto left = v.data() + i * n;
+                            auto right = v.data() + (i + 1) * n;
+                            for (size_t k = 0; k < n; k++) {
+                                h = right[k];
+                                right[k] = s * left[k] + c * h;
+                                left[k] = c * left[k] - s * h;
+                            }
+                        }
+                        p = -s * s2 * c3 * el1 * e[l] / dl1;
+                        e[l] = s * p;
+                        d[l] = c * p;
+                    } while (std::abs(e[l]) > eps * tst1);
+                }
+                d[l] += f;
+                e[l] = 0;
+            }
+        }
+
+    private:
+        size_t n;
+        std::vector<double> &v;
+        std::vector<double> d;
+        std::vector<double> e;
+    };
+
+    VectorTransform::VectorTransform(size_t dimension, TransformType type, size_t outputDimension, uint64_t seed): dimension(dimension), type(type), outputDimension(outputDimension == 0 ? dimension : outputDimension), seed(seed), trained(false), mean(dimension, 0) {
+        if (this->outputDimension > dimension) {
+            throw std::invalid_argument("Transform output dimension larger than its input dimension");
+        }
+        if (type != TransformType::RANDOM_ROTATION) {
+            return;
+        }
+
+        // Gram-Schmidt on a gaussian matrix gives a uniformly random orthonormal basis.
+        Random random(seed);
+        std::vector<double> basis(this->outputDimension * dimension);
+        for (size_t i = 0; i < basis.size(); i += 2) {
+            // Box-Muller, nextDouble() is in [0, 1) so 1 - u is never 0.
+            auto radius = sqrt(-2 * log(1 - random.nextDouble()));
+            auto angle = 2 * M_PI * random.nextDouble();
+            basis[i] = radius * cos(angle);
+            if (i + 1 < basis.size()) {
+                basis[i + 1] = radius * sin(angle);
+            }
+        }
+        for (size_t i = 0; i < this->outputDimension; i++) {
+            auto row = basis.data() + i * dimension;
+            for (size_t j = 0; j < i; j++) {
+                auto previous = basis.data() + j * dimension;
+                auto dot = std::inner_product(row, row + dimension, previous, 0.0);
+                for (size_t l = 0; l < dimension; l++) {
+                    row[l] -= dot * previous[l];
+                }
+            }
+            auto norm = sqrt(std::inner_product(row, row + dimension, row, 0.0));
+            for (size_t l = 0; l < dimension; l++) {
+                row[l] /= norm;
+            }
+        }
+        matrix.resize(dimension * this->outputDimension);
+        for (size_t i = 0; i < this->outputDimension; i++) {
+            for (size_t j = 0; j < dimension; j++) {
+                matrix[j * this->outputDimension + i] = basis[i * dimension + j];
+            }
+        }
+        trained = true;
+    }
+
+    void VectorTransform::train(const float* data, size_t numVectors) {
+        if (type == TransformType::RANDOM_ROTATION) {
+            return;
+        }
+        if (numVectors == 0) {
+            throw std::invalid_argument("PCA needs training vectors");
+        }
+
+        Random random(seed);
+        std::vector<size_t> sample(numVectors);
+        std::iota(sample.begin(), sample.end(), 0);
+        auto numPoints = std::min(numVectors, MAX_TRAINING_VECTORS);
+        for (size_t i = 0; i < numPoints; i++) {
+            std::swap(sample[i], sample[random.nextInt(i, numVectors - 1)]);
+        }
+
+        std::vector<double> sum(dimension, 0);
+        for (size_t i = 0; i < numPoints; i++) {
+            for (size_t j = 0; j < dimension; j++) {
+                sum[j] += data[sample[i] * dimension + j];
+            }
+        }
+        for (size_t j = 0; j < dimension; j++) {
+            mean[j] = sum[j] / numPoints;
+        }
+
+        // Upper triangle of the covariance, mirrored below.
+        std::vector<double> covariance(dimension * dimension, 0);
+        std::vector<double> centered(dimension);
+        for (size_t i = 0; i < numPoints; i++) {
+            for (size_t j = 0; j < dimension; j++) {
+                centered[j] = data[sample[i] * dimension + j] - mean[j];
+            }
+            for (size_t j = 0; j < dimension; j++) {
+                auto row = covariance.data() + j * dimension;
+                for (size_t l = j; l < dimension; l++) {
+                    row[l] += centered[j] * centered[l];
+                }
+            }
+        }
+        for (size_t j = 0; j < dimension; j++) {
+            for (size_t l = j; l < dimension; l++) {
+                covariance[j * dimension + l] /= numPoints;
+                covariance[l * dimension + j] = covariance[j * dimension + l];
+            }
+        }
+
+        SymmetricEigenSolver solver(dimension, covariance);
+        auto &values = solver.getEigenvalues();
+        std::vector<size_t> order(dimension);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return values[a] > values[b];
+        });
+        eigenvalues.resize(outputDimension);
+        matrix.resize(dimension * outputDimension);
+        for (size_t i = 0; i < outputDimension; i++) {
+            eigenvalues[i] = values[order[i]];
+            // The eigenvectors are the columns of the solved matrix.
+            auto eigenvector = covariance.data() + order[i] * dimension;
+            for (size_t j = 0; j < dimension; j++) {
+                matrix[j * outputDimension + i] = eigenvector[j];
+            }
+        }
+        trained = true;
+    }
+
+    void VectorTransform::apply(const float* x, float* y) const {
+        std::fill(y, y + outputDimension, 0);
+        for (size_t j = 0; j < dimension; j++) {
+            auto centered = x[j] - mean[j];
+            auto row = matrix.data() + j * outputDimension;
+            for (size_t i = 0; i < outputDimension; i++) {
+                y[i] += centered * row[i];
+            }
+        }
+    }
+
+    std::vector<float> VectorTransform::apply(const float* data, size_t numVectors) const {
+        std::vector<float> transformed(numVectors * outputDimension);
+        for (size_t i = 0; i < numVectors; i++) {
+            apply(data + i * dimension, transformed.data() + i * outputDimension);
+        }
+        return transformed;
+    }
+} // namespace vector_index
@@ -7,19 +7,75 @@
 #include <sys/fcntl.h>
 #include <unistd.h>
 
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
 namespace vector_index {
     int* Utils::ivecs_read(const char *fname, size_t *d_out, size_t *n_out) {
         return (int*)fvecs_read(fname, d_out, n_out);
     }
 
     double Utils::l2_distance(std::vector<float> &a, std::vector<float> &b) {
-        double distance = 0;
-        for (int i = 0; i < a.size(); i++) {
+        return l2_distance(a.data(), b.data(), a.size());
+    }
+
+    double Utils::l2_distance(const float* a, const float* b, size_t d) {
+        // The same kernel as the bounded distance, so that a pair gets the same distance with any bound.
+        return l2_distance(a, b, d, INFINITY);
+    }
+
+#if defined(__AVX2__) && defined(__FMA__)
+    static inline float horizontalSum(__m256 v) {
+        auto sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+        return _mm_cvtss_f32(sum);
+    }
+#endif
+
+    double Utils::l2_distance(const float* a, const float* b, size_t d, double bound) {
+        auto boundSquared = bound * bound;
+        float distance = 0;
+        size_t i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+        auto acc = _mm256_setzero_ps();
+        for (; i + ABANDON_BLOCK <= d; i += ABANDON_BLOCK) {
+            for (size_t j = i; j < i + ABANDON_BLOCK; j += 8) {
+                auto diff = _mm256_sub_ps(_mm256_loadu_ps(a + j), _mm256_loadu_ps(b + j));
+                acc = _mm256_fmadd_ps(diff, diff, acc);
+            }
+            distance = horizontalSum(acc);
+            if (distance > boundSquared) {
+                return sqrt(distance);
+            }
+        }
+#endif
+        for (; i < d; i++) {
             distance += (a[i] - b[i]) * (a[i] - b[i]);
+            if ((i + 1) % ABANDON_BLOCK == 0 && distance > boundSquared) {
+                break;
+            }
         }
         return sqrt(distance);
     }
 
+    double Utils::inner_product(const float* a, const float* b, size_t d) {
+        float dot = 0;
+        size_t i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+        auto acc = _mm256_setzero_ps();
+        for (; i + 8 <= d; i += 8) {
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+        }
+        dot = horizontalSum(acc);
+#endif
+        for (; i < d; i++) {
+            dot += a[i] * b[i];
+        }
+        return dot;
+    }
+
     double Utils::cosine_distance(std::vector<float> &a, std::vector<float> &b) {
         double dot = 0.0, denom_a = 0.0, denom_b = 0.0 ;
         for (int i = 0; i < a.size(); i++) {
@@ -27,7 +83,7 @@ namespace vector_index {
             denom_a += a[i] * a[i] ;
             denom_b += b[i] * b[i] ;
         }
-        return dot / (sqrt(denom_a) * sqrt(denom_b)) ;
+        return 1 - dot / (sqrt(denom_a) * sqrt(denom_b)) ;
     }
 
     float* Utils::fvecs_read(const char *fname, size_t *d_out, size_t *n_out) {
@@ -61,18 +117,21 @@ namespace vector_index {
         return x;
     }
 
+    Random& Utils::thread_random() {
+        thread_local Random random(std::random_device{}());
+        return random;
+    }
+
+    void Utils::seed(uint64_t seed) {
+        thread_random().seed(seed);
+    }
+
     double Utils::rand_double() {
-        std::random_device r;
-        std::default_random_engine e1(r());
-        std::uniform_real_distribution<double> uniform_dist(0,1);
-        return uniform_dist(e1);
+        return thread_random().nextDouble();
     }
 
     int Utils::rand_int(int min, int max) {
-        std::random_device r;
-        std::default_random_engine e1(r());
-        std::uniform_int_distribution<int> uniform_dist(min,max);
-        return uniform_dist(e1);
+        return thread_random().nextInt(min, max);
     }
 
     int Utils::open_file(const char *fname, int flags, int mode) {
@@ -84,6 +143,6 @@ namespace vector_index {
     }
 
     int Utils::close(int fd) {
-        return close(fd);
+        return ::close(fd);
     }
 } // namespace vector_index
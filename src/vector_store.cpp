@@ -0,0 +1,262 @@
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include "include/vector_store.h"
+#include "include/utils.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+namespace vector_index {
+    static inline float halfToFloat(uint16_t h) {
+#if defined(__F16C__)
+        return _cvtsh_ss(h);
+#else
+        uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+        uint32_t exponent = (h >> 10) & 0x1f;
+        uint32_t mantissa = h & 0x3ff;
+        if (exponent == 0) {
+            // Zero or subnormal.
+            auto value = std::ldexp((float) mantissa, -24);
+            return sign ? -value : value;
+        }
+        uint32_t bits = exponent == 0x1f ? sign | 0x7f800000 | (mantissa << 13) : sign | ((exponent + 112) << 23) | (mantissa << 13);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+#endif
+    }
+
+    // Rounds to nearest even, like the F16C conversion.
+    static inline uint16_t floatToHalf(float value) {
+#if defined(__F16C__)
+        return _cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        int32_t exponent = (int32_t) ((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+        if (((bits >> 23) & 0xff) == 0xff) {
+            return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+        }
+        if (exponent >= 0x1f) {
+            return sign | 0x7c00;
+        }
+        uint32_t shift = 13;
+        if (exponent <= 0) {
+            if (exponent < -10) {
+                return sign;
+            }
+            // Subnormal, shift the implicit bit into the mantissa.
+            mantissa |= 0x800000;
+            shift = 14 - exponent;
+            exponent = 0;
+        }
+        uint32_t half = ((uint32_t) exponent << 10) | (mantissa >> shift);
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        // A carry out of the mantissa correctly bumps the exponent.
+        if (rest > halfway || (rest == halfway && (half & 1))) {
+            half++;
+        }
+        return sign | half;
+#endif
+    }
+
+    static inline float bf16ToFloat(uint16_t h) {
+        uint32_t bits = (uint32_t) h << 16;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Rounds to nearest even and keeps NaNs quiet.
+    static inline uint16_t floatToBf16(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        if ((bits & 0x7fffffff) > 0x7f800000) {
+            return (bits >> 16) | 0x40;
+        }
+        bits += 0x7fff + ((bits >> 16) & 1);
+        return bits >> 16;
+    }
+
+#if defined(__AVX2__) && defined(__FMA__)
+    static inline float horizontalSum(__m256 v) {
+        auto sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+        return _mm_cvtss_f32(sum);
+    }
+#endif
+
+    // With innerProduct the kernels return <query, x>. Otherwise they return the squared L2 distance and
+    // stop once the partial sum of a block of Utils::ABANDON_BLOCK dimensions exceeds boundSquared, the
+    // partial sum is returned then. A partial inner product bounds nothing, it is always complete.
+    template <bool innerProduct>
+    static float fp16Kernel(const float* query, const uint16_t* x, size_t dimension, float boundSquared) {
+        constexpr auto blockSize = Utils::ABANDON_BLOCK;
+        size_t j = 0;
+        float sum = 0;
+#if defined(__F16C__) && defined(__AVX2__) && defined(__FMA__)
+        auto acc = _mm256_setzero_ps();
+        for (; j + blockSize <= dimension; j += blockSize) {
+            for (size_t l = j; l < j + blockSize; l += 8) {
+                auto widened = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) (x + l)));
+                if constexpr (innerProduct) {
+                    acc = _mm256_fmadd_ps(_mm256_loadu_ps(query + l), widened, acc);
+                } else {
+                    auto diff = _mm256_sub_ps(_mm256_loadu_ps(query + l), widened);
+                    acc = _mm256_fmadd_ps(diff, diff, acc);
+                }
+            }
+            if constexpr (!innerProduct) {
+                sum = horizontalSum(acc);
+                if (sum > boundSquared) {
+                    return sum;
+                }
+            }
+        }
+        sum = horizontalSum(acc);
+#endif
+        for (; j < dimension; j++) {
+            if constexpr (innerProduct) {
+                sum += query[j] * halfToFloat(x[j]);
+            } else {
+                auto diff = query[j] - halfToFloat(x[j]);
+                sum += diff * diff;
+                if ((j + 1) % blockSize == 0 && sum > boundSquared) {
+                    break;
+                }
+            }
+        }
+        return sum;
+    }
+
+    template <bool innerProduct>
+    static float bf16Kernel(const float* query, const uint16_t* x, size_t dimension, float boundSquared) {
+        constexpr auto blockSize = Utils::ABANDON_BLOCK;
+        size_t j = 0;
+        float sum = 0;
+#if defined(__AVX512F__)
+        auto acc = _mm512_setzero_ps();
+        for (; j + blockSize <= dimension; j += blockSize) {
+            for (size_t l = j; l < j + blockSize; l += 16) {
+                auto widened = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*) (x + l))), 16));
+                if constexpr (innerProduct) {
+                    acc = _mm512_fmadd_ps(_mm512_loadu_ps(query + l), widened, acc);
+                } else {
+                    auto diff = _mm512_sub_ps(_mm512_loadu_ps(query + l), widened);
+                    acc = _mm512_fmadd_ps(diff, diff, acc);
+                }
+            }
+            if constexpr (!innerProduct) {
+                sum = _mm512_reduce_add_ps(acc);
+                if (sum > boundSquared) {
+                    return sum;
+                }
+            }
+        }
+        sum = _mm512_reduce_add_ps(acc);
+#elif defined(__AVX2__) && defined(__FMA__)
+        auto acc = _mm256_setzero_ps();
+        for (; j + blockSize <= dimension; j += blockSize) {
+            for (size_t l = j; l < j + blockSize; l += 8) {
+                auto widened = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) (x + l))), 16));
+                if constexpr (innerProduct) {
+                    acc = _mm256_fmadd_ps(_mm256_loadu_ps(query + l), widened, acc);
+                } else {
+                    auto diff = _mm256_sub_ps(_mm256_loadu_ps(query + l), widened);
+                    acc = _mm256_fmadd_ps(diff, diff, acc);
+                }
+            }
+            if constexpr (!innerProduct) {
+                sum = horizontalSum(acc);
+                if (sum > boundSquared) {
+                    return sum;
+                }
+            }
+        }
+        sum = horizontalSum(acc);
+#endif
+        for (; j < dimension; j++) {
+            if constexpr (innerProduct) {
+                sum += query[j] * bf16ToFloat(x[j]);
+            } else {
+                auto diff = query[j] - bf16ToFloat(x[j]);
+                sum += diff * diff;
+                if ((j + 1) % blockSize == 0 && sum > boundSquared) {
+                    break;
+                }
+            }
+        }
+        return sum;
+    }
+
+    static size_t bytesPerValue(StorageType type) {
+        return type == StorageType::FP32 ? sizeof(float) : sizeof(uint16_t);
+    }
+
+    VectorStore::VectorStore(size_t dimension, StorageType type, Metric metric): dimension(dimension), type(type), metric(metric), records(dimension * bytesPerValue(type)) {
+        if (metric == Metric::COSINE) {
+            throw std::invalid_argument("Cosine vectors are normalized and stored for L2");
+        }
+    }
+
+    const void* VectorStore::add(const float* x) {
+        if (type == StorageType::FP32) {
+            return records.add((const uint8_t*) x);
+        }
+        std::vector<uint16_t> converted(dimension);
+        for (size_t j = 0; j < dimension; j++) {
+            converted[j] = type == StorageType::FP16 ? floatToHalf(x[j]) : floatToBf16(x[j]);
+        }
+        return records.add((const uint8_t*) converted.data());
+    }
+
+    const void* VectorStore::copy(const void* record) {
+        return records.add((const uint8_t*) record);
+    }
+
+    void VectorStore::decode(const void* record, float* x) const {
+        if (type == StorageType::FP32) {
+            memcpy(x, record, dimension * sizeof(float));
+            return;
+        }
+        auto values = (const uint16_t*) record;
+        for (size_t j = 0; j < dimension; j++) {
+            x[j] = type == StorageType::FP16 ? halfToFloat(values[j]) : bf16ToFloat(values[j]);
+        }
+    }
+
+    double VectorStore::distance(const float* query, const void* record) const {
+        return prefixDistance(query, record, dimension);
+    }
+
+    double VectorStore::distance(const float* query, const void* record, double bound) const {
+        return prefixDistance(query, record, dimension, bound);
+    }
+
+    double VectorStore::prefixDistance(const float* query, const void* record, size_t numDimensions, double bound) const {
+        if (metric == Metric::INNER_PRODUCT) {
+            switch (type) {
+                case StorageType::FP16:
+                    return -fp16Kernel<true>(query, (const uint16_t*) record, numDimensions, INFINITY);
+                case StorageType::BF16:
+                    return -bf16Kernel<true>(query, (const uint16_t*) record, numDimensions, INFINITY);
+                default:
+                    return -Utils::inner_product(query, (const float*) record, numDimensions);
+            }
+        }
+        switch (type) {
+            case StorageType::FP16:
+                return sqrt(fp16Kernel<false>(query, (const uint16_t*) record, numDimensions, bound * bound));
+            case StorageType::BF16:
+                return sqrt(bf16Kernel<false>(query, (const uint16_t*) record, numDimensions, bound * bound));
+            default:
+                return Utils::l2_distance(query, (const float*) record, numDimensions, bound);
+        }
+    }
+} // namespace vector_index
@@ -0,0 +1,173 @@
+#include "gtest/gtest.h"
+#include "hnsw.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace vector_index;
+using namespace vector_index::hnsw;
+
+static std::vector<float> randomVectors(Random &random, size_t dimension, size_t numVectors) {
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    return data;
+}
+
+static std::vector<std::vector<int>> groundTruth(std::vector<float> &data, std::vector<std::vector<float>> &queries, size_t dimension, int k) {
+    auto numVectors = data.size() / dimension;
+    std::vector<std::vector<int>> truth;
+    std::vector<int> ids(numVectors);
+    std::vector<double> distances(numVectors);
+    for (auto &query: queries) {
+        for (size_t i = 0; i < numVectors; i++) {
+            distances[i] = Utils::l2_distance(query.data(), data.data() + i * dimension, dimension);
+        }
+        std::iota(ids.begin(), ids.end(), 0);
+        std::partial_sort(ids.begin(), ids.begin() + k, ids.end(), [&](int a, int b) {
+            return distances[a] < distances[b];
+        });
+        truth.emplace_back(ids.begin(), ids.begin() + k);
+    }
+    return truth;
+}
+
+static void evaluate(HNSW &index, std::vector<std::vector<float>> &queries, std::vector<std::vector<int>> &truth, int k, int efSearch, double &recall, double &meanVisited) {
+    size_t matches = 0, visited = 0;
+    for (size_t i = 0; i < queries.size(); i++) {
+        auto result = index.knnSearch(queries[i], k, efSearch);
+        for (auto id: result.ids) {
+            matches += std::find(truth[i].begin(), truth[i].end(), id) != truth[i].end();
+        }
+        visited += result.nodesVisited;
+    }
+    recall = (double) matches / (queries.size() * k);
+    meanVisited = (double) visited / queries.size();
+}
+
+TEST(AdaptiveTerminationTest, FewerDistancesAtTheSameRecall) {
+    size_t dimension = 32, numVectors = 20000, numQueries = 400;
+    int k = 10, maxEfSearch = 256;
+    Random random(13);
+    auto data = randomVectors(random, dimension, numVectors);
+    // Half of the queries are close to an indexed vector and easy, the others are not.
+    std::vector<std::vector<float>> trainQueries, testQueries;
+    for (size_t i = 0; i < 2 * numQueries; i++) {
+        auto &queries = i % 2 == 0 ? trainQueries : testQueries;
+        auto query = randomVectors(random, dimension, 1);
+        if (i % 4 < 2) {
+            auto base = data.begin() + random.nextInt(0, numVectors - 1) * dimension;
+            for (size_t j = 0; j < dimension; j++) {
+                query[j] = base[j] + 0.05 * (query[j] - 0.5);
+            }
+        }
+        queries.push_back(query);
+    }
+    auto trainTruth = groundTruth(data, trainQueries, dimension, k);
+    auto testTruth = groundTruth(data, testQueries, dimension, k);
+
+    HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+    std::vector<std::pair<double, double>> staticPoints;
+    for (int efSearch: {10, 12, 14, 16, 20, 24, 28, 32, 40, 48, 56, 64, 80, 96, 128, 160, 192, 256}) {
+        double recall, visited;
+        evaluate(index, testQueries, testTruth, k, efSearch, recall, visited);
+        staticPoints.emplace_back(recall, visited);
+        printf("efSearch %d: recall %f, distances %f\n", efSearch, recall, visited);
+    }
+
+    for (double target: {0.9, 0.95}) {
+        auto model = trainTerminationModel(index, trainQueries, trainTruth, k, maxEfSearch, target);
+        double recall, visited;
+        evaluate(index, testQueries, testTruth, k, maxEfSearch, recall, visited);
+        // The cheapest static efSearch with at least the same recall.
+        double staticVisited = INFINITY;
+        for (auto &[staticRecall, staticCost]: staticPoints) {
+            if (staticRecall >= recall) {
+                staticVisited = std::min(staticVisited, staticCost);
+            }
+        }
+        printf("Target %f: multiplier %f, recall %f, distances %f, static %f\n", target, model->getMultiplier(), recall, visited, staticVisited);
+        EXPECT_GT(recall, target - 0.03);
+        EXPECT_LT(visited, staticVisited);
+    }
+    index.setTerminationModel(nullptr);
+    double recall, visited;
+    evaluate(index, testQueries, testTruth, k, 64, recall, visited);
+    EXPECT_EQ(visited, staticPoints[11].second);
+}
+
+TEST(AdaptiveTerminationTest, SamplesAndPersistence) {
+    size_t dimension = 16, numVectors = 5000;
+    Random random(2);
+    auto data = randomVectors(random, dimension, numVectors);
+    std::vector<std::vector<float>> queries;
+    for (size_t i = 0; i < 100; i++) {
+        queries.emplace_back(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+    }
+    auto truth = groundTruth(data, queries, dimension, 10);
+    HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+
+    TerminationModel untrained(10);
+    std::vector<TerminationSample> samples;
+    for (size_t i = 0; i < queries.size(); i++) {
+        auto sample = index.sampleTermination(queries[i], 10, 128, truth[i], untrained);
+        auto full = index.knnSearch(queries[i], 10, 128);
+        EXPECT_TRUE(sample.warmedUp);
+        EXPECT_EQ(sample.features[0], 1);
+        // The ground truth is found before the search converges.
+        EXPECT_GT(sample.distances, 0);
+        EXPECT_LE(sample.distances, full.nodesVisited);
+        samples.push_back(sample);
+    }
+    EXPECT_THROW(untrained.fit({TerminationSample{}}), std::invalid_argument);
+
+    TerminationModel model(10);
+    model.fit(samples);
+    model.setMultiplier(1.5);
+    auto path = "/tmp/vector_index_termination.model";
+    model.save(path);
+    auto loaded = TerminationModel::load(path);
+    EXPECT_EQ(loaded.getNumWarmupHops(), 10);
+    EXPECT_EQ(loaded.getMultiplier(), 1.5);
+    for (auto &sample: samples) {
+        EXPECT_DOUBLE_EQ(loaded.predict(sample.features), model.predict(sample.features));
+    }
+
+    // The interleaved batch search stops at the same point.
+    index.setTerminationModel(std::make_shared<TerminationModel>(loaded));
+    auto batch = index.knnSearchBatch(queries, 10, 128);
+    for (size_t i = 0; i < queries.size(); i++) {
+        auto result = index.knnSearch(queries[i], 10, 128);
+        EXPECT_EQ(batch[i].ids, result.ids);
+        EXPECT_EQ(batch[i].nodesVisited, result.nodesVisited);
+    }
+}
+
+TEST(AdaptiveTerminationTest, CalibrationBypassesTheQueryCache) {
+    size_t dimension = 16, numVectors = 5000, numQueries = 200;
+    int k = 10;
+    Random random(7);
+    auto data = randomVectors(random, dimension, numVectors);
+    std::vector<std::vector<float>> queries;
+    for (size_t i = 0; i < numQueries; i++) {
+        queries.push_back(randomVectors(random, dimension, 1));
+    }
+    auto truth = groundTruth(data, queries, dimension, k);
+    HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+    auto uncached = trainTerminationModel(index, queries, truth, k, 256, 0.99)->getMultiplier();
+
+    // Cached results would not change with the multiplier, calibration would then run to the largest.
+    index.setTerminationModel(nullptr);
+    index.enableQueryCache();
+    for (auto &query: queries) {
+        index.knnSearch(query, k, 256);
+    }
+    auto model = trainTerminationModel(index, queries, truth, k, 256, 0.99);
+    printf("Multiplier %f, cached %f\n", uncached, model->getMultiplier());
+    EXPECT_GT(uncached, 0.5);
+    EXPECT_EQ(model->getMultiplier(), uncached);
+    // Installing the model invalidates the results cached before.
+    EXPECT_GT(index.knnSearch(queries[0], k, 256).nodesVisited, 0);
+}
@@ -0,0 +1,123 @@
+#include "gtest/gtest.h"
+#include "arena.h"
+#include "hnsw.h"
+#include "sa_tree.h"
+#include "small_world.h"
+#include "utils.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace vector_index;
+
+// Counts the heap allocations of the whole test binary.
+static std::atomic<size_t> numAllocations{0};
+
+void* operator new(size_t size) {
+    numAllocations++;
+    if (auto p = malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+TEST(ArenaTest, ReusesMemory) {
+    Arena arena(256);
+    std::vector<void*> first;
+    for (size_t i = 0; i < 100; i++) {
+        auto p = arena.allocate(24, 16);
+        EXPECT_EQ((uintptr_t) p % 16, 0);
+        first.push_back(p);
+    }
+    // The chained blocks are merged, the same allocations then fit without growing.
+    arena.reset();
+    auto capacity = arena.getCapacity();
+    EXPECT_GE(capacity, 100 * 24);
+    for (size_t i = 0; i < 100; i++) {
+        EXPECT_NE(arena.allocate(24, 16), nullptr);
+    }
+    EXPECT_EQ(arena.getCapacity(), capacity);
+    // Larger than a whole block.
+    arena.reset();
+    auto large = arena.allocate(10 * capacity, 64);
+    EXPECT_EQ((uintptr_t) large % 64, 0);
+}
+
+TEST(ArenaTest, SearchDoesNotAllocate) {
+    size_t dimension = 32, numVectors = 5000, numQueries = 100;
+    Random random(42);
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    std::vector<std::vector<float>> queries;
+    for (size_t i = 0; i < numQueries; i++) {
+        queries.emplace_back(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+    }
+
+    for (auto storage: {StorageType::FP32, StorageType::FP16}) {
+        auto hnsw = hnsw::HNSW(data.data(), dimension, numVectors, 64, 16, 32, Random::DEFAULT_SEED, storage);
+        hnsw::Result result;
+        // Grows the arena and the result arrays to the largest search.
+        for (auto &query: queries) {
+            hnsw.knnSearch(query, 10, 64, result);
+        }
+        auto before = numAllocations.load();
+        for (auto &query: queries) {
+            hnsw.knnSearch(query, 10, 64, result);
+            ASSERT_EQ(result.ids.size(), 10);
+        }
+        EXPECT_EQ(numAllocations.load() - before, 0);
+        // The flat result matches the one returned by value.
+        auto expected = hnsw.knnSearch(queries.back(), 10, 64);
+        EXPECT_EQ(expected.ids, result.ids);
+        EXPECT_EQ(expected.distances, result.distances);
+        EXPECT_TRUE(std::is_sorted(result.distances.begin(), result.distances.end()));
+    }
+
+    // The beam searches of the other indexes fill flat results the same way.
+    small_world::SmallWorldNG swng(data.data(), dimension, numVectors, 8, 8);
+    small_world::Result swngResult;
+    sa_tree::SATree tree(data.data(), dimension, numVectors);
+    sa_tree::ResultObject treeResult;
+    for (auto &query: queries) {
+        swng.beamKnnSearch(query, 32, 10, swngResult);
+        tree.beamKnnSearch(query, 32, 10, treeResult);
+    }
+    auto before = numAllocations.load();
+    for (auto &query: queries) {
+        swng.beamKnnSearch(query, 32, 10, swngResult);
+        ASSERT_EQ(swngResult.ids.size(), 10);
+        tree.beamKnnSearch(query, 32, 10, treeResult);
+        ASSERT_EQ(treeResult.ids.size(), 10);
+    }
+    EXPECT_EQ(numAllocations.load() - before, 0);
+    EXPECT_TRUE(std::is_sorted(swngResult.distances.begin(), swngResult.distances.end()));
+    EXPECT_TRUE(std::is_sorted(treeResult.distances.begin(), treeResult.distances.end()));
+    EXPECT_EQ(tree.beamKnnSearch(queries.back(), 32, 10).ids, treeResult.ids);
+
+    // So do the exact searches of the tree.
+    sa_tree::ResultObject rangeResult;
+    for (auto &query: queries) {
+        tree.knnSearch(query, 10, treeResult);
+        tree.rangeSearch(query, 1, 0, rangeResult);
+    }
+    before = numAllocations.load();
+    for (auto &query: queries) {
+        tree.knnSearch(query, 10, treeResult);
+        ASSERT_EQ(treeResult.ids.size(), 10);
+        tree.rangeSearch(query, 1, 0, rangeResult);
+    }
+    EXPECT_EQ(numAllocations.load() - before, 0);
+    EXPECT_EQ(tree.knnSearch(queries.back(), 10).ids, treeResult.ids);
+    EXPECT_EQ(tree.rangeSearch(queries.back(), 1, 0).ids, rangeResult.ids);
+}
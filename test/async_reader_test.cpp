@@ -0,0 +1,119 @@
+#include "gtest/gtest.h"
+#include "async_reader.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+
+using namespace vector_index;
+using namespace vector_index::io;
+
+class AsyncReaderTest: public ::testing::Test {
+protected:
+    void SetUp() override {
+        char path[] = "/tmp/async_reader_testXXXXXX";
+        fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        unlink(path);
+        data.resize(CHUNK * NUM_CHUNKS);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = (char) (i * 31 + i / CHUNK);
+        }
+        ASSERT_EQ(write(fd, data.data(), data.size()), (ssize_t) data.size());
+    }
+
+    void TearDown() override {
+        close(fd);
+    }
+
+    // Reads random chunks with up to queueDepth reads in flight and checks every byte.
+    void readChunks(AsyncReader &reader, unsigned queueDepth, bool registered) {
+        auto buffers = static_cast<char*>(std::aligned_alloc(4096, CHUNK * queueDepth));
+        std::vector<int> freeSlots;
+        std::vector<iovec> iovs;
+        for (unsigned i = 0; i < queueDepth; i++) {
+            freeSlots.push_back((int) i);
+            iovs.push_back(iovec{buffers + i * CHUNK, CHUNK});
+        }
+        if (registered) {
+            reader.registerFiles({fd});
+            reader.registerBuffers(iovs);
+        }
+        Random random(7);
+        std::vector<size_t> chunkOfSlot(queueDepth);
+        std::vector<Completion> completions;
+        size_t numReads = 500, next = 0, done = 0;
+        while (done < numReads) {
+            while (next < numReads && !freeSlots.empty()) {
+                auto slot = freeSlots.back();
+                freeSlots.pop_back();
+                chunkOfSlot[slot] = random.nextInt(0, NUM_CHUNKS - 1);
+                ReadRequest request{registered ? 0 : fd, iovs[slot].iov_base, CHUNK, chunkOfSlot[slot] * CHUNK, (uint64_t) slot, registered ? slot : -1};
+                ASSERT_TRUE(reader.read(request));
+                next++;
+            }
+            EXPECT_EQ(reader.pending(), std::min<size_t>(queueDepth, numReads - done));
+            // Every slot is in use, the reader is full.
+            if (freeSlots.empty()) {
+                EXPECT_FALSE(reader.read(ReadRequest{registered ? 0 : fd, buffers, CHUNK, 0, 0}));
+            }
+            completions.clear();
+            ASSERT_GE(reader.reap(completions, 1), 1);
+            for (auto &completion: completions) {
+                ASSERT_EQ(completion.result, (int64_t) CHUNK);
+                auto slot = completion.userData;
+                ASSERT_EQ(memcmp(iovs[slot].iov_base, data.data() + chunkOfSlot[slot] * CHUNK, CHUNK), 0);
+                freeSlots.push_back((int) slot);
+                done++;
+            }
+        }
+        EXPECT_EQ(reader.pending(), 0);
+        std::free(buffers);
+    }
+
+    static constexpr size_t CHUNK = 4096;
+    static constexpr size_t NUM_CHUNKS = 256;
+    int fd;
+    std::vector<char> data;
+};
+
+TEST_F(AsyncReaderTest, IoUring) {
+    for (unsigned queueDepth: {1, 8, 32}) {
+        for (bool registered: {false, true}) {
+            AsyncReaderOptions options;
+            options.queueDepth = queueDepth;
+            std::unique_ptr<IoUringReader> reader;
+            try {
+                reader = std::make_unique<IoUringReader>(options);
+            } catch (const std::runtime_error &e) {
+                GTEST_SKIP() << e.what();
+            }
+            readChunks(*reader, queueDepth, registered);
+        }
+    }
+}
+
+TEST_F(AsyncReaderTest, SqPoll) {
+    AsyncReaderOptions options;
+    options.queueDepth = 16;
+    options.sqPoll = true;
+    std::unique_ptr<IoUringReader> reader;
+    try {
+        reader = std::make_unique<IoUringReader>(options);
+    } catch (const std::runtime_error &e) {
+        GTEST_SKIP() << e.what();
+    }
+    readChunks(*reader, options.queueDepth, true);
+}
+
+TEST_F(AsyncReaderTest, Pread) {
+    for (bool registered: {false, true}) {
+        AsyncReaderOptions options;
+        options.queueDepth = 8;
+        PreadReader reader(options);
+        readChunks(reader, options.queueDepth, registered);
+    }
+    EXPECT_NE(makeAsyncReader(), nullptr);
+}
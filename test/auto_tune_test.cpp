@@ -0,0 +1,75 @@
+#include "spdlog/fmt/fmt.h"
+#include "gtest/gtest.h"
+#include "auto_tune.h"
+#include "hnsw.h"
+#include "utils.h"
+
+using namespace vector_index;
+using namespace vector_index::auto_tune;
+
+TEST(AutoTuneTest, HNSWEfSearch) {
+    size_t baseDimension, baseNumVectors;
+    auto basePath = "/Users/gauravsehgal/work/vector_index/data";
+    auto benchmarkType = "siftsmall";
+    auto baseVectorPath = fmt::format("{}/{}/base.fvecs", basePath, benchmarkType);
+    auto queryVectorPath = fmt::format("{}/{}/query.fvecs", basePath, benchmarkType);
+    auto gtVectorPath = fmt::format("{}/{}/groundtruth.ivecs", basePath, benchmarkType);
+
+    float* baseVecs = Utils::fvecs_read(baseVectorPath.c_str(),&baseDimension,&baseNumVectors);
+    auto hnsw = hnsw::HNSW(baseVecs, baseDimension, baseNumVectors, 128, 32, 64);
+    auto k = 10;
+
+    size_t queryDimension, queryNumVectors;
+    float *queryVecs = Utils::fvecs_read(queryVectorPath.c_str(), &queryDimension, &queryNumVectors);
+    std::vector<std::vector<float>> queryEmbeddings;
+    for (int i = 0; i < queryNumVectors; i++) {
+        std::vector<float> embedding;
+        for (int j = i * queryDimension; j < (i + 1) * queryDimension; j++) {
+            embedding.push_back(queryVecs[j]);
+        }
+        queryEmbeddings.push_back(embedding);
+    }
+
+    size_t gtDimension, gtNumVectors;
+    int *gtVecs = Utils::ivecs_read(gtVectorPath.c_str(), &gtDimension, &gtNumVectors);
+    std::vector<std::vector<int>> groundTruth;
+    for (int i = 0; i < gtNumVectors; i++) {
+        std::vector<int> gt;
+        for (int j = i * gtDimension; j < (i + 1) * gtDimension; j++) {
+            gt.push_back(gtVecs[j]);
+        }
+        groundTruth.push_back(gt);
+    }
+
+    AutoTuner tuner({{"efSearch", {10, 16, 32, 64, 128, 256}}}, hnswSearch(hnsw));
+    auto frontier = tuner.explore(queryEmbeddings, groundTruth, k);
+    ASSERT_FALSE(frontier.empty());
+
+    printf("\n=====================================\n");
+    for (auto &point: frontier) {
+        printf("efSearch: %d, recall: %f, qps: %f, p99: %f s\n", point.values[0], point.recall, point.qps, point.p99Latency);
+    }
+    for (int i = 1; i < frontier.size(); i++) {
+        EXPECT_GT(frontier[i].recall, frontier[i - 1].recall);
+        EXPECT_LE(frontier[i].qps, frontier[i - 1].qps);
+    }
+
+    OperatingPoint point;
+    if (tuner.selectForRecall(0.9, point)) {
+        printf("Cheapest efSearch for recall 0.9: %d\n", point.values[0]);
+        auto paramsPath = "/tmp/hnsw_siftsmall.params";
+        tuner.save(paramsPath, point);
+        EXPECT_EQ(tuner.load(paramsPath), point.values);
+    }
+}
+
+TEST(AutoTuneTest, RejectsMissingQueries) {
+    AutoTuner tuner({{"efSearch", {10, 16}}}, [](std::vector<float> &, int, const std::vector<int> &) {
+        return std::vector<int>();
+    });
+    std::vector<std::vector<float>> queries;
+    std::vector<std::vector<int>> groundTruth;
+    EXPECT_THROW(tuner.explore(queries, groundTruth, 10), std::invalid_argument);
+    queries.push_back({1, 2});
+    EXPECT_THROW(tuner.explore(queries, groundTruth, 10), std::invalid_argument);
+}
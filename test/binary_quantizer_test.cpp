@@ -0,0 +1,80 @@
+#include "spdlog/fmt/fmt.h"
+#include "gtest/gtest.h"
+#include "binary_quantizer.h"
+#include "hnsw.h"
+#include "utils.h"
+
+#include <algorithm>
+
+using namespace vector_index;
+
+TEST(BinaryQuantizerTest, HammingMatchesBits) {
+    // 600 dimensions span both the 8 word SIMD body and the scalar tail.
+    size_t dimension = 600, numVectors = 100;
+    Random random(42);
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble() * 2 - 1;
+    }
+
+    for (auto rotate: {false, true}) {
+        BinaryQuantizer quantizer(dimension, rotate);
+        quantizer.train(data.data(), numVectors);
+        std::vector<uint64_t> codes(quantizer.getNumWords() * numVectors);
+        for (size_t i = 0; i < numVectors; i++) {
+            quantizer.encode(data.data() + i * dimension, codes.data() + i * quantizer.getNumWords());
+        }
+        for (size_t i = 1; i < numVectors; i++) {
+            auto a = codes.data(), b = codes.data() + i * quantizer.getNumWords();
+            int expected = 0;
+            for (size_t j = 0; j < dimension; j++) {
+                expected += ((a[j / 64] >> (j % 64)) & 1) != ((b[j / 64] >> (j % 64)) & 1);
+            }
+            ASSERT_EQ(expected, BinaryQuantizer::hamming(a, b, quantizer.getNumWords()));
+        }
+    }
+}
+
+TEST(BinaryQuantizerTest, HNSWPrefilter) {
+    size_t baseDimension, baseNumVectors;
+    auto basePath = "/Users/gauravsehgal/work/vector_index/data";
+    auto benchmarkType = "siftsmall";
+    auto baseVectorPath = fmt::format("{}/{}/base.fvecs", basePath, benchmarkType);
+    auto queryVectorPath = fmt::format("{}/{}/query.fvecs", basePath, benchmarkType);
+    auto gtVectorPath = fmt::format("{}/{}/groundtruth.ivecs", basePath, benchmarkType);
+
+    float* baseVecs = Utils::fvecs_read(baseVectorPath.c_str(), &baseDimension, &baseNumVectors);
+    auto hnsw = hnsw::HNSW(baseVecs, baseDimension, baseNumVectors, 128, 16, 32);
+    size_t queryDimension, queryNumVectors;
+    float *queryVecs = Utils::fvecs_read(queryVectorPath.c_str(), &queryDimension, &queryNumVectors);
+    size_t gtDimension, gtNumVectors;
+    int *gtVecs = Utils::ivecs_read(gtVectorPath.c_str(), &gtDimension, &gtNumVectors);
+    auto k = 10;
+
+    auto run = [&](double &recall, size_t &distances) {
+        size_t matches = 0;
+        distances = 0;
+        for (int i = 0; i < queryNumVectors; i++) {
+            std::vector<float> query(queryVecs + i * queryDimension, queryVecs + (i + 1) * queryDimension);
+            auto result = hnsw.knnSearch(query, k, 64);
+            distances += result.nodesVisited;
+            for (auto id: result.ids) {
+                if (std::find(gtVecs + i * gtDimension, gtVecs + i * gtDimension + k, id) != gtVecs + i * gtDimension + k) {
+                    matches++;
+                }
+            }
+        }
+        recall = (double) matches / (queryNumVectors * k);
+    };
+
+    double recall, prefilterRecall;
+    size_t distances, prefilterDistances;
+    run(recall, distances);
+    // A margin of an eighth of the bits.
+    hnsw.enableBinaryPrefilter(baseDimension / 8);
+    run(prefilterRecall, prefilterDistances);
+    printf("Without prefilter: recall %f, %zu distances\n", recall, distances);
+    printf("Hamming prefilter: recall %f, %zu distances\n", prefilterRecall, prefilterDistances);
+    EXPECT_LT(prefilterDistances, distances);
+    EXPECT_GE(prefilterRecall, recall - 0.1);
+}
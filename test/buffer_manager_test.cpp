@@ -0,0 +1,151 @@
+#include "gtest/gtest.h"
+#include "buffer_manager.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <thread>
+
+using namespace vector_index;
+using namespace vector_index::io;
+
+class BufferManagerTest: public ::testing::Test {
+protected:
+    void SetUp() override {
+        char path[] = "/tmp/buffer_manager_testXXXXXX";
+        fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        unlink(path);
+        // The last page is half full.
+        data.resize(PAGE * NUM_PAGES - PAGE / 2);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = (char) (i * 13 + i / PAGE);
+        }
+        ASSERT_EQ(write(fd, data.data(), data.size()), (ssize_t) data.size());
+    }
+
+    void TearDown() override {
+        Utils::close(fd);
+    }
+
+    void expectPage(const void* page, size_t number) {
+        auto length = std::min(PAGE, data.size() - number * PAGE);
+        ASSERT_EQ(memcmp(page, data.data() + number * PAGE, length), 0) << "page " << number;
+        for (size_t i = length; i < PAGE; i++) {
+            ASSERT_EQ(static_cast<const char*>(page)[i], 0);
+        }
+    }
+
+    static constexpr size_t PAGE = 4096;
+    static constexpr size_t NUM_PAGES = 64;
+    int fd;
+    std::vector<char> data;
+};
+
+TEST_F(BufferManagerTest, HitsAndEvictions) {
+    for (auto policy: {EvictionPolicy::CLOCK, EvictionPolicy::LRU_K}) {
+        BufferManager manager(fd, PAGE, 8 * PAGE, policy);
+        EXPECT_EQ(manager.getNumFrames(), 8);
+        for (size_t page = 0; page < 8; page++) {
+            expectPage(manager.pin(page).data(), page);
+        }
+        for (size_t page = 0; page < 8; page++) {
+            expectPage(manager.pin(page).data(), page);
+        }
+        auto stats = manager.getStats();
+        EXPECT_EQ(stats.misses, 8);
+        EXPECT_EQ(stats.hits, 8);
+        EXPECT_EQ(stats.evictions, 0);
+
+        Random random(5);
+        for (size_t i = 0; i < 1000; i++) {
+            auto page = random.nextInt(0, NUM_PAGES - 1);
+            expectPage(manager.pin(page).data(), page);
+        }
+        stats = manager.getStats();
+        EXPECT_EQ(stats.hits + stats.misses, 1016);
+        EXPECT_EQ(stats.evictions, stats.misses - 8);
+
+        // Reads spanning pages and the end of the file.
+        std::vector<char> out(3 * PAGE);
+        manager.read(out.data(), PAGE / 3, out.size());
+        EXPECT_EQ(memcmp(out.data(), data.data() + PAGE / 3, out.size()), 0);
+        manager.read(out.data(), data.size() - 100, 100);
+        EXPECT_EQ(memcmp(out.data(), data.data() + data.size() - 100, 100), 0);
+    }
+}
+
+TEST_F(BufferManagerTest, PinnedPagesStay) {
+    BufferManager manager(fd, PAGE, 4 * PAGE, EvictionPolicy::CLOCK);
+    std::vector<BufferManager::PageHandle> pinned;
+    for (size_t page = 0; page < 3; page++) {
+        pinned.push_back(manager.pin(page));
+    }
+    // One frame serves every other page.
+    for (size_t page = 3; page < NUM_PAGES; page++) {
+        expectPage(manager.pin(page).data(), page);
+    }
+    for (size_t page = 0; page < 3; page++) {
+        expectPage(pinned[page].data(), page);
+    }
+    auto stats = manager.getStats();
+    pinned.push_back(manager.pin(3));
+    EXPECT_THROW(manager.pin(4), std::runtime_error);
+    pinned.clear();
+    manager.resetStats();
+    expectPage(manager.pin(0).data(), 0);
+    EXPECT_EQ(manager.getStats().hits, 1);
+    EXPECT_EQ(stats.misses, NUM_PAGES);
+}
+
+TEST_F(BufferManagerTest, LruKResistsScans) {
+    for (auto policy: {EvictionPolicy::CLOCK, EvictionPolicy::LRU_K}) {
+        BufferManager manager(fd, PAGE, 8 * PAGE, policy);
+        // Four hot pages accessed twice, then a scan of cold pages accessed once.
+        for (int round = 0; round < 2; round++) {
+            for (size_t page = 0; page < 4; page++) {
+                manager.pin(page);
+            }
+        }
+        for (size_t page = 4; page < NUM_PAGES; page++) {
+            manager.pin(page);
+        }
+        manager.resetStats();
+        for (size_t page = 0; page < 4; page++) {
+            manager.pin(page);
+        }
+        printf("Policy %d: %lu of 4 hot pages survived the scan\n", (int) policy, manager.getStats().hits);
+        if (policy == EvictionPolicy::LRU_K) {
+            EXPECT_EQ(manager.getStats().hits, 4);
+        }
+    }
+}
+
+TEST_F(BufferManagerTest, ConcurrentReads) {
+    for (auto policy: {EvictionPolicy::CLOCK, EvictionPolicy::LRU_K}) {
+        BufferManager manager(fd, PAGE, 16 * PAGE, policy);
+        std::vector<std::thread> threads;
+        std::atomic<size_t> mismatches(0);
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&, t]() {
+                Random random(t);
+                std::vector<char> out(PAGE);
+                for (size_t i = 0; i < 5000; i++) {
+                    auto offset = random.nextInt(0, data.size() - PAGE);
+                    manager.read(out.data(), offset, PAGE);
+                    if (memcmp(out.data(), data.data() + offset, PAGE) != 0) {
+                        mismatches++;
+                    }
+                }
+            });
+        }
+        for (auto &thread: threads) {
+            thread.join();
+        }
+        EXPECT_EQ(mismatches, 0);
+        auto stats = manager.getStats();
+        EXPECT_GE(stats.hits + stats.misses, 8 * 5000);
+        EXPECT_LE(stats.misses - stats.evictions, manager.getNumFrames());
+    }
+}
@@ -0,0 +1,128 @@
+#include "gtest/gtest.h"
+#include "buffer_pool.h"
+#include "async_reader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <set>
+#include <thread>
+
+using namespace vector_index::io;
+
+TEST(BufferPoolTest, AlignedBuffers) {
+    BufferPool pool(5000, 10, 4);
+    EXPECT_EQ(pool.getBufferSize(), 8192);
+    // The last slab only holds the two buffers left.
+    auto slabs = pool.getSlabs();
+    ASSERT_EQ(slabs.size(), 3);
+    EXPECT_EQ(slabs[0].iov_len, 4 * 8192);
+    EXPECT_EQ(slabs[2].iov_len, 2 * 8192);
+    EXPECT_THROW(pool.slabOf(static_cast<char*>(slabs[2].iov_base) + 2 * 8192), std::invalid_argument);
+    // Fewer buffers than a slab holds get a slab of their size.
+    EXPECT_EQ(BufferPool(4096, 1).getSlabs()[0].iov_len, 4096);
+    std::set<void*> buffers;
+    for (size_t i = 0; i < 10; i++) {
+        auto buffer = pool.acquire();
+        ASSERT_NE(buffer, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer) % SECTOR_SIZE, 0);
+        EXPECT_EQ(pool.slabOf(buffer), (int) i / 4);
+        memset(buffer, 1, pool.getBufferSize());
+        buffers.insert(buffer);
+    }
+    EXPECT_EQ(buffers.size(), 10);
+    EXPECT_EQ(pool.acquire(), nullptr);
+    EXPECT_EQ(pool.getNumFree(), 0);
+    for (auto buffer: buffers) {
+        pool.release(buffer);
+    }
+    EXPECT_EQ(pool.getNumFree(), 10);
+    int outside;
+    EXPECT_THROW(pool.release(&outside), std::invalid_argument);
+
+    auto range = alignRange(5000, 100, 4096);
+    EXPECT_EQ(range.offset, 4096);
+    EXPECT_EQ(range.length, 4096);
+    EXPECT_EQ(range.skip, 904);
+    range = alignRange(4000, 200, 4096);
+    EXPECT_EQ(range.offset, 0);
+    EXPECT_EQ(range.length, 8192);
+}
+
+TEST(BufferPoolTest, ConcurrentAcquireRelease) {
+    size_t numThreads = 8, numBuffers = 16;
+    BufferPool pool(64, numBuffers, 4, 64);
+    std::vector<std::thread> threads;
+    std::atomic<size_t> conflicts(0);
+    for (size_t t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = 0; i < 100000; i++) {
+                auto buffer = static_cast<size_t*>(pool.acquire());
+                if (buffer == nullptr) {
+                    continue;
+                }
+                // A buffer handed to two threads at once would see the other's mark.
+                *buffer = t;
+                for (int spin = 0; spin < 10; spin++) {
+                    if (*(volatile size_t*) buffer != t) {
+                        conflicts++;
+                    }
+                }
+                pool.release(buffer);
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    EXPECT_EQ(conflicts, 0);
+    EXPECT_EQ(pool.getNumFree(), numBuffers);
+}
+
+TEST(BufferPoolTest, DirectReads) {
+    char path[] = "buffer_pool_testXXXXXX";
+    int writer = mkstemp(path);
+    ASSERT_GE(writer, 0);
+    std::vector<char> data(1 << 20);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (char) (i * 7 + i / 4096);
+    }
+    ASSERT_EQ(write(writer, data.data(), data.size()), (ssize_t) data.size());
+    close(writer);
+
+    for (auto mode: {IoMode::CACHED, IoMode::DIRECT}) {
+        int fd;
+        try {
+            fd = openFile(path, mode);
+        } catch (const std::runtime_error &e) {
+            // The file system of the working directory may not support direct I/O.
+            std::cout << e.what() << std::endl;
+            continue;
+        }
+        auto alignment = directIoAlignment(fd);
+        EXPECT_EQ(alignment & (alignment - 1), 0);
+        BufferPool pool(8192, 8, 8, std::max(alignment, SECTOR_SIZE));
+        auto reader = makeAsyncReader();
+        reader->registerBuffers(pool.getSlabs());
+        // Unaligned requests are widened to aligned reads.
+        std::vector<std::pair<uint64_t, size_t>> requests = {{0, 4096}, {5000, 100}, {12345, 3000}, {(1 << 20) - 10, 10}};
+        std::vector<AlignedRange> ranges;
+        std::vector<void*> buffers;
+        for (size_t i = 0; i < requests.size(); i++) {
+            ranges.push_back(alignRange(requests[i].first, requests[i].second, std::max(alignment, SECTOR_SIZE)));
+            buffers.push_back(pool.acquire());
+            ASSERT_TRUE(reader->read(ReadRequest{fd, buffers[i], ranges[i].length, ranges[i].offset, i, pool.slabOf(buffers[i])}));
+        }
+        std::vector<Completion> completions;
+        reader->reap(completions, requests.size());
+        ASSERT_EQ(completions.size(), requests.size());
+        for (auto &completion: completions) {
+            auto i = completion.userData;
+            ASSERT_GE(completion.result, (int64_t) (ranges[i].skip + requests[i].second)) << "mode " << (int) mode;
+            EXPECT_EQ(memcmp(static_cast<char*>(buffers[i]) + ranges[i].skip, data.data() + requests[i].first, requests[i].second), 0);
+            pool.release(buffers[i]);
+        }
+        close(fd);
+    }
+    unlink(path);
+}
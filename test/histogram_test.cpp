@@ -0,0 +1,52 @@
+#include "gtest/gtest.h"
+#include "histogram.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vector_index;
+
+TEST(HistogramTest, SmallValuesAreExact) {
+    LatencyHistogram histogram;
+    for (uint64_t i = 1; i <= 100; i++) {
+        histogram.record(i);
+    }
+    EXPECT_EQ(histogram.getCount(), 100);
+    EXPECT_EQ(histogram.getMin(), 1);
+    EXPECT_EQ(histogram.getMax(), 100);
+    EXPECT_EQ(histogram.percentile(0.5), 50);
+    EXPECT_EQ(histogram.percentile(0.99), 99);
+    EXPECT_EQ(histogram.percentile(1), 100);
+    EXPECT_DOUBLE_EQ(histogram.getMean(), 50.5);
+}
+
+TEST(HistogramTest, PercentilesWithinPrecision) {
+    Random random(3);
+    std::vector<uint64_t> values;
+    LatencyHistogram histogram(7), first(7), second(7);
+    for (size_t i = 0; i < 100000; i++) {
+        // Log-uniform from 1 us to 1 s in nanoseconds.
+        auto value = (uint64_t) std::exp(std::log(1e3) + random.nextDouble() * std::log(1e6));
+        values.push_back(value);
+        histogram.record(value);
+        (i % 2 == 0 ? first : second).record(value);
+    }
+    first.merge(second);
+    std::sort(values.begin(), values.end());
+    for (auto q: {0.5, 0.9, 0.99, 0.999}) {
+        auto exact = values[(size_t) std::ceil(q * values.size()) - 1];
+        auto estimate = histogram.percentile(q);
+        EXPECT_GE(estimate, exact);
+        EXPECT_LE(estimate, exact + exact / 64);
+        EXPECT_EQ(first.percentile(q), estimate);
+    }
+    EXPECT_EQ(histogram.percentile(1), values.back());
+    EXPECT_EQ(first.getCount(), histogram.getCount());
+    EXPECT_EQ(first.getMin(), values.front());
+
+    histogram.reset();
+    EXPECT_EQ(histogram.getCount(), 0);
+    EXPECT_EQ(histogram.percentile(0.5), 0);
+    EXPECT_THROW(histogram.merge(LatencyHistogram(5)), std::invalid_argument);
+}
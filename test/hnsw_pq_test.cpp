@@ -2,6 +2,8 @@
 #include "gtest/gtest.h"
 
 #include <faiss/IndexHNSW.h>
+#include "hnsw.h"
+#include "product_quantizer.h"
 #include "utils.h"
 
 using namespace vector_index;
@@ -61,4 +63,112 @@ TEST(HNSWPQTest, Benchmark) {
     }
 
     printf("Avg recall: %zu/%d\n", avgRecall / queryNumVectors, k);
-}
\ No newline at end of file
+}
+
+TEST(HNSWPQTest, ADCMatchesDecoded) {
+    size_t baseDimension, baseNumVectors;
+    auto basePath = "/Users/gauravsehgal/work/vector_index/data";
+    auto benchmarkType = "siftsmall";
+    auto baseVectorPath = fmt::format("{}/{}/base.fvecs", basePath, benchmarkType);
+    float* baseVecs = Utils::fvecs_read(baseVectorPath.c_str(), &baseDimension, &baseNumVectors);
+    auto m = baseDimension % 16 == 0 ? 16 : baseDimension;
+
+    for (auto nbits: {4, 8}) {
+        ProductQuantizer pq(baseDimension, m, nbits);
+        pq.train(baseVecs, baseNumVectors);
+        std::vector<uint8_t> codes(pq.getCodeSize() * 64);
+        std::vector<const uint8_t*> codePointers;
+        for (int i = 0; i < 64; i++) {
+            pq.encode(baseVecs + i * baseDimension, codes.data() + i * pq.getCodeSize());
+            codePointers.push_back(codes.data() + i * pq.getCodeSize());
+        }
+
+        // The query is a base vector that was not encoded.
+        auto query = baseVecs + 100 * baseDimension;
+        auto distance = pq.prepare(query);
+        std::vector<float> decoded(baseDimension);
+        for (int i = 0; i < 64; i++) {
+            pq.decode(codePointers[i], decoded.data());
+            auto expected = Utils::l2_distance(query, decoded.data(), baseDimension);
+            EXPECT_NEAR(distance->distance(codePointers[i]), expected, 1e-3 * expected + 1e-3);
+        }
+
+        if (pq.supportsPacking()) {
+            // Fast scan quantizes the tables to 8 bits, allow for the rounding of every sub-quantizer.
+            std::vector<uint8_t> packed(pq.getPackedSize(codePointers.size()));
+            pq.pack(codePointers, packed.data());
+            std::vector<float> distances(codePointers.size());
+            distance->packedDistances(packed.data(), codePointers.size(), distances.data());
+            for (int i = 0; i < 64; i++) {
+                auto expected = distance->distance(codePointers[i]);
+                EXPECT_NEAR(distances[i] * distances[i], expected * expected, 0.05 * expected * expected + 1);
+            }
+        }
+    }
+}
+
+// Native HNSW traversing PQ codes with per query lookup tables against faiss::IndexHNSWPQ, with the
+// same pq_m and graph degree. Unlike faiss the native index re-ranks its efSearch candidates with the
+// float embeddings.
+TEST(HNSWPQTest, NativeVsFaiss) {
+    int k = 10;
+    int efSearch = 128;
+    int pqM = 60;
+    size_t baseDimension, baseNumVectors;
+    auto basePath = "/Users/gauravsehgal/work/vector_index/data";
+    auto benchmarkType = "gist";
+    auto baseVectorPath = fmt::format("{}/{}/base.fvecs", basePath, benchmarkType);
+    auto queryVectorPath = fmt::format("{}/{}/query.fvecs", basePath, benchmarkType);
+    auto gtVectorPath = fmt::format("{}/{}/groundtruth.ivecs", basePath, benchmarkType);
+    float* baseVecs = Utils::fvecs_read(baseVectorPath.c_str(), &baseDimension, &baseNumVectors);
+    size_t queryDimension, queryNumVectors;
+    float *queryVecs = Utils::fvecs_read(queryVectorPath.c_str(), &queryDimension, &queryNumVectors);
+    size_t gtDimension, gtNumVectors;
+    int *gtVecs = Utils::ivecs_read(gtVectorPath.c_str(), &gtDimension, &gtNumVectors);
+
+    auto recall = [&](int i, const std::vector<int> &ids) {
+        int matches = 0;
+        for (auto id: ids) {
+            if (std::find(gtVecs + i * gtDimension, gtVecs + i * gtDimension + k, id) != gtVecs + i * gtDimension + k) {
+                matches++;
+            }
+        }
+        return matches;
+    };
+
+    faiss::IndexHNSWPQ faissIndex(baseDimension, pqM, 32);
+    faissIndex.train(baseNumVectors, baseVecs);
+    faissIndex.add(baseNumVectors, baseVecs);
+    faissIndex.hnsw.efSearch = efSearch;
+    std::vector<int64_t> I(k * queryNumVectors);
+    std::vector<float> D(k * queryNumVectors);
+    auto start = std::chrono::high_resolution_clock::now();
+    faissIndex.search(queryNumVectors, queryVecs, k, D.data(), I.data());
+    std::chrono::duration<double> faissTime = std::chrono::high_resolution_clock::now() - start;
+    int faissMatches = 0;
+    for (int i = 0; i < queryNumVectors; i++) {
+        faissMatches += recall(i, std::vector<int>(I.begin() + i * k, I.begin() + (i + 1) * k));
+    }
+    printf("faiss HNSWPQ%d: recall %f, qps %f\n", pqM, (double) faissMatches / (queryNumVectors * k), queryNumVectors / faissTime.count());
+
+    auto hnsw = hnsw::HNSW(baseVecs, baseDimension, baseNumVectors, 128, 32, 64);
+    for (auto nbits: {8, 4}) {
+        hnsw.quantize(std::make_unique<ProductQuantizer>(baseDimension, pqM, nbits));
+        for (auto fastScan: {false, true}) {
+            if (fastScan && nbits != 4) {
+                continue;
+            }
+            if (fastScan) {
+                hnsw.enableFastScan();
+            }
+            int matches = 0;
+            start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < queryNumVectors; i++) {
+                std::vector<float> query(queryVecs + i * queryDimension, queryVecs + (i + 1) * queryDimension);
+                matches += recall(i, hnsw.knnSearch(query, k, efSearch).ids);
+            }
+            std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+            printf("native HNSW PQ%dx%d%s: recall %f, qps %f\n", pqM, nbits, fastScan ? " fast scan" : "", (double) matches / (queryNumVectors * k), queryNumVectors / time.count());
+        }
+    }
+}
@@ -3,6 +3,8 @@
 #include "hnsw.h"
 #include "utils.h"
 
+#include <x86intrin.h>
+
 using namespace vector_index;
 using namespace vector_index::hnsw;
 
@@ -55,8 +57,8 @@ TEST(HNSWTest, Benchmark) {
         auto query = queryEmbeddings[i];
         auto gt = groundTruth[i];
         auto res = hnsw.knnSearch(query, k, efSearch);
-        for (auto nodeWithDistance: res.nodes) {
-            if (std::find(gt.begin(), gt.end(), nodeWithDistance.item->id) != gt.end()) {
+        for (auto id: res.ids) {
+            if (std::find(gt.begin(), gt.end(), id) != gt.end()) {
                 avgRecall++;
             }
         }
@@ -87,3 +89,153 @@ TEST(HNSWTest, Benchmark) {
     printf("Avg depth: %zu\n", avgDepth / queryNumVectors);
     printf("Max depth: %zu\n", maxDepth);
 }
+
+TEST(HNSWTest, SameSeedSameGraph) {
+    size_t dimension = 16, numVectors = 2000;
+    Random random(42);
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+
+    auto first = HNSW(data.data(), dimension, numVectors, 64, 8, 16, 7);
+    auto second = HNSW(data.data(), dimension, numVectors, 64, 8, 16, 7);
+    for (int i = 0; i < 20; i++) {
+        std::vector<float> query(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+        auto a = first.knnSearch(query, 10, 32);
+        auto b = second.knnSearch(query, 10, 32);
+        ASSERT_EQ(a.nodesVisited, b.nodesVisited);
+        EXPECT_EQ(a.ids, b.ids);
+        EXPECT_EQ(a.distances, b.distances);
+    }
+}
+
+TEST(HNSWTest, InterleavedBatchSearch) {
+    size_t dimension = 64, numVectors = 5000, numQueries = 200;
+    Random random(42);
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    std::vector<std::vector<float>> queries;
+    for (int i = 0; i < numQueries; i++) {
+        std::vector<float> query(dimension);
+        for (auto &x: query) {
+            x = random.nextDouble();
+        }
+        queries.push_back(query);
+    }
+
+    auto hnsw = HNSW(data.data(), dimension, numVectors, 64, 16, 32);
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<Result> sequential;
+    for (auto &query: queries) {
+        sequential.push_back(hnsw.knnSearch(query, 10, 64));
+    }
+    std::chrono::duration<double> sequentialTime = std::chrono::high_resolution_clock::now() - start;
+
+    start = std::chrono::high_resolution_clock::now();
+    auto interleaved = hnsw.knnSearchBatch(queries, 10, 64);
+    std::chrono::duration<double> interleavedTime = std::chrono::high_resolution_clock::now() - start;
+
+    ASSERT_EQ(sequential.size(), interleaved.size());
+    for (int i = 0; i < numQueries; i++) {
+        EXPECT_EQ(sequential[i].nodesVisited, interleaved[i].nodesVisited);
+        EXPECT_EQ(sequential[i].ids, interleaved[i].ids);
+    }
+    printf("Sequential QPS: %f\n", numQueries / sequentialTime.count());
+    printf("Interleaved QPS: %f\n", numQueries / interleavedTime.count());
+}
+
+TEST(HNSWTest, ReorderKeepsResults) {
+    size_t dimension = 32, numVectors = 5000, numQueries = 100;
+    Random random(42);
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    std::vector<std::vector<float>> queries;
+    for (int i = 0; i < numQueries; i++) {
+        queries.emplace_back(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+    }
+
+    auto hnsw = HNSW(data.data(), dimension, numVectors, 64, 16, 32);
+    std::vector<std::vector<int>> expected;
+    for (auto &query: queries) {
+        expected.push_back(hnsw.knnSearch(query, 10, 64).ids);
+    }
+
+    for (auto ordering: {reorder::Ordering::BFS, reorder::Ordering::RCM, reorder::Ordering::GORDER}) {
+        hnsw.reorder(ordering);
+        double searchTime = 0;
+        for (int i = 0; i < numQueries; i++) {
+            auto res = hnsw.knnSearch(queries[i], 10, 64);
+            EXPECT_EQ(expected[i], res.ids);
+            searchTime += res.searchTime.count();
+        }
+        printf("Ordering %d, avg search time: %f s\n", (int) ordering, searchTime / numQueries);
+    }
+}
+
+TEST(HNSWTest, PrefetchBenchmark) {
+    size_t baseDimension, baseNumVectors;
+    auto basePath = "/Users/gauravsehgal/work/vector_index/data";
+    auto benchmarkType = "gist";
+    auto baseVectorPath = fmt::format("{}/{}/base.fvecs", basePath, benchmarkType);
+    auto queryVectorPath = fmt::format("{}/{}/query.fvecs", basePath, benchmarkType);
+
+    float* baseVecs = Utils::fvecs_read(baseVectorPath.c_str(),&baseDimension,&baseNumVectors);
+    auto hnsw = HNSW(baseVecs, baseDimension, baseNumVectors, 128, 32, 64);
+    auto k = 100;
+    auto efSearch = 128;
+
+    size_t queryDimension, queryNumVectors;
+    float *queryVecs = Utils::fvecs_read(queryVectorPath.c_str(), &queryDimension, &queryNumVectors);
+    std::vector<std::vector<float>> queryEmbeddings;
+    for (int i = 0; i < queryNumVectors; i++) {
+        queryEmbeddings.emplace_back(queryVecs + i * queryDimension, queryVecs + (i + 1) * queryDimension);
+    }
+
+    printf("\n=====================================\n");
+    printf("Dimension: %zu\n", baseDimension);
+    for (size_t prefetchDistance: {0, 1, 2, 4, 8}) {
+        hnsw.setPrefetchDistance(prefetchDistance);
+        size_t nodesVisited = 0;
+        auto start = __rdtsc();
+        for (auto &query: queryEmbeddings) {
+            nodesVisited += hnsw.knnSearch(query, k, efSearch).nodesVisited;
+        }
+        auto cycles = __rdtsc() - start;
+        printf("Prefetch distance: %zu, cycles per visited node: %f\n", prefetchDistance, (double) cycles / nodesVisited);
+    }
+}
+
+TEST(HNSWTest, EarlyAbandon) {
+    size_t dimension = 256, numVectors = 5000, numQueries = 100;
+    Random random(42);
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    std::vector<std::vector<float>> queries;
+    for (int i = 0; i < numQueries; i++) {
+        queries.emplace_back(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+    }
+
+    auto hnsw = HNSW(data.data(), dimension, numVectors, 64, 16, 32);
+    // Abandoned neighbors would have been discarded anyway, the results do not change.
+    std::vector<std::vector<int>> results[2];
+    double searchTime[2] = {0, 0};
+    for (auto earlyAbandon: {false, true}) {
+        hnsw.setEarlyAbandon(earlyAbandon);
+        for (auto &query: queries) {
+            auto res = hnsw.knnSearch(query, 10, 64);
+            results[earlyAbandon].push_back(res.ids);
+            searchTime[earlyAbandon] += res.searchTime.count();
+        }
+    }
+    printf("Avg search time: %f s, with early abandon: %f s\n", searchTime[0] / numQueries, searchTime[1] / numQueries);
+    for (int i = 0; i < numQueries; i++) {
+        EXPECT_EQ(results[1][i], results[0][i]);
+    }
+}
@@ -0,0 +1,117 @@
+#include "gtest/gtest.h"
+#include "huge_pages.h"
+#include "hnsw.h"
+#include "utils.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+
+using namespace vector_index;
+
+// Counts the dTLB load misses of the calling thread, -1 when perf events are not permitted.
+class TlbMissCounter {
+public:
+    TlbMissCounter() {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~TlbMissCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void start() {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    long long stop() {
+        long long count = -1;
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+                count = -1;
+            }
+        }
+        return count;
+    }
+
+private:
+    int fd;
+};
+
+TEST(HugePagesTest, BuffersFallBack) {
+    for (auto policy: {PagePolicy::NONE, PagePolicy::TRANSPARENT, PagePolicy::EXPLICIT}) {
+        auto before = getPageStats();
+        {
+            PageBuffer buffer(3 << 20, policy);
+            ASSERT_NE(buffer.get(), nullptr);
+            ASSERT_GE(buffer.getSize(), 3 << 20);
+            memset(buffer.get(), 1, buffer.getSize());
+            if (buffer.getKind() != PagePolicy::NONE) {
+                EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.get()) % HUGE_PAGE_SIZE, 0);
+                EXPECT_EQ(buffer.getSize() % HUGE_PAGE_SIZE, 0);
+            }
+            if (policy == PagePolicy::NONE) {
+                EXPECT_EQ(buffer.getKind(), PagePolicy::NONE);
+            }
+            auto stats = getPageStats();
+            EXPECT_EQ(stats.explicitBytes + stats.transparentBytes + stats.regularBytes, before.explicitBytes + before.transparentBytes + before.regularBytes + buffer.getSize());
+            printf("Policy %d: obtained %d, AnonHugePages %zu\n", (int) policy, (int) buffer.getKind(), stats.anonHugeBytes);
+        }
+        auto after = getPageStats();
+        EXPECT_EQ(after.explicitBytes + after.transparentBytes + after.regularBytes, before.explicitBytes + before.transparentBytes + before.regularBytes);
+    }
+}
+
+TEST(HugePagesTest, SearchTlbMisses) {
+    size_t dimension = 64, numVectors = 10000, numQueries = 1000;
+    Random random(42);
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    std::vector<std::vector<float>> queries;
+    for (size_t i = 0; i < numQueries; i++) {
+        queries.emplace_back(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+    }
+
+    std::vector<std::vector<int>> expected;
+    for (auto policy: {PagePolicy::NONE, PagePolicy::TRANSPARENT, PagePolicy::EXPLICIT}) {
+        setPagePolicy(policy);
+        auto hnsw = hnsw::HNSW(data.data(), dimension, numVectors, 64, 16, 32);
+        auto stats = getPageStats();
+        TlbMissCounter counter;
+        hnsw::Result result;
+        auto start = std::chrono::high_resolution_clock::now();
+        counter.start();
+        for (size_t i = 0; i < numQueries; i++) {
+            hnsw.knnSearch(queries[i], 10, 64, result);
+            if (policy == PagePolicy::NONE) {
+                expected.push_back(result.ids);
+            } else {
+                // The page size does not change the graph.
+                EXPECT_EQ(expected[i], result.ids);
+            }
+        }
+        auto misses = counter.stop();
+        std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+        printf("Policy %d: hugetlb %zu, THP advised %zu, regular %zu, AnonHugePages %zu bytes; dTLB load misses per query %f, QPS %f\n",
+               (int) policy, stats.explicitBytes, stats.transparentBytes, stats.regularBytes, stats.anonHugeBytes,
+               misses < 0 ? -1.0 : (double) misses / numQueries, numQueries / time.count());
+    }
+    setPagePolicy(PagePolicy::NONE);
+}
@@ -0,0 +1,157 @@
+#include "gtest/gtest.h"
+#include "metric.h"
+#include "vector_store.h"
+#include "hnsw.h"
+#include "small_world.h"
+#include "sa_tree.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace vector_index;
+
+// Gaussian-ish vectors with norms spread over [0.5, 2], so that inner product and cosine rank
+// differently from L2.
+static std::vector<float> randomData(size_t dimension, size_t numVectors, uint64_t seed) {
+    Random random(seed);
+    std::vector<float> data(dimension * numVectors);
+    for (size_t i = 0; i < numVectors; i++) {
+        auto scale = 0.5 + 1.5 * random.nextDouble();
+        for (size_t j = 0; j < dimension; j++) {
+            data[i * dimension + j] = (random.nextDouble() + random.nextDouble() - 1) * scale;
+        }
+    }
+    return data;
+}
+
+static double metricDistance(Metric metric, const float* q, const float* x, size_t dimension) {
+    auto dot = std::inner_product(q, q + dimension, x, 0.0);
+    if (metric == Metric::INNER_PRODUCT) {
+        return -dot;
+    }
+    return 1 - dot / sqrt(MetricReduction::squaredNorm(q, dimension) * MetricReduction::squaredNorm(x, dimension));
+}
+
+TEST(MetricTest, CosineDistance) {
+    std::vector<float> a{1, 0}, b{0, 2}, c{-3, 0}, d{2, 0};
+    EXPECT_NEAR(Utils::cosine_distance(a, d), 0, 1e-9);
+    EXPECT_NEAR(Utils::cosine_distance(a, b), 1, 1e-9);
+    EXPECT_NEAR(Utils::cosine_distance(a, c), 2, 1e-9);
+}
+
+TEST(MetricTest, ReductionMatchesMetric) {
+    size_t dimension = 19, numVectors = 500;
+    auto data = randomData(dimension, numVectors, 1);
+    auto queries = randomData(dimension, 10, 2);
+    for (auto metric: {Metric::L2, Metric::INNER_PRODUCT, Metric::COSINE}) {
+        // Reduced to L2 like in the SATree.
+        MetricReduction reduction(dimension, metric, true);
+        reduction.fit(data.data(), numVectors);
+        auto reduced = reduction.reduceVectors(data.data(), numVectors);
+        std::vector<float> query(reduction.getDimension());
+        for (size_t i = 0; i < 10; i++) {
+            auto q = queries.data() + i * dimension;
+            auto squaredNorm = MetricReduction::squaredNorm(q, dimension);
+            reduction.reduceQuery(q, query.data());
+            for (size_t j = 0; j < numVectors; j++) {
+                auto x = data.data() + j * dimension;
+                auto l2 = Utils::l2_distance(query.data(), reduced.data() + j * reduction.getDimension(), reduction.getDimension());
+                auto expected = metric == Metric::L2 ? Utils::l2_distance(q, x, dimension) : metricDistance(metric, q, x, dimension);
+                ASSERT_NEAR(reduction.toMetric(l2, squaredNorm), expected, 1e-4);
+                ASSERT_NEAR(reduction.fromMetric(expected, squaredNorm), l2, 1e-3);
+            }
+        }
+    }
+}
+
+TEST(MetricTest, InnerProductStore) {
+    // 37 dimensions exercise both the SIMD body and the scalar tail.
+    size_t dimension = 37, numVectors = 200;
+    auto data = randomData(dimension, numVectors, 5);
+    auto query = randomData(dimension, 1, 6);
+    for (auto type: {StorageType::FP32, StorageType::FP16, StorageType::BF16}) {
+        VectorStore store(dimension, type, Metric::INNER_PRODUCT);
+        std::vector<float> decoded(dimension);
+        for (size_t i = 0; i < numVectors; i++) {
+            auto record = store.add(data.data() + i * dimension);
+            store.decode(record, decoded.data());
+            auto expected = -std::inner_product(query.begin(), query.end(), decoded.begin(), 0.0);
+            ASSERT_NEAR(store.distance(query.data(), record), expected, 1e-4);
+            // Inner products are never abandoned.
+            ASSERT_NEAR(store.distance(query.data(), record, -1e9), expected, 1e-4);
+        }
+    }
+    EXPECT_THROW(VectorStore(dimension, StorageType::FP32, Metric::COSINE), std::invalid_argument);
+}
+
+TEST(MetricTest, IndexesSearchMetric) {
+    size_t dimension = 32, numVectors = 5000, numQueries = 50;
+    auto data = randomData(dimension, numVectors, 3);
+    auto queries = randomData(dimension, numQueries, 4);
+    auto k = 10;
+
+    for (auto metric: {Metric::INNER_PRODUCT, Metric::COSINE}) {
+        std::vector<std::vector<int>> groundTruth(numQueries);
+        for (size_t i = 0; i < numQueries; i++) {
+            MinQueue<int> closest(k);
+            for (size_t j = 0; j < numVectors; j++) {
+                closest.insert(Record<int>{(int) j, metricDistance(metric, queries.data() + i * dimension, data.data() + j * dimension, dimension)});
+            }
+            for (auto &record: closest.getRecords()) {
+                groundTruth[i].push_back(record.item);
+            }
+        }
+        // Checks the reported distances and returns the recall.
+        auto evaluate = [&](auto search) {
+            size_t matches = 0;
+            for (size_t i = 0; i < numQueries; i++) {
+                std::vector<float> query(queries.data() + i * dimension, queries.data() + (i + 1) * dimension);
+                for (auto [id, distance]: search(query)) {
+                    EXPECT_NEAR(distance, metricDistance(metric, query.data(), data.data() + id * dimension, dimension), 1e-4);
+                    if (std::find(groundTruth[i].begin(), groundTruth[i].end(), id) != groundTruth[i].end()) {
+                        matches++;
+                    }
+                }
+            }
+            return (double) matches / (numQueries * k);
+        };
+
+        auto hnsw = hnsw::HNSW(data.data(), dimension, numVectors, 64, 16, 32, Random::DEFAULT_SEED, StorageType::FP32, nullptr, metric);
+        auto hnswRecall = evaluate([&](std::vector<float> &query) {
+            auto result = hnsw.knnSearch(query, k, 64);
+            std::vector<std::pair<int, double>> results;
+            for (size_t i = 0; i < result.ids.size(); i++) {
+                results.emplace_back(result.ids[i], result.distances[i]);
+            }
+            return results;
+        });
+
+        auto swng = small_world::SmallWorldNG(data.data(), dimension, numVectors, 10, 10, Random::DEFAULT_SEED, StorageType::FP32, metric);
+        auto swngRecall = evaluate([&](std::vector<float> &query) {
+            std::vector<std::pair<int, double>> results;
+            auto result = swng.trueKnnSearch(query, k);
+            for (size_t i = 0; i < result.ids.size(); i++) {
+                results.emplace_back(result.ids[i], result.distances[i]);
+            }
+            return results;
+        });
+
+        auto tree = sa_tree::SATree(data.data(), dimension, numVectors, Random::DEFAULT_SEED, StorageType::FP32, nullptr, metric);
+        auto treeRecall = evaluate([&](std::vector<float> &query) {
+            std::vector<std::pair<int, double>> results;
+            auto result = tree.knnSearch(query, k);
+            for (size_t i = 0; i < result.ids.size(); i++) {
+                results.emplace_back(result.ids[i], result.distances[i]);
+            }
+            return results;
+        });
+        if (metric == Metric::INNER_PRODUCT) {
+            EXPECT_THROW(hnsw.quantize(ScalarQuantizerType::SQ8), std::logic_error);
+        }
+        printf("Metric %d: HNSW recall %f, SWNG exact recall %f, SATree exact recall %f\n", (int) metric, hnswRecall, swngRecall, treeRecall);
+        EXPECT_GE(hnswRecall, 0.9);
+        EXPECT_GE(swngRecall, 0.99);
+        EXPECT_GE(treeRecall, 0.99);
+    }
+}
@@ -0,0 +1,170 @@
+#include "gtest/gtest.h"
+#include "hnsw.h"
+#include "query_cache.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace vector_index;
+
+static std::vector<float> randomVectors(Random &random, size_t dimension, size_t numVectors) {
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    return data;
+}
+
+TEST(QueryCacheTest, LookupAndEviction) {
+    QueryCacheOptions options;
+    options.capacity = 4;
+    options.numShards = 1;
+    options.numHashBits = 2;
+    options.epsilon = 0.1;
+    QueryCache cache(2, options);
+    std::vector<int> ids;
+    std::vector<double> distances;
+
+    float a[] = {0.5, 0.5}, nearA[] = {0.52, 0.5}, farA[] = {0.9, 0.1}, distant[] = {1.5, 0.5}, origin[] = {0, 0};
+    EXPECT_EQ(cache.lookup(a, 2, 16, ids, distances), CacheMatch::NONE);
+    // The first cached query centers the hash hyperplanes.
+    cache.insert(origin, 16, {0}, {0});
+    cache.insert(a, 16, {7, 3, 9}, {0.1, 0.2, 0.3});
+    EXPECT_EQ(cache.lookup(a, 2, 16, ids, distances), CacheMatch::EXACT);
+    EXPECT_EQ(ids, std::vector<int>({7, 3}));
+    EXPECT_EQ(distances, std::vector<double>({0.1, 0.2}));
+    // More results or another efSearch than cached only seed the search.
+    EXPECT_EQ(cache.lookup(a, 4, 16, ids, distances), CacheMatch::NEAR);
+    EXPECT_EQ(cache.lookup(a, 2, 32, ids, distances), CacheMatch::NEAR);
+    EXPECT_EQ(ids, std::vector<int>({7, 3, 9}));
+    EXPECT_EQ(cache.lookup(nearA, 2, 16, ids, distances), CacheMatch::NEAR);
+    EXPECT_EQ(cache.lookup(farA, 2, 16, ids, distances), CacheMatch::NONE);
+    EXPECT_EQ(cache.lookup(distant, 2, 16, ids, distances), CacheMatch::NONE);
+
+    cache.invalidate();
+    EXPECT_EQ(cache.lookup(a, 2, 16, ids, distances), CacheMatch::NEAR);
+    cache.insert(a, 16, {7, 3, 9}, {0.1, 0.2, 0.3});
+    EXPECT_EQ(cache.lookup(a, 2, 16, ids, distances), CacheMatch::EXACT);
+
+    // The least recently used entries go first: the origin, then the first of these.
+    for (int i = 0; i < 4; i++) {
+        float query[] = {(float) i + 5, 0};
+        cache.insert(query, 16, {i}, {0});
+        EXPECT_EQ(cache.lookup(a, 2, 16, ids, distances), CacheMatch::EXACT);
+    }
+    float oldest[] = {5, 0};
+    EXPECT_EQ(cache.lookup(oldest, 1, 16, ids, distances), CacheMatch::NONE);
+
+    auto stats = cache.getStats();
+    EXPECT_EQ(stats.hits, 6);
+    EXPECT_EQ(stats.nearHits, 4);
+    EXPECT_EQ(stats.misses, 4);
+    EXPECT_EQ(stats.evictions, 2);
+    EXPECT_EQ(stats.invalidations, 1);
+    EXPECT_EQ(stats.size, 4);
+    cache.clear();
+    EXPECT_EQ(cache.getStats().size, 0);
+    EXPECT_EQ(cache.lookup(a, 2, 16, ids, distances), CacheMatch::NONE);
+
+    options.numShards = 0;
+    EXPECT_THROW(QueryCache(2, options), std::invalid_argument);
+    options.numShards = 1;
+    options.numHashBits = 65;
+    EXPECT_THROW(QueryCache(2, options), std::invalid_argument);
+}
+
+TEST(QueryCacheTest, HNSWRepeatsAndNearDuplicates) {
+    size_t dimension = 128, numVectors = 5000, numQueries = 200;
+    int k = 10, efSearch = 64;
+    Random random(17);
+    auto data = randomVectors(random, dimension, numVectors);
+    auto queryData = randomVectors(random, dimension, numQueries);
+    std::vector<std::vector<float>> queries, nearDuplicates;
+    for (size_t i = 0; i < numQueries; i++) {
+        queries.emplace_back(queryData.begin() + i * dimension, queryData.begin() + (i + 1) * dimension);
+        auto near = queries.back();
+        for (auto &x: near) {
+            x += 0.002 * (random.nextDouble() - 0.5);
+        }
+        nearDuplicates.push_back(near);
+    }
+    hnsw::HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+    std::vector<hnsw::Result> uncached, uncachedNear;
+    for (size_t i = 0; i < numQueries; i++) {
+        uncached.push_back(index.knnSearch(queries[i], k, efSearch));
+        uncachedNear.push_back(index.knnSearch(nearDuplicates[i], k, efSearch));
+    }
+
+    index.enableQueryCache();
+    for (size_t i = 0; i < numQueries; i++) {
+        auto first = index.knnSearch(queries[i], k, efSearch);
+        EXPECT_EQ(first.ids, uncached[i].ids);
+        auto repeat = index.knnSearch(queries[i], k, efSearch);
+        EXPECT_EQ(repeat.ids, uncached[i].ids);
+        EXPECT_EQ(repeat.distances, uncached[i].distances);
+        EXPECT_EQ(repeat.nodesVisited, 0);
+    }
+    auto stats = index.getQueryCacheStats();
+    EXPECT_EQ(stats.hits, numQueries);
+    EXPECT_EQ(stats.misses, numQueries);
+
+    // Near duplicates start next to their results and find about the same ones for less work.
+    size_t seededVisited = 0, uncachedVisited = 0, matches = 0;
+    for (size_t i = 0; i < numQueries; i++) {
+        auto seeded = index.knnSearch(nearDuplicates[i], k, efSearch);
+        seededVisited += seeded.nodesVisited;
+        uncachedVisited += uncachedNear[i].nodesVisited;
+        for (auto id: seeded.ids) {
+            matches += std::find(uncachedNear[i].ids.begin(), uncachedNear[i].ids.end(), id) != uncachedNear[i].ids.end();
+        }
+    }
+    stats = index.getQueryCacheStats();
+    printf("Near hits %lu of %zu, distances %zu vs %zu uncached, overlap %f\n", stats.nearHits, numQueries, seededVisited, uncachedVisited, (double) matches / (numQueries * k));
+    EXPECT_GT(stats.nearHits, numQueries * 3 / 4);
+    EXPECT_LT(seededVisited, uncachedVisited);
+    EXPECT_GT(matches, numQueries * k * 95 / 100);
+
+    // The interleaved batch search shares the cache.
+    auto batch = index.knnSearchBatch(queries, k, efSearch);
+    for (size_t i = 0; i < numQueries; i++) {
+        EXPECT_EQ(batch[i].ids, uncached[i].ids);
+    }
+
+    // Searches of several threads hit the shards concurrently.
+    std::vector<std::thread> threads;
+    std::atomic<size_t> mismatches(0);
+    for (size_t t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = t; i < numQueries; i += 4) {
+                mismatches += index.knnSearch(queries[i], k, efSearch).ids != uncached[i].ids;
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    EXPECT_EQ(mismatches, 0);
+
+    // An insert invalidates the cached results, a repeat then searches from them and finds the new vector.
+    auto query = queries[0];
+    index.insert(query, 64);
+    auto afterInsert = index.knnSearch(query, k, efSearch);
+    EXPECT_GT(afterInsert.nodesVisited, 0);
+    EXPECT_EQ(afterInsert.ids[0], numVectors);
+    EXPECT_EQ(index.getQueryCacheStats().invalidations, 1);
+    EXPECT_EQ(index.knnSearch(query, k, efSearch).nodesVisited, 0);
+
+    // So does a change of how the index searches.
+    index.quantize(ScalarQuantizerType::SQ8);
+    EXPECT_GT(index.knnSearch(query, k, efSearch).nodesVisited, 0);
+    EXPECT_EQ(index.getQueryCacheStats().invalidations, 2);
+    index.setSearchDimension(dimension / 2);
+    EXPECT_GT(index.knnSearch(query, k, efSearch).nodesVisited, 0);
+    index.setTerminationModel(nullptr);
+    EXPECT_EQ(index.getQueryCacheStats().invalidations, 4);
+
+    index.disableQueryCache();
+    EXPECT_GT(index.knnSearch(queries[1], k, efSearch).nodesVisited, 0);
+    EXPECT_EQ(index.getQueryCacheStats().hits, 0);
+}
@@ -55,11 +55,11 @@ TEST(SATreeTest, Benchmark1) {
             auto res = saTree.beamKnnSearch2(query, bSearch, kSearch);
             auto recall = 0;
             int j = 0;
-            for (auto nodeWithDistance: res.nodes) {
+            for (auto id: res.ids) {
                 if (j++ >= kSearch) {
                     break;
                 }
-                if (std::find(gt.begin(), gt.end(), nodeWithDistance.node->id) != gt.end()) {
+                if (std::find(gt.begin(), gt.end(), id) != gt.end()) {
                     avgRecall++;
                     recall++;
                 }
@@ -86,3 +86,31 @@ TEST(SATreeTest, Benchmark1) {
         printf("Max depth: %zu\n", maxDepth);
     }
 }
+
+TEST(SATreeTest, EarlyAbandonKnnSearch) {
+    size_t baseDimension, baseNumVectors;
+    auto basePath = "/Users/gauravsehgal/work/vector_index/data";
+    auto benchmarkType = "siftsmall";
+    auto baseVectorPath = fmt::format("{}/{}/base.fvecs", basePath, benchmarkType);
+    auto queryVectorPath = fmt::format("{}/{}/query.fvecs", basePath, benchmarkType);
+    float* baseVecs = Utils::fvecs_read(baseVectorPath.c_str(), &baseDimension, &baseNumVectors);
+    size_t queryDimension, queryNumVectors;
+    float* queryVecs = Utils::fvecs_read(queryVectorPath.c_str(), &queryDimension, &queryNumVectors);
+    auto saTree = SATree(baseVecs, baseDimension, baseNumVectors);
+    int k = 10;
+
+    // knnSearch is exact, abandoning distances must not change its results.
+    std::vector<std::vector<int>> results[2];
+    double searchTime[2] = {0, 0};
+    for (auto earlyAbandon: {false, true}) {
+        saTree.setEarlyAbandon(earlyAbandon);
+        for (int i = 0; i < queryNumVectors; i++) {
+            std::vector<float> query(queryVecs + i * queryDimension, queryVecs + (i + 1) * queryDimension);
+            auto res = saTree.knnSearch(query, k);
+            results[earlyAbandon].push_back(res.ids);
+            searchTime[earlyAbandon] += res.searchTime.count();
+        }
+    }
+    printf("Avg search time: %f s, with early abandon: %f s\n", searchTime[0] / queryNumVectors, searchTime[1] / queryNumVectors);
+    EXPECT_EQ(results[0], results[1]);
+}
@@ -0,0 +1,87 @@
+#include "gtest/gtest.h"
+#include "scalar_quantizer.h"
+#include "hnsw.h"
+#include "utils.h"
+
+#include <algorithm>
+
+using namespace vector_index;
+
+static std::vector<float> randomVectors(Random &random, size_t dimension, size_t numVectors) {
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble() * 10 - 5;
+    }
+    return data;
+}
+
+TEST(ScalarQuantizerTest, DistanceMatchesDecoded) {
+    // 37 dimensions exercise both the SIMD body and the scalar tail.
+    size_t dimension = 37, numVectors = 1000;
+    Random random(42);
+    auto data = randomVectors(random, dimension, numVectors);
+    auto query = randomVectors(random, dimension, 1);
+
+    for (auto type: {ScalarQuantizerType::SQ8, ScalarQuantizerType::SQ4}) {
+        ScalarQuantizer quantizer(dimension, type);
+        quantizer.train(data.data(), numVectors);
+        std::vector<uint8_t> code(quantizer.getCodeSize());
+        std::vector<float> decoded(dimension);
+        // Half a step of error per dimension at most.
+        auto maxError = type == ScalarQuantizerType::SQ8 ? 10.0 / 255 / 2 : 10.0 / 15 / 2;
+        for (size_t i = 0; i < numVectors; i++) {
+            quantizer.encode(data.data() + i * dimension, code.data());
+            quantizer.decode(code.data(), decoded.data());
+            for (size_t j = 0; j < dimension; j++) {
+                ASSERT_NEAR(data[i * dimension + j], decoded[j], maxError + 1e-5);
+            }
+            auto expected = Utils::l2_distance(query.data(), decoded.data(), dimension);
+            ASSERT_NEAR(expected, quantizer.distance(query.data(), code.data()), 1e-3 * expected);
+        }
+    }
+}
+
+TEST(ScalarQuantizerTest, HNSWRecall) {
+    size_t dimension = 64, numVectors = 5000, numQueries = 100;
+    Random random(42);
+    auto data = randomVectors(random, dimension, numVectors);
+    auto queryData = randomVectors(random, dimension, numQueries);
+    auto k = 10;
+
+    auto hnsw = hnsw::HNSW(data.data(), dimension, numVectors, 64, 16, 32);
+    std::vector<std::vector<int>> groundTruth;
+    std::vector<std::vector<float>> queries;
+    for (int i = 0; i < numQueries; i++) {
+        queries.emplace_back(queryData.begin() + i * dimension, queryData.begin() + (i + 1) * dimension);
+        MinQueue<int> exact(k);
+        for (int j = 0; j < numVectors; j++) {
+            exact.insert({j, Utils::l2_distance(queries[i].data(), data.data() + j * dimension, dimension)});
+        }
+        std::vector<int> ids;
+        for (auto &record: exact.getRecords()) {
+            ids.push_back(record.item);
+        }
+        groundTruth.push_back(ids);
+    }
+
+    auto recall = [&]() {
+        size_t matches = 0;
+        for (int i = 0; i < numQueries; i++) {
+            for (auto id: hnsw.knnSearch(queries[i], k, 64).ids) {
+                if (std::find(groundTruth[i].begin(), groundTruth[i].end(), id) != groundTruth[i].end()) {
+                    matches++;
+                }
+            }
+        }
+        return (double) matches / (numQueries * k);
+    };
+
+    auto fullPrecisionRecall = recall();
+    hnsw.quantize(ScalarQuantizerType::SQ8);
+    auto sq8Recall = recall();
+    hnsw.quantize(ScalarQuantizerType::SQ4);
+    auto sq4Recall = recall();
+    printf("Recall fp32: %f, sq8: %f, sq4: %f\n", fullPrecisionRecall, sq8Recall, sq4Recall);
+    EXPECT_GE(sq8Recall, fullPrecisionRecall - 0.05);
+    EXPECT_GE(sq4Recall, fullPrecisionRecall - 0.25);
+}
@@ -0,0 +1,181 @@
+#include "gtest/gtest.h"
+#include "hnsw.h"
+#include "sa_tree.h"
+#include "sharded_hnsw.h"
+#include "small_world.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+using namespace vector_index;
+
+static std::vector<float> randomVectors(Random &random, size_t dimension, size_t numVectors) {
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    return data;
+}
+
+TEST(SearchBudgetTest, Tracker) {
+    BudgetTracker unlimited;
+    for (size_t i = 0; i < 1000; i++) {
+        EXPECT_TRUE(unlimited.allowHop(i * 100));
+    }
+    EXPECT_FALSE(unlimited.isExhausted());
+    EXPECT_EQ(unlimited.getHops(), 1000);
+
+    BudgetTracker hops(SearchBudget{.maxHops = 3});
+    EXPECT_TRUE(hops.allowHop(0));
+    EXPECT_TRUE(hops.allowHop(0));
+    EXPECT_TRUE(hops.allowHop(0));
+    EXPECT_FALSE(hops.allowHop(0));
+    EXPECT_TRUE(hops.isExhausted());
+    EXPECT_EQ(hops.getHops(), 3);
+
+    BudgetTracker distances(SearchBudget{.maxDistances = 50});
+    EXPECT_TRUE(distances.allowHop(49));
+    EXPECT_FALSE(distances.allowHop(50));
+    // Spent budgets stay spent.
+    EXPECT_FALSE(distances.allowHop(0));
+
+    BudgetTracker time(SearchBudget{.time = std::chrono::microseconds(1)});
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_FALSE(time.allowHop(0));
+    EXPECT_TRUE(time.isExhausted());
+}
+
+TEST(SearchBudgetTest, HNSWPartialResults) {
+    size_t dimension = 32, numVectors = 5000, numQueries = 50;
+    Random random(11);
+    auto data = randomVectors(random, dimension, numVectors);
+    auto queries = randomVectors(random, dimension, numQueries);
+    hnsw::HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+
+    for (size_t q = 0; q < numQueries; q++) {
+        std::vector<float> query(queries.begin() + q * dimension, queries.begin() + (q + 1) * dimension);
+        auto full = index.knnSearch(query, 10, 128);
+        EXPECT_FALSE(full.partial);
+        EXPECT_GT(full.hops, 0);
+
+        // A budget the search does not reach changes nothing.
+        auto generous = index.knnSearch(query, 10, 128, SearchBudget{std::chrono::seconds(10), 1000000, 1000000});
+        EXPECT_FALSE(generous.partial);
+        EXPECT_EQ(generous.ids, full.ids);
+        EXPECT_EQ(generous.nodesVisited, full.nodesVisited);
+
+        auto hops = index.knnSearch(query, 10, 128, SearchBudget{.maxHops = full.hops / 4});
+        EXPECT_TRUE(hops.partial);
+        EXPECT_EQ(hops.hops, full.hops / 4);
+        EXPECT_LT(hops.nodesVisited, full.nodesVisited);
+
+        // Overshoots by at most one neighborhood of the base layer.
+        auto distances = index.knnSearch(query, 10, 128, SearchBudget{.maxDistances = full.nodesVisited / 2});
+        EXPECT_TRUE(distances.partial);
+        EXPECT_LE(distances.nodesVisited, full.nodesVisited / 2 + 32);
+        // Best so far results, sorted.
+        EXPECT_TRUE(std::is_sorted(distances.distances.begin(), distances.distances.end()));
+        EXPECT_LE(distances.ids.size(), 10);
+
+        // The interleaved search honors the same budget.
+        std::vector<std::vector<float>> batch = {query};
+        auto batched = index.knnSearchBatch(batch, 10, 128, hnsw::HNSW::DEFAULT_NUM_IN_FLIGHT, SearchBudget{.maxHops = full.hops / 4});
+        EXPECT_TRUE(batched[0].partial);
+        EXPECT_EQ(batched[0].ids, hops.ids);
+        EXPECT_EQ(batched[0].nodesVisited, hops.nodesVisited);
+    }
+}
+
+TEST(SearchBudgetTest, ShardedAndSmallWorld) {
+    size_t dimension = 16, numVectors = 4000;
+    Random random(3);
+    auto data = randomVectors(random, dimension, numVectors);
+    std::vector<float> query(data.begin(), data.begin() + dimension);
+
+    hnsw::ShardedHNSW sharded(data.data(), dimension, numVectors, 2, hnsw::Routing::RANDOM, 64, 16, 32);
+    auto full = sharded.knnSearch(query, 10, 64);
+    EXPECT_FALSE(full.partial);
+    EXPECT_EQ(full.ids[0], 0);
+    auto limited = sharded.knnSearch(query, 10, 64, 0, SearchBudget{.maxHops = 2});
+    EXPECT_TRUE(limited.partial);
+    EXPECT_EQ(limited.hops, 4);
+    // The batch shares its time budget, a spent one leaves the queries their entry points.
+    std::vector<std::vector<float>> batch = {query, query};
+    auto expired = sharded.knnSearchBatch(batch, 10, 64, 0, SearchBudget{.time = std::chrono::nanoseconds(1)});
+    for (auto &result: expired) {
+        EXPECT_TRUE(result.partial);
+        EXPECT_FALSE(result.ids.empty());
+        EXPECT_LT(result.nodesVisited, full.nodesVisited);
+    }
+
+    small_world::SmallWorldNG swng(data.data(), dimension, numVectors, 8, 8);
+    auto beam = swng.beamKnnSearch(query, 16, 10);
+    EXPECT_FALSE(beam.partial);
+    auto partialBeam = swng.beamKnnSearch(query, 16, 10, SearchBudget{.maxHops = 4});
+    EXPECT_TRUE(partialBeam.partial);
+    EXPECT_EQ(partialBeam.hops, 4);
+    EXPECT_LT(partialBeam.nodesVisited, beam.nodesVisited);
+    EXPECT_EQ(partialBeam.ids.size(), 10);
+    // Entry points are random, a query away from the data needs many hops from any of them.
+    auto away = randomVectors(random, dimension, 1);
+    auto beam2 = swng.beamKnnSearch2(away, 16, 10);
+    EXPECT_FALSE(beam2.partial);
+    auto partialBeam2 = swng.beamKnnSearch2(away, 16, 10, SearchBudget{.maxHops = 2});
+    EXPECT_TRUE(partialBeam2.partial);
+    EXPECT_EQ(partialBeam2.hops, 2);
+    EXPECT_LT(partialBeam2.nodesVisited, beam2.nodesVisited);
+    // Only the entry points fit into the budget.
+    auto entryPoints = swng.someOtherKnnSearch(away, 16, 10, SearchBudget{.maxDistances = 1});
+    EXPECT_TRUE(entryPoints.partial);
+    EXPECT_EQ(entryPoints.hops, 0);
+    EXPECT_EQ(entryPoints.nodesVisited, 16);
+    EXPECT_EQ(entryPoints.ids.size(), 10);
+    auto greedy = swng.greedyKnnSearch(query, 2, 10);
+    EXPECT_FALSE(greedy.partial);
+    // The entry points are random, only the first distance is sure to be spent before the first hop.
+    auto partialGreedy = swng.greedyKnnSearch(query, 2, 10, SearchBudget{.maxDistances = 1});
+    EXPECT_TRUE(partialGreedy.partial);
+    EXPECT_LT(partialGreedy.nodesVisited, greedy.nodesVisited);
+}
+
+TEST(SearchBudgetTest, SATree) {
+    size_t dimension = 16, numVectors = 4000;
+    Random random(5);
+    auto data = randomVectors(random, dimension, numVectors);
+    std::vector<float> query(data.begin(), data.begin() + dimension);
+    sa_tree::SATree tree(data.data(), dimension, numVectors);
+
+    auto knn = tree.knnSearch(query, 10);
+    EXPECT_FALSE(knn.partial);
+    EXPECT_EQ(knn.ids[0], 0);
+    auto partialKnn = tree.knnSearch(query, 10, SearchBudget{.maxHops = 3});
+    EXPECT_TRUE(partialKnn.partial);
+    EXPECT_LT(partialKnn.nodesVisited, knn.nodesVisited);
+    EXPECT_LE(partialKnn.ids.size(), 10);
+
+    std::vector<std::function<sa_tree::ResultObject(const SearchBudget &)>> beamSearches = {
+        [&](const SearchBudget &budget) { return tree.beamKnnSearch(query, 16, 10, budget); },
+        [&](const SearchBudget &budget) { return tree.beamKnnSearch2(query, 16, 10, budget); }
+    };
+    for (auto &search: beamSearches) {
+        auto unlimited = search({});
+        EXPECT_FALSE(unlimited.partial);
+        auto limited = search(SearchBudget{.maxHops = 2});
+        EXPECT_TRUE(limited.partial);
+        EXPECT_LT(limited.nodesVisited, unlimited.nodesVisited);
+    }
+
+    auto greedy = tree.greedyKnnSearch(query, 2, 16, 10);
+    EXPECT_FALSE(greedy.partial);
+    auto partialGreedy = tree.greedyKnnSearch(query, 2, 16, 10, SearchBudget{.maxDistances = greedy.nodesVisited / 2});
+    EXPECT_TRUE(partialGreedy.partial);
+    EXPECT_LT(partialGreedy.nodesVisited, greedy.nodesVisited);
+
+    auto range = tree.rangeSearch(query, 1.0, 0);
+    EXPECT_FALSE(range.partial);
+    auto partialRange = tree.rangeSearch(query, 1.0, 0, SearchBudget{.maxHops = 1});
+    EXPECT_TRUE(partialRange.partial);
+    EXPECT_LT(partialRange.nodesVisited, range.nodesVisited);
+}
@@ -0,0 +1,275 @@
+#include "gtest/gtest.h"
+#include "server.h"
+#include "hnsw.h"
+#include "utils.h"
+
+#include <unistd.h>
+#include <atomic>
+#include <climits>
+#include <thread>
+
+using namespace vector_index;
+using namespace vector_index::server;
+
+static uint64_t metric(const std::string &metrics, const std::string &name) {
+    auto position = metrics.find("\n" + name + " ");
+    EXPECT_NE(position, std::string::npos) << name;
+    return position == std::string::npos ? 0 : std::stoull(metrics.substr(position + name.size() + 2));
+}
+
+TEST(ServerTest, ProtocolRoundTrip) {
+    std::vector<char> frames;
+    Request request{MessageType::SEARCH, 42, 10, 64, 500, {1.5f, -2, 3}};
+    encode(request, frames);
+    Response response{MessageType::SEARCH, 42, Status::OK, {7, 3}, {0.5f, 1.25f}};
+    encode(response, frames);
+
+    // Incomplete frames wait for more bytes.
+    for (size_t size = 0; size < HEADER_SIZE; size++) {
+        EXPECT_EQ(frameSize(frames.data(), size), 0);
+    }
+    auto first = frameSize(frames.data(), frames.size());
+    ASSERT_GT(first, 0);
+    EXPECT_EQ(frameSize(frames.data(), first - 1), 0);
+    auto decoded = decodeRequest(frames.data(), first);
+    EXPECT_EQ(decoded.requestId, 42);
+    EXPECT_EQ(decoded.k, 10);
+    EXPECT_EQ(decoded.efSearch, 64);
+    EXPECT_EQ(decoded.deadlineMicros, 500);
+    EXPECT_EQ(decoded.query, request.query);
+
+    auto second = frameSize(frames.data() + first, frames.size() - first);
+    ASSERT_EQ(first + second, frames.size());
+    auto decodedResponse = decodeResponse(frames.data() + first, second);
+    EXPECT_EQ(decodedResponse.status, Status::OK);
+    EXPECT_EQ(decodedResponse.ids, response.ids);
+    EXPECT_EQ(decodedResponse.distances, response.distances);
+
+    EXPECT_THROW(decodeRequest(frames.data(), first - 4), std::invalid_argument);
+    uint32_t huge = MAX_FRAME_SIZE;
+    EXPECT_THROW(frameSize(reinterpret_cast<const char*>(&huge), sizeof(huge)), std::invalid_argument);
+}
+
+TEST(ServerTest, BatchedSearchesMatchTheIndex) {
+    size_t dimension = 16, numVectors = 3000, numQueries = 400, numClients = 8;
+    Random random(5);
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    hnsw::HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+    std::vector<std::vector<float>> queries;
+    std::vector<hnsw::Result> expected;
+    for (size_t i = 0; i < numQueries; i++) {
+        queries.emplace_back(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+        expected.push_back(index.knnSearch(queries.back(), 10, 64));
+    }
+
+    for (std::string address: {"127.0.0.1:0", "unix:/tmp/vector_index_server_test.sock"}) {
+        ServerOptions options;
+        options.address = address;
+        options.maxBatchSize = 8;
+        options.maxBatchDelay = std::chrono::milliseconds(2);
+        options.numWorkers = 2;
+        Server server([&](std::vector<std::vector<float>> &batch, int k, int efSearch, const SearchBudget &budget) {
+            return index.knnSearchBatch(batch, k, efSearch, hnsw::HNSW::DEFAULT_NUM_IN_FLIGHT, budget);
+        }, dimension, options);
+        server.start();
+        std::vector<std::thread> clients;
+        std::atomic<size_t> mismatches(0);
+        for (size_t c = 0; c < numClients; c++) {
+            clients.emplace_back([&, c]() {
+                Client client(server.getAddress());
+                for (size_t i = c; i < numQueries; i += numClients) {
+                    auto response = client.search(queries[i], 10, 64);
+                    std::vector<float> distances(expected[i].distances.begin(), expected[i].distances.end());
+                    if (response.status != Status::OK || response.ids != expected[i].ids || response.distances != distances) {
+                        mismatches++;
+                    }
+                }
+            });
+        }
+        for (auto &client: clients) {
+            client.join();
+        }
+        EXPECT_EQ(mismatches, 0);
+
+        auto metrics = Client(server.getAddress()).metrics();
+        EXPECT_EQ(metric(metrics, "vector_index_requests_total"), numQueries);
+        EXPECT_EQ(metric(metrics, "vector_index_responses_total{status=\"ok\"}"), numQueries);
+        EXPECT_EQ(metric(metrics, "vector_index_connections_total"), numClients + 1);
+        // Concurrent clients share batches.
+        EXPECT_LT(metric(metrics, "vector_index_batches_total"), numQueries);
+        printf("%s: %lu batches for %zu queries\n", address.c_str(), metric(metrics, "vector_index_batches_total"), numQueries);
+        server.stop();
+    }
+}
+
+TEST(ServerTest, DeadlinesAndBadRequests) {
+    size_t dimension = 4;
+    ServerOptions options;
+    options.maxBatchDelay = std::chrono::microseconds(0);
+    // The search ignores its budget.
+    Server server([&](std::vector<std::vector<float>> &batch, int k, int, const SearchBudget &) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::vector<hnsw::Result> results(batch.size());
+        for (auto &result: results) {
+            result.ids.assign(k, 1);
+            result.distances.assign(k, 0.5);
+        }
+        return results;
+    }, dimension, options);
+    server.start();
+    Client client(server.getAddress());
+    std::vector<float> query(dimension, 1);
+    auto response = client.search(query, 3, 8);
+    EXPECT_EQ(response.status, Status::OK);
+    EXPECT_EQ(response.ids.size(), 3);
+    // The search takes longer than the deadline.
+    response = client.search(query, 3, 8, 1000);
+    EXPECT_EQ(response.status, Status::DEADLINE_EXCEEDED);
+    EXPECT_TRUE(response.ids.empty());
+    std::vector<float> wrong(dimension + 1, 1);
+    EXPECT_EQ(client.search(wrong, 3, 8).status, Status::BAD_REQUEST);
+    EXPECT_EQ(client.search(query, 0, 8).status, Status::BAD_REQUEST);
+
+    auto metrics = client.metrics();
+    EXPECT_EQ(metric(metrics, "vector_index_responses_total{status=\"deadline_exceeded\"}"), 1);
+    EXPECT_EQ(metric(metrics, "vector_index_responses_total{status=\"bad_request\"}"), 2);
+    EXPECT_EQ(metric(metrics, "vector_index_latency_seconds_count"), 4);
+
+    // A malformed frame closes the connection, the server keeps serving the others.
+    int fd = connectTo(server.getAddress());
+    uint32_t garbage[2] = {1, 0};
+    ASSERT_EQ(write(fd, garbage, sizeof(garbage)), (ssize_t) sizeof(garbage));
+    char byte;
+    EXPECT_EQ(read(fd, &byte, 1), 0);
+    close(fd);
+    EXPECT_EQ(client.search(query, 3, 8).status, Status::OK);
+
+    ServerOptions taken;
+    taken.address = server.getAddress();
+    Server second([](std::vector<std::vector<float>> &, int, int, const SearchBudget &) { return std::vector<hnsw::Result>(); }, dimension, taken);
+    EXPECT_THROW(second.start(), std::runtime_error);
+}
+
+TEST(ServerTest, LimitsAndInternalErrors) {
+    size_t dimension = 4;
+    ServerOptions options;
+    options.maxBatchDelay = std::chrono::microseconds(0);
+    options.maxK = 16;
+    options.maxEfSearch = 64;
+    // The search fails on the queries with a negative first coordinate.
+    Server server([&](std::vector<std::vector<float>> &batch, int k, int, const SearchBudget &) {
+        if (batch[0][0] < 0) {
+            throw std::runtime_error("Search failed");
+        }
+        std::vector<hnsw::Result> results(batch.size());
+        for (auto &result: results) {
+            result.ids.assign(k, 1);
+            result.distances.assign(k, 0.5);
+        }
+        return results;
+    }, dimension, options);
+    server.start();
+    Client client(server.getAddress());
+    std::vector<float> query(dimension, 1);
+    EXPECT_EQ(client.search(query, 16, 64).status, Status::OK);
+    EXPECT_EQ(client.search(query, 17, 64).status, Status::BAD_REQUEST);
+    EXPECT_EQ(client.search(query, 16, 65).status, Status::BAD_REQUEST);
+    // Would be negative as an int.
+    EXPECT_EQ(client.search(query, 16, 0x80000000).status, Status::BAD_REQUEST);
+    std::vector<float> failing(dimension, -1);
+    auto response = client.search(failing, 4, 8);
+    EXPECT_EQ(response.status, Status::INTERNAL_ERROR);
+    EXPECT_TRUE(response.ids.empty());
+
+    auto metrics = client.metrics();
+    EXPECT_EQ(metric(metrics, "vector_index_responses_total{status=\"bad_request\"}"), 3);
+    EXPECT_EQ(metric(metrics, "vector_index_responses_total{status=\"internal_error\"}"), 1);
+    server.stop();
+
+    options.maxEfSearch = (size_t) INT_MAX + 1;
+    EXPECT_THROW(Server([](std::vector<std::vector<float>> &, int, int, const SearchBudget &) { return std::vector<hnsw::Result>(); }, dimension, options), std::invalid_argument);
+}
+
+TEST(ServerTest, PartialResultsAtTheDeadline) {
+    size_t dimension = 4;
+    ServerOptions options;
+    options.maxBatchDelay = std::chrono::microseconds(0);
+    std::atomic<int64_t> budgetNanos(-1);
+    // The search stops at the deadline with half of the results.
+    Server server([&](std::vector<std::vector<float>> &batch, int k, int, const SearchBudget &budget) {
+        budgetNanos = budget.time.count();
+        std::vector<hnsw::Result> results(batch.size());
+        for (auto &result: results) {
+            result.partial = budget.time.count() > 0;
+            result.ids.assign(result.partial ? k / 2 : k, 1);
+            result.distances.assign(result.ids.size(), 0.5);
+        }
+        std::this_thread::sleep_for(budget.time);
+        return results;
+    }, dimension, options);
+    server.start();
+    Client client(server.getAddress());
+    std::vector<float> query(dimension, 1);
+    auto response = client.search(query, 4, 8);
+    EXPECT_EQ(response.status, Status::OK);
+    EXPECT_EQ(response.ids.size(), 4);
+    EXPECT_EQ(budgetNanos, 0);
+
+    response = client.search(query, 4, 8, 5000);
+    EXPECT_EQ(response.status, Status::PARTIAL);
+    EXPECT_EQ(response.ids.size(), 2);
+    EXPECT_GT(budgetNanos, 0);
+    EXPECT_LE(budgetNanos, 5000000);
+
+    auto metrics = client.metrics();
+    EXPECT_EQ(metric(metrics, "vector_index_responses_total{status=\"partial\"}"), 1);
+    EXPECT_EQ(metric(metrics, "vector_index_responses_total{status=\"ok\"}"), 1);
+    server.stop();
+}
+
+TEST(ServerTest, BatchLargerThanInFlightMeetsTheDeadline) {
+    size_t dimension = 32, numVectors = 5000, numQueries = 32, numInFlight = 4;
+    Random random(3);
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    hnsw::HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+    ServerOptions options;
+    options.maxBatchDelay = std::chrono::milliseconds(5);
+    options.numWorkers = 2;
+    options.maxEfSearch = numVectors;
+    std::atomic<size_t> largestBatch(0);
+    Server server([&](std::vector<std::vector<float>> &batch, int k, int efSearch, const SearchBudget &budget) {
+        largestBatch = std::max(largestBatch.load(), batch.size());
+        return index.knnSearchBatch(batch, k, efSearch, numInFlight, budget);
+    }, dimension, options);
+    server.start();
+
+    // A full search visits every vector, the batch takes many times the deadline. The queries waiting
+    // for an in flight slot must not get a budget of their own.
+    auto deadline = std::chrono::milliseconds(30);
+    std::vector<std::thread> clients;
+    std::atomic<size_t> partials(0), late(0);
+    for (size_t i = 0; i < numQueries; i++) {
+        clients.emplace_back([&, i]() {
+            Client client(server.getAddress());
+            std::vector<float> query(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+            auto start = std::chrono::steady_clock::now();
+            auto response = client.search(query, 10, numVectors, std::chrono::duration_cast<std::chrono::microseconds>(deadline).count());
+            late += std::chrono::steady_clock::now() - start > 2 * deadline;
+            partials += response.status == Status::PARTIAL;
+        });
+    }
+    for (auto &client: clients) {
+        client.join();
+    }
+    printf("Largest batch %zu, %zu partial, %zu late\n", largestBatch.load(), partials.load(), late.load());
+    EXPECT_GT(largestBatch, numInFlight);
+    EXPECT_GT(partials, numInFlight);
+    EXPECT_EQ(late, 0);
+    server.stop();
+}
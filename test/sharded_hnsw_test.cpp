@@ -0,0 +1,130 @@
+#include "gtest/gtest.h"
+#include "sharded_hnsw.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace vector_index;
+
+class ShardedHNSWTest: public ::testing::Test {
+protected:
+    void SetUp() override {
+        // Overlapping clusters: k-means routing has clusters to find, and the graphs stay connected.
+        Random random(3);
+        std::vector<float> centers(numClusters * dimension);
+        for (auto &x: centers) {
+            x = random.nextDouble();
+        }
+        data.resize(numVectors * dimension);
+        for (size_t i = 0; i < numVectors; i++) {
+            auto center = random.nextInt(0, numClusters - 1);
+            for (size_t j = 0; j < dimension; j++) {
+                data[i * dimension + j] = centers[center * dimension + j] + random.nextDouble();
+            }
+        }
+        for (size_t i = 0; i < numQueries; i++) {
+            auto base = random.nextInt(0, numVectors - 1);
+            std::vector<float> query(dimension);
+            for (size_t j = 0; j < dimension; j++) {
+                query[j] = data[base * dimension + j] + random.nextDouble() * 0.1;
+            }
+            queries.push_back(query);
+        }
+    }
+
+    double recall(const std::vector<hnsw::Result> &results) {
+        size_t found = 0;
+        for (size_t i = 0; i < numQueries; i++) {
+            std::vector<std::pair<double, int>> distances;
+            for (size_t j = 0; j < numVectors; j++) {
+                distances.emplace_back(Utils::l2_distance(queries[i].data(), data.data() + j * dimension, dimension), j);
+            }
+            std::partial_sort(distances.begin(), distances.begin() + k, distances.end());
+            std::vector<int> expected;
+            for (int j = 0; j < k; j++) {
+                expected.push_back(distances[j].second);
+            }
+            for (auto id: results[i].ids) {
+                found += std::find(expected.begin(), expected.end(), id) != expected.end();
+            }
+        }
+        return (double) found / (numQueries * k);
+    }
+
+    size_t dimension = 16, numVectors = 8000, numQueries = 200, numClusters = 8;
+    int k = 10;
+    std::vector<float> data;
+    std::vector<std::vector<float>> queries;
+};
+
+TEST_F(ShardedHNSWTest, SearchAllShards) {
+    for (auto routing: {hnsw::Routing::RANDOM, hnsw::Routing::KMEANS}) {
+        hnsw::ShardedHNSW index(data.data(), dimension, numVectors, 4, routing, 64, 16, 32);
+        size_t total = 0;
+        for (size_t i = 0; i < index.getNumShards(); i++) {
+            total += index.getShardSize(i);
+        }
+        EXPECT_EQ(total, numVectors);
+
+        std::vector<hnsw::Result> results;
+        for (auto &query: queries) {
+            results.push_back(index.knnSearch(query, k, 64));
+            ASSERT_EQ(results.back().ids.size(), k);
+            EXPECT_TRUE(std::is_sorted(results.back().distances.begin(), results.back().distances.end()));
+        }
+        auto batch = index.knnSearchBatch(queries, k, 64);
+        for (size_t i = 0; i < numQueries; i++) {
+            EXPECT_EQ(results[i].ids, batch[i].ids);
+            EXPECT_EQ(results[i].distances, batch[i].distances);
+        }
+        auto r = recall(results);
+        printf("Routing %d: recall %f\n", (int) routing, r);
+        EXPECT_GT(r, 0.95);
+    }
+}
+
+TEST_F(ShardedHNSWTest, RoutedProbes) {
+    hnsw::ShardedHNSW index(data.data(), dimension, numVectors, 8, hnsw::Routing::KMEANS, 64, 16, 32);
+    auto all = index.knnSearchBatch(queries, k, 64);
+    auto routed = index.knnSearchBatch(queries, k, 64, 2);
+    size_t visitedAll = 0, visitedRouted = 0;
+    for (size_t i = 0; i < numQueries; i++) {
+        visitedAll += all[i].nodesVisited;
+        visitedRouted += routed[i].nodesVisited;
+    }
+    auto recallAll = recall(all), recallRouted = recall(routed);
+    printf("All shards: recall %f, %zu nodes visited. 2 probes: recall %f, %zu nodes visited\n", recallAll, visitedAll, recallRouted, visitedRouted);
+    EXPECT_LT(visitedRouted * 2, visitedAll);
+    EXPECT_GT(recallRouted, 0.9);
+    EXPECT_EQ(index.route(queries[0].data(), 3).size(), 3);
+}
+
+TEST_F(ShardedHNSWTest, ConcurrentInserts) {
+    size_t numInitial = numVectors / 2;
+    hnsw::ShardedHNSW index(data.data(), dimension, numInitial, 4, hnsw::Routing::RANDOM, 64, 16, 32);
+    std::vector<std::thread> threads;
+    std::vector<int> ids(numVectors - numInitial);
+    for (size_t t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = numInitial + t; i < numVectors; i += 4) {
+                std::vector<float> embedding(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+                ids[i - numInitial] = index.insert(embedding, 64);
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    std::sort(ids.begin(), ids.end());
+    for (size_t i = 0; i < ids.size(); i++) {
+        EXPECT_EQ(ids[i], numInitial + i);
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < index.getNumShards(); i++) {
+        total += index.getShardSize(i);
+    }
+    EXPECT_EQ(total, numVectors);
+    std::vector<float> wrong(dimension + 1);
+    EXPECT_THROW(index.insert(wrong, 64), std::invalid_argument);
+}
@@ -59,8 +59,8 @@ TEST(SWGTest, Benchmark) {
                     auto query = queryEmbeddings[i];
                     auto gt = groundTruth[i];
                     auto res = swng.greedyKnnSearch(query, mSearch, kSearch);
-                    for (auto nodeWithDistance: res.nodes) {
-                        if (std::find(gt.begin(), gt.end(), nodeWithDistance.item->id) != gt.end()) {
+                    for (auto id: res.ids) {
+                        if (std::find(gt.begin(), gt.end(), id) != gt.end()) {
                             avgRecall++;
                         }
                     }
@@ -0,0 +1,128 @@
+#include "gtest/gtest.h"
+#include "hnsw.h"
+#include "utils.h"
+
+#include <thread>
+
+using namespace vector_index;
+
+class TieredTest: public ::testing::Test {
+protected:
+    void SetUp() override {
+        Random random(11);
+        data.resize(dimension * numVectors);
+        for (auto &x: data) {
+            x = random.nextDouble();
+        }
+        for (size_t i = 0; i < numQueries; i++) {
+            std::vector<float> query(dimension);
+            for (auto &x: query) {
+                x = random.nextDouble();
+            }
+            queries.push_back(query);
+        }
+    }
+
+    std::vector<hnsw::Result> searchAll(hnsw::HNSW &index, size_t numQueries) {
+        std::vector<hnsw::Result> results;
+        for (size_t i = 0; i < numQueries; i++) {
+            results.push_back(index.knnSearch(queries[i], 10, 64));
+        }
+        return results;
+    }
+
+    static void expectSame(const std::vector<hnsw::Result> &expected, const std::vector<hnsw::Result> &actual) {
+        ASSERT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            EXPECT_EQ(expected[i].ids, actual[i].ids);
+            EXPECT_EQ(expected[i].distances, actual[i].distances);
+        }
+    }
+
+    size_t dimension = 32, numVectors = 5000, numQueries = 200;
+    std::vector<float> data;
+    std::vector<std::vector<float>> queries;
+    std::string path = "/tmp/tiered_test.vectors";
+};
+
+TEST_F(TieredTest, SameResults) {
+    for (auto quantized: {false, true}) {
+        for (auto mode: {io::IoMode::CACHED, io::IoMode::DIRECT}) {
+            hnsw::HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+            if (quantized) {
+                index.quantize(ScalarQuantizerType::SQ8);
+            }
+            auto expected = searchAll(index, numQueries);
+            TieringOptions options;
+            options.mode = mode;
+            options.rebalanceInterval = std::chrono::milliseconds(0);
+            try {
+                // A tenth of the embeddings stay in memory.
+                index.enableTiering(path, numVectors / 10 * dimension * sizeof(float), options);
+            } catch (const std::runtime_error &e) {
+                std::cout << e.what() << std::endl;
+                continue;
+            }
+            EXPECT_THROW(index.insert(queries[0], 64), std::logic_error);
+            EXPECT_THROW(index.reorder(reorder::Ordering::BFS), std::logic_error);
+            auto stats = index.getTierStats();
+            EXPECT_EQ(stats.numHot, numVectors / 10);
+            expectSame(expected, searchAll(index, numQueries));
+            stats = index.getTierStats();
+            EXPECT_GT(stats.coldReads, 0);
+            printf("Quantized %d, mode %d: %lu hot reads, %lu cold reads\n", quantized, (int) mode, stats.hotReads, stats.coldReads);
+        }
+    }
+}
+
+TEST_F(TieredTest, HotSetFollowsVisits) {
+    hnsw::HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+    auto expected = searchAll(index, 2);
+    TieringOptions options;
+    options.rebalanceInterval = std::chrono::milliseconds(0);
+    index.enableTiering(path, numVectors / 2 * dimension * sizeof(float), options);
+    auto initial = index.getTierStats();
+    EXPECT_EQ(initial.promotions, numVectors / 2);
+
+    // A skewed workload: the same 2 queries over and over.
+    for (int round = 0; round < 4; round++) {
+        searchAll(index, 2);
+    }
+    auto before = index.getTierStats();
+    index.rebalanceTiers();
+    auto promoted = index.getTierStats();
+    EXPECT_GT(promoted.promotions, initial.promotions);
+    EXPECT_EQ(promoted.promotions - initial.promotions, promoted.demotions);
+    for (int round = 0; round < 4; round++) {
+        searchAll(index, 2);
+    }
+    auto after = index.getTierStats();
+    auto coldBefore = before.coldReads, coldAfter = after.coldReads - promoted.coldReads;
+    printf("Cold reads before rebalancing %lu, after %lu\n", coldBefore, coldAfter);
+    EXPECT_LT(coldAfter, coldBefore / 2);
+    expectSame(expected, searchAll(index, 2));
+}
+
+TEST_F(TieredTest, BackgroundRebalancing) {
+    hnsw::HNSW index(data.data(), dimension, numVectors, 64, 16, 32);
+    auto expected = searchAll(index, numQueries);
+    TieringOptions options;
+    options.rebalanceInterval = std::chrono::milliseconds(5);
+    index.enableTiering(path, numVectors / 4 * dimension * sizeof(float), options);
+    std::vector<std::thread> threads;
+    std::vector<std::vector<hnsw::Result>> results(4);
+    for (size_t t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            for (int round = 0; round < 5; round++) {
+                results[t] = searchAll(index, numQueries);
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    for (auto &result: results) {
+        expectSame(expected, result);
+    }
+    EXPECT_GT(index.getTierStats().promotions, 0);
+}
@@ -0,0 +1,50 @@
+#include "gtest/gtest.h"
+#include "topology.h"
+#include "hnsw.h"
+#include "utils.h"
+
+using namespace vector_index;
+
+TEST(TopologyTest, ReplicasSearchLikeTheIndex) {
+    ASSERT_GE(numa::numNodes(), 1);
+    for (size_t node = 0; node < numa::numNodes(); node++) {
+        EXPECT_FALSE(numa::nodeCpus(node).empty());
+    }
+
+    size_t dimension = 32, numVectors = 5000, numQueries = 500;
+    Random random(42);
+    std::vector<float> data(dimension * numVectors);
+    for (auto &x: data) {
+        x = random.nextDouble();
+    }
+    std::vector<std::vector<float>> queries;
+    for (size_t i = 0; i < numQueries; i++) {
+        queries.emplace_back(data.begin() + i * dimension, data.begin() + (i + 1) * dimension);
+    }
+
+    auto hnsw = hnsw::HNSW(data.data(), dimension, numVectors, 64, 16, 32);
+    for (auto quantized: {false, true}) {
+        if (quantized) {
+            hnsw.quantize(ScalarQuantizerType::SQ8);
+        }
+        std::vector<hnsw::Result> expected;
+        for (auto &query: queries) {
+            expected.push_back(hnsw.knnSearch(query, 10, 64));
+        }
+
+        numa::Replicated<hnsw::HNSW> replicated(hnsw, 4);
+        EXPECT_EQ(replicated.numReplicas(), numa::numNodes());
+        std::vector<hnsw::Result> results(numQueries);
+        auto start = std::chrono::high_resolution_clock::now();
+        replicated.forEach(numQueries, [&](hnsw::HNSW &replica, size_t i) {
+            replica.knnSearch(queries[i], 10, 64, results[i]);
+        });
+        std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+        for (size_t i = 0; i < numQueries; i++) {
+            EXPECT_EQ(expected[i].ids, results[i].ids);
+            EXPECT_EQ(expected[i].distances, results[i].distances);
+            EXPECT_EQ(expected[i].nodesVisited, results[i].nodesVisited);
+        }
+        printf("Nodes %zu, quantized %d, QPS: %f\n", numa::numNodes(), quantized, numQueries / time.count());
+    }
+}
@@ -0,0 +1,123 @@
+#include "gtest/gtest.h"
+#include "transform.h"
+#include "hnsw.h"
+#include "sa_tree.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <memory>
+
+using namespace vector_index;
+
+// Uniform vectors whose dimension j is scaled by `scale(j)`, mixed by a random rotation so that the
+// variance is spread over all the coordinates.
+template <typename Scale>
+static std::vector<float> correlatedData(size_t dimension, size_t numVectors, Scale scale) {
+    Random random(42);
+    VectorTransform mixing(dimension, TransformType::RANDOM_ROTATION, 0, 7);
+    std::vector<float> data(dimension * numVectors), scaled(dimension);
+    for (size_t i = 0; i < numVectors; i++) {
+        for (size_t j = 0; j < dimension; j++) {
+            scaled[j] = (random.nextDouble() * 2 - 1) * scale(j);
+        }
+        mixing.apply(scaled.data(), data.data() + i * dimension);
+    }
+    return data;
+}
+
+TEST(TransformTest, PCAPreservesDistances) {
+    size_t dimension = 24, numVectors = 4000;
+    auto data = correlatedData(dimension, numVectors, [](size_t j) {
+        return 1 + j / 4.0;
+    });
+
+    VectorTransform pca(dimension, TransformType::PCA);
+    EXPECT_FALSE(pca.isTrained());
+    pca.train(data.data(), numVectors);
+    EXPECT_TRUE(pca.isTrained());
+    auto &eigenvalues = pca.getEigenvalues();
+    ASSERT_EQ(eigenvalues.size(), dimension);
+    EXPECT_TRUE(std::is_sorted(eigenvalues.rbegin(), eigenvalues.rend()));
+
+    // The variance of every output dimension is its eigenvalue.
+    auto transformed = pca.apply(data.data(), numVectors);
+    for (size_t j = 0; j < dimension; j++) {
+        double variance = 0;
+        for (size_t i = 0; i < numVectors; i++) {
+            variance += transformed[i * dimension + j] * transformed[i * dimension + j];
+        }
+        EXPECT_NEAR(variance / numVectors, eigenvalues[j], 1e-3 * eigenvalues[0]);
+    }
+
+    for (size_t i = 1; i < 100; i++) {
+        auto expected = Utils::l2_distance(data.data(), data.data() + i * dimension, dimension);
+        auto actual = Utils::l2_distance(transformed.data(), transformed.data() + i * dimension, dimension);
+        ASSERT_NEAR(expected, actual, 1e-4 * expected);
+    }
+
+    // Dropping dimensions keeps the leading components.
+    VectorTransform truncated(dimension, TransformType::PCA, 8);
+    truncated.train(data.data(), numVectors);
+    std::vector<float> y(8);
+    truncated.apply(data.data(), y.data());
+    for (size_t j = 0; j < 8; j++) {
+        EXPECT_NEAR(std::abs(y[j]), std::abs(transformed[j]), 1e-3);
+    }
+    EXPECT_THROW(VectorTransform(dimension, TransformType::PCA, dimension + 1), std::invalid_argument);
+}
+
+TEST(TransformTest, SearchTransformed) {
+    // The variance decays exponentially, like real embeddings, so a prefix of the principal
+    // components ranks the neighbors nearly as well as all of them.
+    size_t dimension = 128, numVectors = 10000, numQueries = 100;
+    auto data = correlatedData(dimension, numVectors + numQueries, [](size_t j) {
+        return 100 * exp(-(double) j / 20);
+    });
+    auto queries = data.data() + numVectors * dimension;
+    auto k = 10;
+    std::vector<std::vector<int>> groundTruth(numQueries);
+    for (size_t i = 0; i < numQueries; i++) {
+        MinQueue<int> closest(k);
+        for (size_t j = 0; j < numVectors; j++) {
+            closest.insert(Record<int>{(int) j, Utils::l2_distance(queries + i * dimension, data.data() + j * dimension, dimension)});
+        }
+        for (auto &record: closest.getRecords()) {
+            groundTruth[i].push_back(record.item);
+        }
+    }
+
+    auto recall = [&](auto search) {
+        size_t matches = 0;
+        for (size_t i = 0; i < numQueries; i++) {
+            std::vector<float> query(queries + i * dimension, queries + (i + 1) * dimension);
+            for (auto id: search(query)) {
+                if (std::find(groundTruth[i].begin(), groundTruth[i].end(), id) != groundTruth[i].end()) {
+                    matches++;
+                }
+            }
+        }
+        return (double) matches / (numQueries * k);
+    };
+
+    auto pca = std::make_shared<VectorTransform>(dimension, TransformType::PCA);
+    auto hnsw = hnsw::HNSW(data.data(), dimension, numVectors, 128, 16, 32, Random::DEFAULT_SEED, StorageType::FP32, pca);
+    EXPECT_TRUE(pca->isTrained());
+    auto hnswSearch = [&](std::vector<float> &query) {
+        return hnsw.knnSearch(query, k, 64).ids;
+    };
+    auto fullRecall = recall(hnswSearch);
+    hnsw.setSearchDimension(dimension / 4);
+    auto prefixRecall = recall(hnswSearch);
+    printf("PCA recall %f, prefix recall %f\n", fullRecall, prefixRecall);
+    EXPECT_GE(fullRecall, 0.95);
+    EXPECT_GE(prefixRecall, fullRecall - 0.02);
+    EXPECT_THROW(hnsw.setSearchDimension(dimension + 1), std::invalid_argument);
+
+    // The rotation preserves distances, so the exact tree search stays exact.
+    auto rotation = std::make_shared<VectorTransform>(dimension, TransformType::RANDOM_ROTATION);
+    auto tree = sa_tree::SATree(data.data(), dimension, numVectors, Random::DEFAULT_SEED, StorageType::FP32, rotation);
+    auto treeRecall = recall([&](std::vector<float> &query) {
+        return tree.knnSearch(query, k).ids;
+    });
+    EXPECT_GE(treeRecall, 0.99);
+}
@@ -0,0 +1,75 @@
+#include "spdlog/fmt/fmt.h"
+#include "gtest/gtest.h"
+#include "vector_store.h"
+#include "hnsw.h"
+#include "utils.h"
+
+#include <algorithm>
+
+using namespace vector_index;
+
+TEST(VectorStoreTest, HalfPrecisionDistances) {
+    // 37 dimensions exercise both the SIMD body and the scalar tail.
+    size_t dimension = 37, numVectors = 1000;
+    Random random(42);
+    std::vector<float> data(dimension * numVectors), query(dimension);
+    for (auto &x: data) {
+        x = random.nextDouble() * 200 - 100;
+    }
+    for (auto &x: query) {
+        x = random.nextDouble() * 200 - 100;
+    }
+
+    // Relative error of a single rounding: 2^-11 for fp16, 2^-8 for bf16.
+    for (auto [type, epsilon]: {std::pair{StorageType::FP16, 1.0 / 2048}, std::pair{StorageType::BF16, 1.0 / 256}}) {
+        VectorStore store(dimension, type);
+        EXPECT_EQ(store.getRecordSize(), dimension * 2);
+        std::vector<float> decoded(dimension);
+        for (size_t i = 0; i < numVectors; i++) {
+            auto x = data.data() + i * dimension;
+            auto record = store.add(x);
+            store.decode(record, decoded.data());
+            for (size_t j = 0; j < dimension; j++) {
+                ASSERT_NEAR(x[j], decoded[j], std::abs(x[j]) * epsilon);
+            }
+            auto expected = Utils::l2_distance(query.data(), decoded.data(), dimension);
+            ASSERT_NEAR(expected, store.distance(query.data(), record), 1e-4 * expected);
+        }
+    }
+}
+
+TEST(VectorStoreTest, HNSWRecall) {
+    size_t baseDimension, baseNumVectors;
+    auto basePath = "/Users/gauravsehgal/work/vector_index/data";
+    auto benchmarkType = "siftsmall";
+    auto baseVectorPath = fmt::format("{}/{}/base.fvecs", basePath, benchmarkType);
+    auto queryVectorPath = fmt::format("{}/{}/query.fvecs", basePath, benchmarkType);
+    auto gtVectorPath = fmt::format("{}/{}/groundtruth.ivecs", basePath, benchmarkType);
+
+    float* baseVecs = Utils::fvecs_read(baseVectorPath.c_str(), &baseDimension, &baseNumVectors);
+    size_t queryDimension, queryNumVectors;
+    float *queryVecs = Utils::fvecs_read(queryVectorPath.c_str(), &queryDimension, &queryNumVectors);
+    size_t gtDimension, gtNumVectors;
+    int *gtVecs = Utils::ivecs_read(gtVectorPath.c_str(), &gtDimension, &gtNumVectors);
+    auto k = 10;
+
+    std::vector<double> recalls;
+    for (auto storage: {StorageType::FP32, StorageType::FP16, StorageType::BF16}) {
+        auto hnsw = hnsw::HNSW(baseVecs, baseDimension, baseNumVectors, 128, 16, 32, Random::DEFAULT_SEED, storage);
+        size_t matches = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < queryNumVectors; i++) {
+            std::vector<float> query(queryVecs + i * queryDimension, queryVecs + (i + 1) * queryDimension);
+            for (auto id: hnsw.knnSearch(query, k, 64).ids) {
+                if (std::find(gtVecs + i * gtDimension, gtVecs + i * gtDimension + k, id) != gtVecs + i * gtDimension + k) {
+                    matches++;
+                }
+            }
+        }
+        std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+        recalls.push_back((double) matches / (queryNumVectors * k));
+        printf("Storage %d: recall %f, qps %f\n", (int) storage, recalls.back(), queryNumVectors / time.count());
+    }
+    EXPECT_GE(recalls[1], recalls[0] - 0.02);
+    EXPECT_GE(recalls[2], recalls[0] - 0.05);
+}